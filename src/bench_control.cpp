@@ -0,0 +1,419 @@
+// Control-plane load generator.
+//
+//   bench_control [--target HOST] [--port N] [--connections N] [--sessions N]
+//                 [--duration S] [--warmup S] [--mix LIST=40,STATUS=30,...]
+//                 [--elf PATH] [--args "..."]
+//
+// Drives a running debuglanternd over its control port from N connections,
+// each sending one command at a time and waiting for the reply (closed
+// loop), for S seconds after a warmup.  Commands are drawn at random by the
+// weights in --mix from LIST, STATUS, OUTPUT, ENV and START (a START
+// followed by a KILL of the same session).  The binary given by --elf is
+// uploaded as --sessions sessions beforehand and deleted afterwards.
+//
+// Prints a JSON report on stdout -- throughput and p50/p90/p99/p99.9/max
+// latency overall and per command -- and a summary table on stderr, so runs
+// can be kept and compared between releases.  Latency is wall time from
+// sending the line to reading the reply's newline, so it includes the
+// loopback round trip.
+
+#include "common.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Op { kList, kStatus, kOutput, kEnv, kStart, kOps };
+const char *const kOpNames[kOps] = {"LIST", "STATUS", "OUTPUT", "ENV", "START"};
+
+// Recorded separately: the KILL that follows each START
+enum Command { kCmdList, kCmdStatus, kCmdOutput, kCmdEnv, kCmdStart, kCmdKill, kCommands };
+const char *const kCommandNames[kCommands] = {"LIST", "STATUS", "OUTPUT", "ENV", "START", "KILL"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 4444;
+    int connections = 8;
+    int sessions = 4;
+    double duration_s = 10;
+    double warmup_s = 1;
+    std::string mix = "LIST=40,STATUS=30,OUTPUT=20,ENV=9,START=1";
+    std::string elf = "/bin/sleep";
+    std::string args = "60";
+};
+
+// Latencies of one command on one connection, in nanoseconds
+struct Samples {
+    std::vector<int64_t> ns;
+    uint64_t errors = 0;
+};
+
+struct Worker {
+    std::thread thread;
+    Samples commands[kCommands];
+    bool failed = false;
+};
+
+int connect_to(const std::string &host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0) {
+        std::cerr << "getaddrinfo: " << gai_strerror(rc) << "\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        // One small request at a time: don't let Nagle hold lines back
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool write_all(int fd, const char *data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// A connection with its read buffer, for line-at-a-time replies
+class Conn {
+public:
+    explicit Conn(int fd) : fd_(fd) {}
+    ~Conn() {
+        if (fd_ >= 0) close(fd_);
+    }
+    Conn(const Conn &) = delete;
+    Conn &operator=(const Conn &) = delete;
+
+    // Sends `line` and reads one reply line into `reply`
+    bool call(const std::string &line, std::string &reply) {
+        std::string payload = line + "\n";
+        return write_all(fd_, payload.data(), payload.size()) && read_line(reply);
+    }
+
+    bool send_raw(const std::string &data) { return write_all(fd_, data.data(), data.size()); }
+
+    bool read_line(std::string &reply) {
+        while (true) {
+            auto nl = buf_.find('\n');
+            if (nl != std::string::npos) {
+                reply.assign(buf_, 0, nl);
+                buf_.erase(0, nl + 1);
+                return true;
+            }
+            char chunk[16384];
+            ssize_t n = read(fd_, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf_.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+private:
+    int fd_;
+    std::string buf_;
+};
+
+bool is_error(const std::string &reply) {
+    return reply.compare(0, 11, "{\"ok\":false") == 0;
+}
+
+// The "id" of a session reply
+std::string reply_id(const std::string &reply) {
+    auto p = reply.find("\"id\":\"");
+    if (p == std::string::npos) return "";
+    p += 6;
+    auto e = reply.find('"', p);
+    return e == std::string::npos ? "" : reply.substr(p, e - p);
+}
+
+bool parse_mix(const std::string &spec, int weights[kOps]) {
+    std::fill(weights, weights + kOps, 0);
+    std::istringstream iss(spec);
+    std::string item;
+    int total = 0;
+    while (std::getline(iss, item, ',')) {
+        auto eq = item.find('=');
+        std::string name = item.substr(0, eq);
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return static_cast<char>(toupper(c)); });
+        int w = eq == std::string::npos ? 1 : atoi(item.c_str() + eq + 1);
+        auto it = std::find_if(kOpNames, kOpNames + kOps,
+                               [&](const char *n) { return name == n; });
+        if (it == kOpNames + kOps || w < 0) {
+            std::cerr << "unknown command in --mix: " << item << "\n";
+            return false;
+        }
+        weights[it - kOpNames] = w;
+        total += w;
+    }
+    if (total == 0) {
+        std::cerr << "--mix has no weight\n";
+        return false;
+    }
+    return true;
+}
+
+// Uploads the test binary once per session; empty on failure
+std::vector<std::string> create_sessions(const Options &opt) {
+    std::ifstream in(opt.elf, std::ios::binary);
+    std::string elf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!in.good() && !in.eof()) elf.clear();
+    if (elf.empty()) {
+        std::cerr << "cannot read " << opt.elf << "\n";
+        return {};
+    }
+    std::vector<std::string> ids;
+    for (int i = 0; i < opt.sessions; ++i) {
+        int fd = connect_to(opt.host, opt.port);
+        if (fd < 0) {
+            std::cerr << "cannot connect to " << opt.host << ":" << opt.port << "\n";
+            return ids;
+        }
+        Conn conn(fd);
+        std::string reply;
+        if (!conn.send_raw("UPLOAD " + std::to_string(elf.size()) + "\n" + elf) ||
+            !conn.read_line(reply) || reply_id(reply).empty()) {
+            std::cerr << "upload failed: " << reply << "\n";
+            return ids;
+        }
+        std::string id = reply_id(reply);
+        ids.push_back(id);
+        if (!opt.args.empty()) conn.call("ARGS " + id + " " + opt.args, reply);
+    }
+    return ids;
+}
+
+void delete_sessions(const Options &opt, const std::vector<std::string> &ids) {
+    int fd = connect_to(opt.host, opt.port);
+    if (fd < 0) return;
+    Conn conn(fd);
+    std::string reply;
+    for (const auto &id : ids) {
+        conn.call("KILL " + id, reply);
+        conn.call("DELETE " + id, reply);
+    }
+}
+
+void run_worker(const Options &opt, int index, const int weights[kOps],
+                const std::vector<std::string> &ids, Clock::time_point measure_from,
+                Clock::time_point until, Worker &w) {
+    int fd = connect_to(opt.host, opt.port);
+    if (fd < 0) {
+        w.failed = true;
+        return;
+    }
+    Conn conn(fd);
+    std::mt19937 rng(static_cast<unsigned>(index) * 7919u + 1);
+    std::discrete_distribution<int> pick_op(weights, weights + kOps);
+    std::uniform_int_distribution<size_t> pick_session(0, ids.size() - 1);
+    const std::string env_key = "BENCH_" + std::to_string(index) + "=";
+    std::string reply;
+    unsigned long counter = 0;
+
+    auto timed = [&](Command cmd, const std::string &line) {
+        auto t0 = Clock::now();
+        if (!conn.call(line, reply)) return false;
+        auto t1 = Clock::now();
+        if (t0 >= measure_from) {
+            Samples &s = w.commands[cmd];
+            s.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            if (is_error(reply)) ++s.errors;
+        }
+        return true;
+    };
+
+    while (Clock::now() < until) {
+        const std::string &id = ids[pick_session(rng)];
+        bool ok = true;
+        switch (pick_op(rng)) {
+        case kList: ok = timed(kCmdList, "LIST"); break;
+        case kStatus: ok = timed(kCmdStatus, "STATUS " + id); break;
+        case kOutput: ok = timed(kCmdOutput, "OUTPUT " + id + " 0 4096"); break;
+        case kEnv: ok = timed(kCmdEnv, "ENV " + id + " " + env_key + std::to_string(++counter)); break;
+        case kStart:
+            // KILL tries to reap on the spot, so the session can usually start again
+            ok = timed(kCmdStart, "START " + id) && timed(kCmdKill, "KILL " + id);
+            break;
+        }
+        if (!ok) {
+            w.failed = true;
+            return;
+        }
+    }
+}
+
+int64_t percentile(const std::vector<int64_t> &sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t i = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// "count":..,"errors":..,"throughput_rps":..,"mean_us":..,"p50_us":.. ...
+// (no braces); sorts `ns`
+std::string stats_json(std::vector<int64_t> &ns, uint64_t errors, double seconds) {
+    std::sort(ns.begin(), ns.end());
+    long double sum = 0;
+    for (int64_t v : ns) sum += v;
+    auto us = [](long double v) { return static_cast<long long>(v / 1000 + 0.5); };
+    char rps[32];
+    snprintf(rps, sizeof(rps), "%.1f", static_cast<double>(ns.size()) / seconds);
+    return debuglantern::json_kv("count", static_cast<long long>(ns.size())) + "," +
+           debuglantern::json_kv("errors", static_cast<long long>(errors)) + "," +
+           "\"throughput_rps\":" + rps + "," +
+           debuglantern::json_kv("mean_us", ns.empty() ? 0LL : us(sum / ns.size())) + "," +
+           debuglantern::json_kv("p50_us", us(percentile(ns, 0.5))) + "," +
+           debuglantern::json_kv("p90_us", us(percentile(ns, 0.9))) + "," +
+           debuglantern::json_kv("p99_us", us(percentile(ns, 0.99))) + "," +
+           debuglantern::json_kv("p999_us", us(percentile(ns, 0.999))) + "," +
+           debuglantern::json_kv("max_us", ns.empty() ? 0LL : us(ns.back()));
+}
+
+void summary_row(const char *name, const std::vector<int64_t> &sorted, uint64_t errors,
+                 double seconds) {
+    fprintf(stderr, "  %-8s %9zu %7llu %10.0f %9.1f %9.1f %9.1f %9.1f\n", name, sorted.size(),
+            static_cast<unsigned long long>(errors), static_cast<double>(sorted.size()) / seconds,
+            static_cast<double>(percentile(sorted, 0.5)) / 1000,
+            static_cast<double>(percentile(sorted, 0.99)) / 1000,
+            static_cast<double>(percentile(sorted, 0.999)) / 1000,
+            sorted.empty() ? 0.0 : static_cast<double>(sorted.back()) / 1000);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has = i + 1 < argc;
+        if (a == "--target" && has) {
+            opt.host = argv[++i];
+        } else if (a == "--port" && has) {
+            opt.port = atoi(argv[++i]);
+        } else if (a == "--connections" && has) {
+            opt.connections = std::max(1, atoi(argv[++i]));
+        } else if (a == "--sessions" && has) {
+            opt.sessions = std::max(1, atoi(argv[++i]));
+        } else if (a == "--duration" && has) {
+            opt.duration_s = std::max(0.1, atof(argv[++i]));
+        } else if (a == "--warmup" && has) {
+            opt.warmup_s = std::max(0.0, atof(argv[++i]));
+        } else if (a == "--mix" && has) {
+            opt.mix = argv[++i];
+        } else if (a == "--elf" && has) {
+            opt.elf = argv[++i];
+        } else if (a == "--args" && has) {
+            opt.args = argv[++i];
+        } else {
+            std::cerr << "usage: bench_control [--target HOST] [--port N] [--connections N]\n"
+                         "                     [--sessions N] [--duration S] [--warmup S]\n"
+                         "                     [--mix LIST=40,STATUS=30,OUTPUT=20,ENV=9,START=1]\n"
+                         "                     [--elf PATH] [--args \"...\"]\n";
+            return 1;
+        }
+    }
+    int weights[kOps];
+    if (!parse_mix(opt.mix, weights)) return 1;
+
+    std::vector<std::string> ids = create_sessions(opt);
+    if (static_cast<int>(ids.size()) != opt.sessions) {
+        delete_sessions(opt, ids);
+        return 1;
+    }
+
+    auto begin = Clock::now();
+    auto measure_from = begin + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(opt.warmup_s));
+    auto until = measure_from + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(opt.duration_s));
+    std::vector<Worker> workers(static_cast<size_t>(opt.connections));
+    for (int i = 0; i < opt.connections; ++i) {
+        workers[static_cast<size_t>(i)].thread =
+            std::thread(run_worker, std::cref(opt), i, weights, std::cref(ids), measure_from,
+                        until, std::ref(workers[static_cast<size_t>(i)]));
+    }
+    int failed = 0;
+    for (auto &w : workers) {
+        w.thread.join();
+        if (w.failed) ++failed;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - measure_from).count();
+    delete_sessions(opt, ids);
+
+    // Merge the connections' samples
+    std::vector<int64_t> all;
+    uint64_t all_errors = 0;
+    std::string commands;
+    fprintf(stderr, "%d connections, %d sessions, %.1f s; latency in us\n", opt.connections,
+            opt.sessions, seconds);
+    fprintf(stderr, "  %-8s %9s %7s %10s %9s %9s %9s %9s\n", "command", "count", "errors",
+            "req/s", "p50", "p99", "p99.9", "max");
+    for (int c = 0; c < kCommands; ++c) {
+        std::vector<int64_t> ns;
+        uint64_t errors = 0;
+        for (auto &w : workers) {
+            ns.insert(ns.end(), w.commands[c].ns.begin(), w.commands[c].ns.end());
+            errors += w.commands[c].errors;
+        }
+        if (ns.empty()) continue;
+        all.insert(all.end(), ns.begin(), ns.end());
+        all_errors += errors;
+        if (!commands.empty()) commands += ",";
+        commands += "{" + debuglantern::json_kv("command", kCommandNames[c], true) + "," +
+                    stats_json(ns, errors, seconds) + "}";
+        summary_row(kCommandNames[c], ns, errors, seconds);
+    }
+    std::string total = stats_json(all, all_errors, seconds);
+    summary_row("all", all, all_errors, seconds);
+    if (failed) fprintf(stderr, "%d connections failed\n", failed);
+
+    char dur[32];
+    snprintf(dur, sizeof(dur), "%.3f", seconds);
+    std::cout << "{" << debuglantern::json_kv("target", opt.host + ":" + std::to_string(opt.port), true)
+              << "," << debuglantern::json_kv("connections", static_cast<long long>(opt.connections))
+              << "," << debuglantern::json_kv("sessions", static_cast<long long>(opt.sessions))
+              << "," << debuglantern::json_kv("mix", opt.mix, true) << ","
+              << debuglantern::json_kv("elf", opt.elf, true) << ",\"duration_s\":" << dur << ","
+              << debuglantern::json_kv("failed_connections", static_cast<long long>(failed))
+              << ",\"total\":{" << total << "},\"commands\":[" << commands << "]}\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,578 @@
+// Dashboard rendering budget: the web UI with 1k sessions and a 100 MB log.
+//
+//   bench_dashboard [--target HOST] [--web-port N] [--sessions N] [--log-mb N]
+//                   [--ticks N] [--changed N] [--frame-budget MS] [--slow-frame MS]
+//                   [--snapshot-budget MS] [--jump-budget MS] [--listen PORT]
+//                   [--browser PATH] [--timeout S]
+//
+// Loads the dashboard page from a running debuglanternd's web port and
+// serves it again from here with the daemon swapped out: fetch() and
+// EventSource answer from synthetic data in the page, so the table and
+// the output viewer run their own code against any number of sessions and
+// any log size, with nothing stored.  The page then times what a user
+// would feel, one frame at a time:
+//
+//   - the session table: a snapshot of --sessions sessions, the same
+//     snapshot again (which must cost nothing), then --ticks diff events,
+//     one per frame, each changing --changed sessions and now and then
+//     adding and removing one;
+//   - the output viewer on a --log-mb MB stream of lines of mixed length
+//     (some wrap): opening at the tail, jumping to 40 points through the log,
+//     and scrolling through it a wheel step per frame.
+//
+// Each frame's cost is the handler's script plus the layout it forces.
+// The run fails when the p95 frame is over --frame-budget or the p99 over
+// --slow-frame, when the first snapshot is over --snapshot-budget, when
+// the p95 jump in the log takes over --jump-budget to show text (its page
+// fetch included; the stand-in answers at once), or when the viewer holds
+// more pages than its cache allows.  Progress goes to stderr and the JSON
+// report to stdout; the exit status is 0 only if every check passed.
+//
+// With --browser (a Chrome or Chromium binary) the page is run headless;
+// otherwise open the printed URL in any browser.  This measures the page,
+// not the daemon: a real session only keeps a 100 MB log if the daemon
+// runs with --output-buffer 104857600 (the default ring is 256 KB).
+
+#include "common.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int web_port = 8080;
+    int sessions = 1000;
+    int log_mb = 100;
+    int ticks = 300;
+    int changed = 20;
+    double frame_budget_ms = 16.7;
+    double slow_frame_ms = 50;
+    double snapshot_budget_ms = 250;
+    double jump_budget_ms = 100;
+    int listen_port = 0;
+    std::string browser;
+    int timeout_s = 300;
+};
+
+// Installed ahead of the dashboard's script.  Names are bench-prefixed so
+// they cannot collide with the dashboard's own globals.
+const char *kStubScript = R"JS(
+const benchFetch=window.fetch.bind(window);
+const benchState={list:[],sources:[]};
+const BENCH_LOG_ID='0000b10b-5e55-4b0c-9a1e-00000000b10b';
+
+function benchId(i){const h=(i>>>0).toString(16).padStart(8,'0');return h+'-5e55-4b0c-9a1e-'+h.padStart(12,'0');}
+const BENCH_STATES=['RUNNING','RUNNING','RUNNING','LOADED','STOPPED'];
+// Session i at version v; a new version changes its state, pid and run
+function benchSession(i,v){
+  const state=BENCH_STATES[(i+v)%BENCH_STATES.length];
+  return {id:benchId(i),state,pid:state==='RUNNING'?10000+i+v:null,debug_port:null,run:1+v,
+          build_id:benchId(i).replace(/-/g,'')+'0123abcd'};
+}
+
+// Lines of a few lengths in a fixed cycle, some long enough to wrap, so
+// any byte range of the log can be made on demand
+const BENCH_LINES=[72,140,96,260,64,180,88,400];
+const BENCH_CYCLE=BENCH_LINES.reduce((a,b)=>a+b,0);
+const BENCH_FILL='lorem ipsum dolor sit amet, consectetur adipiscing elit; '.repeat(8);
+function benchLine(n){
+  const len=BENCH_LINES[n%BENCH_LINES.length];
+  return ('['+String(n).padStart(9,'0')+'] worker '+(n%16)+' seq='+n+' '+BENCH_FILL).slice(0,len-1)+'\n';
+}
+function benchOutput(offset,length){
+  const total=BENCH.logBytes,lo=Math.min(Math.max(offset,0),total),hi=Math.min(lo+Math.max(length,0),total);
+  let n=Math.floor(lo/BENCH_CYCLE)*BENCH_LINES.length,at=Math.floor(lo/BENCH_CYCLE)*BENCH_CYCLE;
+  while(at+BENCH_LINES[n%BENCH_LINES.length]<=lo)at+=BENCH_LINES[n++%BENCH_LINES.length];
+  const first=at,parts=[];
+  while(at<hi){const l=benchLine(n++);parts.push(l);at+=l.length;}
+  return {id:BENCH_LOG_ID,output:parts.join('').slice(lo-first,hi-first),offset:lo,start:0,total};
+}
+
+const BENCH_METRICS=['time_ms','cpu_ms','rss_kb','read_bytes','write_bytes','threads','fds','processes'];
+function benchRoute(url){
+  const u=new URL(url,location.href),p=u.pathname.split('/').filter(Boolean),q=u.searchParams;
+  if(u.pathname==='/api/sessions')return benchState.list;
+  if(u.pathname==='/api/deps')return {all_satisfied:true,deps:[]};
+  if(p[0]==='api'&&p[1]==='sessions'&&p[3]==='output'){
+    if(p[2]!==BENCH_LOG_ID)return {ok:false,error_code:'not_found'};
+    return benchOutput(+q.get('offset')||0,q.has('length')?+q.get('length'):65536);
+  }
+  if(p[0]==='api'&&p[1]==='sessions'&&p[3]==='metrics'){
+    const since=+q.get('since')||0,i=parseInt(p[2],16)||0;
+    return {id:p[2],interval_ms:1000,first:0,next:since+1,fields:BENCH_METRICS,
+            samples:[[Date.now(),(i+since)%40,4096+(i*37+since*13)%8192,0,0,2,8,1]]};
+  }
+  return {};
+}
+window.fetch=async(url,opts)=>{
+  if(String(url).startsWith('/bench/'))return benchFetch(url,opts);
+  return new Response(JSON.stringify(benchRoute(String(url))),{headers:{'Content-Type':'application/json'}});
+};
+
+// The runner pushes snapshots and diffs through the dashboard's listeners
+window.EventSource=class{
+  constructor(url){this.url=url;this.onmessage=null;this.onerror=null;this.listeners={};benchState.sources.push(this);}
+  addEventListener(type,fn){(this.listeners[type]=this.listeners[type]||[]).push(fn);}
+  close(){}
+  emit(type,data){
+    const e={data:JSON.stringify(data)};
+    if(type==='message'){if(this.onmessage)this.onmessage(e);}
+    else for(const fn of this.listeners[type]||[])fn(e);
+  }
+};
+)JS";
+
+// Runs after the dashboard's script, through the dashboard's own entry
+// points (render/applyDiff via the event stream, showOutput, logRender).
+const char *kRunnerScript = R"JS(
+(async()=>{
+const frame=()=>new Promise(r=>requestAnimationFrame(r));
+const idle=ms=>new Promise(r=>setTimeout(r,ms));
+const layout=()=>document.body.offsetHeight;
+const benchOut=document.createElement('pre');
+benchOut.style.cssText='position:fixed;right:8px;bottom:8px;z-index:99;max-width:45%;max-height:60%;overflow:auto;background:#000c;color:#eee;padding:8px;font-size:11px';
+document.body.appendChild(benchOut);
+function note(line){benchOut.textContent+=line+'\n';benchFetch('/bench/log',{method:'POST',body:line}).catch(()=>{});}
+function stats(v){
+  const s=[...v].sort((a,b)=>a-b),at=q=>s.length?s[Math.min(s.length-1,Math.floor(q*s.length))]:0;
+  const r=x=>+x.toFixed(2);
+  return {frames:s.length,p50_ms:r(at(.5)),p95_ms:r(at(.95)),p99_ms:r(at(.99)),max_ms:r(s.length?s[s.length-1]:0)};
+}
+function fmt(name,st){return name.padEnd(16)+String(st.frames).padStart(6)+' frames  p50 '+st.p50_ms.toFixed(2)+
+  '  p95 '+st.p95_ms.toFixed(2)+'  p99 '+st.p99_ms.toFixed(2)+'  max '+st.max_ms.toFixed(2)+' ms';}
+const report={sessions:BENCH.sessions,log_bytes:BENCH.logBytes,user_agent:navigator.userAgent,
+              budgets:{frame_ms:BENCH.frameBudget,slow_frame_ms:BENCH.slowFrame,snapshot_ms:BENCH.snapshotBudget,
+                       jump_ms:BENCH.jumpBudget},checks:[]};
+function check(name,value,limit){
+  const ok=value<=limit;
+  report.checks.push({name,value:+value.toFixed(2),limit,ok});
+  note((ok?'ok    ':'FAIL  ')+name+' '+value.toFixed(2)+' (limit '+limit+')');
+}
+function frameChecks(name,st){
+  check(name+' p95_ms',st.p95_ms,BENCH.frameBudget);
+  check(name+' p99_ms',st.p99_ms,BENCH.slowFrame);
+}
+async function settle(){
+  let quiet=0;
+  for(let i=0;i<2000&&quiet<2;i++){
+    await frame();await idle(0);
+    quiet=lv&&!lv.raf&&![...lv.pages.values()].some(p=>p.loading)?quiet+1:0;
+  }
+}
+function visibleText(){
+  const box=$('output-content'),y=box.scrollTop+box.clientHeight/2;
+  for(const el of document.querySelectorAll('#output-spacer .log-page')){
+    const top=parseFloat(el.style.top);
+    if(top<=y&&y<top+el.offsetHeight)return el.textContent;
+  }
+  return '';
+}
+
+try{
+  const es=benchState.sources[benchState.sources.length-1];
+  await idle(50);
+
+  // Session table
+  const version=new Array(BENCH.sessions).fill(0),live=[];
+  for(let i=0;i<BENCH.sessions;i++)live.push(i);
+  let next=BENCH.sessions;
+  const snapshot=()=>live.map(i=>benchSession(i,version[i]||0));
+  benchState.list=snapshot();
+  await frame();
+  let t=performance.now();
+  es.emit('message',benchState.list);layout();
+  report.snapshot_ms=+(performance.now()-t).toFixed(2);
+  note('table: '+BENCH.sessions+' sessions, first snapshot '+report.snapshot_ms+' ms');
+  await frame();
+  t=performance.now();
+  es.emit('message',benchState.list);layout();
+  report.resnapshot_ms=+(performance.now()-t).toFixed(2);
+  note('table: unchanged snapshot again '+report.resnapshot_ms+' ms');
+
+  const tick=[];
+  for(let n=0,at=0;n<BENCH.ticks;n++){
+    const upsert=[],remove=[];
+    for(let c=0;c<BENCH.changed;c++){
+      const i=live[at++%live.length];
+      version[i]=(version[i]||0)+1;
+      upsert.push(benchSession(i,version[i]));
+    }
+    if(n%10===9){
+      remove.push(benchId(live.shift()));
+      live.push(next);
+      upsert.push(benchSession(next++,0));
+    }
+    benchState.list=snapshot();
+    await frame();
+    t=performance.now();
+    es.emit('sessions',{upsert,remove});layout();
+    tick.push(performance.now()-t);
+  }
+  report.table=stats(tick);
+  note(fmt('table diff',report.table));
+  const shown=document.querySelectorAll('#sessions > tr').length;
+  report.table_rows=shown;
+  check('table rows over sessions',Math.abs(shown-BENCH.sessions),0);
+
+  // Output viewer
+  const logFrames=[],origRender=logRender;
+  logRender=function(){const s=performance.now();origRender();layout();logFrames.push(performance.now()-s);};
+  t=performance.now();
+  showOutput(BENCH_LOG_ID);
+  await settle();
+  report.open_ms=+(performance.now()-t).toFixed(2);
+  const lastLine=String(benchOutput(BENCH.logBytes-600,600).output.split('\n').slice(-2)[0]).slice(1,10);
+  note('log: '+(BENCH.logBytes/1048576).toFixed(0)+' MB, open at the tail '+report.open_ms+' ms');
+  check('log tail shown',$('output-spacer').textContent.includes('['+lastLine+']')?0:1,0);
+
+  const box=$('output-content'),jumps=[];
+  // From the jump to the end of the first frame with text at the middle of
+  // the view (looked for once the frame's callbacks, logRender's too, ran)
+  const lineRe=/\[\d{9}\] worker/;
+  for(let j=0;j<40;j++){
+    const f=(j*17%40+.5)/40;
+    t=performance.now();
+    box.scrollTop=f*(box.scrollHeight-box.clientHeight);
+    let shown=false;
+    for(let n=0;n<600&&!shown;n++){await frame();await idle(0);shown=lineRe.test(visibleText());}
+    jumps.push(performance.now()-t);
+    if(!shown)check('log text at '+f,1,0);
+    await settle();
+  }
+  report.jump=stats(jumps);
+  note(fmt('log jump',report.jump));
+
+  box.scrollTop=.5*(box.scrollHeight-box.clientHeight);
+  await settle();
+  logFrames.length=0;
+  const gaps=[];
+  let prev=performance.now();
+  for(let n=0;n<240;n++){
+    box.scrollTop+=120;
+    await frame();
+    const now=performance.now();gaps.push(now-prev);prev=now;
+  }
+  await settle();
+  report.log=stats(logFrames);
+  report.scroll_frame_interval=stats(gaps);
+  note(fmt('log scroll',report.log));
+  note(fmt('frame interval',report.scroll_frame_interval));
+  report.log_dom_pages=document.querySelectorAll('#output-spacer .log-page').length;
+  report.log_cached_pages=[...lv.pages.values()].filter(p=>p.bytes).length;
+
+  check('snapshot_ms',report.snapshot_ms,BENCH.snapshotBudget);
+  frameChecks('table diff',report.table);
+  frameChecks('log scroll',report.log);
+  check('log jump p95_ms',report.jump.p95_ms,BENCH.jumpBudget);
+  check('log cached pages',report.log_cached_pages,LOG_CACHE);
+  check('log DOM pages',report.log_dom_pages,LOG_CACHE);
+}catch(e){
+  report.error=String(e&&e.stack||e);
+  note('error: '+report.error);
+}
+report.pass=!report.error&&report.checks.every(c=>c.ok);
+note(report.pass?'PASS':'FAIL');
+await benchFetch('/bench/result',{method:'POST',body:JSON.stringify(report)});
+})();
+)JS";
+
+int connect_to(const std::string &host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0) {
+        std::cerr << "getaddrinfo: " << gai_strerror(rc) << "\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+bool write_all(int fd, const char *data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// GET / from the daemon's web port; the server closes after one response
+bool fetch_page(const Options &opt, std::string &page) {
+    int fd = connect_to(opt.host, opt.web_port);
+    if (fd < 0) {
+        std::cerr << "cannot connect to " << opt.host << ":" << opt.web_port << "\n";
+        return false;
+    }
+    std::string req = "GET / HTTP/1.1\r\nHost: " + opt.host + "\r\nConnection: close\r\n\r\n";
+    std::string resp;
+    if (write_all(fd, req.data(), req.size())) {
+        char buf[65536];
+        for (;;) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            resp.append(buf, static_cast<size_t>(n));
+        }
+    }
+    close(fd);
+    size_t body = resp.find("\r\n\r\n");
+    if (resp.compare(0, 12, "HTTP/1.1 200") != 0 || body == std::string::npos) {
+        std::cerr << "GET / on the web port failed (is --web-port set?)\n";
+        return false;
+    }
+    page = resp.substr(body + 4);
+    return true;
+}
+
+// The stubs go ahead of the dashboard's script, the runner after it
+bool inject(std::string &page, const Options &opt) {
+    size_t script = page.find("<script>");
+    size_t end = page.rfind("</body>");
+    if (script == std::string::npos || end == std::string::npos || end < script) {
+        std::cerr << "unexpected dashboard page layout\n";
+        return false;
+    }
+    char config[512];
+    snprintf(config, sizeof(config),
+             "const BENCH={sessions:%d,logBytes:%lld,ticks:%d,changed:%d,frameBudget:%g,"
+             "slowFrame:%g,snapshotBudget:%g,jumpBudget:%g};",
+             opt.sessions, static_cast<long long>(opt.log_mb) * 1048576, opt.ticks, opt.changed,
+             opt.frame_budget_ms, opt.slow_frame_ms, opt.snapshot_budget_ms, opt.jump_budget_ms);
+    page.insert(end, std::string("<script>") + kRunnerScript + "</script>\n");
+    page.insert(script, std::string("<script>") + config + kStubScript + "</script>\n");
+    return true;
+}
+
+int listen_on(int port, int &bound) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    socklen_t len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    bound = ntohs(addr.sin_port);
+    return fd;
+}
+
+pid_t launch_browser(const std::string &browser, const std::string &url,
+                     const std::string &profile_dir) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    std::string profile = "--user-data-dir=" + profile_dir;
+    std::vector<const char *> args = {browser.c_str(), "--headless=new", "--no-first-run",
+                                      "--no-default-browser-check", "--window-size=1280,900",
+                                      profile.c_str()};
+    // Chrome refuses to run as root with its sandbox on
+    if (geteuid() == 0) args.push_back("--no-sandbox");
+    args.push_back(url.c_str());
+    args.push_back(nullptr);
+    execvp(args[0], const_cast<char *const *>(args.data()));
+    _exit(127);
+}
+
+struct Client {
+    std::string in;
+};
+
+void respond(int fd, int status, const char *type, const std::string &body) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Not Found") +
+                       "\r\nContent-Type: " + type +
+                       "\r\nContent-Length: " + std::to_string(body.size()) +
+                       "\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n";
+    if (write_all(fd, head.data(), head.size())) write_all(fd, body.data(), body.size());
+}
+
+// Serves the page and collects what it posts back until /bench/result or
+// the deadline.  Progress lines (/bench/log) go straight to stderr.
+bool serve(int listen_fd, const std::string &page, Clock::time_point deadline,
+           std::string &result) {
+    std::map<int, Client> clients;
+    bool done = false;
+    while (!done && Clock::now() < deadline) {
+        std::vector<pollfd> fds = {{listen_fd, POLLIN, 0}};
+        for (const auto &c : clients) fds.push_back({c.first, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 500) < 0 && errno != EINTR) return false;
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) clients[fd] = Client{};
+        }
+        for (size_t i = 1; i < fds.size(); ++i) {
+            if (!fds[i].revents) continue;
+            int fd = fds[i].fd;
+            Client &c = clients[fd];
+            char buf[16384];
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) {
+                close(fd);
+                clients.erase(fd);
+                continue;
+            }
+            c.in.append(buf, static_cast<size_t>(n));
+            size_t head_end = c.in.find("\r\n\r\n");
+            if (head_end == std::string::npos) continue;
+            size_t length = 0;
+            size_t cl = c.in.find("Content-Length:");
+            if (cl == std::string::npos) cl = c.in.find("content-length:");
+            if (cl != std::string::npos && cl < head_end) {
+                length = static_cast<size_t>(strtoull(c.in.c_str() + cl + 15, nullptr, 10));
+            }
+            if (c.in.size() < head_end + 4 + length) continue;
+            std::string line = c.in.substr(0, c.in.find("\r\n"));
+            std::string body = c.in.substr(head_end + 4, length);
+            if (line.compare(0, 6, "GET / ") == 0) {
+                respond(fd, 200, "text/html; charset=utf-8", page);
+            } else if (line.compare(0, 15, "POST /bench/log") == 0) {
+                std::cerr << "  " << body << "\n";
+                respond(fd, 200, "text/plain", "");
+            } else if (line.compare(0, 18, "POST /bench/result") == 0) {
+                result = body;
+                done = true;
+                respond(fd, 200, "text/plain", "");
+            } else {
+                respond(fd, 404, "text/plain", "");
+            }
+            close(fd);
+            clients.erase(fd);
+        }
+    }
+    for (const auto &c : clients) close(c.first);
+    return done;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has = i + 1 < argc;
+        if (a == "--target" && has) {
+            opt.host = argv[++i];
+        } else if (a == "--web-port" && has) {
+            opt.web_port = atoi(argv[++i]);
+        } else if (a == "--sessions" && has) {
+            opt.sessions = std::max(1, atoi(argv[++i]));
+        } else if (a == "--log-mb" && has) {
+            opt.log_mb = std::max(1, atoi(argv[++i]));
+        } else if (a == "--ticks" && has) {
+            opt.ticks = std::max(1, atoi(argv[++i]));
+        } else if (a == "--changed" && has) {
+            opt.changed = std::max(1, atoi(argv[++i]));
+        } else if (a == "--frame-budget" && has) {
+            opt.frame_budget_ms = atof(argv[++i]);
+        } else if (a == "--slow-frame" && has) {
+            opt.slow_frame_ms = atof(argv[++i]);
+        } else if (a == "--snapshot-budget" && has) {
+            opt.snapshot_budget_ms = atof(argv[++i]);
+        } else if (a == "--jump-budget" && has) {
+            opt.jump_budget_ms = atof(argv[++i]);
+        } else if (a == "--listen" && has) {
+            opt.listen_port = atoi(argv[++i]);
+        } else if (a == "--browser" && has) {
+            opt.browser = argv[++i];
+        } else if (a == "--timeout" && has) {
+            opt.timeout_s = std::max(1, atoi(argv[++i]));
+        } else {
+            std::cerr << "usage: bench_dashboard [--target HOST] [--web-port N] [--sessions N]\n"
+                         "                       [--log-mb N] [--ticks N] [--changed N]\n"
+                         "                       [--frame-budget MS] [--slow-frame MS]\n"
+                         "                       [--snapshot-budget MS] [--jump-budget MS]\n"
+                         "                       [--listen PORT] [--browser PATH] [--timeout S]\n";
+            return 1;
+        }
+    }
+    opt.changed = std::min(opt.changed, opt.sessions);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string page;
+    if (!fetch_page(opt, page) || !inject(page, opt)) return 1;
+
+    int port = 0;
+    int listen_fd = listen_on(opt.listen_port, port);
+    if (listen_fd < 0) return 1;
+    std::string url = "http://127.0.0.1:" + std::to_string(port) + "/";
+
+    pid_t browser = -1;
+    std::filesystem::path profile;
+    if (!opt.browser.empty()) {
+        char tmpl[] = "/tmp/bench_dashboard.XXXXXX";
+        if (!mkdtemp(tmpl)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        profile = tmpl;
+        browser = launch_browser(opt.browser, url, profile.string());
+        fprintf(stderr, "running %s headless on %s\n", opt.browser.c_str(), url.c_str());
+    } else {
+        fprintf(stderr, "open %s in a browser\n", url.c_str());
+    }
+
+    std::string result;
+    bool done = serve(listen_fd, page, Clock::now() + std::chrono::seconds(opt.timeout_s), result);
+    close(listen_fd);
+    if (browser > 0) {
+        kill(browser, SIGTERM);
+        waitpid(browser, nullptr, 0);
+        std::error_code ec;
+        std::filesystem::remove_all(profile, ec);
+    }
+    if (!done) {
+        fprintf(stderr, "no result within %d s\n", opt.timeout_s);
+        return 1;
+    }
+
+    std::cout << "{" << debuglantern::json_kv("target", opt.host + ":" + std::to_string(opt.web_port), true)
+              << ",\"report\":" << result << "}\n";
+    return result.find("\"pass\":true") != std::string::npos ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+// Data-plane benchmark: how long a binary takes from upload to running.
+//
+//   bench_data [--target HOST] [--port N] [--sizes 1M,16M,128M] [--kinds elf,bundle]
+//              [--clients 1,4] [--iterations N] [--elf PATH] [--args "..."]
+//
+// For each size, kind and client count it runs full session lifecycles
+// against a running debuglanternd, with that many clients at once:
+// UPLOAD, START, wait for the first byte of output, wait for the exit,
+// DELETE.  Binaries are synthetic: --elf (/bin/echo by default, run with
+// --args) padded with random bytes to the size, which leaves it a valid,
+// runnable ELF and makes bundles incompressible; bundles are that file as
+// app/<name> in a tar.gz.
+//
+// Each phase is timed by the client, and the daemon's own view of it is
+// read back from TRACE: receiving the upload, extracting the bundle, fork
+// to first output and removing the bundle.  Prints a table on stderr and a
+// JSON report on stdout.  Uploads over --max-total-bytes (512 MB by
+// default) are refused by the daemon; raise it to go up to 1G.
+
+#include "common.h"
+
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 4444;
+    std::vector<long long> sizes = {1LL << 20, 16LL << 20, 128LL << 20};
+    std::vector<std::string> kinds = {"elf", "bundle"};
+    std::vector<int> clients = {1, 4};
+    int iterations = 3;
+    std::string elf = "/bin/echo";
+    std::string args = "ready";
+};
+
+// One lifecycle.  Client-side times are wall clock on this end; server_*
+// come from the daemon's TRACE spans (-1 when it has none, e.g. no extract
+// for a plain ELF).
+enum Phase {
+    kUpload,               // first byte sent to the UPLOAD reply
+    kServerReceive,        // "receive upload"
+    kServerExtract,        // "extract tar.gz"
+    kStart,                // START round trip
+    kFirstOutput,          // START sent to the first output byte over TAIL
+    kServerFirstOutput,    // "first output": fork to the first byte read
+    kDelete,               // DELETE round trip, once the process has exited
+    kServerRemove,         // "remove bundle"
+    kPhases
+};
+const char *const kPhaseNames[kPhases] = {
+    "upload_ms", "server_receive_ms", "server_extract_ms", "start_ms",
+    "first_output_ms", "server_first_output_ms", "delete_ms", "server_remove_ms"};
+
+struct Cycle {
+    bool ok = false;
+    std::string error;
+    double ms[kPhases];
+};
+
+// A file ready to upload
+struct Payload {
+    std::string path;
+    long long bytes = 0;
+    std::string exec_path;  // bundles only
+};
+
+double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+int connect_to(const std::string &host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0) {
+        std::cerr << "getaddrinfo: " << gai_strerror(rc) << "\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *p = res; p; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool write_all(int fd, const char *data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+class Conn {
+public:
+    explicit Conn(int fd) : fd_(fd) {}
+    ~Conn() {
+        if (fd_ >= 0) close(fd_);
+    }
+    Conn(const Conn &) = delete;
+    Conn &operator=(const Conn &) = delete;
+
+    int fd() const { return fd_; }
+
+    bool send_line(const std::string &line) {
+        std::string payload = line + "\n";
+        return write_all(fd_, payload.data(), payload.size());
+    }
+    bool call(const std::string &line, std::string &reply) {
+        return send_line(line) && read_line(reply);
+    }
+    bool read_line(std::string &reply) {
+        while (true) {
+            auto nl = buf_.find('\n');
+            if (nl != std::string::npos) {
+                reply.assign(buf_, 0, nl);
+                buf_.erase(0, nl + 1);
+                return true;
+            }
+            if (!fill()) return false;
+        }
+    }
+    // Waits for at least one byte past what read_line() consumed
+    bool read_some() { return !buf_.empty() || fill(); }
+
+private:
+    bool fill() {
+        char chunk[65536];
+        while (true) {
+            ssize_t n = read(fd_, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf_.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    int fd_;
+    std::string buf_;
+};
+
+std::string json_string_field(const std::string &json, const std::string &key) {
+    auto p = json.find("\"" + key + "\":\"");
+    if (p == std::string::npos) return "";
+    p += key.size() + 4;
+    auto e = json.find('"', p);
+    return e == std::string::npos ? "" : json.substr(p, e - p);
+}
+
+// Duration of the first span called `name` in a TRACE reply, in ms; -1 if none
+double span_ms(const std::string &trace, const char *name) {
+    auto p = trace.find("{\"name\":\"" + std::string(name) + "\",\"cat\"");
+    if (p == std::string::npos) return -1;
+    p = trace.find("\"dur\":", p);
+    if (p == std::string::npos) return -1;
+    return atof(trace.c_str() + p + 6) / 1000;
+}
+
+long long parse_size(const std::string &s) {
+    char *end = nullptr;
+    double v = strtod(s.c_str(), &end);
+    switch (end && *end ? toupper(static_cast<unsigned char>(*end)) : 0) {
+    case 'K': v *= 1024; break;
+    case 'M': v *= 1024 * 1024; break;
+    case 'G': v *= 1024.0 * 1024 * 1024; break;
+    default: break;
+    }
+    return static_cast<long long>(v);
+}
+
+std::string size_label(long long bytes) {
+    if (bytes >= (1LL << 30) && bytes % (1LL << 30) == 0) return std::to_string(bytes >> 30) + "G";
+    if (bytes >= (1LL << 20) && bytes % (1LL << 20) == 0) return std::to_string(bytes >> 20) + "M";
+    if (bytes >= (1LL << 10) && bytes % (1LL << 10) == 0) return std::to_string(bytes >> 10) + "K";
+    return std::to_string(bytes);
+}
+
+template <typename T, typename F>
+std::vector<T> parse_list(const std::string &spec, F parse) {
+    std::vector<T> out;
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        if (!item.empty()) out.push_back(parse(item));
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic payloads
+// ---------------------------------------------------------------------------
+
+// `base` followed by random bytes up to `bytes` in total
+bool write_padded_elf(const std::string &base, const std::string &path, long long bytes) {
+    int in = open(base.c_str(), O_RDONLY | O_CLOEXEC);
+    int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    bool ok = in >= 0 && out >= 0;
+    long long written = 0;
+    std::vector<char> buf(1 << 20);
+    while (ok) {
+        ssize_t n = read(in, buf.data(), buf.size());
+        if (n == 0) break;
+        ok = n > 0 && write_all(out, buf.data(), static_cast<size_t>(n));
+        written += n;
+    }
+    uint64_t x = 0x9e3779b97f4a7c15ull ^ static_cast<uint64_t>(bytes);
+    while (ok && written < bytes) {
+        size_t n = static_cast<size_t>(std::min<long long>(bytes - written, buf.size()));
+        for (size_t i = 0; i + 8 <= buf.size(); i += 8) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            memcpy(&buf[i], &x, 8);
+        }
+        ok = write_all(out, buf.data(), n);
+        written += static_cast<long long>(n);
+    }
+    if (in >= 0) close(in);
+    if (out >= 0) close(out);
+    return ok;
+}
+
+bool run_tar(const std::string &archive, const std::string &dir) {
+    pid_t child = fork();
+    if (child == 0) {
+        execlp("tar", "tar", "czf", archive.c_str(), "-C", dir.c_str(), "app", nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    return child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+}
+
+bool make_payload(const Options &opt, const std::string &workdir, const std::string &kind,
+                  long long size, Payload &p) {
+    std::string name = opt.elf.substr(opt.elf.rfind('/') + 1);
+    std::string label = size_label(size);
+    if (kind == "elf") {
+        p.path = workdir + "/" + name + "-" + label;
+        if (!write_padded_elf(opt.elf, p.path, size)) return false;
+    } else {
+        std::string dir = workdir + "/bundle-" + label;
+        mkdir(dir.c_str(), 0755);
+        mkdir((dir + "/app").c_str(), 0755);
+        std::string bin = dir + "/app/" + name;
+        p.path = workdir + "/bundle-" + label + ".tar.gz";
+        p.exec_path = "app/" + name;
+        bool ok = write_padded_elf(opt.elf, bin, size) && run_tar(p.path, dir);
+        unlink(bin.c_str());
+        rmdir((dir + "/app").c_str());
+        rmdir(dir.c_str());
+        if (!ok) return false;
+    }
+    struct stat st{};
+    if (stat(p.path.c_str(), &st) != 0) return false;
+    p.bytes = st.st_size;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// One lifecycle
+// ---------------------------------------------------------------------------
+
+bool send_file(int sock, const std::string &path, long long bytes) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    off_t off = 0;
+    bool ok = true;
+    while (ok && off < bytes) {
+        ssize_t n = sendfile(sock, fd, &off, static_cast<size_t>(bytes - off));
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+    }
+    close(fd);
+    return ok;
+}
+
+Cycle run_cycle(const Options &opt, const Payload &p) {
+    Cycle c;
+    std::fill(c.ms, c.ms + kPhases, -1.0);
+    int fd = connect_to(opt.host, opt.port);
+    if (fd < 0) {
+        c.error = "connect failed";
+        return c;
+    }
+    Conn conn(fd);
+    std::string reply;
+
+    std::string upload = "UPLOAD " + std::to_string(p.bytes);
+    if (!p.exec_path.empty()) upload += " " + p.exec_path;
+    auto t0 = Clock::now();
+    if (!conn.send_line(upload) || !send_file(conn.fd(), p.path, p.bytes) ||
+        !conn.read_line(reply)) {
+        c.error = "upload failed";
+        return c;
+    }
+    c.ms[kUpload] = ms_since(t0);
+    std::string id = json_string_field(reply, "id");
+    if (id.empty()) {
+        c.error = reply;
+        return c;
+    }
+    if (!opt.args.empty()) conn.call("ARGS " + id + " " + opt.args, reply);
+
+    t0 = Clock::now();
+    if (!conn.call("START " + id, reply)) {
+        c.error = "start failed";
+        return c;
+    }
+    c.ms[kStart] = ms_since(t0);
+    if (json_string_field(reply, "state") != "RUNNING" &&
+        json_string_field(reply, "state") != "STOPPED") {
+        c.error = reply;
+    }
+    // TAIL from offset 0 has the first byte whether or not it is out yet
+    int tfd = connect_to(opt.host, opt.port);
+    if (tfd >= 0) {
+        Conn tail(tfd);
+        if (tail.call("TAIL " + id + " 0", reply) && tail.read_some()) {
+            c.ms[kFirstOutput] = ms_since(t0);
+        }
+    }
+
+    // Not timed: wait for the exit, so DELETE measures cleanup only
+    for (int i = 0; i < 2000; ++i) {
+        if (!conn.call("STATUS " + id, reply) || json_string_field(reply, "state") == "STOPPED") {
+            break;
+        }
+        usleep(5000);
+    }
+    if (json_string_field(reply, "state") != "STOPPED") {
+        conn.call("KILL " + id, reply);
+    }
+    t0 = Clock::now();
+    conn.call("DELETE " + id, reply);
+    c.ms[kDelete] = ms_since(t0);
+
+    // TRACE spans outlive the session
+    if (conn.call("TRACE " + id, reply)) {
+        c.ms[kServerReceive] = span_ms(reply, "receive upload");
+        c.ms[kServerExtract] = span_ms(reply, "extract tar.gz");
+        c.ms[kServerFirstOutput] = span_ms(reply, "first output");
+        c.ms[kServerRemove] = span_ms(reply, "remove bundle");
+    }
+    c.ok = c.error.empty();
+    return c;
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+
+struct Stat {
+    double mean = -1;
+    double p50 = -1;
+    double max = -1;
+};
+
+Stat stat_of(std::vector<double> v) {
+    Stat s;
+    v.erase(std::remove_if(v.begin(), v.end(), [](double x) { return x < 0; }), v.end());
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+    double sum = 0;
+    for (double x : v) sum += x;
+    s.mean = sum / static_cast<double>(v.size());
+    s.p50 = v[v.size() / 2];
+    s.max = v.back();
+    return s;
+}
+
+std::string fmt(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", v);
+    return buf;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has = i + 1 < argc;
+        if (a == "--target" && has) {
+            opt.host = argv[++i];
+        } else if (a == "--port" && has) {
+            opt.port = atoi(argv[++i]);
+        } else if (a == "--sizes" && has) {
+            opt.sizes = parse_list<long long>(argv[++i], parse_size);
+        } else if (a == "--kinds" && has) {
+            opt.kinds = parse_list<std::string>(argv[++i], [](const std::string &s) { return s; });
+        } else if (a == "--clients" && has) {
+            opt.clients = parse_list<int>(argv[++i], [](const std::string &s) {
+                return std::max(1, atoi(s.c_str()));
+            });
+        } else if (a == "--iterations" && has) {
+            opt.iterations = std::max(1, atoi(argv[++i]));
+        } else if (a == "--elf" && has) {
+            opt.elf = argv[++i];
+        } else if (a == "--args" && has) {
+            opt.args = argv[++i];
+        } else {
+            std::cerr << "usage: bench_data [--target HOST] [--port N] [--sizes 1M,16M,128M]\n"
+                         "                  [--kinds elf,bundle] [--clients 1,4] [--iterations N]\n"
+                         "                  [--elf PATH] [--args \"...\"]\n";
+            return 1;
+        }
+    }
+    for (const auto &k : opt.kinds) {
+        if (k != "elf" && k != "bundle") {
+            std::cerr << "unknown kind: " << k << "\n";
+            return 1;
+        }
+    }
+
+    char tmpl[] = "/tmp/bench_data-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string workdir = tmpl;
+
+    fprintf(stderr, "%-7s %6s %7s %6s %10s %9s %9s %9s %9s %9s %9s\n", "kind", "size", "clients",
+            "ok", "upload", "MB/s", "extract", "start", "1st out", "delete", "remove");
+    std::string rows;
+    int failures = 0;
+    for (const auto &kind : opt.kinds) {
+        for (long long size : opt.sizes) {
+            Payload p;
+            if (!make_payload(opt, workdir, kind, size, p)) {
+                std::cerr << "cannot generate " << kind << " of " << size_label(size) << "\n";
+                unlink(p.path.c_str());
+                ++failures;
+                continue;
+            }
+            for (int clients : opt.clients) {
+                std::vector<Cycle> cycles;
+                std::vector<double> aggregate;  // MB/s of all clients' uploads together
+                std::string first_error;
+                for (int it = 0; it < opt.iterations; ++it) {
+                    std::vector<Cycle> batch(static_cast<size_t>(clients));
+                    std::vector<std::thread> threads;
+                    for (int c = 0; c < clients; ++c) {
+                        threads.emplace_back([&, c] { batch[static_cast<size_t>(c)] = run_cycle(opt, p); });
+                    }
+                    for (auto &t : threads) t.join();
+                    double slowest = 0;
+                    for (const auto &c : batch) slowest = std::max(slowest, c.ms[kUpload]);
+                    if (slowest > 0) {
+                        aggregate.push_back(static_cast<double>(p.bytes) * clients /
+                                            (1024.0 * 1024) / (slowest / 1000));
+                    }
+                    for (auto &c : batch) {
+                        if (!c.ok && first_error.empty()) first_error = c.error;
+                        cycles.push_back(c);
+                    }
+                }
+                Stat st[kPhases];
+                long long ok = 0;
+                for (int ph = 0; ph < kPhases; ++ph) {
+                    std::vector<double> v;
+                    for (const auto &c : cycles) v.push_back(c.ms[ph]);
+                    st[ph] = stat_of(v);
+                }
+                for (const auto &c : cycles) ok += c.ok;
+                if (ok != static_cast<long long>(cycles.size())) ++failures;
+                Stat agg = stat_of(aggregate);
+                double per_client = st[kUpload].p50 > 0
+                                        ? static_cast<double>(p.bytes) / (1024.0 * 1024) /
+                                              (st[kUpload].p50 / 1000)
+                                        : 0;
+
+                fprintf(stderr, "%-7s %6s %7d %3lld/%-2zu %8.1fms %9.1f %7.1fms %7.1fms %7.1fms %7.1fms %7.1fms\n",
+                        kind.c_str(), size_label(size).c_str(), clients, ok, cycles.size(),
+                        st[kUpload].p50, per_client, st[kServerExtract].p50, st[kStart].p50,
+                        st[kFirstOutput].p50, st[kDelete].p50, st[kServerRemove].p50);
+                if (!first_error.empty()) fprintf(stderr, "        error: %s\n", first_error.c_str());
+
+                if (!rows.empty()) rows += ",";
+                rows += "{" + debuglantern::json_kv("kind", kind, true) + "," +
+                        debuglantern::json_kv("size", size_label(size), true) + "," +
+                        debuglantern::json_kv("bytes", p.bytes) + "," +
+                        debuglantern::json_kv("clients", static_cast<long long>(clients)) + "," +
+                        debuglantern::json_kv("cycles", static_cast<long long>(cycles.size())) + "," +
+                        debuglantern::json_kv("ok", ok) + "," +
+                        debuglantern::json_kv("error", first_error, true) + "," +
+                        "\"upload_mb_s\":" + fmt(per_client) + "," +
+                        "\"aggregate_upload_mb_s\":" + fmt(agg.p50) + ",\"phases\":{";
+                bool first = true;
+                for (int ph = 0; ph < kPhases; ++ph) {
+                    if (st[ph].mean < 0) continue;
+                    if (!first) rows += ",";
+                    first = false;
+                    rows += "\"" + std::string(kPhaseNames[ph]) + "\":{\"mean\":" +
+                            fmt(st[ph].mean) + ",\"p50\":" + fmt(st[ph].p50) +
+                            ",\"max\":" + fmt(st[ph].max) + "}";
+                }
+                rows += "}}";
+            }
+            unlink(p.path.c_str());
+        }
+    }
+    rmdir(workdir.c_str());
+
+    std::cout << "{" << debuglantern::json_kv("target", opt.host + ":" + std::to_string(opt.port), true)
+              << "," << debuglantern::json_kv("elf", opt.elf, true) << ","
+              << debuglantern::json_kv("iterations", static_cast<long long>(opt.iterations))
+              << ",\"results\":[" << rows << "]}\n";
+    return failures ? 1 : 0;
+}
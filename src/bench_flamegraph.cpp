@@ -0,0 +1,260 @@
+// Flamegraph pipeline benchmark.
+//
+//   bench_flamegraph [--samples N] [--depth D] [--funcs F] [perf-script.txt ...]
+//
+// Times (CPU) perf-script folding and SVG rendering on each corpus, against the
+// string-keyed pipeline the daemon used before (kept below as `legacy`).
+// Without files it generates a synthetic `perf script` dump: N samples of
+// up to D frames drawn from F C++-style function names.
+
+#include "flamegraph.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Previous implementation, for comparison
+// ---------------------------------------------------------------------------
+
+namespace legacy {
+
+struct FlameNode {
+    std::string name;
+    int self_samples = 0;
+    std::map<std::string, FlameNode> children;
+};
+
+int flame_total(const FlameNode &n) {
+    int t = n.self_samples;
+    for (const auto &c : n.children) t += flame_total(c.second);
+    return t;
+}
+
+int flame_depth(const FlameNode &n) {
+    int d = 0;
+    for (const auto &c : n.children) d = std::max(d, 1 + flame_depth(c.second));
+    return d;
+}
+
+std::map<std::string, int> collapse_perf_script(const std::string &input) {
+    std::map<std::string, int> stacks;
+    std::istringstream iss(input);
+    std::string line;
+    std::vector<std::string> frames;
+    auto flush = [&]() {
+        if (frames.empty()) return;
+        std::reverse(frames.begin(), frames.end());
+        std::string key;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (i) key += ';';
+            key += frames[i];
+        }
+        stacks[key]++;
+        frames.clear();
+    };
+    while (std::getline(iss, line)) {
+        if (line.empty()) { flush(); continue; }
+        if (line[0] == '\t' || line[0] == ' ') {
+            size_t p = line.find_first_not_of(" \t");
+            if (p == std::string::npos) continue;
+            size_t sp = line.find(' ', p);
+            if (sp == std::string::npos) continue;
+            size_t fs = line.find_first_not_of(" ", sp);
+            if (fs == std::string::npos) continue;
+            size_t fe = line.find_first_of("+ (", fs);
+            std::string func = (fe != std::string::npos) ? line.substr(fs, fe - fs) : line.substr(fs);
+            if (!func.empty() && func[0] != '(') frames.push_back(func);
+        } else {
+            flush();
+        }
+    }
+    flush();
+    return stacks;
+}
+
+FlameNode build_flame_tree(const std::map<std::string, int> &stacks) {
+    FlameNode root;
+    root.name = "all";
+    for (const auto &kv : stacks) {
+        FlameNode *node = &root;
+        std::istringstream iss(kv.first);
+        std::string fn;
+        while (std::getline(iss, fn, ';')) {
+            auto &child = node->children[fn];
+            if (child.name.empty()) child.name = fn;
+            node = &child;
+        }
+        node->self_samples += kv.second;
+    }
+    return root;
+}
+
+void render_flame_node(std::ostringstream &svg, const FlameNode &node, int level, double x,
+                       int total, int max_depth) {
+    int nt = flame_total(node);
+    double w = (static_cast<double>(nt) / total) * 1180;
+    if (w < 0.5) return;
+    double y = 60 + (max_depth - level) * 18;
+    svg << "<g><title>" << debuglantern::svg_escape(node.name) << " (" << nt << " samples, "
+        << nt * 100 / total << "%)</title><rect x=\"" << (10 + x) << "\" y=\"" << y
+        << "\" width=\"" << w << "\" height=\"17\" fill=\"#e0a020\" rx=\"2\"/></g>\n";
+    double cx = x;
+    for (const auto &c : node.children) {
+        render_flame_node(svg, c.second, level + 1, cx, total, max_depth);
+        cx += (static_cast<double>(flame_total(c.second)) / total) * 1180;
+    }
+}
+
+std::string generate_flamegraph_svg(const FlameNode &root, int total) {
+    std::ostringstream svg;
+    svg << "<svg>\n";
+    render_flame_node(svg, root, 0, 0, total, flame_depth(root));
+    svg << "</svg>\n";
+    return svg.str();
+}
+
+}  // namespace legacy
+
+// ---------------------------------------------------------------------------
+// Corpus
+// ---------------------------------------------------------------------------
+
+// Stacks share prefixes the way real programs do: a few roots, fan-out
+// narrowing with depth, and a skewed choice so some paths dominate.
+std::string generate_corpus(long samples, int max_depth, int funcs) {
+    std::mt19937 rng(42);
+    std::vector<std::string> names;
+    for (int i = 0; i < funcs; ++i) {
+        names.push_back("app::module" + std::to_string(i % 37) + "::Worker<std::vector<int>>::step" +
+                        std::to_string(i) + "(int, std::string const&)");
+    }
+    std::string out;
+    std::vector<int> stack;
+    for (long s = 0; s < samples; ++s) {
+        int depth = 4 + static_cast<int>(rng() % static_cast<unsigned>(std::max(1, max_depth - 4)));
+        stack.clear();
+        unsigned h = static_cast<unsigned>(rng() % 4);
+        for (int d = 0; d < depth; ++d) {
+            // Mostly the hot path; occasionally one of a few siblings
+            unsigned pick = rng() % 16 < 15 ? 0 : 1 + static_cast<unsigned>(rng() % 3);
+            h = h * 2654435761u + pick + 1;
+            stack.push_back(static_cast<int>(h % static_cast<unsigned>(funcs)));
+        }
+        out += "app 1234/1234 " + std::to_string(s) + ".000000: 10101010 cpu-clock:\n";
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+            char addr[32];
+            snprintf(addr, sizeof(addr), "\t%12lx ", 0x400000ul + static_cast<unsigned long>(*it) * 64);
+            out += addr;
+            out += names[static_cast<size_t>(*it)];
+            out += "+0x1c (/usr/bin/app)\n";
+        }
+        out += "\n";
+    }
+    return out;
+}
+
+// Thread CPU time, so a busy or throttled board does not skew the numbers
+double cpu_ms() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+}
+
+void bench(const std::string &label, const std::string &text) {
+    std::cout << label << ": " << text.size() / (1024 * 1024) << " MB\n";
+
+    // Legacy: the whole dump in memory, string keys, nested maps
+    double t0 = cpu_ms();
+    auto stacks = legacy::collapse_perf_script(text);
+    double l_fold = cpu_ms() - t0;
+    t0 = cpu_ms();
+    auto tree = legacy::build_flame_tree(stacks);
+    double l_tree = cpu_ms() - t0;
+    t0 = cpu_ms();
+    std::string l_svg = legacy::generate_flamegraph_svg(tree, legacy::flame_total(tree));
+    double l_render = cpu_ms() - t0;
+
+    // Current: streamed from a FILE, interned trie, pruned SVG
+    FILE *in = tmpfile();
+    if (!in || fwrite(text.data(), 1, text.size(), in) != text.size()) {
+        perror("tmpfile");
+        return;
+    }
+    rewind(in);
+    t0 = cpu_ms();
+    debuglantern::FlameGraph graph;
+    debuglantern::collapse_perf_script(in, graph);
+    double n_fold = cpu_ms() - t0;
+    fclose(in);
+    t0 = cpu_ms();
+    std::string n_svg = debuglantern::render_flamegraph_svg(graph);
+    double n_render = cpu_ms() - t0;
+
+    double legacy_ms = l_fold + l_tree + l_render;
+    double new_ms = n_fold + n_render;
+    printf("  %-8s %10s %10s %10s %10s\n", "", "fold", "tree", "svg", "total");
+    printf("  %-8s %8.1fms %8.1fms %8.1fms %8.1fms  (%zu stacks, svg %zu KB)\n", "legacy",
+           l_fold, l_tree, l_render, legacy_ms, stacks.size(), l_svg.size() / 1024);
+    printf("  %-8s %8.1fms %10s %8.1fms %8.1fms  (%zu nodes, svg %zu KB)\n", "trie", n_fold, "-",
+           n_render, new_ms, graph.nodes().size(), n_svg.size() / 1024);
+    printf("  speedup  %.1fx, samples %lld\n", legacy_ms / std::max(new_ms, 0.001), graph.total());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    long samples = 200000;
+    int depth = 48;
+    int funcs = 4000;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--samples" && i + 1 < argc) {
+            samples = atol(argv[++i]);
+        } else if (a == "--depth" && i + 1 < argc) {
+            depth = std::max(5, atoi(argv[++i]));
+        } else if (a == "--funcs" && i + 1 < argc) {
+            funcs = std::max(1, atoi(argv[++i]));
+        } else if (a == "--help" || a == "-h") {
+            std::cout << "usage: bench_flamegraph [--samples N] [--depth D] [--funcs F] [file...]\n";
+            return 0;
+        } else {
+            files.push_back(a);
+        }
+    }
+
+    if (files.empty()) {
+        for (long n : {samples / 10, samples}) {
+            bench("synthetic " + std::to_string(n) + " samples, depth <= " + std::to_string(depth),
+                  generate_corpus(n, depth, funcs));
+        }
+        return 0;
+    }
+    for (const auto &path : files) {
+        FILE *f = fopen(path.c_str(), "r");
+        if (!f) {
+            perror(path.c_str());
+            return 1;
+        }
+        std::string text;
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+        fclose(f);
+        bench(path, text);
+    }
+    return 0;
+}
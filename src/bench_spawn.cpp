@@ -0,0 +1,141 @@
+// Process launch benchmark.
+//
+//   bench_spawn [--rss MB] [--fds N] [--iterations N] [program [args...]]
+//
+// Times starting `program` (/bin/true by default) with fork() + execve(),
+// the way the daemon used to, against spawn_process() (clone with CLONE_VM
+// and CLONE_VFORK), from a process made to look like a busy daemon: --rss
+// MB of touched heap (256 by default) and --fds open descriptors (500).
+//
+// "blocked" is how long the caller is held up, which is what delays the
+// daemon's event loop: until fork() returns, or until the spawned child
+// has exec'd.  "to exit" runs until the child has been reaped.
+
+#include "spawn.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" char **environ;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double us_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+struct Timing {
+    std::vector<double> blocked;
+    std::vector<double> to_exit;
+};
+
+void fork_once(char *const *argv, Timing &t) {
+    auto t0 = Clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(argv[0], argv, environ);
+        _exit(127);
+    }
+    t.blocked.push_back(us_since(t0));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    t.to_exit.push_back(us_since(t0));
+}
+
+void spawn_once(char *const *argv, Timing &t) {
+    debuglantern::SpawnOptions opts;
+    opts.path = argv[0];
+    opts.argv = argv;
+    opts.envp = environ;
+    auto t0 = Clock::now();
+    debuglantern::Spawned child = debuglantern::spawn_process(opts);
+    t.blocked.push_back(us_since(t0));
+    if (child.pid < 0) {
+        perror("spawn");
+        exit(1);
+    }
+    int status = 0;
+    waitpid(child.pid, &status, 0);
+    t.to_exit.push_back(us_since(t0));
+    if (child.pidfd >= 0) close(child.pidfd);
+}
+
+double pct(std::vector<double> v, double q) {
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(q * static_cast<double>(v.size())))];
+}
+
+void report(const char *label, const Timing &t) {
+    printf("  %-10s %12.1f %8.1f %8.1f %12.1f %8.1f\n", label, pct(t.blocked, 0.5),
+           pct(t.blocked, 0.99), pct(t.blocked, 1), pct(t.to_exit, 0.5), pct(t.to_exit, 0.99));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    long rss_mb = 256;
+    int fds = 500;
+    int iterations = 200;
+    std::vector<char *> child_argv;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--rss" && i + 1 < argc) {
+            rss_mb = std::max(0L, atol(argv[++i]));
+        } else if (a == "--fds" && i + 1 < argc) {
+            fds = std::max(0, atoi(argv[++i]));
+        } else if (a == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        } else {
+            child_argv.assign(argv + i, argv + argc);
+            break;
+        }
+    }
+    if (child_argv.empty()) child_argv.push_back(const_cast<char *>("/bin/true"));
+    child_argv.push_back(nullptr);
+
+    // Touched, so every page has a page-table entry for fork() to copy
+    size_t rss = static_cast<size_t>(rss_mb) << 20;
+    if (rss) {
+        void *heap = mmap(nullptr, rss, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (heap == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        memset(heap, 1, rss);
+    }
+    for (int i = 0; i < fds; ++i) {
+        if (open("/dev/null", O_RDONLY | O_CLOEXEC) < 0) {
+            perror("open");
+            return 1;
+        }
+    }
+
+    Timing forked, spawned;
+    for (int i = 0; i < iterations; ++i) {
+        // Interleaved, so drift in machine load hits both alike
+        fork_once(child_argv.data(), forked);
+        spawn_once(child_argv.data(), spawned);
+    }
+
+    printf("%s, %ld MB resident, %d fds, %d runs; microseconds\n", child_argv[0], rss_mb, fds,
+           iterations);
+    printf("  %-10s %12s %8s %8s %12s %8s\n", "", "blocked p50", "p99", "max", "to exit p50",
+           "p99");
+    report("fork+exec", forked);
+    report("spawn", spawned);
+    printf("  blocked speedup %.1fx at p50\n",
+           pct(forked.blocked, 0.5) / std::max(pct(spawned.blocked, 0.5), 0.001));
+    return 0;
+}
@@ -1,12 +1,27 @@
 #include "common.h"
 
+#include <cerrno>
 #include <chrono>
 #include <ctime>
 #include <fcntl.h>
 #include <sstream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
 
 namespace debuglantern {
 
@@ -75,4 +90,37 @@ std::string now_iso8601() {
     return std::string(buf);
 }
 
+int sealed_memfd(const char *name, const unsigned char *data, size_t size) {
+#ifdef SYS_memfd_create
+    int fd = static_cast<int>(syscall(SYS_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+#else
+    int fd = -1;
+#endif
+    if (fd < 0) return -1;
+    size_t off = 0;
+    while (off < size) {
+        ssize_t n = write(fd, data + off, size - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        off += static_cast<size_t>(n);
+    }
+    // Sessions share it, so no child may change it
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    return fd;
+}
+
+void prepend_preload(std::vector<std::string> &env, const std::string &lib) {
+    bool preload = false;
+    for (auto &e : env) {
+        if (e.compare(0, 11, "LD_PRELOAD=") == 0) {
+            e = "LD_PRELOAD=" + lib + (e.size() > 11 ? ":" + e.substr(11) : "");
+            preload = true;
+        }
+    }
+    if (!preload) env.push_back("LD_PRELOAD=" + lib);
+}
+
 }  // namespace debuglantern
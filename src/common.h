@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace debuglantern {
 
@@ -16,6 +17,14 @@ std::string json_kv(const std::string &key, bool value);
 
 std::string now_iso8601();
 
+// A sealed, close-on-exec memfd called `name` holding `size` bytes from
+// `data`, for handing an embedded library to children; -1 on failure.
+int sealed_memfd(const char *name, const unsigned char *data, size_t size);
+
+// Puts `lib` first in the LD_PRELOAD of `env` ("NAME=value" entries),
+// ahead of any the environment already names, adding the entry if needed.
+void prepend_preload(std::vector<std::string> &env, const std::string &lib);
+
 }  // namespace debuglantern
 
 #endif  // DEBUGLANTERN_COMMON_H
@@ -0,0 +1,192 @@
+#include "continuous.h"
+
+#include "common.h"
+#include "flamegraph.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace debuglantern {
+
+namespace {
+
+constexpr time_t kBucketSeconds = 60;
+
+double thread_cpu_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+}  // namespace
+
+ContinuousProfiler::ContinuousProfiler(const ContinuousOptions &opts,
+                                       std::function<pid_t()> target)
+    : opts_(opts), target_(std::move(target)), frequency_(opts.frequency) {}
+
+ContinuousProfiler::~ContinuousProfiler() { stop(); }
+
+void ContinuousProfiler::start() {
+    started_ = time(nullptr);
+    thread_ = std::thread(&ContinuousProfiler::run, this);
+}
+
+void ContinuousProfiler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+bool ContinuousProfiler::running() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return !stop_ && state_ != "ended";
+}
+
+int ContinuousProfiler::frequency() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return frequency_;
+}
+
+// Sleeps until `when`; false if stopped meanwhile.
+bool ContinuousProfiler::wait_until(time_t when) {
+    std::unique_lock<std::mutex> lock(mu_);
+    wake_.wait_until(lock, std::chrono::system_clock::from_time_t(when), [this] { return stop_; });
+    return !stop_;
+}
+
+void ContinuousProfiler::run() {
+    auto keep_going = [this]() {
+        std::lock_guard<std::mutex> lock(mu_);
+        return !stop_;
+    };
+    while (keep_going()) {
+        pid_t pid = target_();
+        time_t now = time(nullptr);
+        time_t next = (now / kBucketSeconds + 1) * kBucketSeconds;
+        if (pid < 0) {
+            std::lock_guard<std::mutex> lock(mu_);
+            state_ = "ended";
+            return;
+        }
+        if (pid == 0) {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                state_ = "waiting";
+            }
+            wait_until(std::min(next, now + 5));
+            continue;
+        }
+
+        SampleOptions so;
+        so.duration_sec = static_cast<int>(std::max<time_t>(1, next - now));
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            so.frequency = frequency_;
+            state_ = "sampling";
+        }
+        FlameGraph graph;
+        SampleStats stats;
+        std::string error;
+        double cpu0 = thread_cpu_seconds();
+        auto wall0 = std::chrono::steady_clock::now();
+        bool ok = sample_stacks(pid, so, keep_going, graph, stats, error);
+
+        std::shared_ptr<const FlameGraph> kept;
+        if (ok) {
+            long long min_total = trim_threshold(graph, opts_.max_bucket_nodes);
+            if (min_total > 0) {
+                auto trimmed = std::make_shared<FlameGraph>();
+                trimmed->merge(graph, min_total);
+                kept = std::move(trimmed);
+            } else {
+                kept = std::make_shared<FlameGraph>(std::move(graph));
+            }
+        }
+        double cpu = thread_cpu_seconds() - cpu0;
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+
+        std::unique_lock<std::mutex> lock(mu_);
+        if (!ok) {
+            // An exit is picked up by target_() on the next round
+            if (error != "process exited") {
+                state_ = "error";
+                error_ = error;
+            }
+            lock.unlock();
+            wait_until(error == "process exited" ? time(nullptr) + 1 : next);
+            continue;
+        }
+        error_.clear();
+        buckets_.push_back(Bucket{now, time(nullptr), stats.samples, stats.lost, kept});
+        while (buckets_.size() > static_cast<size_t>(opts_.window_minutes)) buckets_.pop_front();
+
+        // A cut-short window says little about the steady-state cost
+        if (wall < 1.0) continue;
+        cpu_percent_ = cpu / wall * 100;
+        if (cpu_percent_ > opts_.budget_percent && frequency_ > 1) {
+            frequency_ = std::max(1, frequency_ / 2);
+            ++throttled_;
+        } else if (cpu_percent_ < opts_.budget_percent / 4 && frequency_ < opts_.frequency) {
+            frequency_ = std::min(opts_.frequency, frequency_ * 2);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    state_ = "ended";
+}
+
+size_t ContinuousProfiler::collect(time_t from, time_t to, FlameGraph &graph, time_t &first,
+                                   time_t &last) const {
+    std::vector<Bucket> picked;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (const auto &b : buckets_) {
+            if (b.end > from && b.start < to) picked.push_back(b);
+        }
+    }
+    first = last = 0;
+    for (const auto &b : picked) {
+        graph.merge(*b.graph);
+        if (!first || b.start < first) first = b.start;
+        last = std::max(last, b.end);
+    }
+    return picked.size();
+}
+
+std::string ContinuousProfiler::status_json() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    char pct[32];
+    std::string out = "{" + json_kv("state", state_, true);
+    if (!error_.empty()) out += "," + json_kv("error", error_, true);
+    out += "," + json_kv("frequency", static_cast<long long>(frequency_));
+    out += "," + json_kv("target_frequency", static_cast<long long>(opts_.frequency));
+    snprintf(pct, sizeof(pct), "%.3f", opts_.budget_percent);
+    out += "," + json_kv("budget_percent", pct, false);
+    snprintf(pct, sizeof(pct), "%.3f", cpu_percent_);
+    out += "," + json_kv("cpu_percent", pct, false);
+    out += "," + json_kv("throttled", throttled_);
+    out += "," + json_kv("window_minutes", static_cast<long long>(opts_.window_minutes));
+    out += "," + json_kv("started", static_cast<long long>(started_));
+
+    long long nodes = 0;
+    std::string buckets;
+    for (const auto &b : buckets_) {
+        nodes += static_cast<long long>(b.graph->nodes().size());
+        if (!buckets.empty()) buckets += ",";
+        buckets += "{" + json_kv("start", static_cast<long long>(b.start)) + "," +
+                   json_kv("end", static_cast<long long>(b.end)) + "," +
+                   json_kv("samples", b.samples) + "," + json_kv("lost", b.lost) + "}";
+    }
+    out += "," + json_kv("nodes", nodes);
+    out += "," + json_kv("max_nodes", static_cast<long long>(opts_.max_bucket_nodes) *
+                                          opts_.window_minutes);
+    out += ",\"buckets\":[" + buckets + "]}";
+    return out;
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,81 @@
+#ifndef DEBUGLANTERN_CONTINUOUS_H
+#define DEBUGLANTERN_CONTINUOUS_H
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace debuglantern {
+
+class FlameGraph;
+
+struct ContinuousOptions {
+    int frequency = 19;          // Hz per thread
+    int window_minutes = 60;     // buckets kept
+    double budget_percent = 1.0; // of one CPU, for sampling and symbolizing
+    size_t max_bucket_nodes = 5000;
+};
+
+// Always-on, low-rate sampling of one session into a ring of one-minute
+// buckets aligned to wall-clock minutes, so a window can be pulled out
+// after the fact.  Each bucket is trimmed to max_bucket_nodes nodes, which
+// bounds memory at roughly window_minutes * max_bucket_nodes nodes.
+//
+// The sampler's own CPU time is measured per bucket: over budget, the
+// frequency halves (down to 1 Hz); well under it, it climbs back.
+class ContinuousProfiler {
+public:
+    // `target` returns the session's pid, 0 while it is not running, or -1
+    // once the session is gone, which ends the profiler.
+    ContinuousProfiler(const ContinuousOptions &opts, std::function<pid_t()> target);
+    ~ContinuousProfiler();
+
+    void start();
+    void stop();
+    bool running() const;  // false once stopped or the session is gone
+    int frequency() const;  // current, after throttling
+
+    // Merges the buckets overlapping [from, to) into `graph` and returns
+    // how many there were; `first` and `last` are the span they cover.
+    size_t collect(time_t from, time_t to, FlameGraph &graph, time_t &first, time_t &last) const;
+
+    std::string status_json() const;
+
+private:
+    struct Bucket {
+        time_t start = 0;
+        time_t end = 0;
+        long long samples = 0;
+        long long lost = 0;
+        std::shared_ptr<const FlameGraph> graph;
+    };
+
+    void run();
+    bool wait_until(time_t when);
+
+    const ContinuousOptions opts_;
+    const std::function<pid_t()> target_;
+    std::thread thread_;
+
+    mutable std::mutex mu_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::deque<Bucket> buckets_;
+    std::string state_ = "starting";  // sampling, waiting (not running), error, ended
+    std::string error_;
+    int frequency_ = 0;           // current, after throttling
+    double cpu_percent_ = 0;      // sampler CPU over the last bucket
+    long long throttled_ = 0;     // times the frequency was cut
+    time_t started_ = 0;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_CONTINUOUS_H
@@ -0,0 +1,258 @@
+#include "counters.h"
+
+#include "common.h"
+#include "metrics.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace debuglantern {
+
+namespace {
+
+constexpr size_t kMaxThreads = 256;  // 12 fds each
+
+struct CounterDef {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int group;  // hardware group, or -1 for software events counted alone
+};
+
+// Four events fit the generic counters of most cores alongside the fixed
+// cycle and instruction counters; cache events get a group of their own.
+const CounterDef kCounters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0},
+    {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, 0},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0},
+    {"cache_references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, 1},
+    {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 1},
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1},
+    {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1},
+    {"cpu_migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, -1},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1},
+    {"minor_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN, -1},
+    {"major_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ, -1},
+};
+constexpr size_t kCounterCount = sizeof(kCounters) / sizeof(kCounters[0]);
+constexpr int kGroupCount = 2;
+
+enum { kCycles, kInstructions, kBranches, kBranchMisses, kCacheRefs, kCacheMisses, kTaskClock };
+
+// Opened without a group fd: software events, and each group's first event
+bool opens_alone(size_t i) {
+    return kCounters[i].group < 0 || i == 0 || kCounters[i - 1].group != kCounters[i].group;
+}
+
+long perf_event_open(perf_event_attr *attr, pid_t pid, int cpu, int group, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group, flags);
+}
+
+perf_event_attr counter_attr(const CounterDef &def, bool leader, bool user_only) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = def.type;
+    attr.config = def.config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = leader ? 1 : 0;  // members follow their group's first event
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = user_only ? 1 : 0;
+    return attr;
+}
+
+int open_counter(const CounterDef &def, pid_t tid, int group_fd, bool user_only) {
+    perf_event_attr attr = counter_attr(def, group_fd < 0, user_only);
+    return static_cast<int>(perf_event_open(&attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::string format_ratio(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", v);
+    return buf;
+}
+
+// `"cycles":N,...` plus the ratios derived from them, for the counters
+// that were counted
+std::string counts_json(const double *value, const bool *have, double duration_ns) {
+    std::string out;
+    auto add = [&out](const std::string &kv) {
+        if (!out.empty()) out += ",";
+        out += kv;
+    };
+    for (size_t i = 0; i < kCounterCount; ++i) {
+        if (have[i]) add(json_kv(kCounters[i].name, static_cast<long long>(value[i] + 0.5)));
+    }
+    if (have[kCycles] && have[kInstructions] && value[kCycles] > 0) {
+        add(json_kv("ipc", format_ratio(value[kInstructions] / value[kCycles]), false));
+    }
+    if (have[kCacheRefs] && have[kCacheMisses] && value[kCacheRefs] > 0) {
+        add(json_kv("cache_miss_rate", format_ratio(value[kCacheMisses] / value[kCacheRefs]), false));
+    }
+    if (have[kBranches] && have[kBranchMisses] && value[kBranches] > 0) {
+        add(json_kv("branch_miss_rate", format_ratio(value[kBranchMisses] / value[kBranches]), false));
+    }
+    if (have[kTaskClock] && duration_ns > 0) {
+        add(json_kv("cpus_utilized", format_ratio(value[kTaskClock] / duration_ns), false));
+    }
+    return out;
+}
+
+}  // namespace
+
+PerfCounters::~PerfCounters() { close_all(); }
+
+void PerfCounters::close_all() {
+    for (auto &t : threads_) {
+        for (int fd : t.fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+    threads_.clear();
+}
+
+bool PerfCounters::start(pid_t pid, std::string &error) {
+    close_all();
+    pid_ = pid;
+
+    // Probe once: whether kernel-side counts are allowed, and whether
+    // there is a PMU at all
+    int probe = open_counter(kCounters[kTaskClock], pid, -1, false);
+    if (probe < 0 && (errno == EACCES || errno == EPERM)) {
+        user_only_ = true;
+        probe = open_counter(kCounters[kTaskClock], pid, -1, true);
+    }
+    if (probe < 0) {
+        error = errno == ESRCH ? "process exited" : std::string("perf_event_open: ") + strerror(errno);
+        return false;
+    }
+    close(probe);
+    probe = open_counter(kCounters[kCycles], pid, -1, user_only_);
+    pmu_ = probe >= 0;
+    if (probe >= 0) close(probe);
+
+    for (pid_t proc : process_tree(pid)) {
+        for (pid_t tid : list_threads(proc)) {
+            if (threads_.size() >= kMaxThreads) {
+                truncated_ = true;
+                break;
+            }
+            Thread t;
+            t.pid = proc;
+            t.tid = tid;
+            std::ifstream comm("/proc/" + std::to_string(proc) + "/task/" + std::to_string(tid) +
+                               "/comm");
+            std::getline(comm, t.comm);
+            t.fds.assign(kCounterCount, -1);
+            int leaders[kGroupCount] = {-1, -1};
+            bool gone = false;
+            for (size_t i = 0; i < kCounterCount && !gone; ++i) {
+                const CounterDef &def = kCounters[i];
+                if (def.group >= 0 && !pmu_) continue;
+                bool alone = opens_alone(i);
+                int group_fd = alone ? -1 : leaders[def.group];
+                // A member whose leader failed would count on its own
+                if (!alone && group_fd < 0) continue;
+                int fd = open_counter(def, tid, group_fd, user_only_);
+                if (fd < 0 && errno == ESRCH) gone = true;
+                t.fds[i] = fd;
+                if (alone && def.group >= 0) leaders[def.group] = fd;
+            }
+            if (gone) {
+                for (int fd : t.fds) {
+                    if (fd >= 0) close(fd);
+                }
+                continue;
+            }
+            threads_.push_back(std::move(t));
+        }
+    }
+    if (threads_.empty()) {
+        error = "process exited";
+        return false;
+    }
+
+    started_ = std::chrono::steady_clock::now();
+    for (auto &t : threads_) {
+        for (size_t i = 0; i < kCounterCount; ++i) {
+            if (t.fds[i] >= 0 && opens_alone(i)) ioctl(t.fds[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    return true;
+}
+
+std::string PerfCounters::stop_json() {
+    for (auto &t : threads_) {
+        for (int fd : t.fds) {
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    double duration_ns =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started_).count();
+
+    struct Row {
+        const Thread *thread;
+        double value[kCounterCount] = {};
+        bool have[kCounterCount] = {};
+    };
+    std::vector<Row> rows;
+    double total[kCounterCount] = {};
+    bool have_total[kCounterCount] = {};
+    bool multiplexed = false;
+    for (const auto &t : threads_) {
+        Row row{&t};
+        for (size_t i = 0; i < kCounterCount; ++i) {
+            uint64_t v[3];  // value, time enabled, time running
+            if (t.fds[i] < 0 || read(t.fds[i], v, sizeof(v)) != sizeof(v)) continue;
+            // Enabled but never on a counter says nothing; a thread that
+            // never ran just counted nothing
+            if (v[1] > 0 && v[2] == 0) continue;
+            double value = static_cast<double>(v[0]);
+            if (v[2] > 0 && v[2] < v[1]) {
+                value *= static_cast<double>(v[1]) / static_cast<double>(v[2]);
+                multiplexed = true;
+            }
+            row.value[i] = value;
+            row.have[i] = true;
+            total[i] += value;
+            have_total[i] = true;
+        }
+        rows.push_back(row);
+    }
+    // Busiest threads first
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return a.value[kTaskClock] > b.value[kTaskClock];
+    });
+
+    std::string out = "{" + json_kv("pid", static_cast<long long>(pid_));
+    out += "," + json_kv("duration_ms", static_cast<long long>(duration_ns / 1e6 + 0.5));
+    out += "," + json_kv("pmu", pmu_);
+    out += "," + json_kv("user_only", user_only_);
+    out += "," + json_kv("multiplexed", multiplexed);
+    if (truncated_) out += "," + json_kv("truncated", true);
+    out += ",\"total\":{" + counts_json(total, have_total, duration_ns) + "},\"threads\":[";
+    for (size_t r = 0; r < rows.size(); ++r) {
+        const Thread &t = *rows[r].thread;
+        if (r) out += ",";
+        out += "{" + json_kv("pid", static_cast<long long>(t.pid)) + "," +
+               json_kv("tid", static_cast<long long>(t.tid)) + "," + json_kv("comm", t.comm, true);
+        std::string counts = counts_json(rows[r].value, rows[r].have, duration_ns);
+        if (!counts.empty()) out += "," + counts;
+        out += "}";
+    }
+    out += "]}";
+    close_all();
+    return out;
+}
+
+}  // namespace debuglantern
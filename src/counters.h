@@ -0,0 +1,54 @@
+#ifndef DEBUGLANTERN_COUNTERS_H
+#define DEBUGLANTERN_COUNTERS_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace debuglantern {
+
+// perf stat for a session: counts cycles, instructions, cache and branch
+// misses, context switches and page faults on every thread of a process
+// and of its descendants.  Hardware events are opened as groups so ratios
+// such as IPC come from counts taken over the same intervals; boards
+// without a PMU get the software events alone.  Counters are inherited,
+// so threads and processes created while counting add to their creator.
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Opens and enables the counters.  False with `error` set, having
+    // opened nothing, when not even the software events are allowed.
+    bool start(pid_t pid, std::string &error);
+
+    // Stops counting and returns {"pid","duration_ms","pmu","total":{...},
+    // "threads":[{"pid","tid","comm",...}]}; counts are scaled when the
+    // kernel multiplexed a group ("multiplexed":true).
+    std::string stop_json();
+
+private:
+    struct Thread {
+        pid_t pid = 0;
+        pid_t tid = 0;
+        std::string comm;
+        std::vector<int> fds;  // per counter, -1 when not opened
+    };
+
+    void close_all();
+
+    pid_t pid_ = 0;
+    bool pmu_ = false;
+    bool user_only_ = false;
+    bool truncated_ = false;
+    std::vector<Thread> threads_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_COUNTERS_H
@@ -25,17 +25,30 @@ struct Target {
 void usage() {
     std::cout << "debuglanternctl <cmd> [args] --target host --port 4444\n"
                  "commands: upload <file> [--exec-path <path>],\n"
-                 "          args <id> \"arg1 arg2 ...\", start <id> [--debug],\n"
+                 "          args <id> \"arg1 arg2 ...\",\n"
+                 "          start <id> [--debug] [--pty] [--heap-profile] [--replicas n],\n"
                  "          env <id> KEY=VALUE, envdel <id> KEY, envlist <id>,\n"
                  "          stop <id>, kill <id>, debug <id>, list, status <id>, delete <id>,\n"
-                 "          output <id> [--follow], deps\n"
+                 "          output <id> [--follow], counters <id> [seconds], heap <id> [live|alloc],\n"
+                 "          threads <id> [seconds], metrics <id> [since], stats, trace [id],\n"
+                 "          prepare <id> [n] [--pty], deps\n"
                  "\n"
                  "  --exec-path       path to binary inside a tar.gz bundle (triggers bundle upload)\n"
                  "  args <id> \"...\"  set arguments for a session (saved, used on every start)\n"
                  "  env <id> K=V      set an environment variable for a session\n"
                  "  envdel <id> KEY   remove an environment variable\n"
                  "  envlist <id>      list environment variables for a session\n"
-                 "  --follow          continuously stream output (for output command)\n";
+                 "  counters <id> [s] count cycles, instructions, misses, faults (default 1 s)\n"
+                 "  threads <id> [s]  per-thread CPU, switches, run-queue delay, CPU placement\n"
+                 "  heap <id> [view]  bytes live or allocated by stack (start with --heap-profile)\n"
+                 "  metrics <id> [n]  CPU, RSS, I/O, threads, fds per second, from sample n on\n"
+                 "  stats             daemon loop and command latency, recent stalls\n"
+                 "  trace [id]        session lifecycle spans as Chrome trace JSON (for Perfetto)\n"
+                 "  prepare <id> [n]  keep n instances (default 1) parked before main for start\n"
+                 "  --follow          continuously stream output (for output command)\n"
+                 "  --pty             start with a pseudo-terminal (interactive input via web UI)\n"
+                 "  --heap-profile[=bytes]  start with the heap sampler (one sample per 512 KB)\n"
+                 "  --replicas n      start n copies <id>.0..n-1; {{index}} in args/env is replaced\n";
 }
 
 Target parse_target(int &argc, char **argv) {
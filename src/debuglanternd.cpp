@@ -3,6 +3,16 @@
 #endif
 
 #include "common.h"
+#include "counters.h"
+#include "execblock.h"
+#include "flamegraph.h"
+#include "heapprof.h"
+#include "metrics.h"
+#include "prewarm.h"
+#include "symbolizer.h"
+#include "spawn.h"
+#include "telemetry.h"
+#include "trace.h"
 
 #include <avahi-client/client.h>
 #include <avahi-client/publish.h>
@@ -16,18 +26,24 @@
 #include <netinet/in.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <termios.h>
 #include <unistd.h>
 #include <uuid/uuid.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -45,8 +61,34 @@ constexpr int kDefaultPort = 4444;
 constexpr int kMaxEvents = 64;
 constexpr int kDefaultDebugPortBase = 5500;
 constexpr int kDebugPortRange = 200;
-constexpr size_t kMaxOutputBuffer = 256 * 1024;
+constexpr size_t kDefaultOutputBuffer = 256 * 1024;
+// Per-wakeup read cap for client sockets.  Epoll is level-triggered, so any
+// remainder is picked up on the next iteration; this keeps a fast upload from
+// piling its whole body into ClientConn::inbuf before it reaches the memfd.
+constexpr size_t kMaxClientReadPerEvent = 256 * 1024;
 constexpr const char *kServiceType = "_mydebug._tcp";
+// How far an attached (streaming) client may fall behind before pending
+// output is dropped, and how much keyboard input may queue for a PTY.
+constexpr size_t kMaxPtyInputBacklog = 64 * 1024;
+// COUNTERS and THREADS runs in flight; a COUNTERS run holds a dozen perf
+// fds per thread.
+constexpr size_t kMaxSampleRuns = 4;
+constexpr double kMaxSampleSeconds = 60;
+// START --heap-profile: mean bytes allocated between heap samples
+constexpr long long kDefaultHeapRate = 512 * 1024;
+// Call-tree nodes a HEAP reply carries; smaller subtrees fold into callers
+constexpr size_t kMaxHeapNodes = 5000;
+// How often running sessions' /proc resource use is read (METRICS)
+constexpr int kDefaultMetricsIntervalMs = 1000;
+// A loop iteration taking this long is logged as a stall (--stall-threshold)
+constexpr int kDefaultStallThresholdMs = 250;
+constexpr size_t kMaxStallRecords = 32;
+// Lifecycle spans kept for TRACE, across all sessions
+constexpr size_t kTraceSpans = 4096;
+// PREPARE: instances a session may keep parked ahead of START
+constexpr size_t kMaxPrepared = 8;
+// START --replicas: instances one session may run at once
+constexpr long long kMaxReplicas = 64;
 
 int pidfd_open_sys(pid_t pid) {
 #ifdef SYS_pidfd_open
@@ -195,6 +237,95 @@ void stop_mdns(MdnsAdvertiser &adv) {
     adv.started = false;
 }
 
+// Captured stdout/stderr.  A fixed-capacity ring addressed by absolute
+// stream offsets: once full, the oldest bytes fall off and start() moves
+// forward, but offsets a client already holds stay valid.  Storage grows
+// by doubling up to the capacity (it only wraps once fully grown), so
+// quiet sessions stay small even with a large --output-buffer.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(size_t capacity = kDefaultOutputBuffer)
+        : capacity_(capacity ? capacity : kDefaultOutputBuffer) {}
+
+    void append(const char *data, size_t len) {
+        if (len > capacity_) {
+            data += len - capacity_;
+            end_ += len - capacity_;
+            len = capacity_;
+        }
+        if (buf_.size() < capacity_ && end_ + len > buf_.size()) {
+            size_t want = std::max({buf_.size() * 2, end_ + len, size_t{4096}});
+            buf_.resize(std::min(want, capacity_));
+        }
+        size_t pos = end_ % capacity_;
+        size_t first = std::min(len, capacity_ - pos);
+        memcpy(buf_.data() + pos, data, first);
+        memcpy(buf_.data(), data + first, len - first);
+        end_ += len;
+    }
+
+    // Forget all data; offsets restart at zero for the next run.
+    void clear() { end_ = 0; }
+
+    size_t start() const { return end_ > capacity_ ? end_ - capacity_ : 0; }
+    size_t end() const { return end_; }
+    size_t size() const { return end_ - start(); }
+
+    // Contiguous run of retained bytes at absolute `offset`, up to the end
+    // of the data or the wrap point; `len` is 0 when nothing is there.
+    const char *peek(size_t offset, size_t &len) const {
+        len = 0;
+        if (offset < start() || offset >= end_) {
+            return nullptr;
+        }
+        size_t pos = offset % capacity_;
+        len = std::min(end_ - offset, capacity_ - pos);
+        return buf_.data() + pos;
+    }
+
+    // Appends up to `len` bytes beginning at absolute `offset` (clamped to
+    // the retained window) to `out`; returns the offset actually used.
+    size_t read(size_t offset, size_t len, std::string &out) const {
+        offset = std::max(offset, start());
+        if (offset >= end_) {
+            return std::min(offset, end_);
+        }
+        len = std::min(len, end_ - offset);
+        size_t pos = offset % capacity_;
+        size_t first = std::min(len, capacity_ - pos);
+        out.append(buf_.data() + pos, first);
+        out.append(buf_.data(), len - first);
+        return offset;
+    }
+
+private:
+    std::vector<char> buf_;
+    size_t capacity_;
+    size_t end_ = 0;
+};
+
+// Where a child's stdio goes: a pipe, or a PTY slave for interactive use.
+// The parent keeps read_fd (pipe read end or PTY master).
+struct OutputChannel {
+    int read_fd = -1;
+    int write_fd = -1;  // pipe write end or PTY slave; closed after spawn
+    bool pty = false;
+};
+
+// A PREPARE instance: exec'd, loaded and initialised, and held by the start
+// gate just before main until START writes to release_fd.
+struct PreparedProcess {
+    pid_t pid = -1;
+    int pidfd = -1;
+    OutputChannel chan;   // write_fd already closed
+    int ready_fd = -1;    // the gate's GateReport, or EOF if it dies first
+    int release_fd = -1;  // one byte lets it run main
+    std::chrono::steady_clock::time_point spawned;  // spawn began
+    bool ready = false;
+    long long loader_us = -1;  // exec and dynamic loading, to __libc_start_main
+    long long init_us = -1;    // constructors, up to main
+};
+
 struct Session {
     std::string id;
     int memfd = -1;
@@ -205,13 +336,48 @@ struct Session {
     int gdb_pidfd = -1;
     size_t size = 0;
     int state = 0;
+    long long run = 0;  // START count; identifies one execution
     bool is_bundle = false;
     std::string bundle_dir;
     std::string exec_path;
-    std::string output;
+    std::string build_id;  // GNU build-id of the binary, if it has one
+    OutputBuffer output;
     int output_pipe_fd = -1;
-    std::string saved_args;
+    bool pty = false;               // output_pipe_fd is a PTY master
+    std::string pty_input;          // keystrokes waiting for the PTY
+    std::vector<int> attached_fds;  // clients following output (ATTACH/TAIL)
+    std::string saved_args;         // as given to ARGS
+    std::vector<std::string> args;  // saved_args split into words
     std::map<std::string, std::string> env_vars;
+    debuglantern::ExecBlock exec;   // argv and envp, rebuilt after ARGS/ENV/ENVDEL
+    std::shared_ptr<debuglantern::HeapProfile> heap;  // this run's, with --heap-profile
+    std::shared_ptr<debuglantern::ResourceHistory> metrics;  // this run's resource use
+    int heap_pipe_fd = -1;
+    int telemetry_slot = -1;
+    // Where this run's "run", "first output" and "gdbserver" trace spans begin
+    std::chrono::steady_clock::time_point run_started;
+    std::chrono::steady_clock::time_point gdb_started;
+    bool awaiting_output = false;
+    // PREPARE: parked instances, topped up to prepare_target when a run ends
+    std::vector<PreparedProcess> prepared;
+    size_t prepare_target = 0;
+    bool prepare_pty = false;
+    long long loader_us = -1;  // of the prepared instance this run came from
+    long long init_us = -1;
+    // START --replicas: on a replica, the session it was made from and its
+    // index; on that session, its replicas' ids by index
+    std::string replica_of;
+    long long replica_index = -1;
+    std::vector<std::string> replicas;
+};
+
+// The pipe a --heap-profile child's sampler reports on.  The parent keeps
+// read_fd; the child inherits write_fd and the sampler library's memfd.
+struct HeapChannel {
+    int lib_fd = -1;
+    int read_fd = -1;
+    int write_fd = -1;  // closed after spawn
+    long long rate = 0;
 };
 
 struct OutputPipeInfo {
@@ -223,6 +389,15 @@ struct WatchInfo {
     bool is_gdb = false;
 };
 
+// A COUNTERS or THREADS command waiting on its timerfd to answer
+// `client_fd`; exactly one of the samplers is set.
+struct SampleRun {
+    int client_fd = -1;
+    std::string id;
+    std::unique_ptr<debuglantern::PerfCounters> counters;
+    std::unique_ptr<debuglantern::ThreadSampler> threads;
+};
+
 struct ClientConn {
     int fd = -1;
     std::string inbuf;
@@ -236,6 +411,22 @@ struct ClientConn {
     std::string exec_path;
     int upload_tmpfd = -1;
     std::string upload_tmppath;
+    std::chrono::steady_clock::time_point upload_started;
+    // Output streaming (ATTACH, TAIL, OUTPUTRAW): session output is written
+    // from `stream_pos` straight out of the session's ring buffer up to
+    // `stream_end`, then the write side is shut down.  Followers are listed
+    // in Session::attached_fds and stream until the output ends.  ATTACH
+    // additionally forwards client bytes to the session's PTY.
+    bool streaming = false;
+    bool stream_done = false;
+    bool attached = false;
+    std::string attach_id;
+    size_t stream_pos = 0;
+    size_t stream_end = SIZE_MAX;
+    std::string outbuf;  // written ahead of stream data
+    bool write_blocked = false;
+    bool reading_paused = false;
+    uint32_t epoll_events = EPOLLIN | EPOLLRDHUP;
 };
 
 struct ActivityEntry {
@@ -243,6 +434,14 @@ struct ActivityEntry {
     std::string message;
 };
 
+// A loop iteration over the stall threshold, and its slowest handler
+struct StallRecord {
+    std::string time;
+    long long duration_us = 0;
+    std::string handler;
+    long long handler_us = 0;
+};
+
 constexpr size_t kMaxActivityEntries = 100;
 
 struct Config {
@@ -251,6 +450,9 @@ struct Config {
     std::string service_name = "debuglantern";
     size_t max_sessions = 32;
     size_t max_total_bytes = 512 * 1024 * 1024ULL;
+    size_t output_buffer = kDefaultOutputBuffer;
+    int metrics_interval_ms = kDefaultMetricsIntervalMs;  // 0 disables
+    int stall_threshold_ms = kDefaultStallThresholdMs;    // 0 disables
     int drop_uid = -1;
     int drop_gid = -1;
 };
@@ -264,19 +466,121 @@ bool remove_directory_recursive(const std::string &path) {
 }
 
 bool extract_tar_gz(const std::string &archive_path, const std::string &dest_dir) {
-    pid_t child = fork();
-    if (child == 0) {
-        execlp("tar", "tar", "xzf", archive_path.c_str(), "-C", dest_dir.c_str(), nullptr);
-        _exit(127);
-    }
-    if (child < 0) {
+    char *argv[] = {const_cast<char *>("tar"), const_cast<char *>("xzf"),
+                    const_cast<char *>(archive_path.c_str()), const_cast<char *>("-C"),
+                    const_cast<char *>(dest_dir.c_str()), nullptr};
+    debuglantern::SpawnOptions opts;
+    opts.path = "tar";
+    opts.search_path = true;
+    opts.argv = argv;
+    opts.envp = environ;
+    opts.new_group = false;
+    opts.allow_ptrace = false;
+    debuglantern::Spawned child = debuglantern::spawn_process(opts);
+    if (child.pid < 0) {
         return false;
     }
+    if (child.pidfd >= 0) close(child.pidfd);
     int status = 0;
-    waitpid(child, &status, 0);
+    waitpid(child.pid, &status, 0);
     return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
+bool open_output_channel(bool pty, OutputChannel &chan) {
+    chan = OutputChannel{};
+    chan.pty = pty;
+    if (!pty) {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) < 0) {
+            return false;
+        }
+        chan.read_fd = p[0];
+        chan.write_fd = p[1];
+        return true;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0) {
+        return false;
+    }
+    char name[128];
+    if (grantpt(master) != 0 || unlockpt(master) != 0 ||
+        ptsname_r(master, name, sizeof(name)) != 0) {
+        close(master);
+        return false;
+    }
+    // Open the slave here rather than in the child so the master never sees
+    // a window with no slave open (which reads as EIO / hangup).
+    int slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0) {
+        close(master);
+        return false;
+    }
+    struct winsize ws{};
+    ws.ws_row = 24;
+    ws.ws_col = 80;
+    ioctl(master, TIOCSWINSZ, &ws);
+    chan.read_fd = master;
+    chan.write_fd = slave;
+    return true;
+}
+
+void close_output_channel(OutputChannel &chan) {
+    if (chan.read_fd >= 0) close(chan.read_fd);
+    if (chan.write_fd >= 0) close(chan.write_fd);
+    chan.read_fd = -1;
+    chan.write_fd = -1;
+}
+
+// The child's stdio.  PTY children become session leaders with the slave
+// as controlling terminal; pipe children just get their own group.
+void spawn_output(const OutputChannel &chan, debuglantern::SpawnOptions &opts) {
+    opts.stdio_fd = chan.write_fd;
+    opts.terminal = chan.pty;
+}
+
+bool open_heap_channel(long long rate, HeapChannel &chan) {
+    chan = HeapChannel{};
+    chan.lib_fd = debuglantern::heap_sampler_memfd();
+    if (chan.lib_fd < 0) {
+        return false;
+    }
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) {
+        return false;
+    }
+    // The sampler drops records rather than block the allocating thread
+    debuglantern::set_nonblocking(p[1]);
+    fcntl(p[1], F_SETPIPE_SZ, 1 << 20);
+    chan.read_fd = p[0];
+    chan.write_fd = p[1];
+    chan.rate = rate;
+    return true;
+}
+
+void close_heap_channel(HeapChannel &chan) {
+    if (chan.read_fd >= 0) close(chan.read_fd);
+    if (chan.write_fd >= 0) close(chan.write_fd);
+    chan.read_fd = -1;
+    chan.write_fd = -1;
+}
+
+// Preloads the sampler ahead of anything the session's own LD_PRELOAD names.
+void add_heap_env(std::vector<std::string> &env, const HeapChannel &chan) {
+    std::string lib = "/proc/self/fd/" + std::to_string(chan.lib_fd);
+    debuglantern::prepend_preload(env, lib);
+    env.push_back("DEBUGLANTERN_HEAP_FD=" + std::to_string(chan.write_fd));
+    env.push_back("DEBUGLANTERN_HEAP_RATE=" + std::to_string(chan.rate));
+    env.push_back("DEBUGLANTERN_HEAP_LIB=" + lib);
+}
+
+// Lets the library and the pipe survive exec.
+void spawn_heap(const HeapChannel &chan, debuglantern::SpawnOptions &opts) {
+    if (chan.write_fd < 0) return;
+    opts.keep_fds.push_back(chan.lib_fd);
+    opts.keep_fds.push_back(chan.write_fd);
+}
+
 struct DepStatus {
     std::string name;
     std::string description;
@@ -297,7 +601,7 @@ std::vector<DepStatus> check_dependencies() {
     deps.push_back({"gdbserver", "Required for debug attach and start --debug", check_cmd("gdbserver"), true});
     deps.push_back({"tar", "Required for bundle (tar.gz) extraction", check_cmd("tar"), true});
     deps.push_back({"gzip", "Required for bundle (tar.gz) decompression", check_cmd("gzip"), true});
-    deps.push_back({"perf", "Optional: CPU profiling for flamegraph generation", check_cmd("perf"), false});
+    deps.push_back({"perf", "Optional: flamegraph fallback when perf_event_open is unavailable", check_cmd("perf"), false});
 
     return deps;
 }
@@ -335,11 +639,11 @@ bool validate_elf_file(const std::string &path) {
 
 class Server {
 public:
-    explicit Server(const Config &cfg)
-        : cfg_(cfg) {}
+    Server(const Config &cfg, debuglantern::Telemetry &telemetry)
+        : cfg_(cfg), telemetry_(telemetry), started_(std::chrono::steady_clock::now()) {}
 
     bool init() {
-        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
         if (listen_fd_ < 0) {
             perror("socket");
             return false;
@@ -363,7 +667,7 @@ public:
             return false;
         }
 
-        epoll_fd_ = epoll_create1(0);
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
         if (epoll_fd_ < 0) {
             perror("epoll_create1");
             return false;
@@ -377,6 +681,20 @@ public:
             return false;
         }
 
+        if (cfg_.metrics_interval_ms > 0) {
+            metrics_timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            itimerspec its{};
+            its.it_interval.tv_sec = cfg_.metrics_interval_ms / 1000;
+            its.it_interval.tv_nsec = (cfg_.metrics_interval_ms % 1000) * 1000000L;
+            its.it_value = its.it_interval;
+            ev.data.fd = metrics_timer_;
+            if (metrics_timer_ < 0 || timerfd_settime(metrics_timer_, 0, &its, nullptr) < 0 ||
+                epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, metrics_timer_, &ev) < 0) {
+                perror("metrics timer");
+            }
+        }
+
+        telemetry_.set_binary_bytes(total_bytes_, cfg_.max_total_bytes);
         return true;
     }
 
@@ -392,31 +710,29 @@ public:
                 break;
             }
 
+            // Every handler is timed so a slow iteration can name its cause
+            auto began = std::chrono::steady_clock::now();
+            auto slowest = std::chrono::steady_clock::duration::zero();
+            std::string slowest_handler;
             for (int i = 0; i < n; ++i) {
-                int fd = events[i].data.fd;
-                if (fd == listen_fd_) {
-                    handle_accept();
-                    continue;
-                }
-
-                auto watch_it = watches_.find(fd);
-                if (watch_it != watches_.end()) {
-                    handle_watch(fd, watch_it->second);
-                    continue;
-                }
-
-                auto pipe_it = output_pipes_.find(fd);
-                if (pipe_it != output_pipes_.end()) {
-                    handle_output_pipe(fd, pipe_it->second);
-                    continue;
-                }
-
-                auto conn_it = clients_.find(fd);
-                if (conn_it != clients_.end()) {
-                    handle_client(conn_it->second);
-                    continue;
+                handler_ = "";
+                handler_detail_.clear();
+                auto handler_began = std::chrono::steady_clock::now();
+                dispatch(events[i].data.fd, events[i].events);
+                auto took = std::chrono::steady_clock::now() - handler_began;
+                if (took > slowest) {
+                    slowest = took;
+                    slowest_handler = handler_detail_.empty() ? handler_
+                                                              : std::string(handler_) + " " +
+                                                                    handler_detail_;
                 }
             }
+            publish_states();
+            auto took = std::chrono::steady_clock::now() - began;
+            bool stalled = cfg_.stall_threshold_ms > 0 &&
+                           took >= std::chrono::milliseconds(cfg_.stall_threshold_ms);
+            telemetry_.observe_loop(took, stalled);
+            if (stalled) report_stall(took, slowest_handler, slowest);
         }
     }
 
@@ -425,11 +741,112 @@ public:
     }
 
 private:
+    void dispatch(int fd, uint32_t events) {
+        if (fd == listen_fd_) {
+            handler_ = "accept";
+            handle_accept();
+            return;
+        }
+        if (fd == metrics_timer_) {
+            handler_ = "metrics timer";
+            sample_metrics();
+            return;
+        }
+
+        auto watch_it = watches_.find(fd);
+        if (watch_it != watches_.end()) {
+            handler_ = watch_it->second.is_gdb ? "gdb exit" : "process exit";
+            handler_detail_ = watch_it->second.id;
+            handle_watch(fd, watch_it->second);
+            return;
+        }
+
+        auto sample_it = sample_runs_.find(fd);
+        if (sample_it != sample_runs_.end()) {
+            handler_ = sample_it->second.counters ? "COUNTERS reply" : "THREADS reply";
+            handler_detail_ = sample_it->second.id;
+            finish_sample_run(fd);
+            return;
+        }
+
+        auto ready_it = prepared_pipes_.find(fd);
+        if (ready_it != prepared_pipes_.end()) {
+            handler_ = "prepared instance";
+            handler_detail_ = ready_it->second;
+            handle_gate_report(fd, ready_it->second);
+            return;
+        }
+
+        auto heap_it = heap_pipes_.find(fd);
+        if (heap_it != heap_pipes_.end()) {
+            handler_ = "heap samples";
+            handle_heap_pipe(fd, heap_it->second);
+            return;
+        }
+
+        auto pipe_it = output_pipes_.find(fd);
+        if (pipe_it != output_pipes_.end()) {
+            handler_ = "process output";
+            handle_output_pipe(fd, events, pipe_it->second);
+            return;
+        }
+
+        auto conn_it = clients_.find(fd);
+        if (conn_it != clients_.end()) {
+            handler_ = "client";
+            handle_client(conn_it->second, events);
+        }
+    }
+
+    // The watchdog: an iteration over --stall-threshold goes to stderr and
+    // the activity log, and is kept for STATS.
+    void report_stall(std::chrono::steady_clock::duration took, const std::string &handler,
+                      std::chrono::steady_clock::duration handler_took) {
+        StallRecord r;
+        r.time = debuglantern::now_iso8601();
+        r.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(took).count();
+        r.handler = handler;
+        r.handler_us = std::chrono::duration_cast<std::chrono::microseconds>(handler_took).count();
+        std::ostringstream msg;
+        msg << "event loop stalled " << r.duration_us / 1000 << " ms (" << r.handler_us / 1000
+            << " ms in " << (handler.empty() ? "?" : handler) << ")";
+        std::cerr << msg.str() << "\n";
+        add_activity(msg.str());
+        stalls_.push_back(std::move(r));
+        if (stalls_.size() > kMaxStallRecords) stalls_.pop_front();
+    }
+
+    void send_stats(int fd) {
+        auto uptime = std::chrono::steady_clock::now() - started_;
+        std::ostringstream oss;
+        oss << "{"
+            << debuglantern::json_kv(
+                   "uptime_ms", static_cast<long long>(
+                                    std::chrono::duration_cast<std::chrono::milliseconds>(uptime)
+                                        .count()))
+            << ","
+            << debuglantern::json_kv("stall_threshold_ms",
+                                     static_cast<long long>(cfg_.stall_threshold_ms))
+            << ",\"loop\":{" << telemetry_.loop_json() << "},\"commands\":"
+            << telemetry_.commands_json() << ",\"recent_stalls\":[";
+        for (size_t i = 0; i < stalls_.size(); ++i) {
+            const StallRecord &r = stalls_[i];
+            if (i) oss << ",";
+            oss << "{" << debuglantern::json_kv("time", r.time, true) << ","
+                << debuglantern::json_kv("duration_us", r.duration_us) << ","
+                << debuglantern::json_kv("handler", r.handler, true) << ","
+                << debuglantern::json_kv("handler_us", r.handler_us) << "}";
+        }
+        oss << "]}\n";
+        send_response(fd, oss.str());
+    }
+
     void handle_accept() {
         while (true) {
             sockaddr_in addr{};
             socklen_t len = sizeof(addr);
-            int fd = accept4(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len, SOCK_NONBLOCK);
+            int fd = accept4(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
             if (fd < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     break;
@@ -452,6 +869,22 @@ private:
     }
 
     void close_client(ClientConn &conn) {
+        if (!conn.attach_id.empty()) {
+            auto it = sessions_.find(conn.attach_id);
+            if (it != sessions_.end()) {
+                auto &fds = it->second.attached_fds;
+                fds.erase(std::remove(fds.begin(), fds.end(), conn.fd), fds.end());
+            }
+        }
+        for (auto it = sample_runs_.begin(); it != sample_runs_.end();) {
+            if (it->second.client_fd == conn.fd) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->first, nullptr);
+                close(it->first);
+                it = sample_runs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
         epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
         close(conn.fd);
         if (conn.in_upload && conn.upload_memfd >= 0) {
@@ -466,29 +899,58 @@ private:
         clients_.erase(conn.fd);
     }
 
-    void handle_client(ClientConn &conn) {
+    void handle_client(ClientConn &conn, uint32_t events) {
+        if (events & EPOLLOUT) {
+            flush_client(conn);
+        }
+        if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+            return;
+        }
         if (!read_into_buffer(conn)) {
             close_client(conn);
             return;
         }
 
+        if (conn.attached) {
+            consume_attach_input(conn);
+            return;
+        }
+        if (conn.streaming || conn.stream_done) {
+            conn.inbuf.clear();
+            return;
+        }
+
         if (conn.in_upload) {
+            handler_ = "upload";
             if (!consume_upload(conn)) {
                 close_client(conn);
                 return;
             }
         }
 
-        while (!conn.in_upload) {
+        while (!conn.in_upload && !conn.streaming && !conn.stream_done) {
             auto line = read_line(conn.inbuf);
             if (!line.has_value()) {
                 break;
             }
+            // The verb and its first argument; ARGS and ENV values stay out of logs
+            handler_ = "command";
+            handler_detail_ = line->substr(0, line->find(' ', line->find(' ') + 1));
+            auto began = std::chrono::steady_clock::now();
             handle_command(conn, *line);
+            telemetry_.observe_command(line->substr(0, line->find(' ')),
+                                       std::chrono::steady_clock::now() - began);
+        }
+
+        // Bytes after an ATTACH line are already terminal input
+        if (conn.attached && !conn.inbuf.empty()) {
+            consume_attach_input(conn);
         }
 
         // Consume any buffered upload data after entering upload mode
         if (conn.in_upload && !conn.inbuf.empty()) {
+            handler_ = "upload";
+            handler_detail_.clear();
             if (!consume_upload(conn)) {
                 close_client(conn);
                 return;
@@ -497,8 +959,9 @@ private:
     }
 
     bool read_into_buffer(ClientConn &conn) {
-        char buf[4096];
-        while (true) {
+        char buf[65536];
+        size_t total = 0;
+        while (total < kMaxClientReadPerEvent) {
             ssize_t n = read(conn.fd, buf, sizeof(buf));
             if (n == 0) {
                 return false;
@@ -510,6 +973,7 @@ private:
                 return false;
             }
             conn.inbuf.append(buf, static_cast<size_t>(n));
+            total += static_cast<size_t>(n);
         }
         return true;
     }
@@ -553,18 +1017,28 @@ private:
             }
             off += static_cast<size_t>(wrote);
         }
+        telemetry_.add_upload_bytes(len);
         return true;
     }
 
+    // The session id is drawn first so that the upload's trace spans carry
+    // it, even when the upload is then refused.
     bool finish_upload(ClientConn &conn) {
         conn.in_upload = false;
+        auto received = std::chrono::steady_clock::now();
+        telemetry_.upload_done(received - conn.upload_started);
+        std::string id = generate_uuid();
+        trace_.add(id, "receive upload", conn.upload_started, received,
+                   debuglantern::json_kv("bytes", static_cast<long long>(conn.upload_size)));
 
         if (conn.is_bundle) {
-            return finish_bundle_upload(conn);
+            return finish_bundle_upload(conn, id);
         }
 
         if (conn.elf_filled < 4 || conn.elf_magic[0] != 0x7f || conn.elf_magic[1] != 'E' ||
             conn.elf_magic[2] != 'L' || conn.elf_magic[3] != 'F') {
+            trace_.add(id, "validate ELF", received, std::chrono::steady_clock::now(),
+                       debuglantern::json_kv("error", std::string("invalid_elf"), true));
             send_error(conn.fd, "invalid_elf");
             close(conn.upload_memfd);
             conn.upload_memfd = -1;
@@ -585,15 +1059,25 @@ private:
             return true;
         }
 
-        std::string id = generate_uuid();
         Session s;
         s.id = id;
         s.memfd = conn.upload_memfd;
         s.size = conn.upload_size;
         s.state = 0;
+        s.output = OutputBuffer(cfg_.output_buffer);
+        {
+            debuglantern::TraceBuffer::Scope span(trace_, id, "read build-id");
+            s.build_id = debuglantern::elf_build_id(s.memfd);
+        }
+        {
+            debuglantern::TraceBuffer::Scope span(trace_, id, "queue symbol index");
+            index_symbols(s.memfd, "");
+        }
 
+        s.telemetry_slot = telemetry_.acquire(id);
         sessions_[id] = s;
         total_bytes_ += conn.upload_size;
+        telemetry_.set_binary_bytes(total_bytes_, cfg_.max_total_bytes);
 
         std::ostringstream oss;
         oss << "{" << debuglantern::json_kv("id", id, true) << ","
@@ -607,7 +1091,14 @@ private:
         return true;
     }
 
-    bool finish_bundle_upload(ClientConn &conn) {
+    // Profiles of this binary then find its symbols already parsed.  The
+    // parse runs on its own copy of the descriptor, off the event loop.
+    static void index_symbols(int fd, const std::string &path) {
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (copy >= 0) debuglantern::preload_symbols(copy, path);
+    }
+
+    bool finish_bundle_upload(ClientConn &conn, const std::string &id) {
         close(conn.upload_tmpfd);
         conn.upload_tmpfd = -1;
 
@@ -633,9 +1124,18 @@ private:
         std::string bundle_dir = tmpdir;
 
         // Extract tar.gz
-        if (!extract_tar_gz(conn.upload_tmppath, bundle_dir)) {
+        bool extracted;
+        {
+            debuglantern::TraceBuffer::Scope span(trace_, id, "extract tar.gz");
+            extracted = extract_tar_gz(conn.upload_tmppath, bundle_dir);
+            if (!extracted) {
+                span.set_args(debuglantern::json_kv("error", std::string("extract_failed"), true));
+            }
+        }
+        if (!extracted) {
             send_error(conn.fd, "extract_failed");
             unlink(conn.upload_tmppath.c_str());
+            debuglantern::TraceBuffer::Scope span(trace_, id, "remove bundle");
             remove_directory_recursive(bundle_dir);
             return true;
         }
@@ -645,8 +1145,18 @@ private:
 
         // Validate the exec_path binary exists and is ELF
         std::string full_exec = bundle_dir + "/" + conn.exec_path;
-        if (!validate_elf_file(full_exec)) {
+        bool valid;
+        {
+            debuglantern::TraceBuffer::Scope span(trace_, id, "validate ELF");
+            valid = validate_elf_file(full_exec);
+            if (!valid) {
+                span.set_args(
+                    debuglantern::json_kv("error", std::string("invalid_exec_path"), true));
+            }
+        }
+        if (!valid) {
             send_error(conn.fd, "invalid_exec_path");
+            debuglantern::TraceBuffer::Scope span(trace_, id, "remove bundle");
             remove_directory_recursive(bundle_dir);
             return true;
         }
@@ -654,18 +1164,32 @@ private:
         // Make executable
         chmod(full_exec.c_str(), 0755);
 
-        std::string id = generate_uuid();
         Session s;
         s.id = id;
         s.memfd = -1;
         s.size = conn.upload_size;
         s.state = 0;
+        s.output = OutputBuffer(cfg_.output_buffer);
         s.is_bundle = true;
         s.bundle_dir = bundle_dir;
         s.exec_path = conn.exec_path;
+        int exec_fd = open(full_exec.c_str(), O_RDONLY | O_CLOEXEC);
+        if (exec_fd >= 0) {
+            {
+                debuglantern::TraceBuffer::Scope span(trace_, id, "read build-id");
+                s.build_id = debuglantern::elf_build_id(exec_fd);
+            }
+            {
+                debuglantern::TraceBuffer::Scope span(trace_, id, "queue symbol index");
+                index_symbols(exec_fd, full_exec);
+            }
+            close(exec_fd);
+        }
 
+        s.telemetry_slot = telemetry_.acquire(id);
         sessions_[id] = s;
         total_bytes_ += conn.upload_size;
+        telemetry_.set_binary_bytes(total_bytes_, cfg_.max_total_bytes);
 
         std::ostringstream oss;
         oss << "{" << debuglantern::json_kv("id", id, true) << ","
@@ -740,6 +1264,7 @@ private:
                 conn.upload_tmppath = tmppath;
                 conn.upload_memfd = -1;
                 conn.elf_filled = 0;
+                conn.upload_started = std::chrono::steady_clock::now();
             } else {
                 int memfd = memfd_create_sys("debuglantern", MFD_CLOEXEC);
                 if (memfd < 0) {
@@ -756,6 +1281,7 @@ private:
                 conn.upload_tmpfd = -1;
                 conn.upload_tmppath.clear();
                 conn.elf_filled = 0;
+                conn.upload_started = std::chrono::steady_clock::now();
             }
             return;
         }
@@ -776,11 +1302,16 @@ private:
             std::string id;
             iss >> id;
             size_t offset = 0;
+            size_t length = SIZE_MAX;
             std::string off_str;
+            std::string len_str;
             if (iss >> off_str) {
-                offset = std::stoull(off_str);
+                try { offset = std::stoull(off_str); } catch (...) {}
+            }
+            if (iss >> len_str) {
+                try { length = std::stoull(len_str); } catch (...) {}
             }
-            handle_output(conn.fd, id, offset);
+            handle_output(conn.fd, id, offset, length);
             return;
         }
 
@@ -830,13 +1361,48 @@ private:
             std::string id;
             iss >> id;
             bool debug = false;
+            bool pty = false;
+            long long heap_rate = 0;
+            std::optional<long long> replicas;
             std::string token;
             while (iss >> token) {
-                if (token == "--debug") {
+                if (token == "--replicas" || token.compare(0, 11, "--replicas=") == 0) {
+                    std::string n = token.size() > 10 ? token.substr(11) : "";
+                    if (n.empty()) iss >> n;
+                    try { replicas = std::stoll(n); } catch (...) { replicas = -1; }
+                } else if (token == "--debug") {
                     debug = true;
+                } else if (token == "--pty") {
+                    pty = true;
+                } else if (token == "--heap-profile") {
+                    heap_rate = kDefaultHeapRate;
+                } else if (token.compare(0, 15, "--heap-profile=") == 0) {
+                    try { heap_rate = std::stoll(token.substr(15)); } catch (...) { heap_rate = -1; }
+                    if (heap_rate <= 0) heap_rate = -1;
+                }
+            }
+            if (replicas) {
+                handle_start_replicas(conn.fd, id, *replicas, debug, pty, heap_rate);
+            } else {
+                handle_start(conn.fd, id, debug, pty, heap_rate);
+            }
+            return;
+        }
+
+        if (cmd == "PREPARE") {
+            std::string id;
+            iss >> id;
+            long long count = 1;
+            bool pty = false;
+            std::string token;
+            while (iss >> token) {
+                if (token == "--pty") {
+                    pty = true;
+                } else {
+                    try { count = std::stoll(token); } catch (...) { count = -1; }
                 }
             }
-            handle_start(conn.fd, id, debug);
+            handle_prepare(conn.fd, id, count, pty);
             return;
         }
 
@@ -868,11 +1434,113 @@ private:
             return;
         }
 
+        if (cmd == "ATTACH") {
+            std::string id;
+            iss >> id;
+            std::optional<size_t> offset;
+            std::string off_str;
+            if (iss >> off_str) {
+                try { offset = std::stoull(off_str); } catch (...) {}
+            }
+            handle_attach(conn, id, offset);
+            return;
+        }
+
+        if (cmd == "TAIL") {
+            std::string id;
+            iss >> id;
+            size_t offset = 0;
+            std::string off_str;
+            if (iss >> off_str) {
+                try { offset = std::stoull(off_str); } catch (...) {}
+            }
+            handle_tail(conn, id, offset);
+            return;
+        }
+
+        if (cmd == "OUTPUTRAW") {
+            std::string id;
+            iss >> id;
+            size_t offset = 0;
+            size_t length = SIZE_MAX;
+            std::string off_str;
+            std::string len_str;
+            if (iss >> off_str) {
+                try { offset = std::stoull(off_str); } catch (...) {}
+            }
+            if (iss >> len_str) {
+                try { length = std::stoull(len_str); } catch (...) {}
+            }
+            handle_output_raw(conn, id, offset, length);
+            return;
+        }
+
+        if (cmd == "RESIZE") {
+            std::string id;
+            int cols = 0;
+            int rows = 0;
+            iss >> id >> cols >> rows;
+            handle_resize(conn.fd, id, cols, rows);
+            return;
+        }
+
         if (cmd == "ACTIVITY") {
             send_activity(conn.fd);
             return;
         }
 
+        if (cmd == "STATS") {
+            send_stats(conn.fd);
+            return;
+        }
+
+        if (cmd == "TRACE") {
+            // Spans outlive their sessions, so any id is fine; an unknown
+            // one just has no spans
+            std::string id;
+            iss >> id;
+            send_response(conn.fd, trace_.chrome_json(id) + "\n");
+            return;
+        }
+
+        if (cmd == "COUNTERS") {
+            std::string id;
+            iss >> id;
+            double seconds = 1;
+            std::string dur_str;
+            if (iss >> dur_str) {
+                try { seconds = std::stod(dur_str); } catch (...) { seconds = 0; }
+            }
+            handle_counters(conn.fd, id, seconds);
+            return;
+        }
+
+        if (cmd == "THREADS") {
+            std::string id;
+            iss >> id;
+            double seconds = 1;
+            std::string dur_str;
+            if (iss >> dur_str) {
+                try { seconds = std::stod(dur_str); } catch (...) { seconds = 0; }
+            }
+            handle_threads(conn.fd, id, seconds);
+            return;
+        }
+
+        if (cmd == "METRICS") {
+            std::string id, since;
+            iss >> id >> since;
+            handle_metrics(conn.fd, id, since.empty() ? 0 : std::strtoull(since.c_str(), nullptr, 10));
+            return;
+        }
+
+        if (cmd == "HEAP") {
+            std::string id, view;
+            iss >> id >> view;
+            handle_heap(conn.fd, id, view.empty() ? "live" : view);
+            return;
+        }
+
         send_error(conn.fd, "unknown_command");
     }
 
@@ -890,6 +1558,8 @@ private:
         std::string key = kv.substr(0, eq);
         std::string val = kv.substr(eq + 1);
         it->second.env_vars[key] = val;
+        it->second.exec.clear();
+        reprepare(it->second);
         send_status(fd, id);
     }
 
@@ -899,7 +1569,10 @@ private:
             send_error(fd, "not_found");
             return;
         }
-        it->second.env_vars.erase(key);
+        if (it->second.env_vars.erase(key)) {
+            it->second.exec.clear();
+            reprepare(it->second);
+        }
         send_status(fd, id);
     }
 
@@ -921,28 +1594,6 @@ private:
         send_response(fd, oss.str());
     }
 
-    static std::vector<std::string> build_env(const std::map<std::string, std::string> &overrides) {
-        std::map<std::string, std::string> merged;
-        // Start with current environ
-        for (char **e = environ; *e; ++e) {
-            std::string entry(*e);
-            auto eq = entry.find('=');
-            if (eq != std::string::npos) {
-                merged[entry.substr(0, eq)] = entry.substr(eq + 1);
-            }
-        }
-        // Apply overrides
-        for (const auto &kv : overrides) {
-            merged[kv.first] = kv.second;
-        }
-        std::vector<std::string> result;
-        result.reserve(merged.size());
-        for (const auto &kv : merged) {
-            result.push_back(kv.first + "=" + kv.second);
-        }
-        return result;
-    }
-
     static std::vector<char *> env_ptrs(std::vector<std::string> &env_strs) {
         std::vector<char *> ptrs;
         ptrs.reserve(env_strs.size() + 1);
@@ -959,221 +1610,619 @@ private:
             send_error(fd, "not_found");
             return;
         }
+        std::vector<std::string> words;
+        if (!debuglantern::split_shell_words(args, words)) {
+            send_error(fd, "invalid_args");
+            return;
+        }
         it->second.saved_args = args;
+        it->second.args = std::move(words);
+        it->second.exec.clear();
+        reprepare(it->second);
         send_status(fd, id);
     }
 
-    static std::vector<std::string> split_args(const std::string &s) {
-        std::vector<std::string> result;
-        std::istringstream iss(s);
-        std::string tok;
-        while (iss >> tok) {
-            result.push_back(tok);
+    // Built on the first start after ARGS, ENV or ENVDEL
+    debuglantern::ExecBlock &exec_block(Session &s) {
+        if (!s.exec.built()) {
+            s.exec.build(s.args, s.env_vars);
         }
-        return result;
+        return s.exec;
     }
 
-    void handle_start(int fd, const std::string &id, bool debug) {
+    // `heap_rate` > 0 preloads the heap sampler; -1 is a malformed rate.
+    void handle_start(int fd, const std::string &id, bool debug, bool pty, long long heap_rate) {
         auto it = sessions_.find(id);
         if (it == sessions_.end()) {
             send_error(fd, "not_found");
             return;
         }
-
-        Session &s = it->second;
-        if (s.state == 1 || s.state == 2) {
-            send_error(fd, "already_running");
+        std::string err = start_session(it->second, debug, pty, heap_rate);
+        if (!err.empty()) {
+            send_error(fd, err);
             return;
         }
+        send_status(fd, id);
+    }
 
-        // Clear previous output
-        s.output.clear();
-
-        auto args = split_args(s.saved_args);
-        auto env_strs = build_env(s.env_vars);
-        auto envp = env_ptrs(env_strs);
-
-        if (s.is_bundle) {
-            handle_start_bundle(fd, s, debug, args, envp);
+    // START <id> --replicas N: N more sessions running this one's binary,
+    // named <id>.<index>, each with its own process, pidfd watch and output,
+    // and this session's ARGS and ENV with {{index}} filled in.  Once they
+    // have all stopped, starting again restarts them with the current ARGS
+    // and ENV; 0 deletes them.  Replicas count against --max-sessions.
+    void handle_start_replicas(int fd, const std::string &id, long long count, bool debug,
+                               bool pty, long long heap_rate) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
             return;
         }
-
-        int pipefd[2];
-        if (pipe(pipefd) < 0) {
-            send_error(fd, "fork_failed");
+        Session &s = it->second;
+        if (count < 0 || count > kMaxReplicas || !s.replica_of.empty()) {
+            send_error(fd, "invalid_replicas");
             return;
         }
-
-        if (debug) {
-            int port = alloc_debug_port();
-            pid_t child = fork();
-            if (child == 0) {
-                setpgid(0, 0);
-                close(pipefd[0]);
-                dup2(pipefd[1], STDOUT_FILENO);
-                dup2(pipefd[1], STDERR_FILENO);
-                close(pipefd[1]);
-                prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
-                std::string fdpath = "/proc/self/fd/" + std::to_string(s.memfd);
-                std::string port_arg = ":" + std::to_string(port);
-                std::vector<char *> argv_vec;
-                argv_vec.push_back(const_cast<char *>("gdbserver"));
-                argv_vec.push_back(const_cast<char *>(port_arg.c_str()));
-                argv_vec.push_back(const_cast<char *>(fdpath.c_str()));
-                for (const auto &a : args) {
-                    argv_vec.push_back(const_cast<char *>(a.c_str()));
-                }
-                argv_vec.push_back(nullptr);
-                execvpe("gdbserver", argv_vec.data(), envp.data());
-                _exit(127);
-            }
-            if (child < 0) {
-                close(pipefd[0]);
-                close(pipefd[1]);
-                send_error(fd, "fork_failed");
+        for (const auto &rid : s.replicas) {
+            int state = sessions_.at(rid).state;
+            if (state == 1 || state == 2) {
+                send_error(fd, "already_running");
                 return;
             }
+        }
 
-            setpgid(child, child);
-            close(pipefd[1]);
-            s.pid = child;
-            s.gdb_pid = child;
-            s.debug_port = port;
-            s.state = 2;
-            setup_output_pipe(s, pipefd[0]);
-            add_watch(child, s.id, true);
-            send_status(fd, s.id);
+        // Always <id>.0 to <id>.N-1; one deleted on its own is made again
+        size_t removed = 0;
+        size_t added = 0;
+        for (const auto &rid : s.replicas) {
+            if (sessions_.at(rid).replica_index >= count) ++removed;
+        }
+        for (long long i = 0; i < count; ++i) {
+            if (sessions_.find(id + "." + std::to_string(i)) == sessions_.end()) ++added;
+        }
+        if (sessions_.size() - removed + added > cfg_.max_sessions) {
+            send_error(fd, "max_sessions_reached");
             return;
         }
 
-        pid_t child = fork();
-        if (child == 0) {
-            setpgid(0, 0);
-            close(pipefd[0]);
-            dup2(pipefd[1], STDOUT_FILENO);
-            dup2(pipefd[1], STDERR_FILENO);
-            close(pipefd[1]);
-            prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
-            std::string path = "/proc/self/fd/" + std::to_string(s.memfd);
-            std::vector<char *> argv_vec;
-            argv_vec.push_back(const_cast<char *>(path.c_str()));
-            for (const auto &a : args) {
-                argv_vec.push_back(const_cast<char *>(a.c_str()));
+        debuglantern::TraceBuffer::Scope span(trace_, id, "START --replicas");
+        for (const auto &rid : std::vector<std::string>(s.replicas)) {
+            if (sessions_.at(rid).replica_index >= count) delete_session(sessions_.find(rid));
+        }
+        s.replicas.clear();
+        for (long long i = 0; i < count; ++i) {
+            std::string rid = id + "." + std::to_string(i);
+            if (sessions_.find(rid) == sessions_.end() && !add_replica(s, rid, i)) {
+                send_error(fd, "replica_failed");
+                return;
             }
-            argv_vec.push_back(nullptr);
-            fexecve(s.memfd, argv_vec.data(), envp.data());
-            _exit(127);
+            s.replicas.push_back(rid);
         }
 
-        if (child < 0) {
-            close(pipefd[0]);
-            close(pipefd[1]);
-            send_error(fd, "fork_failed");
+        std::string first_err;
+        size_t failed = 0;
+        for (const auto &rid : s.replicas) {
+            Session &r = sessions_.at(rid);
+            r.saved_args = debuglantern::expand_index(s.saved_args, r.replica_index);
+            debuglantern::split_shell_words(r.saved_args, r.args);
+            r.env_vars.clear();
+            for (const auto &kv : s.env_vars) {
+                r.env_vars[kv.first] = debuglantern::expand_index(kv.second, r.replica_index);
+            }
+            r.exec.clear();
+            std::string err = start_session(r, debug, pty, heap_rate);
+            if (!err.empty()) {
+                if (first_err.empty()) first_err = err;
+                ++failed;
+                add_activity("replica " + rid + " did not start: " + error_message(err));
+            }
+        }
+        if (count > 0 && failed == static_cast<size_t>(count)) {
+            send_error(fd, first_err);
             return;
         }
+        send_status(fd, id);
+    }
 
-        setpgid(child, child);
-        close(pipefd[1]);
-        s.pid = child;
-        s.state = 1;
-        setup_output_pipe(s, pipefd[0]);
-        add_watch(child, s.id, false);
-        send_status(fd, s.id);
+    // Shares the binary: a duplicate of the memfd, or the same extracted
+    // bundle, which stays until the original session is deleted.  False if
+    // the memfd could not be duplicated.
+    bool add_replica(const Session &s, const std::string &rid, long long index) {
+        Session r;
+        r.id = rid;
+        r.replica_index = index;
+        r.replica_of = s.id;
+        if (!s.is_bundle) {
+            r.memfd = fcntl(s.memfd, F_DUPFD_CLOEXEC, 0);
+            if (r.memfd < 0) {
+                return false;
+            }
+        }
+        r.is_bundle = s.is_bundle;
+        r.bundle_dir = s.bundle_dir;
+        r.exec_path = s.exec_path;
+        r.build_id = s.build_id;
+        r.output = OutputBuffer(cfg_.output_buffer);
+        r.telemetry_slot = telemetry_.acquire(r.id);
+        sessions_[r.id] = std::move(r);
+        return true;
     }
 
-    void handle_start_bundle(int fd, Session &s, bool debug,
-                             const std::vector<std::string> &args,
-                             std::vector<char *> &envp) {
+    // Starts `s` and returns "", or the error code when it could not be.
+    std::string start_session(Session &s, bool debug, bool pty, long long heap_rate) {
+        debuglantern::TraceBuffer::Scope span(trace_, s.id, debug ? "START --debug" : "START");
+        if (s.state == 1 || s.state == 2) {
+            return "already_running";
+        }
+        if (heap_rate < 0) {
+            return "invalid_heap_rate";
+        }
+        if (heap_rate > 0 && !debuglantern::kHeapSamplerSupported) {
+            return "heap_profile_unsupported";
+        }
+        if (heap_rate > 0 && debug) {
+            // gdbserver would load the sampler, not the program
+            return "heap_profile_debug";
+        }
+        HeapChannel heap;
+        if (heap_rate > 0 && !open_heap_channel(heap_rate, heap)) {
+            return "heap_profile_failed";
+        }
+
+        // Clear previous output; offsets restart, so old readers must stop
+        end_streams(s.id);
+        s.output.clear();
+        ++s.run;
+        s.loader_us = -1;
+        s.init_us = -1;
+
+        if (!debug && heap_rate == 0 && pty == s.prepare_pty && start_prepared(s)) {
+            return "";
+        }
+
+        debuglantern::ExecBlock &exec = exec_block(s);
+        char *const *envp = exec.envp();
+        // The sampler's preload goes on a copy, not into the cached block
+        std::vector<std::string> heap_env;
+        std::vector<char *> heap_envp;
+        if (heap.read_fd >= 0) {
+            heap_env = exec.env();
+            add_heap_env(heap_env, heap);
+            heap_envp = env_ptrs(heap_env);
+            envp = heap_envp.data();
+        }
+
+        if (s.is_bundle) {
+            return start_bundle(s, debug, pty, heap, exec, envp);
+        }
+
+        OutputChannel chan;
+        auto chan_began = std::chrono::steady_clock::now();
+        bool chan_ok = open_output_channel(pty, chan);
+        trace_.add(s.id, pty ? "open PTY" : "open output pipe", chan_began,
+                   std::chrono::steady_clock::now());
+        if (!chan_ok) {
+            close_heap_channel(heap);
+            return pty ? "pty_failed" : "fork_failed";
+        }
+
+        if (debug) {
+            int port = alloc_debug_port();
+            std::string fdpath = "/proc/self/fd/" + std::to_string(s.memfd);
+            std::string port_arg = ":" + std::to_string(port);
+            debuglantern::SpawnOptions opts;
+            opts.path = "gdbserver";
+            opts.search_path = true;
+            opts.argv = exec.argv({"gdbserver", port_arg.c_str(), fdpath.c_str()});
+            opts.envp = envp;
+            spawn_output(chan, opts);
+            // gdbserver opens the binary by its /proc path after exec
+            opts.keep_fds.push_back(s.memfd);
+
+            auto spawn_began = std::chrono::steady_clock::now();
+            debuglantern::Spawned child = debuglantern::spawn_process(opts);
+            if (child.pid < 0) {
+                close_output_channel(chan);
+                return "fork_failed";
+            }
+
+            close(chan.write_fd);
+            s.pid = child.pid;
+            s.gdb_pid = child.pid;
+            trace_spawn(s, "spawn gdbserver", spawn_began, child);
+            s.gdb_started = s.run_started;
+            s.metrics = std::make_shared<debuglantern::ResourceHistory>(child.pid);
+            s.debug_port = port;
+            s.state = 2;
+            setup_output_pipe(s, chan);
+            add_watch(child, s.id, true);
+            return "";
+        }
+
+        std::string path = "/proc/self/fd/" + std::to_string(s.memfd);
+        debuglantern::SpawnOptions opts;
+        opts.exec_fd = s.memfd;
+        opts.argv = exec.argv({path.c_str()});
+        opts.envp = envp;
+        spawn_output(chan, opts);
+        spawn_heap(heap, opts);
+
+        auto spawn_began = std::chrono::steady_clock::now();
+        debuglantern::Spawned child = debuglantern::spawn_process(opts);
+        if (child.pid < 0) {
+            close_output_channel(chan);
+            close_heap_channel(heap);
+            return "fork_failed";
+        }
+
+        close(chan.write_fd);
+        s.pid = child.pid;
+        s.state = 1;
+        trace_spawn(s, "spawn", spawn_began, child);
+        s.metrics = std::make_shared<debuglantern::ResourceHistory>(child.pid);
+        setup_output_pipe(s, chan);
+        setup_heap_pipe(s, heap);
+        add_watch(child, s.id, false);
+        return "";
+    }
+
+    std::string start_bundle(Session &s, bool debug, bool pty, HeapChannel &heap,
+                             debuglantern::ExecBlock &exec, char *const *envp) {
         std::string full_exec = s.bundle_dir + "/" + s.exec_path;
 
-        int pipefd[2];
-        if (pipe(pipefd) < 0) {
-            send_error(fd, "fork_failed");
-            return;
+        OutputChannel chan;
+        auto chan_began = std::chrono::steady_clock::now();
+        bool chan_ok = open_output_channel(pty, chan);
+        trace_.add(s.id, pty ? "open PTY" : "open output pipe", chan_began,
+                   std::chrono::steady_clock::now());
+        if (!chan_ok) {
+            close_heap_channel(heap);
+            return pty ? "pty_failed" : "fork_failed";
         }
 
         if (debug) {
             int port = alloc_debug_port();
-            pid_t child = fork();
-            if (child == 0) {
-                setpgid(0, 0);
-                close(pipefd[0]);
-                dup2(pipefd[1], STDOUT_FILENO);
-                dup2(pipefd[1], STDERR_FILENO);
-                close(pipefd[1]);
-                prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
-                if (chdir(s.bundle_dir.c_str()) != 0) {
-                    _exit(127);
-                }
-                std::string port_arg = ":" + std::to_string(port);
-                std::vector<char *> argv_vec;
-                argv_vec.push_back(const_cast<char *>("gdbserver"));
-                argv_vec.push_back(const_cast<char *>(port_arg.c_str()));
-                argv_vec.push_back(const_cast<char *>(full_exec.c_str()));
-                for (const auto &a : args) {
-                    argv_vec.push_back(const_cast<char *>(a.c_str()));
-                }
-                argv_vec.push_back(nullptr);
-                execvpe("gdbserver", argv_vec.data(), envp.data());
-                _exit(127);
-            }
-            if (child < 0) {
-                close(pipefd[0]);
-                close(pipefd[1]);
-                send_error(fd, "fork_failed");
-                return;
+            std::string port_arg = ":" + std::to_string(port);
+            debuglantern::SpawnOptions opts;
+            opts.path = "gdbserver";
+            opts.search_path = true;
+            opts.argv = exec.argv({"gdbserver", port_arg.c_str(), full_exec.c_str()});
+            opts.envp = envp;
+            opts.cwd = s.bundle_dir.c_str();
+            spawn_output(chan, opts);
+
+            auto spawn_began = std::chrono::steady_clock::now();
+            debuglantern::Spawned child = debuglantern::spawn_process(opts);
+            if (child.pid < 0) {
+                close_output_channel(chan);
+                return "fork_failed";
             }
 
-            setpgid(child, child);
-            close(pipefd[1]);
-            s.pid = child;
-            s.gdb_pid = child;
+            close(chan.write_fd);
+            s.pid = child.pid;
+            s.gdb_pid = child.pid;
+            trace_spawn(s, "spawn gdbserver", spawn_began, child);
+            s.gdb_started = s.run_started;
+            s.metrics = std::make_shared<debuglantern::ResourceHistory>(child.pid);
             s.debug_port = port;
             s.state = 2;
-            setup_output_pipe(s, pipefd[0]);
+            setup_output_pipe(s, chan);
             add_watch(child, s.id, true);
-            send_status(fd, s.id);
+            return "";
+        }
+
+        debuglantern::SpawnOptions opts;
+        opts.path = full_exec.c_str();
+        opts.argv = exec.argv({full_exec.c_str()});
+        opts.envp = envp;
+        opts.cwd = s.bundle_dir.c_str();
+        spawn_output(chan, opts);
+        spawn_heap(heap, opts);
+
+        auto spawn_began = std::chrono::steady_clock::now();
+        debuglantern::Spawned child = debuglantern::spawn_process(opts);
+        if (child.pid < 0) {
+            close_output_channel(chan);
+            close_heap_channel(heap);
+            return "fork_failed";
+        }
+
+        close(chan.write_fd);
+        s.pid = child.pid;
+        s.state = 1;
+        trace_spawn(s, "spawn", spawn_began, child);
+        s.metrics = std::make_shared<debuglantern::ResourceHistory>(child.pid);
+        setup_output_pipe(s, chan);
+        setup_heap_pipe(s, heap);
+        add_watch(child, s.id, false);
+        return "";
+    }
+
+    // PREPARE <id> [count] [--pty]: keep `count` instances parked before main,
+    // so START only has to release one.  0 discards them.
+    void handle_prepare(int fd, const std::string &id, long long count, bool pty) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
+            return;
+        }
+        if (count < 0 || count > static_cast<long long>(kMaxPrepared)) {
+            send_error(fd, "invalid_prepare_count");
             return;
         }
 
-        pid_t child = fork();
-        if (child == 0) {
-            setpgid(0, 0);
-            close(pipefd[0]);
-            dup2(pipefd[1], STDOUT_FILENO);
-            dup2(pipefd[1], STDERR_FILENO);
-            close(pipefd[1]);
-            prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
-            if (chdir(s.bundle_dir.c_str()) != 0) {
-                _exit(127);
-            }
-            std::vector<char *> argv_vec;
-            argv_vec.push_back(const_cast<char *>(full_exec.c_str()));
-            for (const auto &a : args) {
-                argv_vec.push_back(const_cast<char *>(a.c_str()));
+        Session &s = it->second;
+        debuglantern::TraceBuffer::Scope span(trace_, id, "PREPARE");
+        if (count > 0 && !prepare_supported(s)) {
+            send_error(fd, "prepare_static");
+            return;
+        }
+        if (pty != s.prepare_pty) {
+            discard_prepared(s, 0);
+        }
+        s.prepare_pty = pty;
+        s.prepare_target = static_cast<size_t>(count);
+        discard_prepared(s, s.prepare_target);
+        if (!fill_prepared(s)) {
+            send_error(fd, "prepare_failed");
+            return;
+        }
+        send_status(fd, id);
+    }
+
+    // The gate comes in through the dynamic loader, so a static binary
+    // would run straight to main.
+    bool prepare_supported(const Session &s) {
+        if (!s.is_bundle) {
+            return debuglantern::elf_is_dynamic(s.memfd);
+        }
+        std::string full_exec = s.bundle_dir + "/" + s.exec_path;
+        int efd = open(full_exec.c_str(), O_RDONLY | O_CLOEXEC);
+        if (efd < 0) {
+            return false;
+        }
+        bool dynamic = debuglantern::elf_is_dynamic(efd);
+        close(efd);
+        return dynamic;
+    }
+
+    bool fill_prepared(Session &s) {
+        while (s.prepared.size() < s.prepare_target) {
+            if (!spawn_prepared(s)) {
+                return false;
             }
-            argv_vec.push_back(nullptr);
-            execve(full_exec.c_str(), argv_vec.data(), envp.data());
-            _exit(127);
         }
+        return true;
+    }
 
-        if (child < 0) {
-            close(pipefd[0]);
-            close(pipefd[1]);
-            send_error(fd, "fork_failed");
+    // ARGS and ENV change what an instance would have been started with
+    void reprepare(Session &s) {
+        if (s.prepare_target == 0) {
             return;
         }
+        discard_prepared(s, 0);
+        fill_prepared(s);
+    }
 
-        setpgid(child, child);
-        close(pipefd[1]);
-        s.pid = child;
-        s.state = 1;
-        setup_output_pipe(s, pipefd[0]);
-        add_watch(child, s.id, false);
-        send_status(fd, s.id);
+    // Drops instances from the back until `keep` are left
+    void discard_prepared(Session &s, size_t keep) {
+        while (s.prepared.size() > keep) {
+            drop_prepared(s, s.prepared.size() - 1);
+        }
+    }
+
+    void drop_prepared(Session &s, size_t i) {
+        PreparedProcess &p = s.prepared[i];
+        // Parked in read(), so SIGKILL takes it at once
+        kill(p.pid, SIGKILL);
+        waitpid(p.pid, nullptr, 0);
+        if (p.ready_fd >= 0) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p.ready_fd, nullptr);
+            prepared_pipes_.erase(p.ready_fd);
+            close(p.ready_fd);
+        }
+        if (p.release_fd >= 0) close(p.release_fd);
+        if (p.pidfd >= 0) close(p.pidfd);
+        close_output_channel(p.chan);
+        s.prepared.erase(s.prepared.begin() + static_cast<std::ptrdiff_t>(i));
     }
 
-    void setup_output_pipe(Session &s, int read_fd) {
+    // One instance with the session's current ARGS and ENV, the gate
+    // preloaded, and its output going where START's would.
+    bool spawn_prepared(Session &s) {
+        int lib_fd = debuglantern::start_gate_memfd();
+        if (lib_fd < 0) {
+            return false;
+        }
+        int ready[2];
+        int gate[2];
+        if (pipe2(ready, O_CLOEXEC) < 0) {
+            return false;
+        }
+        if (pipe2(gate, O_CLOEXEC) < 0) {
+            close(ready[0]);
+            close(ready[1]);
+            return false;
+        }
+        OutputChannel chan;
+        if (!open_output_channel(s.prepare_pty, chan)) {
+            close(ready[0]);
+            close(ready[1]);
+            close(gate[0]);
+            close(gate[1]);
+            return false;
+        }
+
+        debuglantern::ExecBlock &exec = exec_block(s);
+        auto env_strs = exec.env();
+        debuglantern::add_gate_env(env_strs, lib_fd, ready[1], gate[0]);
+        auto envp = env_ptrs(env_strs);
+        std::string full_exec = s.is_bundle ? s.bundle_dir + "/" + s.exec_path
+                                            : "/proc/self/fd/" + std::to_string(s.memfd);
+        debuglantern::SpawnOptions opts;
+        if (s.is_bundle) {
+            opts.path = full_exec.c_str();
+            opts.cwd = s.bundle_dir.c_str();
+        } else {
+            opts.exec_fd = s.memfd;
+        }
+        opts.argv = exec.argv({full_exec.c_str()});
+        opts.envp = envp.data();
+        spawn_output(chan, opts);
+        opts.keep_fds = {lib_fd, ready[1], gate[0]};
+
+        auto spawn_began = std::chrono::steady_clock::now();
+        debuglantern::Spawned child = debuglantern::spawn_process(opts);
+        auto spawned = std::chrono::steady_clock::now();
+        close(chan.write_fd);
+        chan.write_fd = -1;
+        close(ready[1]);
+        close(gate[0]);
+        if (child.pid > 0 && child.exec_errno) {
+            waitpid(child.pid, nullptr, 0);
+            if (child.pidfd >= 0) close(child.pidfd);
+            child.pid = -1;
+        }
+        if (child.pid < 0) {
+            close_output_channel(chan);
+            close(ready[0]);
+            close(gate[1]);
+            return false;
+        }
+        trace_.add(s.id, "spawn prepared", spawn_began, spawned,
+                   debuglantern::json_kv("pid", static_cast<long long>(child.pid)));
+
+        PreparedProcess p;
+        p.pid = child.pid;
+        p.pidfd = child.pidfd >= 0 ? child.pidfd : pidfd_open_sys(child.pid);
+        p.chan = chan;
+        p.ready_fd = ready[0];
+        p.release_fd = gate[1];
+        // The child may be through the loader before spawn_process() returns
+        p.spawned = spawn_began;
+        debuglantern::set_nonblocking(p.ready_fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = p.ready_fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, p.ready_fd, &ev) == 0) {
+            prepared_pipes_[p.ready_fd] = s.id;
+        }
+        s.prepared.push_back(p);
+        return true;
+    }
+
+    // The gate reports once it is parked.  EOF means the instance died
+    // loading, in a constructor or while parked; it is replaced only when a
+    // run ends, so a binary that cannot load does not respawn in a loop.
+    void handle_gate_report(int readyfd, std::string id) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, readyfd, nullptr);
+            prepared_pipes_.erase(readyfd);
+            close(readyfd);
+            return;
+        }
+        Session &s = it->second;
+        auto p = std::find_if(s.prepared.begin(), s.prepared.end(),
+                              [readyfd](const PreparedProcess &q) { return q.ready_fd == readyfd; });
+        if (p == s.prepared.end()) {
+            return;
+        }
+
+        debuglantern::GateReport r{};
+        ssize_t n = read(readyfd, &r, sizeof(r));
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        }
+        if (n == static_cast<ssize_t>(sizeof(r)) && !p->ready) {
+            using namespace std::chrono;
+            steady_clock::time_point start(
+                duration_cast<steady_clock::duration>(nanoseconds(r.start_ns)));
+            steady_clock::time_point parked(
+                duration_cast<steady_clock::duration>(nanoseconds(r.main_ns)));
+            p->ready = true;
+            p->loader_us = duration_cast<microseconds>(start - p->spawned).count();
+            p->init_us = duration_cast<microseconds>(parked - start).count();
+            std::string pid = debuglantern::json_kv("pid", static_cast<long long>(p->pid));
+            trace_.add(s.id, "exec and load", p->spawned, start, pid);
+            trace_.add(s.id, "init", start, parked, pid);
+            return;
+        }
+        add_activity("prepared instance of " + s.id + " exited before START");
+        drop_prepared(s, static_cast<size_t>(p - s.prepared.begin()));
+    }
+
+    // START from a parked instance.  False when none is left alive, and the
+    // caller spawns as usual.
+    bool start_prepared(Session &s) {
+        while (!s.prepared.empty()) {
+            PreparedProcess p = s.prepared.front();
+            s.prepared.erase(s.prepared.begin());
+            // From here on its pidfd watch sees it exit
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p.ready_fd, nullptr);
+            prepared_pipes_.erase(p.ready_fd);
+            close(p.ready_fd);
+
+            auto began = std::chrono::steady_clock::now();
+            char go = 1;
+            if (waitpid(p.pid, nullptr, WNOHANG) != 0 || write(p.release_fd, &go, 1) != 1) {
+                kill(p.pid, SIGKILL);
+                waitpid(p.pid, nullptr, 0);
+                close(p.release_fd);
+                if (p.pidfd >= 0) close(p.pidfd);
+                close_output_channel(p.chan);
+                continue;
+            }
+            close(p.release_fd);
+
+            s.pid = p.pid;
+            s.state = 1;
+            s.loader_us = p.loader_us;
+            s.init_us = p.init_us;
+            s.run_started = std::chrono::steady_clock::now();
+            s.awaiting_output = true;
+            trace_.add(s.id, "release", began, s.run_started,
+                       debuglantern::json_kv("pid", static_cast<long long>(p.pid)));
+            s.metrics = std::make_shared<debuglantern::ResourceHistory>(p.pid);
+            setup_output_pipe(s, p.chan);
+            add_watch(debuglantern::Spawned{p.pid, p.pidfd, 0}, s.id, false);
+            return true;
+        }
+        return false;
+    }
+
+    // Called once the child has been spawned (and has exec'd, or failed
+    // to): the span of the spawn itself, and the start of the run that the
+    // exit and first-output spans measure from.
+    void trace_spawn(Session &s, const char *what, std::chrono::steady_clock::time_point began,
+                     const debuglantern::Spawned &child) {
+        s.run_started = std::chrono::steady_clock::now();
+        s.awaiting_output = true;
+        std::string args = debuglantern::json_kv("pid", static_cast<long long>(child.pid));
+        if (child.exec_errno) {
+            args += "," + debuglantern::json_kv("exec_error", strerror(child.exec_errno), true);
+        }
+        trace_.add(s.id, what, began, s.run_started, args);
+    }
+
+    // The "run" and/or "gdbserver" span of a process that just ended, with
+    // its wait status when we were the ones to reap it.
+    void trace_exit(Session &s, bool gdb, bool run, bool reaped, int status) {
+        std::string args;
+        if (reaped) {
+            args = WIFSIGNALED(status)
+                       ? debuglantern::json_kv("signal", static_cast<long long>(WTERMSIG(status)))
+                       : debuglantern::json_kv("exit_code",
+                                               static_cast<long long>(WEXITSTATUS(status)));
+        }
+        auto ended = std::chrono::steady_clock::now();
+        if (gdb) trace_.add(s.id, "gdbserver", s.gdb_started, ended, args);
+        if (run) trace_.add(s.id, "run", s.run_started, ended, args);
+    }
+
+    void setup_output_pipe(Session &s, const OutputChannel &chan) {
+        int read_fd = chan.read_fd;
+        s.pty = chan.pty;
+        s.pty_input.clear();
         debuglantern::set_nonblocking(read_fd);
         epoll_event ev{};
         ev.events = EPOLLIN;
@@ -1186,6 +2235,147 @@ private:
         output_pipes_[read_fd] = OutputPipeInfo{s.id};
     }
 
+    // Replaces the previous run's profile, so HEAP always shows this run.
+    void setup_heap_pipe(Session &s, HeapChannel &heap) {
+        close_heap_pipe(s);
+        s.heap.reset();
+        if (heap.read_fd < 0) {
+            return;
+        }
+        close(heap.write_fd);
+        heap.write_fd = -1;
+        debuglantern::set_nonblocking(heap.read_fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = heap.read_fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, heap.read_fd, &ev) < 0) {
+            close_heap_channel(heap);
+            return;
+        }
+        s.heap = std::make_shared<debuglantern::HeapProfile>(s.pid, heap.rate);
+        s.heap_pipe_fd = heap.read_fd;
+        heap_pipes_[heap.read_fd] = s.id;
+    }
+
+    void close_heap_pipe(Session &s) {
+        if (s.heap_pipe_fd >= 0) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.heap_pipe_fd, nullptr);
+            close(s.heap_pipe_fd);
+            heap_pipes_.erase(s.heap_pipe_fd);
+            s.heap_pipe_fd = -1;
+        }
+        if (s.heap) {
+            s.heap->finish();
+        }
+    }
+
+    // Drains what the sampler wrote.  Forked children keep the pipe open
+    // (their sampler is silent), so the session's exit also ends it.
+    void handle_heap_pipe(int pipefd, const std::string &session_id) {
+        auto it = sessions_.find(session_id);
+        char buf[65536];
+        for (int i = 0; i < 16; ++i) {
+            ssize_t n = read(pipefd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                return;
+            }
+            if (n <= 0) {
+                if (it != sessions_.end() && it->second.heap_pipe_fd == pipefd) {
+                    close_heap_pipe(it->second);
+                } else {
+                    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pipefd, nullptr);
+                    close(pipefd);
+                    heap_pipes_.erase(pipefd);
+                }
+                return;
+            }
+            if (it != sessions_.end() && it->second.heap) {
+                it->second.heap->feed(buf, static_cast<size_t>(n));
+            }
+        }
+    }
+
+    // One reading per running session; the files stay open between ticks.
+    void sample_metrics() {
+        uint64_t expirations = 0;
+        if (read(metrics_timer_, &expirations, sizeof(expirations)) < 0) {
+            return;
+        }
+        for (auto &kv : sessions_) {
+            Session &s = kv.second;
+            if ((s.state == 1 || s.state == 2) && s.metrics && s.metrics->sample()) {
+                const debuglantern::ResourceSample &r = s.metrics->latest();
+                telemetry_.add_resources(s.telemetry_slot, r.cpu_ms, r.rss_kb);
+            } else {
+                telemetry_.add_resources(s.telemetry_slot, 0, 0);
+            }
+        }
+    }
+
+    // States change in many places; each batch of events ends by copying
+    // them for GET /metrics (a relaxed store per session).
+    void publish_states() {
+        for (const auto &kv : sessions_) {
+            telemetry_.set_state(kv.second.telemetry_slot, kv.second.state);
+        }
+    }
+
+    void handle_metrics(int fd, const std::string &id, uint64_t since) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
+            return;
+        }
+        const Session &s = it->second;
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", id, true) << ","
+            << debuglantern::json_kv("interval_ms", static_cast<long long>(cfg_.metrics_interval_ms))
+            << ",";
+        if (s.metrics) {
+            oss << s.metrics->json(since);
+        } else {
+            oss << R"("first":0,"next":0,"fields":[],"samples":[])";
+        }
+        oss << "}\n";
+        send_response(fd, oss.str());
+    }
+
+    void handle_heap(int fd, const std::string &id, const std::string &view) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
+            return;
+        }
+        Session &s = it->second;
+        if (!s.heap) {
+            send_error(fd, "no_heap_profile");
+            return;
+        }
+        if (view != "live" && view != "alloc") {
+            send_error(fd, "invalid_heap_view");
+            return;
+        }
+        debuglantern::FlameGraph graph;
+        s.heap->build(view == "live", graph);
+        if (graph.nodes().size() > kMaxHeapNodes) {
+            debuglantern::FlameGraph trimmed;
+            trimmed.set_unit(graph.unit());
+            trimmed.merge(graph, debuglantern::trim_threshold(graph, kMaxHeapNodes));
+            graph = std::move(trimmed);
+        }
+        // "folded" goes last; the web UI splices the fields before it into
+        // its own replies
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", id, true) << ","
+            << debuglantern::json_kv("view", view, true) << "," << s.heap->stats_json() << ","
+            << debuglantern::json_kv("folded", debuglantern::flamegraph_folded(graph), true)
+            << "}\n";
+        send_response(fd, oss.str());
+    }
+
     void close_output_pipe(Session &s) {
         if (s.output_pipe_fd >= 0) {
             epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.output_pipe_fd, nullptr);
@@ -1193,34 +2383,438 @@ private:
             output_pipes_.erase(s.output_pipe_fd);
             s.output_pipe_fd = -1;
         }
+        end_attachments(s);
     }
 
-    void handle_output_pipe(int pipefd, const OutputPipeInfo &info) {
-        char buf[4096];
+    void handle_output_pipe(int pipefd, uint32_t events, const OutputPipeInfo &info) {
+        std::string session_id = info.session_id;
+        auto it = sessions_.find(session_id);
+
+        if ((events & EPOLLOUT) && it != sessions_.end()) {
+            flush_pty_input(it->second);
+        }
+        if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            return;
+        }
+
+        char buf[65536];
         ssize_t n = read(pipefd, buf, sizeof(buf));
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        }
         if (n <= 0) {
-            // Pipe closed
+            // Pipe closed (a PTY master reads EIO once the last slave closes)
             epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pipefd, nullptr);
             close(pipefd);
-            auto it = sessions_.find(info.session_id);
+            output_pipes_.erase(pipefd);
             if (it != sessions_.end() && it->second.output_pipe_fd == pipefd) {
                 it->second.output_pipe_fd = -1;
+                end_attachments(it->second);
             }
-            output_pipes_.erase(pipefd);
             return;
         }
 
-        auto it = sessions_.find(info.session_id);
+        telemetry_.add_output(it != sessions_.end() ? it->second.telemetry_slot : -1,
+                              static_cast<size_t>(n));
         if (it != sessions_.end()) {
-            it->second.output.append(buf, static_cast<size_t>(n));
-            if (it->second.output.size() > kMaxOutputBuffer) {
-                it->second.output.erase(0,
-                    it->second.output.size() - kMaxOutputBuffer);
+            Session &s = it->second;
+            if (s.awaiting_output) {
+                s.awaiting_output = false;
+                trace_.add(s.id, "first output", s.run_started, std::chrono::steady_clock::now(),
+                           debuglantern::json_kv("bytes", static_cast<long long>(n)));
+            }
+            s.output.append(buf, static_cast<size_t>(n));
+            std::vector<int> fds = s.attached_fds;
+            for (int afd : fds) {
+                auto cit = clients_.find(afd);
+                if (cit != clients_.end() && !cit->second.write_blocked) {
+                    flush_client(cit->second);
+                }
+            }
+        }
+    }
+
+    // ---- ATTACH streaming -------------------------------------------------
+
+    void handle_attach(ClientConn &conn, const std::string &id, std::optional<size_t> offset) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(conn.fd, "not_found");
+            return;
+        }
+        Session &s = it->second;
+        if (s.output_pipe_fd < 0) {
+            send_error(conn.fd, "not_running");
+            return;
+        }
+
+        // Replay buffered output from `offset` (all of it by default) so a
+        // terminal opened mid-run still shows the current screen state.
+        size_t from = std::min(std::max(offset.value_or(0), s.output.start()), s.output.end());
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", s.id, true) << ","
+            << debuglantern::json_kv("attached", true) << ","
+            << debuglantern::json_kv("pty", s.pty) << ","
+            << debuglantern::json_kv("offset", static_cast<long long>(from)) << "}\n";
+        conn.outbuf = oss.str();
+        conn.attached = true;
+        start_stream(conn, s, from, SIZE_MAX);
+    }
+
+    // Read-only ATTACH: streams output from `offset` and follows it while
+    // the process runs.  For a process that is not running, the retained
+    // output is sent and the stream ends.
+    void handle_tail(ClientConn &conn, const std::string &id, size_t offset) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(conn.fd, "not_found");
+            return;
+        }
+        Session &s = it->second;
+        size_t from = std::min(std::max(offset, s.output.start()), s.output.end());
+        bool follow = s.output_pipe_fd >= 0;
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", s.id, true) << ","
+            << debuglantern::json_kv("offset", static_cast<long long>(from)) << ","
+            << debuglantern::json_kv("follow", follow) << "}\n";
+        conn.outbuf = oss.str();
+        start_stream(conn, s, from, follow ? SIZE_MAX : s.output.end());
+    }
+
+    // Raw byte range of the retained output: a JSON header line giving the
+    // effective range, then exactly `length` bytes, then the write side is
+    // shut down.
+    void handle_output_raw(ClientConn &conn, const std::string &id, size_t offset,
+                           size_t length) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(conn.fd, "not_found");
+            return;
+        }
+        Session &s = it->second;
+        size_t end = s.output.end();
+        size_t to = std::min(end, length > SIZE_MAX - offset ? SIZE_MAX : offset + length);
+        size_t from = std::min(std::max(offset, s.output.start()), end);
+        to = std::max(to, from);
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", s.id, true) << ","
+            << debuglantern::json_kv("offset", static_cast<long long>(from)) << ","
+            << debuglantern::json_kv("length", static_cast<long long>(to - from)) << ","
+            << debuglantern::json_kv("start", static_cast<long long>(s.output.start())) << ","
+            << debuglantern::json_kv("total", static_cast<long long>(s.output.end())) << "}\n";
+        conn.outbuf = oss.str();
+        start_stream(conn, s, from, to);
+    }
+
+    void start_stream(ClientConn &conn, Session &s, size_t from, size_t to) {
+        conn.streaming = true;
+        conn.attach_id = s.id;
+        conn.stream_pos = from;
+        conn.stream_end = to;
+        if (to == SIZE_MAX) {
+            s.attached_fds.push_back(conn.fd);
+        }
+        flush_client(conn);
+    }
+
+    // Writes queued bytes, then stream data straight from the session's
+    // ring buffer, until the socket would block or the stream is done.
+    void flush_client(ClientConn &conn) {
+        conn.write_blocked = false;
+        while (true) {
+            const char *data = conn.outbuf.data();
+            size_t len = conn.outbuf.size();
+            bool from_ring = false;
+            if (len == 0) {
+                if (!conn.streaming) {
+                    break;
+                }
+                auto it = sessions_.find(conn.attach_id);
+                if (it == sessions_.end()) {
+                    finish_stream(conn);
+                    break;
+                }
+                const OutputBuffer &out = it->second.output;
+                if (conn.stream_pos < out.start()) {
+                    // The reader fell more than a whole buffer behind.  A
+                    // follower is told and skips ahead; a range read cannot
+                    // be completed and is cut short.
+                    if (conn.stream_end != SIZE_MAX) {
+                        finish_stream(conn);
+                        break;
+                    }
+                    conn.outbuf = "\r\n[debuglantern: " +
+                                  std::to_string(out.start() - conn.stream_pos) +
+                                  " bytes dropped, client too slow]\r\n";
+                    conn.stream_pos = out.start();
+                    continue;
+                }
+                data = out.peek(conn.stream_pos, len);
+                len = std::min(len, conn.stream_end - conn.stream_pos);
+                if (len == 0) {
+                    if (conn.stream_end != SIZE_MAX) {
+                        finish_stream(conn);
+                    }
+                    break;
+                }
+                from_ring = true;
+            }
+            ssize_t n = write(conn.fd, data, len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                conn.write_blocked = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                if (!conn.write_blocked) {
+                    finish_stream(conn);
+                }
+                break;
+            }
+            if (from_ring) {
+                conn.stream_pos += static_cast<size_t>(n);
+            } else {
+                conn.outbuf.erase(0, static_cast<size_t>(n));
+            }
+        }
+        update_client_events(conn);
+    }
+
+    // Ends a client's output stream.  Only the write side is shut down; the
+    // connection is closed once the peer hangs up.
+    void finish_stream(ClientConn &conn) {
+        if (!conn.streaming) {
+            return;
+        }
+        auto it = sessions_.find(conn.attach_id);
+        if (it != sessions_.end()) {
+            auto &fds = it->second.attached_fds;
+            fds.erase(std::remove(fds.begin(), fds.end(), conn.fd), fds.end());
+        }
+        conn.streaming = false;
+        conn.attached = false;
+        conn.stream_done = true;
+        conn.outbuf.clear();
+        conn.write_blocked = false;
+        ::shutdown(conn.fd, SHUT_WR);
+    }
+
+    // Stops every stream reading a session's output (its buffer is about
+    // to be reset).
+    void end_streams(const std::string &id) {
+        for (auto &kv : clients_) {
+            ClientConn &conn = kv.second;
+            if (conn.streaming && conn.attach_id == id) {
+                finish_stream(conn);
+                update_client_events(conn);
+            }
+        }
+    }
+
+    void update_client_events(ClientConn &conn) {
+        uint32_t events = EPOLLRDHUP;
+        if (!conn.reading_paused) events |= EPOLLIN;
+        if (conn.write_blocked) events |= EPOLLOUT;
+        if (events == conn.epoll_events) {
+            return;
+        }
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = conn.fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.epoll_events = events;
+    }
+
+    // Forwards attached-client bytes to the session PTY.  Input for a
+    // non-PTY session has nowhere to go and is discarded.
+    void consume_attach_input(ClientConn &conn) {
+        auto it = sessions_.find(conn.attach_id);
+        if (it == sessions_.end() || !it->second.pty || it->second.output_pipe_fd < 0) {
+            conn.inbuf.clear();
+            return;
+        }
+        Session &s = it->second;
+        size_t room = kMaxPtyInputBacklog > s.pty_input.size()
+                          ? kMaxPtyInputBacklog - s.pty_input.size() : 0;
+        size_t take = std::min(room, conn.inbuf.size());
+        s.pty_input.append(conn.inbuf, 0, take);
+        conn.inbuf.erase(0, take);
+        flush_pty_input(s);
+    }
+
+    void flush_pty_input(Session &s) {
+        while (!s.pty_input.empty() && s.output_pipe_fd >= 0) {
+            ssize_t n = write(s.output_pipe_fd, s.pty_input.data(), s.pty_input.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            s.pty_input.erase(0, static_cast<size_t>(n));
+        }
+
+        // Wait for the PTY to drain before taking more keystrokes; paused
+        // clients stop being read so the kernel socket buffer pushes back.
+        bool backlog = !s.pty_input.empty();
+        if (s.output_pipe_fd >= 0) {
+            epoll_event ev{};
+            ev.events = backlog ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.fd = s.output_pipe_fd;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, s.output_pipe_fd, &ev);
+        }
+        bool pause = s.pty_input.size() >= kMaxPtyInputBacklog;
+        for (int afd : s.attached_fds) {
+            auto cit = clients_.find(afd);
+            if (cit == clients_.end() || cit->second.reading_paused == pause) {
+                continue;
             }
+            cit->second.reading_paused = pause;
+            update_client_events(cit->second);
+            if (!pause && !cit->second.inbuf.empty()) {
+                consume_attach_input(cit->second);
+            }
+        }
+    }
+
+    // The session's output has ended: followers drain what they have not
+    // yet been sent, then their streams end.
+    void end_attachments(Session &s) {
+        std::vector<int> fds;
+        fds.swap(s.attached_fds);
+        for (int afd : fds) {
+            auto cit = clients_.find(afd);
+            if (cit == clients_.end()) {
+                continue;
+            }
+            ClientConn &conn = cit->second;
+            conn.attached = false;
+            conn.stream_end = s.output.end();
+            flush_client(conn);
+        }
+    }
+
+    void handle_resize(int fd, const std::string &id, int cols, int rows) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
+            return;
+        }
+        Session &s = it->second;
+        if (!s.pty || s.output_pipe_fd < 0) {
+            send_error(fd, "not_pty");
+            return;
+        }
+        if (cols <= 0 || rows <= 0 || cols > 1000 || rows > 1000) {
+            send_error(fd, "invalid_size");
+            return;
         }
+        struct winsize ws{};
+        ws.ws_row = static_cast<unsigned short>(rows);
+        ws.ws_col = static_cast<unsigned short>(cols);
+        ioctl(s.output_pipe_fd, TIOCSWINSZ, &ws);
+        send_status(fd, id);
     }
 
-    void handle_output(int fd, const std::string &id, size_t offset) {
+    // The session a COUNTERS or THREADS run may sample, after the checks
+    // both share; null once an error has been sent.
+    Session *sample_target(int fd, const std::string &id, double seconds) {
+        auto it = sessions_.find(id);
+        if (it == sessions_.end()) {
+            send_error(fd, "not_found");
+            return nullptr;
+        }
+        Session &s = it->second;
+        if ((s.state != 1 && s.state != 2) || s.pid <= 0) {
+            send_error(fd, "not_running");
+            return nullptr;
+        }
+        if (!(seconds >= 0.1 && seconds <= kMaxSampleSeconds)) {
+            send_error(fd, "invalid_duration");
+            return nullptr;
+        }
+        if (sample_runs_.size() >= kMaxSampleRuns) {
+            send_error(fd, "too_many_counters");
+            return nullptr;
+        }
+        return &s;
+    }
+
+    // A timerfd in the loop firing once after `seconds`; -1 on failure.
+    int arm_sample_timer(double seconds) {
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd < 0) return -1;
+        auto ns = static_cast<long long>(seconds * 1e9);
+        itimerspec its{};
+        its.it_value.tv_sec = static_cast<time_t>(ns / 1000000000LL);
+        its.it_value.tv_nsec = static_cast<long>(ns % 1000000000LL);
+        timerfd_settime(tfd, 0, &its, nullptr);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = tfd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, tfd, &ev) < 0) {
+            close(tfd);
+            return -1;
+        }
+        return tfd;
+    }
+
+    // Counts for `seconds` without blocking the loop: the counters run
+    // until a timerfd fires, and the reply goes out from finish_sample_run().
+    void handle_counters(int fd, const std::string &id, double seconds) {
+        Session *s = sample_target(fd, id, seconds);
+        if (!s) return;
+        auto counters = std::make_unique<debuglantern::PerfCounters>();
+        std::string error;
+        if (!counters->start(s->pid, error)) {
+            if (error == "process exited") {
+                send_error(fd, "not_running");
+            } else {
+                send_error(fd, "counters_failed", error);
+            }
+            return;
+        }
+        int tfd = arm_sample_timer(seconds);
+        if (tfd < 0) {
+            send_error(fd, "counters_failed");
+            return;
+        }
+        sample_runs_[tfd] = SampleRun{fd, id, std::move(counters), nullptr};
+    }
+
+    // Same shape as COUNTERS: /proc is read now and again when the timer
+    // fires, and the reply holds the differences.
+    void handle_threads(int fd, const std::string &id, double seconds) {
+        Session *s = sample_target(fd, id, seconds);
+        if (!s) return;
+        auto threads = std::make_unique<debuglantern::ThreadSampler>();
+        if (!threads->start(s->pid)) {
+            send_error(fd, "not_running");
+            return;
+        }
+        int tfd = arm_sample_timer(seconds);
+        if (tfd < 0) {
+            send_error(fd, "threads_failed");
+            return;
+        }
+        sample_runs_[tfd] = SampleRun{fd, id, nullptr, std::move(threads)};
+    }
+
+    void finish_sample_run(int tfd) {
+        auto it = sample_runs_.find(tfd);
+        SampleRun &run = it->second;
+        std::string json = run.counters ? run.counters->stop_json() : run.threads->finish_json();
+        std::string reply = "{" + debuglantern::json_kv("id", run.id, true) + "," +
+                            json.substr(1) + "\n";
+        send_response(run.client_fd, reply);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, tfd, nullptr);
+        close(tfd);
+        sample_runs_.erase(it);
+    }
+
+    // Offsets are absolute stream positions.  A request for bytes that have
+    // already been evicted is served from the oldest retained byte; the
+    // effective offset is echoed back alongside the retained window.
+    void handle_output(int fd, const std::string &id, size_t offset, size_t length) {
         auto it = sessions_.find(id);
         if (it == sessions_.end()) {
             send_error(fd, "not_found");
@@ -1229,15 +2823,14 @@ private:
 
         const Session &s = it->second;
         std::string data;
-        if (offset < s.output.size()) {
-            data = s.output.substr(offset);
-        }
+        size_t from = s.output.read(offset, length, data);
 
         std::ostringstream oss;
         oss << "{" << debuglantern::json_kv("id", s.id, true) << ","
             << debuglantern::json_kv("output", data, true) << ","
-            << debuglantern::json_kv("offset", static_cast<long long>(offset)) << ","
-            << debuglantern::json_kv("total", static_cast<long long>(s.output.size()))
+            << debuglantern::json_kv("offset", static_cast<long long>(from)) << ","
+            << debuglantern::json_kv("start", static_cast<long long>(s.output.start())) << ","
+            << debuglantern::json_kv("total", static_cast<long long>(s.output.end()))
             << "}\n";
         send_response(fd, oss.str());
     }
@@ -1250,10 +2843,23 @@ private:
         }
 
         Session &s = it->second;
-        if (s.pid <= 0) {
+        // A session with replicas stops them along with itself
+        bool any = signal_session(s, sig);
+        for (const auto &rid : s.replicas) {
+            any = signal_session(sessions_.at(rid), sig) || any;
+        }
+        if (!any) {
             send_error(fd, "not_running");
             return;
         }
+        send_status(fd, s.id);
+    }
+
+    // False when it has no process to signal
+    bool signal_session(Session &s, int sig) {
+        if (s.pid <= 0) {
+            return false;
+        }
 
         // Kill the entire process group first, then the leader.
         // Group kill may already terminate the leader, so ignore
@@ -1267,8 +2873,7 @@ private:
         if (sig == SIGKILL) {
             force_reap(s);
         }
-
-        send_status(fd, s.id);
+        return true;
     }
 
     // Attempt to reap the process immediately and update session state.
@@ -1280,6 +2885,7 @@ private:
             pid_t w = waitpid(s.pid, &status, WNOHANG);
             if (w > 0 || (w < 0 && errno == ECHILD)) {
                 // Process is dead or not our child; clean up state
+                trace_exit(s, s.gdb_pid > 0, true, w > 0, status);
                 if (s.pidfd >= 0) {
                     cleanup_watch(s.pidfd);
                     s.pidfd = -1;
@@ -1289,10 +2895,13 @@ private:
                     s.gdb_pidfd = -1;
                 }
                 close_output_pipe(s);
+                close_heap_pipe(s);
+                if (s.metrics) s.metrics->stop();
                 s.pid = -1;
                 s.gdb_pid = -1;
                 s.debug_port = -1;
                 s.state = 3;
+                fill_prepared(s);
                 return;
             }
         }
@@ -1302,6 +2911,7 @@ private:
             int status = 0;
             pid_t w = waitpid(s.gdb_pid, &status, WNOHANG);
             if (w > 0 || (w < 0 && errno == ECHILD)) {
+                trace_exit(s, true, false, w > 0, status);
                 if (s.gdb_pidfd >= 0) {
                     cleanup_watch(s.gdb_pidfd);
                     s.gdb_pidfd = -1;
@@ -1328,21 +2938,32 @@ private:
             return;
         }
 
+        debuglantern::TraceBuffer::Scope span(trace_, id, "DEBUG");
         int port = alloc_debug_port();
-        pid_t child = fork();
-        if (child == 0) {
-            std::string port_arg = ":" + std::to_string(port);
-            std::string pid_arg = std::to_string(s.pid);
-            execlp("gdbserver", "gdbserver", port_arg.c_str(), "--attach", pid_arg.c_str(), nullptr);
-            _exit(127);
-        }
-
-        if (child < 0) {
+        std::string port_arg = ":" + std::to_string(port);
+        std::string pid_arg = std::to_string(s.pid);
+        char *argv_vec[] = {const_cast<char *>("gdbserver"), const_cast<char *>(port_arg.c_str()),
+                            const_cast<char *>("--attach"), const_cast<char *>(pid_arg.c_str()),
+                            nullptr};
+        debuglantern::SpawnOptions opts;
+        opts.path = "gdbserver";
+        opts.search_path = true;
+        opts.argv = argv_vec;
+        opts.envp = environ;
+        opts.new_group = false;
+        opts.allow_ptrace = false;
+
+        auto spawn_began = std::chrono::steady_clock::now();
+        debuglantern::Spawned child = debuglantern::spawn_process(opts);
+        if (child.pid < 0) {
             send_error(fd, "fork_failed");
             return;
         }
 
-        s.gdb_pid = child;
+        s.gdb_pid = child.pid;
+        s.gdb_started = std::chrono::steady_clock::now();
+        trace_.add(s.id, "spawn gdbserver", spawn_began, s.gdb_started,
+                   debuglantern::json_kv("pid", static_cast<long long>(child.pid)));
         s.debug_port = port;
         s.state = 2;
         add_watch(child, s.id, true);
@@ -1357,26 +2978,56 @@ private:
         }
 
         Session &s = it->second;
-        if (s.state == 1 || s.state == 2) {
+        if (s.state == 1 || s.state == 2 || replicas_running(s) > 0) {
             send_error(fd, "session_running");
             return;
         }
 
+        while (!s.replicas.empty()) {
+            delete_session(sessions_.find(s.replicas.back()));
+        }
+        delete_session(it);
+
+        std::ostringstream oss;
+        oss << "{" << debuglantern::json_kv("id", id, true) << ","
+            << debuglantern::json_kv("state", "DELETED", true) << "}\n";
+        send_response(fd, oss.str());
+    }
+
+    // A stopped session with no replicas left
+    void delete_session(std::unordered_map<std::string, Session>::iterator it) {
+        Session &s = it->second;
+        discard_prepared(s, 0);
         if (s.memfd >= 0) {
             close(s.memfd);
             s.memfd = -1;
         }
         close_output_pipe(s);
-        if (s.is_bundle && !s.bundle_dir.empty()) {
+        close_heap_pipe(s);
+        if (s.is_bundle && !s.bundle_dir.empty() && s.replica_of.empty()) {
+            debuglantern::TraceBuffer::Scope span(trace_, s.id, "remove bundle");
             remove_directory_recursive(s.bundle_dir);
         }
+        if (!s.replica_of.empty()) {
+            auto parent = sessions_.find(s.replica_of);
+            if (parent != sessions_.end()) {
+                auto &ids = parent->second.replicas;
+                ids.erase(std::remove(ids.begin(), ids.end(), s.id), ids.end());
+            }
+        }
         total_bytes_ -= s.size;
+        telemetry_.release(s.telemetry_slot);
+        telemetry_.set_binary_bytes(total_bytes_, cfg_.max_total_bytes);
         sessions_.erase(it);
+    }
 
-        std::ostringstream oss;
-        oss << "{" << debuglantern::json_kv("id", id, true) << ","
-            << debuglantern::json_kv("state", "DELETED", true) << "}\n";
-        send_response(fd, oss.str());
+    size_t replicas_running(const Session &s) const {
+        size_t n = 0;
+        for (const auto &rid : s.replicas) {
+            auto r = sessions_.find(rid);
+            if (r != sessions_.end() && (r->second.state == 1 || r->second.state == 2)) ++n;
+        }
+        return n;
     }
 
     void send_list(int fd) {
@@ -1420,14 +3071,66 @@ private:
         } else {
             oss << debuglantern::json_kv("debug_port", "null", false);
         }
+        if (s.run > 0) {
+            oss << "," << debuglantern::json_kv("run", s.run);
+        }
+        if (!s.build_id.empty()) {
+            oss << "," << debuglantern::json_kv("build_id", s.build_id, true);
+        }
         if (s.is_bundle) {
             oss << "," << debuglantern::json_kv("bundle", true);
             oss << "," << debuglantern::json_kv("exec_path", s.exec_path, true);
             oss << "," << debuglantern::json_kv("bundle_dir", s.bundle_dir, true);
         }
+        if (s.pty) {
+            oss << "," << debuglantern::json_kv("pty", true);
+        }
+        if (s.heap) {
+            oss << "," << debuglantern::json_kv("heap_profile", true);
+        }
         if (!s.saved_args.empty()) {
             oss << "," << debuglantern::json_kv("args", s.saved_args, true);
         }
+        if (!s.replica_of.empty()) {
+            oss << "," << debuglantern::json_kv("replica_of", s.replica_of, true);
+            oss << "," << debuglantern::json_kv("replica", s.replica_index);
+        }
+        if (!s.replicas.empty()) {
+            long long by_state[4] = {0, 0, 0, 0};
+            for (const auto &rid : s.replicas) {
+                auto r = sessions_.find(rid);
+                if (r != sessions_.end() && r->second.state >= 0 && r->second.state < 4) {
+                    ++by_state[r->second.state];
+                }
+            }
+            oss << ",\"replicas\":{"
+                << debuglantern::json_kv("count", static_cast<long long>(s.replicas.size())) << ","
+                << debuglantern::json_kv("loaded", by_state[0]) << ","
+                << debuglantern::json_kv("running", by_state[1]) << ","
+                << debuglantern::json_kv("debugging", by_state[2]) << ","
+                << debuglantern::json_kv("stopped", by_state[3]) << "}";
+        }
+        if (s.loader_us >= 0) {
+            oss << "," << debuglantern::json_kv("loader_us", s.loader_us);
+            oss << "," << debuglantern::json_kv("init_us", s.init_us);
+        }
+        if (s.prepare_target > 0 || !s.prepared.empty()) {
+            oss << ",\"prepared\":{"
+                << debuglantern::json_kv("target", static_cast<long long>(s.prepare_target)) << ","
+                << debuglantern::json_kv("pty", s.prepare_pty) << ",\"instances\":[";
+            for (size_t i = 0; i < s.prepared.size(); ++i) {
+                const PreparedProcess &p = s.prepared[i];
+                if (i) oss << ",";
+                oss << "{" << debuglantern::json_kv("pid", static_cast<long long>(p.pid)) << ","
+                    << debuglantern::json_kv("ready", p.ready);
+                if (p.ready) {
+                    oss << "," << debuglantern::json_kv("loader_us", p.loader_us) << ","
+                        << debuglantern::json_kv("init_us", p.init_us);
+                }
+                oss << "}";
+            }
+            oss << "]}";
+        }
         if (!s.env_vars.empty()) {
             oss << ",\"env\":{";
             bool first = true;
@@ -1462,15 +3165,35 @@ private:
         if (code == "tmpdir_create_failed") return "failed to create temporary directory";
         if (code == "extract_failed") return "failed to extract tar.gz bundle";
         if (code == "invalid_env") return "env format must be KEY=VALUE";
+        if (code == "invalid_args") return "unterminated quote or trailing backslash in args";
+        if (code == "pty_failed") return "failed to allocate a pseudo-terminal";
+        if (code == "not_pty") return "session was not started with --pty";
+        if (code == "invalid_duration") return "duration must be 0.1 to 60 seconds";
+        if (code == "too_many_counters") return "too many COUNTERS/THREADS runs in progress";
+        if (code == "threads_failed") return "could not sample threads";
+        if (code == "counters_failed") return "perf counters unavailable (check perf_event_paranoid)";
+        if (code == "invalid_heap_rate") return "heap profile rate must be a positive byte count";
+        if (code == "heap_profile_debug") return "--heap-profile cannot be combined with --debug";
+        if (code == "heap_profile_unsupported") return "this build of the daemon has no heap sampler";
+        if (code == "heap_profile_failed") return "failed to set up the heap sampler";
+        if (code == "no_heap_profile") return "session was not started with --heap-profile";
+        if (code == "invalid_heap_view") return "heap view must be live or alloc";
+        if (code == "replica_failed") return "could not share the binary with a replica";
+        if (code == "invalid_replicas") return "replicas must be 0 to 64, of a session that is not a replica";
+        if (code == "invalid_prepare_count") return "prepare count must be 0 to 8";
+        if (code == "prepare_static") return "PREPARE needs a dynamically linked binary";
+        if (code == "prepare_failed") return "failed to spawn a prepared instance";
         return "unspecified error";
     }
 
-    void send_error(int fd, const std::string &err) {
+    // `detail`, when given, is the underlying cause (e.g. a system call's error)
+    void send_error(int fd, const std::string &err, const std::string &detail = "") {
         std::ostringstream oss;
         oss << "{" << debuglantern::json_kv("ok", false) << ","
             << debuglantern::json_kv("error_code", err, true) << ","
-            << debuglantern::json_kv("message", error_message(err), true) << ","
-            << debuglantern::json_kv("time", debuglantern::now_iso8601(), true) << "}\n";
+            << debuglantern::json_kv("message", error_message(err), true) << ",";
+        if (!detail.empty()) oss << debuglantern::json_kv("detail", detail, true) << ",";
+        oss << debuglantern::json_kv("time", debuglantern::now_iso8601(), true) << "}\n";
         send_response(fd, oss.str());
     }
 
@@ -1511,8 +3234,10 @@ private:
         return std::string(out);
     }
 
-    void add_watch(pid_t pid, const std::string &id, bool is_gdb) {
-        int pidfd = pidfd_open_sys(pid);
+    // Watches the child through the pidfd it was spawned with, or one opened
+    // now on kernels too old to hand one out.
+    void add_watch(const debuglantern::Spawned &child, const std::string &id, bool is_gdb) {
+        int pidfd = child.pidfd >= 0 ? child.pidfd : pidfd_open_sys(child.pid);
         if (pidfd < 0) {
             return;
         }
@@ -1543,11 +3268,13 @@ private:
         }
 
         Session &s = it->second;
+        debuglantern::TraceBuffer::Scope span(trace_, s.id, "reap");
         bool gdb_is_app = watch.is_gdb && s.pid == s.gdb_pid && s.pid > 0;
         pid_t pid = watch.is_gdb ? s.gdb_pid : s.pid;
         if (pid > 0) {
             int status = 0;
-            waitpid(pid, &status, WNOHANG);
+            bool reaped = waitpid(pid, &status, WNOHANG) == pid;
+            trace_exit(s, watch.is_gdb, !watch.is_gdb || gdb_is_app, reaped, status);
         }
 
         if (watch.is_gdb) {
@@ -1569,6 +3296,16 @@ private:
         } else {
             s.pid = -1;
             s.state = 3;
+            if (s.heap_pipe_fd >= 0) {
+                handle_heap_pipe(s.heap_pipe_fd, s.id);
+                close_heap_pipe(s);
+            }
+        }
+        if (s.state == 3 && s.metrics) {
+            s.metrics->stop();
+        }
+        if (s.state == 3) {
+            fill_prepared(s);
         }
 
         cleanup_watch(pidfd);
@@ -1590,13 +3327,23 @@ private:
     }
 
     Config cfg_;
+    debuglantern::Telemetry &telemetry_;
+    std::chrono::steady_clock::time_point started_;
+    const char *handler_ = "";    // what the loop is running, for stall reports
+    std::string handler_detail_;  // e.g. the command line
+    std::deque<StallRecord> stalls_;
+    debuglantern::TraceBuffer trace_{kTraceSpans};
     int listen_fd_ = -1;
     int epoll_fd_ = -1;
+    int metrics_timer_ = -1;
     bool shutdown_ = false;
 
     std::unordered_map<int, ClientConn> clients_;
     std::unordered_map<int, WatchInfo> watches_;
+    std::unordered_map<int, SampleRun> sample_runs_;  // by timerfd
     std::unordered_map<int, OutputPipeInfo> output_pipes_;
+    std::unordered_map<int, std::string> heap_pipes_;  // by read end, to session id
+    std::unordered_map<int, std::string> prepared_pipes_;  // by ready fd, to session id
     std::unordered_map<std::string, Session> sessions_;
     std::vector<ActivityEntry> activity_log_;
     size_t total_bytes_ = 0;
@@ -1605,7 +3352,8 @@ private:
 
 void usage() {
     std::cout << "debuglanternd --port 4444 --web-port 8080 --service-name debuglantern "
-                 "--max-sessions 32 --max-total-bytes 536870912 --uid 0 --gid 0\n";
+                 "--max-sessions 32 --max-total-bytes 536870912 --output-buffer 262144 "
+                 "--metrics-interval 1000 --stall-threshold 250 --uid 0 --gid 0\n";
 }
 
 Config parse_args(int argc, char **argv) {
@@ -1622,6 +3370,13 @@ Config parse_args(int argc, char **argv) {
             cfg.max_sessions = static_cast<size_t>(std::stoull(argv[++i]));
         } else if (arg == "--max-total-bytes" && i + 1 < argc) {
             cfg.max_total_bytes = static_cast<size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--output-buffer" && i + 1 < argc) {
+            cfg.output_buffer = static_cast<size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--metrics-interval" && i + 1 < argc) {
+            int ms = std::atoi(argv[++i]);
+            cfg.metrics_interval_ms = ms <= 0 ? 0 : std::max(ms, 100);
+        } else if (arg == "--stall-threshold" && i + 1 < argc) {
+            cfg.stall_threshold_ms = std::max(std::atoi(argv[++i]), 0);
         } else if (arg == "--uid" && i + 1 < argc) {
             cfg.drop_uid = std::atoi(argv[++i]);
         } else if (arg == "--gid" && i + 1 < argc) {
@@ -1665,7 +3420,8 @@ int main(int argc, char **argv) {
 
     drop_privs(cfg);
 
-    Server server(cfg);
+    debuglantern::Telemetry telemetry(cfg.max_sessions);
+    Server server(cfg, telemetry);
     if (!server.init()) {
         stop_mdns(adv);
         return 1;
@@ -1673,7 +3429,7 @@ int main(int argc, char **argv) {
 
     std::unique_ptr<debuglantern::WebUI> webui;
     if (cfg.web_port > 0) {
-        webui = std::make_unique<debuglantern::WebUI>(cfg.web_port, cfg.port);
+        webui = std::make_unique<debuglantern::WebUI>(cfg.web_port, cfg.port, telemetry);
         if (webui->start()) {
             std::cout << "webui: http://0.0.0.0:" << cfg.web_port << "\n";
         } else {
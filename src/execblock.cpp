@@ -0,0 +1,170 @@
+#include "execblock.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+
+namespace debuglantern {
+
+bool split_shell_words(std::string_view line, std::vector<std::string> &words) {
+    words.clear();
+    std::string word;
+    bool in_word = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == ' ' || c == '\t' || c == '\n') {
+            if (in_word) {
+                words.push_back(std::move(word));
+                word.clear();
+                in_word = false;
+            }
+            continue;
+        }
+        in_word = true;
+        if (c == '\\') {
+            if (++i == line.size()) return false;
+            word += line[i];
+        } else if (c == '\'') {
+            size_t end = line.find('\'', i + 1);
+            if (end == std::string_view::npos) return false;
+            word.append(line.substr(i + 1, end - i - 1));
+            i = end;
+        } else if (c == '"') {
+            for (++i;; ++i) {
+                if (i == line.size()) return false;
+                if (line[i] == '"') break;
+                if (line[i] == '\\' && i + 1 < line.size() &&
+                    std::string_view("\"\\$`").find(line[i + 1]) != std::string_view::npos) {
+                    ++i;
+                }
+                word += line[i];
+            }
+        } else {
+            word += c;
+        }
+    }
+    if (in_word) words.push_back(std::move(word));
+    return true;
+}
+
+std::string expand_index(std::string_view text, long long index) {
+    std::string out;
+    size_t pos = 0;
+    for (;;) {
+        size_t open = text.find("{{index", pos);
+        size_t close = open == std::string_view::npos ? open : text.find("}}", open);
+        if (close == std::string_view::npos) break;
+        std::string_view inner = text.substr(open + 7, close - open - 7);
+        long long offset = 0;
+        bool ok = inner.empty();
+        if (!ok && inner[0] == '+' && inner.size() > 1 && inner.size() <= 10) {
+            ok = true;
+            for (char c : inner.substr(1)) {
+                if (c < '0' || c > '9') ok = false;
+                offset = offset * 10 + (c - '0');
+            }
+        }
+        out.append(text.substr(pos, open - pos));
+        if (ok) {
+            out += std::to_string(index + offset);
+        } else {
+            out.append(text.substr(open, close + 2 - open));
+        }
+        pos = close + 2;
+    }
+    out.append(text.substr(pos));
+    return out;
+}
+
+ExecBlock::ExecBlock(const ExecBlock &other)
+    : arena_(other.arena_), ptrs_(other.ptrs_), env_begin_(other.env_begin_), built_(other.built_) {
+    const char *from = other.arena_.data();
+    for (size_t i = 0; i < ptrs_.size(); ++i) {
+        if (i < kArgvPrefix) {
+            ptrs_[i] = nullptr;
+        } else if (ptrs_[i]) {
+            ptrs_[i] = arena_.data() + (ptrs_[i] - from);
+        }
+    }
+}
+
+ExecBlock &ExecBlock::operator=(const ExecBlock &other) {
+    if (this != &other) {
+        ExecBlock copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+void ExecBlock::build(const std::vector<std::string> &args,
+                      const std::map<std::string, std::string> &overrides) {
+    // Views into environ and `overrides`, both of which outlive this call
+    std::map<std::string_view, std::string_view> merged;
+    for (char **e = environ; *e; ++e) {
+        std::string_view entry(*e);
+        auto eq = entry.find('=');
+        if (eq != std::string_view::npos) {
+            merged[entry.substr(0, eq)] = entry.substr(eq + 1);
+        }
+    }
+    for (const auto &kv : overrides) {
+        merged[kv.first] = kv.second;
+    }
+
+    // Sized up front: the pointers go into the arena as it is filled
+    size_t size = 0;
+    for (const auto &a : args) size += a.size() + 1;
+    for (const auto &kv : merged) size += kv.first.size() + kv.second.size() + 2;
+    arena_.assign(size, '\0');
+    ptrs_.assign(kArgvPrefix, nullptr);
+    ptrs_.reserve(kArgvPrefix + args.size() + merged.size() + 2);
+
+    char *p = arena_.data();
+    auto put = [&p](std::string_view s) {
+        memcpy(p, s.data(), s.size());
+        p += s.size();
+    };
+    for (const auto &a : args) {
+        ptrs_.push_back(p);
+        put(a);
+        *p++ = '\0';
+    }
+    ptrs_.push_back(nullptr);
+    env_begin_ = ptrs_.size();
+    for (const auto &kv : merged) {
+        ptrs_.push_back(p);
+        put(kv.first);
+        *p++ = '=';
+        put(kv.second);
+        *p++ = '\0';
+    }
+    ptrs_.push_back(nullptr);
+    built_ = true;
+}
+
+void ExecBlock::clear() {
+    arena_.clear();
+    ptrs_.clear();
+    env_begin_ = 0;
+    built_ = false;
+}
+
+char *const *ExecBlock::argv(std::initializer_list<const char *> prefix) {
+    size_t first = kArgvPrefix - prefix.size();
+    size_t i = first;
+    for (const char *s : prefix) {
+        ptrs_[i++] = const_cast<char *>(s);
+    }
+    return ptrs_.data() + first;
+}
+
+std::vector<std::string> ExecBlock::env() const {
+    std::vector<std::string> out;
+    for (size_t i = env_begin_; ptrs_[i]; ++i) {
+        out.emplace_back(ptrs_[i]);
+    }
+    return out;
+}
+
+}  // namespace debuglantern
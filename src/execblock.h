@@ -0,0 +1,64 @@
+#ifndef DEBUGLANTERN_EXECBLOCK_H
+#define DEBUGLANTERN_EXECBLOCK_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace debuglantern {
+
+// Splits an ARGS line into words the way sh does, without expansion:
+// blanks separate words, '...' is literal, "..." keeps everything but \",
+// \\, \$ and \` escapes, and outside quotes a backslash takes the next
+// character literally.  "" and '' make empty words.  False on an
+// unterminated quote or a trailing backslash.
+bool split_shell_words(std::string_view line, std::vector<std::string> &words);
+
+// START --replicas: replaces {{index}} in `text` with the replica's index
+// and {{index+N}} with index + N (e.g. --port {{index+9000}}).  Anything
+// else in braces is left as it is.
+std::string expand_index(std::string_view text, long long index);
+
+// A session's argv and envp, built once and reused by every start until its
+// arguments or environment change: all the strings in one arena, and the
+// null-terminated pointer arrays exec takes, pointing into it.
+class ExecBlock {
+public:
+    // Slots ahead of the arguments for what a start path puts first: the
+    // binary, or gdbserver, its port and the binary.
+    static constexpr size_t kArgvPrefix = 3;
+
+    ExecBlock() = default;
+    // Copies point into their own arena; the prefix is left for argv() to
+    // fill.  Moves keep the arena's buffer, so its pointers stay valid.
+    ExecBlock(const ExecBlock &other);
+    ExecBlock &operator=(const ExecBlock &other);
+    ExecBlock(ExecBlock &&) noexcept = default;
+    ExecBlock &operator=(ExecBlock &&) noexcept = default;
+
+    // The daemon's environment with `overrides` applied, sorted by name
+    void build(const std::vector<std::string> &args,
+               const std::map<std::string, std::string> &overrides);
+    void clear();
+    bool built() const { return built_; }
+
+    // `prefix` (at most kArgvPrefix), then the arguments.  The prefix
+    // strings must outlive the exec; the array lasts until the next call.
+    char *const *argv(std::initializer_list<const char *> prefix);
+    char *const *envp() const { return ptrs_.data() + env_begin_; }
+    // A copy of the environment, for starts that add to it
+    std::vector<std::string> env() const;
+
+private:
+    std::vector<char> arena_;
+    std::vector<char *> ptrs_;  // [prefix] [args] null [env] null
+    size_t env_begin_ = 0;
+    bool built_ = false;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_EXECBLOCK_H
@@ -0,0 +1,843 @@
+#include "flamegraph.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace debuglantern {
+
+namespace {
+
+constexpr int kSvgWidth = 1200;
+constexpr int kCellHeight = 18;
+constexpr int kTopMargin = 60;
+constexpr double kMinFrameWidth = 0.5;  // px; narrower frames are not drawn
+constexpr uint64_t kEmptySlot = ~uint64_t(0);
+
+uint64_t mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return k;
+}
+
+void flame_color(const std::string &name, char *out) {
+    unsigned h = 0;
+    for (char c : name) h = h * 31 + static_cast<unsigned>(c);
+    int r = 200 + static_cast<int>(h % 55);
+    int g = 80 + static_cast<int>((h >> 8) % 60);
+    int b = 10 + static_cast<int>((h >> 16) % 30);
+    snprintf(out, 8, "#%02x%02x%02x", r, g, b);
+}
+
+// Root-first frames of the path to `node`, root itself excluded.
+void path_to(const FlameGraph &graph, uint32_t node, std::vector<uint32_t> &frames) {
+    frames.clear();
+    const auto &nodes = graph.nodes();
+    for (uint32_t n = node; n != 0; n = nodes[n].parent) frames.push_back(nodes[n].frame);
+    std::reverse(frames.begin(), frames.end());
+}
+
+// Minimal protobuf writer for profile.proto
+void pb_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+void pb_int(std::string &out, int field, uint64_t v) {
+    pb_varint(out, static_cast<uint64_t>(field) << 3);
+    pb_varint(out, v);
+}
+
+void pb_bytes(std::string &out, int field, const std::string &bytes) {
+    pb_varint(out, (static_cast<uint64_t>(field) << 3) | 2);
+    pb_varint(out, bytes.size());
+    out += bytes;
+}
+
+// "1234 samples", or a time or a size for graphs counted in microseconds
+// or bytes
+std::string amount(long long v, const std::string &unit) {
+    char buf[48];
+    if (unit == "bytes") {
+        if (v >= 1 << 30) {
+            snprintf(buf, sizeof(buf), "%.2f GB", static_cast<double>(v) / (1 << 30));
+        } else if (v >= 1 << 20) {
+            snprintf(buf, sizeof(buf), "%.1f MB", static_cast<double>(v) / (1 << 20));
+        } else if (v >= 1 << 10) {
+            snprintf(buf, sizeof(buf), "%.1f KB", static_cast<double>(v) / (1 << 10));
+        } else {
+            snprintf(buf, sizeof(buf), "%lld B", v);
+        }
+    } else if (unit != "us") {
+        snprintf(buf, sizeof(buf), "%lld %s", v, unit.c_str());
+    } else if (v >= 1000000) {
+        snprintf(buf, sizeof(buf), "%.2f s", static_cast<double>(v) / 1e6);
+    } else if (v >= 1000) {
+        snprintf(buf, sizeof(buf), "%.1f ms", static_cast<double>(v) / 1e3);
+    } else {
+        snprintf(buf, sizeof(buf), "%lld us", v);
+    }
+    return buf;
+}
+
+double fraction(long long part, long long whole) {
+    return whole > 0 ? static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+void append_escaped(std::string &out, std::string_view s) {
+    for (char c : s) {
+        switch (c) {
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '&': out += "&amp;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c;
+        }
+    }
+}
+
+std::string empty_svg() {
+    return "<svg xmlns='http://www.w3.org/2000/svg' width='600' height='40'>"
+           "<text y='20' fill='#e0e0e0' font-family='monospace'>"
+           "No samples collected</text></svg>";
+}
+
+// Lays out and writes the SVG for `graph` with each node `width` pixels
+// wide (children within their parent), colored and annotated by the
+// callbacks.
+std::string render_svg(const FlameGraph &graph, const std::vector<double> &width,
+                       const char *title, const std::string &subtitle,
+                       const std::function<void(uint32_t, char *)> &color_of,
+                       const std::function<void(uint32_t, std::string &)> &annotate) {
+    // One pass decides what is drawn: parents precede children, so a
+    // pruned parent has already hidden its whole subtree.
+    const auto &nodes = graph.nodes();
+    std::vector<int> depth(nodes.size(), -1);
+    std::vector<uint32_t> drawn;
+    depth[0] = 0;
+    int max_depth = 0;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        int pd = depth[nodes[i].parent];
+        if (pd < 0 || width[i] < kMinFrameWidth) continue;
+        depth[i] = pd + 1;
+        max_depth = std::max(max_depth, depth[i]);
+        drawn.push_back(static_cast<uint32_t>(i));
+    }
+
+    // Children in name order, as contiguous runs per parent
+    std::sort(drawn.begin(), drawn.end(), [&](uint32_t a, uint32_t b) {
+        if (nodes[a].parent != nodes[b].parent) return nodes[a].parent < nodes[b].parent;
+        return graph.name(nodes[a].frame) < graph.name(nodes[b].frame);
+    });
+    std::unordered_map<uint32_t, std::pair<size_t, size_t>> runs;  // parent -> [begin, end)
+    for (size_t i = 0; i < drawn.size();) {
+        size_t j = i;
+        while (j < drawn.size() && nodes[drawn[j]].parent == nodes[drawn[i]].parent) ++j;
+        runs[nodes[drawn[i]].parent] = {i, j};
+        i = j;
+    }
+
+    int svg_h = kTopMargin + (max_depth + 1) * kCellHeight + 10;
+    std::string svg;
+    svg.reserve((drawn.size() + 1) * 200 + 512);
+    char num[160];
+    snprintf(num, sizeof(num),
+             "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+             "viewBox=\"0 0 %d %d\" ",
+             kSvgWidth, svg_h, kSvgWidth, svg_h);
+    svg += num;
+    svg += "style=\"background:#0f0f23;font-family:'SF Mono','Fira Code',monospace\">\n";
+    snprintf(num, sizeof(num),
+             "<text x=\"%d\" y=\"24\" text-anchor=\"middle\" fill=\"#e94560\" font-size=\"16\" "
+             "font-weight=\"bold\">%s</text>\n",
+             kSvgWidth / 2, title);
+    svg += num;
+    snprintf(num, sizeof(num),
+             "<text x=\"%d\" y=\"42\" text-anchor=\"middle\" fill=\"#666\" font-size=\"11\">",
+             kSvgWidth / 2);
+    svg += num;
+    append_escaped(svg, subtitle);
+    svg += "</text>\n";
+
+    std::vector<std::pair<uint32_t, double>> stack{{0, 0.0}};  // node, x
+    char color[8];
+    while (!stack.empty()) {
+        auto [id, x] = stack.back();
+        stack.pop_back();
+        const auto &node = nodes[id];
+        const std::string &name = graph.name(node.frame);
+        double w = width[id];
+        double y = kTopMargin + (max_depth - depth[id]) * kCellHeight;
+        color_of(id, color);
+
+        svg += "<g><title>";
+        append_escaped(svg, name);
+        annotate(id, svg);
+        snprintf(num, sizeof(num),
+                 "</title><rect x=\"%.2f\" y=\"%.0f\" width=\"%.2f\" "
+                 "height=\"%d\" fill=\"%s\" rx=\"2\"/>",
+                 10 + x, y, w, kCellHeight - 1, color);
+        svg += num;
+        if (w > 30) {
+            size_t mc = static_cast<size_t>(w / 7);
+            std::string_view label = name;
+            bool cut = mc > 2 && label.size() > mc;
+            if (cut) label = label.substr(0, mc - 2);
+            snprintf(num, sizeof(num),
+                     "<text x=\"%.2f\" y=\"%.0f\" fill=\"#000\" font-size=\"11\" "
+                     "style=\"pointer-events:none\">",
+                     10 + x + 3, y + kCellHeight - 5);
+            svg += num;
+            append_escaped(svg, label);
+            if (cut) svg += "..";
+            svg += "</text>";
+        }
+        svg += "</g>\n";
+
+        auto run = runs.find(id);
+        if (run == runs.end()) continue;
+        // Push in reverse so children are emitted left to right
+        double cx = x;
+        size_t first = stack.size();
+        for (size_t k = run->second.first; k < run->second.second; ++k) {
+            stack.emplace_back(drawn[k], cx);
+            cx += width[drawn[k]];
+        }
+        std::reverse(stack.begin() + static_cast<long>(first), stack.end());
+    }
+
+    svg += "</svg>\n";
+    return svg;
+}
+
+}  // namespace
+
+FlameGraph::FlameGraph() : slot_keys_(1024, kEmptySlot), slot_nodes_(1024) {
+    nodes_.push_back(Node{intern("all"), 0, 0, 0});
+}
+
+uint32_t FlameGraph::intern(std::string_view name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) return it->second;
+    auto id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(name);
+    ids_.emplace(names_.back(), id);
+    return id;
+}
+
+// Finds or creates the child of `parent` for `frame`.
+uint32_t FlameGraph::child(uint32_t parent, uint32_t frame) {
+    uint64_t key = (uint64_t(parent) << 32) | frame;
+    size_t mask = slot_keys_.size() - 1;
+    for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+        if (slot_keys_[i] == key) return slot_nodes_[i];
+        if (slot_keys_[i] != kEmptySlot) continue;
+        auto node = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(Node{frame, parent, 0, 0});
+        slot_keys_[i] = key;
+        slot_nodes_[i] = node;
+        if (nodes_.size() * 2 > slot_keys_.size()) grow_slots();
+        return node;
+    }
+}
+
+void FlameGraph::grow_slots() {
+    std::vector<uint64_t> keys(slot_keys_.size() * 2, kEmptySlot);
+    std::vector<uint32_t> ids(keys.size());
+    size_t mask = keys.size() - 1;
+    for (size_t j = 0; j < slot_keys_.size(); ++j) {
+        if (slot_keys_[j] == kEmptySlot) continue;
+        size_t i = mix(slot_keys_[j]) & mask;
+        while (keys[i] != kEmptySlot) i = (i + 1) & mask;
+        keys[i] = slot_keys_[j];
+        ids[i] = slot_nodes_[j];
+    }
+    slot_keys_.swap(keys);
+    slot_nodes_.swap(ids);
+}
+
+uint32_t FlameGraph::add(const uint32_t *frames, size_t depth, long long count) {
+    uint32_t node = 0;
+    nodes_[0].total += count;
+    for (size_t i = 0; i < depth; ++i) {
+        node = child(node, frames[i]);
+        nodes_[node].total += count;
+    }
+    nodes_[node].self += count;
+    return node;
+}
+
+void FlameGraph::merge(const FlameGraph &other, long long min_total) {
+    constexpr uint32_t kSkipped = ~uint32_t(0);
+    std::vector<uint32_t> frames(other.frame_count());
+    for (uint32_t f = 0; f < frames.size(); ++f) frames[f] = intern(other.name(f));
+    // Parents precede children, so one pass maps every node
+    const auto &theirs = other.nodes();
+    std::vector<uint32_t> mapped(theirs.size(), kSkipped);
+    mapped[0] = 0;
+    nodes_[0].total += theirs[0].total;
+    nodes_[0].self += theirs[0].self;
+    for (size_t i = 1; i < theirs.size(); ++i) {
+        uint32_t parent = mapped[theirs[i].parent];
+        if (parent == kSkipped) continue;
+        if (theirs[i].total < min_total) {
+            nodes_[parent].self += theirs[i].total;
+            continue;
+        }
+        uint32_t node = child(parent, frames[theirs[i].frame]);
+        nodes_[node].total += theirs[i].total;
+        nodes_[node].self += theirs[i].self;
+        mapped[i] = node;
+    }
+}
+
+void FlameGraph::add_folded(std::string_view stack, long long count) {
+    scratch_.clear();
+    while (!stack.empty()) {
+        size_t semi = stack.find(';');
+        std::string_view frame = stack.substr(0, semi);
+        if (!frame.empty()) scratch_.push_back(intern(frame));
+        if (semi == std::string_view::npos) break;
+        stack.remove_prefix(semi + 1);
+    }
+    add(scratch_.data(), scratch_.size(), count);
+}
+
+void collapse_perf_script(FILE *in, FlameGraph &graph,
+                          const std::function<std::string(uint64_t)> &resolve) {
+    std::vector<uint32_t> frames;  // leaf-first, as perf prints them
+
+    auto flush = [&]() {
+        if (frames.empty()) return;
+        std::reverse(frames.begin(), frames.end());
+        graph.add(frames.data(), frames.size(), 1);
+        frames.clear();
+    };
+
+    char *buf = nullptr;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&buf, &cap, in)) >= 0) {
+        std::string_view line(buf, static_cast<size_t>(n));
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.remove_suffix(1);
+        if (line.empty()) {
+            flush();
+            continue;
+        }
+        if (line[0] != '\t' && line[0] != ' ') {
+            flush();  // header line for next sample
+            continue;
+        }
+        // Stack frame line: "    addr func+offset (module)"
+        size_t p = line.find_first_not_of(" \t");
+        if (p == std::string_view::npos) continue;
+        size_t sp = line.find(' ', p);
+        if (sp == std::string_view::npos) continue;
+        size_t fs = line.find_first_not_of(' ', sp);
+        if (fs == std::string_view::npos) continue;
+        size_t fe = line.find_first_of("+ (", fs);
+        std::string_view func = line.substr(fs, fe == std::string_view::npos ? fe : fe - fs);
+        if (func.empty() || func[0] == '(') continue;
+        if (resolve && func == "[unknown]") {
+            frames.push_back(graph.intern(resolve(strtoull(buf + p, nullptr, 16))));
+        } else {
+            frames.push_back(graph.intern(func));
+        }
+    }
+    free(buf);
+    flush();
+}
+
+void collapse_perf_switches(FILE *in, FlameGraph &graph, bool per_thread, long long cpu_sample_us,
+                            const std::function<std::string(uint64_t)> &resolve) {
+    graph.set_unit("us");
+    struct Blocked {
+        long long since = 0;  // us
+        std::vector<uint32_t> frames;
+    };
+    std::unordered_map<long, Blocked> blocked;  // by tid
+    std::unordered_map<long, uint32_t> threads;
+    uint32_t on_cpu = per_thread ? graph.intern("[on-cpu]") : 0;
+    uint32_t off_cpu = per_thread ? graph.intern("[off-cpu]") : 0;
+
+    enum { kNone, kCpu, kSwitch } kind = kNone;
+    long tid = 0;
+    long long now = 0;
+    std::string comm;
+    std::vector<uint32_t> frames;  // leaf-first, as perf prints them
+
+    // Root-first, under "comm (tid)" and the on/off marker when per thread
+    auto stack_of = [&](bool off) {
+        std::vector<uint32_t> out;
+        if (per_thread) {
+            auto it = threads.find(tid);
+            if (it == threads.end()) {
+                it = threads.emplace(tid, graph.intern(comm + " (" + std::to_string(tid) + ")")).first;
+            }
+            out.push_back(it->second);
+            out.push_back(off ? off_cpu : on_cpu);
+        }
+        out.insert(out.end(), frames.rbegin(), frames.rend());
+        return out;
+    };
+    auto flush = [&]() {
+        if (kind == kCpu && per_thread) {
+            auto stack = stack_of(false);
+            graph.add(stack.data(), stack.size(), cpu_sample_us);
+        } else if (kind == kSwitch) {
+            blocked[tid] = Blocked{now, stack_of(true)};
+        }
+        kind = kNone;
+        frames.clear();
+    };
+    auto wake = [&](long t, long long at) {
+        auto it = blocked.find(t);
+        if (it == blocked.end()) return;
+        if (at > it->second.since) {
+            graph.add(it->second.frames.data(), it->second.frames.size(), at - it->second.since);
+        }
+        blocked.erase(it);
+    };
+
+    char *buf = nullptr;
+    size_t cap = 0;
+    ssize_t n;
+    while ((n = getline(&buf, &cap, in)) >= 0) {
+        std::string_view line(buf, static_cast<size_t>(n));
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.remove_suffix(1);
+        if (line.empty()) {
+            flush();
+            continue;
+        }
+        if (line[0] == '\t' || line[0] == ' ') {
+            if (kind == kNone) continue;
+            // Stack frame line: "    addr func+offset (module)"
+            size_t p = line.find_first_not_of(" \t");
+            size_t sp = line.find(' ', p);
+            if (p == std::string_view::npos || sp == std::string_view::npos) continue;
+            size_t fs = line.find_first_not_of(' ', sp);
+            if (fs == std::string_view::npos) continue;
+            size_t fe = line.find_first_of("+ (", fs);
+            std::string_view func = line.substr(fs, fe == std::string_view::npos ? fe : fe - fs);
+            if (func.empty() || func[0] == '(') continue;
+            if (resolve && func == "[unknown]") {
+                frames.push_back(graph.intern(resolve(strtoull(buf + p, nullptr, 16))));
+            } else {
+                frames.push_back(graph.intern(func));
+            }
+            continue;
+        }
+
+        // Header: "comm [pid/]tid [cpu] secs.usecs: event: ..."; comm may
+        // hold spaces, so the timestamp is found first
+        flush();
+        size_t colon = line.find(": ");
+        while (colon != std::string_view::npos) {
+            size_t ts = line.rfind(' ', colon);
+            ts = ts == std::string_view::npos ? 0 : ts + 1;
+            std::string_view stamp = line.substr(ts, colon - ts);
+            if (stamp.find('.') != std::string_view::npos &&
+                stamp.find_first_not_of("0123456789.") == std::string_view::npos) {
+                break;
+            }
+            colon = line.find(": ", colon + 1);
+        }
+        if (colon == std::string_view::npos) continue;
+        size_t ts = line.rfind(' ', colon);
+        std::string_view head = line.substr(0, ts);
+        while (!head.empty() && head.back() == ' ') head.remove_suffix(1);
+        if (!head.empty() && head.back() == ']') {  // [cpu]
+            size_t b = head.rfind('[');
+            head = head.substr(0, b == std::string_view::npos ? 0 : b);
+            while (!head.empty() && head.back() == ' ') head.remove_suffix(1);
+        }
+        size_t idp = head.rfind(' ');
+        std::string_view ids = head.substr(idp == std::string_view::npos ? 0 : idp + 1);
+        size_t slash = ids.find('/');
+        tid = strtol(std::string(slash == std::string_view::npos ? ids : ids.substr(slash + 1)).c_str(),
+                     nullptr, 10);
+        std::string_view name = idp == std::string_view::npos ? "" : head.substr(0, idp);
+        while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+        comm.assign(name);
+        double secs = strtod(std::string(line.substr(ts + 1, colon - ts - 1)).c_str(), nullptr);
+        now = static_cast<long long>(secs * 1e6);
+
+        // The event, after the period when perf printed one
+        std::string_view rest = line.substr(colon + 2);
+        rest.remove_prefix(std::min(rest.size(), rest.find_first_not_of(' ')));
+        if (!rest.empty() && isdigit(static_cast<unsigned char>(rest[0]))) {
+            size_t sp = rest.find(' ');
+            rest.remove_prefix(sp == std::string_view::npos ? rest.size() : sp);
+            rest.remove_prefix(std::min(rest.size(), rest.find_first_not_of(' ')));
+        }
+        if (rest.rfind("PERF_RECORD_SWITCH", 0) == 0) {
+            if (rest.find(" OUT") == std::string_view::npos) wake(tid, now);
+        } else if (rest.rfind("cpu-clock", 0) == 0) {
+            kind = kCpu;
+        } else if (rest.rfind("cs:", 0) == 0 || rest.rfind("context-switches", 0) == 0) {
+            kind = kSwitch;
+        }
+    }
+    free(buf);
+    flush();
+    // Still blocked when the recording ended
+    for (auto &kv : blocked) {
+        if (now > kv.second.since) {
+            graph.add(kv.second.frames.data(), kv.second.frames.size(), now - kv.second.since);
+        }
+    }
+}
+
+std::string render_flamegraph_svg(const FlameGraph &graph) {
+    long long total = graph.total();
+    if (total == 0) return empty_svg();
+    const auto &nodes = graph.nodes();
+    double scale = static_cast<double>(kSvgWidth - 20) / static_cast<double>(total);
+    std::vector<double> width(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) width[i] = static_cast<double>(nodes[i].total) * scale;
+
+    return render_svg(
+        graph, width,
+        graph.unit() == "us" ? "Time flamegraph" : graph.unit() == "bytes" ? "Heap flamegraph" : "Flamegraph",
+        amount(total, graph.unit()),
+        [&](uint32_t id, char *color) {
+            if (id == 0) {
+                snprintf(color, 8, "#4ecca3");
+            } else {
+                flame_color(graph.name(nodes[id].frame), color);
+            }
+        },
+        [&](uint32_t id, std::string &out) {
+            char pct[16];
+            snprintf(pct, sizeof(pct), ", %lld%%)", nodes[id].total * 100 / total);
+            out += " (" + amount(nodes[id].total, graph.unit()) + pct;
+        });
+}
+
+std::string flamegraph_json(const FlameGraph &graph) {
+    const auto &nodes = graph.nodes();
+    std::string out = "{\"total\":" + std::to_string(graph.total()) + "," +
+                      json_kv("unit", graph.unit(), true) + ",\"names\":[";
+    for (uint32_t f = 0; f < graph.frame_count(); ++f) {
+        if (f) out += ',';
+        out += '"';
+        out += json_escape(graph.name(f));
+        out += '"';
+    }
+    out += "],\"nodes\":[";
+    char num[96];
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto &n = nodes[i];
+        snprintf(num, sizeof(num), "%s%u,%u,%lld,%lld", i ? "," : "", n.frame, n.parent, n.total,
+                 n.self);
+        out += num;
+    }
+    out += "]}";
+    return out;
+}
+
+std::string flamegraph_folded(const FlameGraph &graph) {
+    const auto &nodes = graph.nodes();
+    std::string out;
+    std::vector<uint32_t> frames;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].self == 0) continue;
+        path_to(graph, static_cast<uint32_t>(i), frames);
+        for (size_t k = 0; k < frames.size(); ++k) {
+            if (k) out += ';';
+            out += graph.name(frames[k]);
+        }
+        out += ' ';
+        out += std::to_string(nodes[i].self);
+        out += '\n';
+    }
+    return out;
+}
+
+// https://www.speedscope.app/file-format-schema.json, one "sampled" profile
+// with a weighted sample per distinct stack.
+std::string flamegraph_speedscope(const FlameGraph &graph, const std::string &name) {
+    const auto &nodes = graph.nodes();
+    std::string out =
+        "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\","
+        "\"exporter\":\"debuglantern\",\"name\":\"" + json_escape(name) +
+        "\",\"activeProfileIndex\":0,\"shared\":{\"frames\":[";
+    for (uint32_t f = 0; f < graph.frame_count(); ++f) {
+        if (f) out += ',';
+        out += "{\"name\":\"" + json_escape(graph.name(f)) + "\"}";
+    }
+    out += "]},\"profiles\":[{\"type\":\"sampled\",\"name\":\"" + json_escape(name) +
+           "\",\"unit\":\"" +
+           (graph.unit() == "us" ? "microseconds" : graph.unit() == "bytes" ? "bytes" : "none") +
+           "\",\"startValue\":0,\"endValue\":" +
+           std::to_string(graph.total()) + ",\"samples\":[";
+    std::string weights;
+    std::vector<uint32_t> frames;
+    bool first = true;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].self == 0) continue;
+        path_to(graph, static_cast<uint32_t>(i), frames);
+        out += first ? "[" : ",[";
+        for (size_t k = 0; k < frames.size(); ++k) {
+            if (k) out += ',';
+            out += std::to_string(frames[k]);
+        }
+        out += ']';
+        if (!first) weights += ',';
+        weights += std::to_string(nodes[i].self);
+        first = false;
+    }
+    out += "],\"weights\":[" + weights + "]}]}";
+    return out;
+}
+
+// github.com/google/pprof/blob/main/proto/profile.proto.  Frames become
+// one function and one location each; a sample per distinct stack carries
+// its count and the CPU time it stands for, or for time- and size-weighted
+// graphs just the time or the bytes.
+std::string flamegraph_pprof(const FlameGraph &graph, int64_t period_ns, int64_t duration_ns,
+                             int64_t time_ns) {
+    // String table: "" first, then the value type names, then frame names
+    std::vector<std::string> strings = {"",     "samples", "count", "cpu",
+                                        "nanoseconds", "time", "space", "bytes"};
+    const uint64_t kSamples = 1, kCount = 2, kCpu = 3, kNanos = 4, kTime = 5, kSpace = 6,
+                   kBytes = 7;
+    size_t frame_base = strings.size();
+    bool timed = graph.unit() == "us";
+    bool sized = graph.unit() == "bytes";
+
+    std::string out;
+    std::string msg;
+    auto value_type = [&](uint64_t type, uint64_t unit) {
+        msg.clear();
+        pb_int(msg, 1, type);
+        pb_int(msg, 2, unit);
+        return msg;
+    };
+    if (timed) {
+        pb_bytes(out, 1, value_type(kTime, kNanos));  // sample_type
+    } else if (sized) {
+        pb_bytes(out, 1, value_type(kSpace, kBytes));
+    } else {
+        pb_bytes(out, 1, value_type(kSamples, kCount));  // sample_type
+        pb_bytes(out, 1, value_type(kCpu, kNanos));
+    }
+
+    const auto &nodes = graph.nodes();
+    std::string ids;
+    std::string values;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].self == 0) continue;
+        // Location ids are frame ids + 1, leaf first
+        ids.clear();
+        for (uint32_t n = static_cast<uint32_t>(i); n != 0; n = nodes[n].parent)
+            pb_varint(ids, uint64_t(nodes[n].frame) + 1);
+        values.clear();
+        if (timed) {
+            pb_varint(values, static_cast<uint64_t>(nodes[i].self * 1000));
+        } else if (sized) {
+            pb_varint(values, static_cast<uint64_t>(nodes[i].self));
+        } else {
+            pb_varint(values, static_cast<uint64_t>(nodes[i].self));
+            pb_varint(values, static_cast<uint64_t>(nodes[i].self * period_ns));
+        }
+        msg.clear();
+        pb_bytes(msg, 1, ids);     // location_id, packed
+        pb_bytes(msg, 2, values);  // value, packed
+        pb_bytes(out, 2, msg);     // sample
+    }
+
+    std::string line;
+    for (uint32_t f = 0; f < graph.frame_count(); ++f) {
+        uint64_t id = uint64_t(f) + 1;
+        line.clear();
+        pb_int(line, 1, id);  // function_id
+        msg.clear();
+        pb_int(msg, 1, id);
+        pb_bytes(msg, 4, line);
+        pb_bytes(out, 4, msg);  // location
+        msg.clear();
+        pb_int(msg, 1, id);
+        pb_int(msg, 2, frame_base + f);  // name
+        pb_int(msg, 3, frame_base + f);  // system_name
+        pb_bytes(out, 5, msg);           // function
+        strings.push_back(graph.name(f));
+    }
+
+    for (const auto &str : strings) pb_bytes(out, 6, str);  // string_table
+    pb_int(out, 9, static_cast<uint64_t>(time_ns));
+    pb_int(out, 10, static_cast<uint64_t>(duration_ns));
+    if (sized) {
+        pb_bytes(out, 11, value_type(kSpace, kBytes));  // period_type
+        pb_int(out, 12, static_cast<uint64_t>(period_ns));
+    } else {
+        pb_bytes(out, 11, value_type(timed ? kTime : kCpu, kNanos));
+        pb_int(out, 12, static_cast<uint64_t>(timed ? 1000 : period_ns));
+    }
+    return out;
+}
+
+long long trim_threshold(const FlameGraph &graph, size_t max_nodes) {
+    const auto &nodes = graph.nodes();
+    if (nodes.size() <= max_nodes || max_nodes == 0) return 0;
+    std::vector<long long> totals;
+    totals.reserve(nodes.size());
+    for (const auto &n : nodes) totals.push_back(n.total);
+    auto nth = totals.begin() + static_cast<long>(max_nodes - 1);
+    std::nth_element(totals.begin(), nth, totals.end(), std::greater<long long>());
+    long long kth = *nth;
+    // Ties at the cut would overshoot; drop them all
+    size_t kept = static_cast<size_t>(std::count_if(totals.begin(), totals.end(),
+                                                    [&](long long t) { return t >= kth; }));
+    return kept > max_nodes ? kth + 1 : kth;
+}
+
+FlameDiff diff_flamegraphs(const FlameGraph &base, const FlameGraph &compared) {
+    FlameDiff diff;
+    FlameGraph &graph = diff.graph;
+    std::vector<uint32_t> frames;
+
+    // Replays every stack of `src` into the union graph, frames re-interned
+    // by name, and reports each stack's leaf with its count.
+    auto replay = [&](const FlameGraph &src, long long weight,
+                      const std::function<void(uint32_t, long long)> &leaf) {
+        std::vector<uint32_t> ids(src.frame_count());
+        for (uint32_t f = 0; f < src.frame_count(); ++f) ids[f] = graph.intern(src.name(f));
+        const auto &nodes = src.nodes();
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            if (nodes[i].self == 0) continue;
+            path_to(src, static_cast<uint32_t>(i), frames);
+            for (auto &f : frames) f = ids[f];
+            uint32_t node = graph.add(frames.data(), frames.size(), nodes[i].self * weight);
+            if (leaf) leaf(node, nodes[i].self);
+        }
+    };
+
+    graph.set_unit(compared.unit());
+    replay(compared, 1, nullptr);
+    std::vector<std::pair<uint32_t, long long>> leaves;
+    replay(base, 0, [&](uint32_t node, long long count) { leaves.emplace_back(node, count); });
+
+    const auto &nodes = graph.nodes();
+    diff.base_total.assign(nodes.size(), 0);
+    diff.base_self.assign(nodes.size(), 0);
+    for (auto [node, count] : leaves) {
+        diff.base_self[node] += count;
+        for (uint32_t n = node;; n = nodes[n].parent) {
+            diff.base_total[n] += count;
+            if (n == 0) break;
+        }
+    }
+    diff.base = diff.base_total[0];
+    return diff;
+}
+
+std::string render_flamegraph_diff_svg(const FlameDiff &diff) {
+    const FlameGraph &graph = diff.graph;
+    const auto &nodes = graph.nodes();
+    if (graph.total() == 0 && diff.base == 0) return empty_svg();
+
+    std::vector<double> share(nodes.size()), base_share(nodes.size()), width(nodes.size());
+    double usable = kSvgWidth - 20;
+    double max_delta = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        share[i] = fraction(nodes[i].total, graph.total());
+        base_share[i] = fraction(diff.base_total[i], diff.base);
+        width[i] = (share[i] + base_share[i]) / 2 * usable;
+        max_delta = std::max(max_delta, std::abs(share[i] - base_share[i]));
+    }
+
+    std::string subtitle = "baseline " + amount(diff.base, graph.unit()) + ", compared " +
+                           amount(graph.total(), graph.unit()) + "; red grew, blue shrank";
+    return render_svg(
+        graph, width, "Differential flamegraph", subtitle,
+        [&](uint32_t id, char *color) {
+            double delta = share[id] - base_share[id];
+            int fade = max_delta > 0 ? static_cast<int>(210 * (1 - std::abs(delta) / max_delta)) : 210;
+            if (delta > 0) {
+                snprintf(color, 8, "#ff%02x%02x", 45 + fade, 45 + fade);
+            } else {
+                snprintf(color, 8, "#%02x%02xff", 45 + fade, 45 + fade);
+            }
+        },
+        [&](uint32_t id, std::string &out) {
+            char num[96];
+            snprintf(num, sizeof(num), " (%.2f%% -> %.2f%%, %+.2f)", base_share[id] * 100,
+                     share[id] * 100, (share[id] - base_share[id]) * 100);
+            out += num;
+        });
+}
+
+std::string flamegraph_diff_json(const FlameDiff &diff, size_t top) {
+    const FlameGraph &graph = diff.graph;
+    const auto &nodes = graph.nodes();
+
+    // Per function: self samples, and total samples counting recursion once
+    struct Counts {
+        long long self = 0, total = 0, base_self = 0, base_total = 0;
+    };
+    std::vector<Counts> fn(graph.frame_count());
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        Counts &c = fn[nodes[i].frame];
+        c.self += nodes[i].self;
+        c.base_self += diff.base_self[i];
+        uint32_t a = nodes[i].parent;
+        while (a != 0 && nodes[a].frame != nodes[i].frame) a = nodes[a].parent;
+        if (a != 0) continue;
+        c.total += nodes[i].total;
+        c.base_total += diff.base_total[i];
+    }
+    auto grew = [&](uint32_t f) {
+        return fraction(fn[f].self, graph.total()) - fraction(fn[f].base_self, diff.base);
+    };
+    std::vector<uint32_t> order;
+    for (uint32_t f = 1; f < fn.size(); ++f) {
+        if (grew(f) > 0) order.push_back(f);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return grew(a) > grew(b); });
+    if (order.size() > top) order.resize(top);
+
+    std::string out = "{\"total\":" + std::to_string(graph.total()) +
+                      ",\"base\":" + std::to_string(diff.base) + ",\"names\":[";
+    for (uint32_t f = 0; f < graph.frame_count(); ++f) {
+        if (f) out += ',';
+        out += '"';
+        out += json_escape(graph.name(f));
+        out += '"';
+    }
+    out += "],\"nodes\":[";
+    char num[160];
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto &n = nodes[i];
+        snprintf(num, sizeof(num), "%s%u,%u,%lld,%lld,%lld,%lld", i ? "," : "", n.frame, n.parent,
+                 n.total, n.self, diff.base_total[i], diff.base_self[i]);
+        out += num;
+    }
+    out += "]," + json_kv("unit", graph.unit(), true) + ",\"regressions\":[";
+    for (size_t k = 0; k < order.size(); ++k) {
+        const Counts &c = fn[order[k]];
+        if (k) out += ',';
+        out += "{" + json_kv("name", graph.name(order[k]), true) + "," + json_kv("self", c.self) +
+               "," + json_kv("total", c.total) + "," + json_kv("base_self", c.base_self) + "," +
+               json_kv("base_total", c.base_total) + "}";
+    }
+    out += "]}";
+    return out;
+}
+
+std::string svg_escape(const std::string &s) {
+    std::string out;
+    out.reserve(s.size());
+    append_escaped(out, s);
+    return out;
+}
+
+}  // namespace debuglantern
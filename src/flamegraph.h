@@ -0,0 +1,133 @@
+#ifndef DEBUGLANTERN_FLAMEGRAPH_H
+#define DEBUGLANTERN_FLAMEGRAPH_H
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace debuglantern {
+
+// Stack samples merged into a call tree.  Frame names are interned once,
+// every node carries its subtree total, and children are found through an
+// open-addressing table keyed by (parent, frame), so adding a stack costs
+// O(depth) without allocating per node.
+class FlameGraph {
+public:
+    struct Node {
+        uint32_t frame = 0;
+        uint32_t parent = 0;
+        long long total = 0;  // samples in this subtree
+        long long self = 0;   // samples where this frame was the leaf
+    };
+
+    FlameGraph();
+    // ids_ keys point into names_, which a move keeps but a copy would not
+    FlameGraph(const FlameGraph &) = delete;
+    FlameGraph &operator=(const FlameGraph &) = delete;
+    FlameGraph(FlameGraph &&) = default;
+    FlameGraph &operator=(FlameGraph &&) = default;
+
+    uint32_t intern(std::string_view name);
+    const std::string &name(uint32_t frame) const { return names_[frame]; }
+    size_t frame_count() const { return names_.size(); }
+
+    // Adds `count` samples of a root-first stack of interned frames and
+    // returns the leaf's node.
+    uint32_t add(const uint32_t *frames, size_t depth, long long count);
+    // Adds one folded line's stack ("root;caller;leaf").
+    void add_folded(std::string_view stack, long long count);
+    // Adds every sample of `other`.  Subtrees with fewer than `min_total`
+    // samples are not copied; their samples count as their caller's own.
+    void merge(const FlameGraph &other, long long min_total = 0);
+
+    // Nodes in insertion order: a parent always precedes its children, and
+    // node 0 is the root ("all").
+    const std::vector<Node> &nodes() const { return nodes_; }
+    long long total() const { return nodes_[0].total; }
+
+    // What counts measure: "samples", "us" for graphs weighted by time
+    // (off-CPU wait, or on- and off-CPU time together), or "bytes" for heap
+    // profiles.
+    const std::string &unit() const { return unit_; }
+    void set_unit(const std::string &unit) { unit_ = unit; }
+
+private:
+    uint32_t child(uint32_t parent, uint32_t frame);
+    void grow_slots();
+
+    std::deque<std::string> names_;  // stable storage behind ids_ keys
+    std::unordered_map<std::string_view, uint32_t> ids_;
+    std::vector<Node> nodes_;
+    std::vector<uint64_t> slot_keys_;   // parent << 32 | frame, or kEmptySlot
+    std::vector<uint32_t> slot_nodes_;
+    std::vector<uint32_t> scratch_;
+    std::string unit_ = "samples";
+};
+
+// Parses `perf script` callchain output into `graph` while streaming it
+// (like stackcollapse-perf.pl).  Frames perf printed as "[unknown]" are
+// passed with their address to `resolve` when one is given.
+void collapse_perf_script(FILE *in, FlameGraph &graph,
+                          const std::function<std::string(uint64_t)> &resolve = nullptr);
+
+// Parses `perf script --show-switch-events` output of a recording of
+// context-switch samples (and optionally cpu-clock samples) into a graph of
+// microseconds: each switch-out stack is weighted by the time until that
+// thread's next switch-in.  With `per_thread`, stacks are rooted at their
+// thread and split into "[on-cpu]" and "[off-cpu]", cpu-clock samples
+// counting `cpu_sample_us` each.
+void collapse_perf_switches(FILE *in, FlameGraph &graph, bool per_thread, long long cpu_sample_us,
+                            const std::function<std::string(uint64_t)> &resolve = nullptr);
+
+// Renders the classic root-at-the-bottom SVG, skipping frames (and their
+// subtrees) that would be narrower than half a pixel.
+std::string render_flamegraph_svg(const FlameGraph &graph);
+
+// The whole tree for the dashboard's viewer:
+// {"total":N,"unit":"samples","names":[...],"nodes":[frame,parent,total,self,...]}
+// with four numbers per node, in nodes() order.
+std::string flamegraph_json(const FlameGraph &graph);
+
+// Export formats for offline tools.  `period_ns` is the sampling interval
+// (in bytes for heap graphs) and `duration_ns` the recording length.
+std::string flamegraph_folded(const FlameGraph &graph);  // Brendan Gregg's format
+std::string flamegraph_speedscope(const FlameGraph &graph, const std::string &name);
+std::string flamegraph_pprof(const FlameGraph &graph, int64_t period_ns, int64_t duration_ns,
+                             int64_t time_ns);  // profile.proto, uncompressed
+
+// The `min_total` for merge() that keeps at most `max_nodes` nodes of `graph`.
+long long trim_threshold(const FlameGraph &graph, size_t max_nodes);
+
+// Two profiles over one tree, for differential flamegraphs.  `graph` is the
+// union of both call trees holding the compared profile's counts; the
+// baseline's counts sit alongside, per node.  Profiles are compared by
+// share of their own samples, so captures of different lengths line up.
+struct FlameDiff {
+    FlameGraph graph;
+    std::vector<long long> base_total;
+    std::vector<long long> base_self;
+    long long base = 0;  // baseline samples
+};
+
+FlameDiff diff_flamegraphs(const FlameGraph &base, const FlameGraph &compared);
+
+// Red where the compared profile spends a larger share than the baseline,
+// blue where it spends less; frames are as wide as their mean share, so
+// code that disappeared still shows.
+std::string render_flamegraph_diff_svg(const FlameDiff &diff);
+
+// {"total":N,"base":M,"names":[...],"nodes":[frame,parent,total,self,
+// base_total,base_self,...],"regressions":[...]} where regressions are the
+// `top` functions whose share of self samples grew the most.
+std::string flamegraph_diff_json(const FlameDiff &diff, size_t top);
+
+std::string svg_escape(const std::string &s);
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_FLAMEGRAPH_H
@@ -0,0 +1,164 @@
+#include "heapprof.h"
+
+#include "common.h"
+#include "flamegraph.h"
+
+#include <signal.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace debuglantern {
+
+namespace {
+
+// Matches the sampler's records (heapsampler.cpp)
+enum : uint32_t { kAlloc = 1, kFree = 2, kDropped = 3 };
+
+struct Record {
+    uint32_t type;
+    uint32_t depth;
+    uint64_t addr;
+    uint64_t size;
+    uint64_t weight;
+};
+
+constexpr uint32_t kMaxDepth = 64;
+// Distinct stacks kept; later ones are charged to a single "[other]" stack
+constexpr size_t kMaxStacks = 1 << 16;
+// How stale the maps may get while samples arrive.  They are reread for
+// every view too, but the process may be gone before anyone asks.
+constexpr auto kMapsRefresh = std::chrono::seconds(5);
+
+}  // namespace
+
+int heap_sampler_memfd() {
+    static int fd = sealed_memfd("libdebuglantern_heap.so", kHeapSamplerLib, kHeapSamplerLibSize);
+    return fd;
+}
+
+HeapProfile::HeapProfile(pid_t pid, long long rate)
+    : pid_(pid), rate_(rate), started_(std::chrono::steady_clock::now()) {}
+
+void HeapProfile::feed(const char *data, size_t len) {
+    if (!running_) return;
+    pending_.append(data, len);
+    size_t off = 0;
+    while (pending_.size() - off >= sizeof(Record)) {
+        Record r;
+        std::memcpy(&r, pending_.data() + off, sizeof(r));
+        if (r.depth > kMaxDepth) {
+            // Not something the sampler writes; give up on the stream
+            finish();
+            return;
+        }
+        size_t need = sizeof(r) + r.depth * sizeof(uint64_t);
+        if (pending_.size() - off < need) break;
+        uint64_t frames[kMaxDepth];
+        std::memcpy(frames, pending_.data() + off + sizeof(r), r.depth * sizeof(uint64_t));
+        record(r.type, frames, r.depth, r.addr, r.weight);
+        off += need;
+    }
+    pending_.erase(0, off);
+    if (samples_ > 0 && std::chrono::steady_clock::now() - space_read_ > kMapsRefresh) {
+        refresh_space();
+    }
+}
+
+void HeapProfile::refresh_space() {
+    space_read_ = std::chrono::steady_clock::now();
+    AddressSpace fresh;
+    if (kill(pid_, 0) == 0 && fresh.load(pid_)) {
+        space_ = std::move(fresh);
+        space_loaded_ = true;
+    }
+}
+
+void HeapProfile::finish() {
+    if (!running_) return;
+    running_ = false;
+    ended_ = std::chrono::steady_clock::now();
+    pending_.clear();
+}
+
+void HeapProfile::record(uint32_t type, const uint64_t *frames, uint32_t depth, uint64_t addr,
+                         uint64_t weight) {
+    auto bytes = static_cast<long long>(weight);
+    if (type == kDropped) {
+        dropped_ += bytes;
+        return;
+    }
+    auto it = live_.find(addr);
+    if (it != live_.end()) {
+        // A free we never saw (dropped) ends the old allocation too
+        stacks_[it->second.stack].live_bytes -= it->second.bytes;
+        live_bytes_ -= it->second.bytes;
+        live_.erase(it);
+    }
+    if (type != kAlloc) return;
+    uint32_t id = stack_id(frames, depth);
+    ++samples_;
+    stacks_[id].alloc_bytes += bytes;
+    stacks_[id].live_bytes += bytes;
+    alloc_bytes_ += bytes;
+    live_bytes_ += bytes;
+    live_[addr] = Live{id, bytes};
+}
+
+uint32_t HeapProfile::stack_id(const uint64_t *frames, uint32_t depth) {
+    std::string key(reinterpret_cast<const char *>(frames), depth * sizeof(uint64_t));
+    auto it = stack_ids_.find(key);
+    if (it != stack_ids_.end()) return it->second;
+    if (stacks_.size() >= kMaxStacks) {
+        // The last slot, with no frames, collects the overflow
+        if (stacks_.size() == kMaxStacks) stacks_.emplace_back();
+        return static_cast<uint32_t>(kMaxStacks);
+    }
+    auto id = static_cast<uint32_t>(stacks_.size());
+    stacks_.emplace_back();
+    stacks_.back().frames.assign(frames, frames + depth);
+    stack_ids_.emplace(std::move(key), id);
+    return id;
+}
+
+void HeapProfile::build(bool live, FlameGraph &graph) {
+    graph.set_unit("bytes");
+    // Reread maps while the process is alive to catch libraries loaded late
+    if (running_) refresh_space();
+    uint32_t unknown = graph.intern("[unknown]");
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::vector<uint32_t> path;
+    for (size_t i = 0; i < stacks_.size(); ++i) {
+        const Stack &s = stacks_[i];
+        long long count = live ? s.live_bytes : s.alloc_bytes;
+        if (count <= 0) continue;
+        path.clear();
+        for (uint64_t addr : s.frames) {
+            auto it = ids.find(addr);
+            if (it == ids.end()) {
+                // Return addresses; step back into the call itself
+                uint32_t id = space_loaded_ ? graph.intern(space_.symbolize(addr - 1)) : unknown;
+                it = ids.emplace(addr, id).first;
+            }
+            path.push_back(it->second);
+        }
+        if (path.empty()) path.push_back(i == kMaxStacks ? graph.intern("[other]") : unknown);
+        std::reverse(path.begin(), path.end());
+        graph.add(path.data(), path.size(), count);
+    }
+}
+
+std::string HeapProfile::stats_json() const {
+    auto end = running_ ? std::chrono::steady_clock::now() : ended_;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - started_).count();
+    std::ostringstream oss;
+    oss << json_kv("pid", static_cast<long long>(pid_)) << "," << json_kv("rate", rate_) << ","
+        << json_kv("running", running_) << ","
+        << json_kv("duration_ms", static_cast<long long>(ms)) << ","
+        << json_kv("samples", samples_) << "," << json_kv("live_bytes", live_bytes_) << ","
+        << json_kv("alloc_bytes", alloc_bytes_) << "," << json_kv("dropped", dropped_);
+    return oss.str();
+}
+
+}  // namespace debuglantern
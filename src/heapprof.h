@@ -0,0 +1,92 @@
+#ifndef DEBUGLANTERN_HEAPPROF_H
+#define DEBUGLANTERN_HEAPPROF_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "symbolizer.h"
+
+namespace debuglantern {
+
+class FlameGraph;
+
+// libdebuglantern_heap.so (heapsampler.cpp), embedded at build time
+extern const unsigned char kHeapSamplerLib[];
+extern const size_t kHeapSamplerLibSize;
+
+// The sampler needs glibc (backtrace(), the __libc_* allocator); other
+// builds embed an empty library and refuse --heap-profile
+#ifdef __GLIBC__
+constexpr bool kHeapSamplerSupported = true;
+#else
+constexpr bool kHeapSamplerSupported = false;
+#endif
+
+// A sealed, close-on-exec memfd holding the sampler library, created on
+// first use and shared by every session after; -1 when it cannot be made.
+int heap_sampler_memfd();
+
+// What the sampler preloaded into one run of a session reported: bytes
+// allocated per stack since the start, and the sampled allocations not yet
+// freed.  Each sample stands for the bytes allocated between it and the
+// previous one, so totals are estimates whose error shrinks with the rate.
+class HeapProfile {
+public:
+    HeapProfile(pid_t pid, long long rate);
+
+    // Bytes read from the sampler's pipe; records may span reads.
+    void feed(const char *data, size_t len);
+    // The pipe closed: the process exited (or exec'd something else).
+    void finish();
+
+    // Bytes still allocated (`live`) or allocated since the start, by
+    // allocating stack, in a graph counting "bytes".
+    void build(bool live, FlameGraph &graph);
+
+    // "pid":..,"rate":..,"running":..,"duration_ms":..,"samples":..,
+    // "live_bytes":..,"alloc_bytes":..,"dropped":.. (no braces)
+    std::string stats_json() const;
+
+private:
+    struct Stack {
+        std::vector<uint64_t> frames;  // return addresses, leaf first
+        long long alloc_bytes = 0;
+        long long live_bytes = 0;
+    };
+    struct Live {
+        uint32_t stack = 0;
+        long long bytes = 0;
+    };
+
+    void record(uint32_t type, const uint64_t *frames, uint32_t depth, uint64_t addr,
+                uint64_t weight);
+    uint32_t stack_id(const uint64_t *frames, uint32_t depth);
+    void refresh_space();
+
+    pid_t pid_;
+    long long rate_;
+    bool running_ = true;
+    std::string pending_;  // a partial record
+    std::vector<Stack> stacks_;
+    std::unordered_map<std::string, uint32_t> stack_ids_;  // frames as bytes
+    std::unordered_map<uint64_t, Live> live_;              // by address
+    long long samples_ = 0;
+    long long live_bytes_ = 0;
+    long long alloc_bytes_ = 0;
+    long long dropped_ = 0;
+    AddressSpace space_;  // last maps read while the process was alive
+    bool space_loaded_ = false;
+    std::chrono::steady_clock::time_point space_read_;
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point ended_;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_HEAPPROF_H
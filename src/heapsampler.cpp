@@ -0,0 +1,340 @@
+// Heap allocation sampler, preloaded into sessions started with
+// --heap-profile.  The daemon embeds this library, hands it to the dynamic
+// loader through a memfd in LD_PRELOAD, and reads what it reports from a
+// pipe (DEBUGLANTERN_HEAP_FD).
+//
+// Allocations are sampled by bytes, as tcmalloc does: each thread counts
+// down an exponentially distributed number of bytes (mean
+// DEBUGLANTERN_HEAP_RATE) and records the allocation that crosses zero,
+// with its stack and the number of bytes it stands for.  Frees are
+// reported only for sampled addresses, which are kept in a fixed-size
+// table, so unsampled traffic costs one countdown and one table probe.
+//
+// No libstdc++ and no allocation of its own: everything here runs inside
+// malloc.  Built for glibc, whose __libc_* entry points stand in for the
+// real allocator; anywhere else (musl) this is an empty library and the
+// daemon refuses --heap-profile.
+
+#include "preload_util.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+
+#include <execinfo.h>
+
+extern "C" {
+void *__libc_malloc(size_t);
+void __libc_free(void *);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+void *__libc_valloc(size_t);
+void *__libc_pvalloc(size_t);
+}
+
+namespace {
+
+// Matches HeapProfile on the daemon side (heapprof.cpp)
+enum : uint32_t { kAlloc = 1, kFree = 2, kDropped = 3 };
+
+struct Record {
+    uint32_t type;
+    uint32_t depth;   // frames following, leaf first
+    uint64_t addr;
+    uint64_t size;    // requested bytes
+    uint64_t weight;  // bytes this sample stands for; records dropped for kDropped
+};
+
+constexpr int kMaxDepth = 64;
+constexpr size_t kTableSize = 1 << 16;  // sampled live allocations; power of two
+constexpr uint64_t kEmpty = 0;
+constexpr uint64_t kTombstone = 1;
+constexpr long kDefaultRate = 512 * 1024;
+
+int g_fd = -1;
+double g_rate = kDefaultRate;
+uintptr_t g_self_start = 0;  // our own text, skipped at the top of stacks
+uintptr_t g_self_end = 0;
+
+uint64_t *g_table = nullptr;
+unsigned g_live = 0;  // entries in g_table, read unlocked as a hint
+pthread_mutex_t g_table_mu = PTHREAD_MUTEX_INITIALIZER;
+unsigned long g_dropped = 0;
+
+__thread long t_countdown __attribute__((tls_model("initial-exec"))) = 0;
+__thread bool t_seeded __attribute__((tls_model("initial-exec"))) = false;
+__thread uint64_t t_rng __attribute__((tls_model("initial-exec"))) = 0;
+__thread bool t_busy __attribute__((tls_model("initial-exec"))) = false;
+
+size_t slot_of(uint64_t addr) {
+    addr ^= addr >> 33;
+    addr *= 0xff51afd7ed558ccdULL;
+    addr ^= addr >> 33;
+    return static_cast<size_t>(addr) & (kTableSize - 1);
+}
+
+bool table_insert(uint64_t addr) {
+    pthread_mutex_lock(&g_table_mu);
+    bool ok = false;
+    for (size_t i = slot_of(addr), n = 0; n < kTableSize; i = (i + 1) & (kTableSize - 1), ++n) {
+        uint64_t cur = __atomic_load_n(&g_table[i], __ATOMIC_RELAXED);
+        if (cur == kEmpty || cur == kTombstone) {
+            __atomic_store_n(&g_table[i], addr, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&g_live, 1, __ATOMIC_RELAXED);
+            ok = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_table_mu);
+    return ok;
+}
+
+// Probes without the lock; only the thread freeing `addr` can remove it
+bool table_remove(uint64_t addr) {
+    for (size_t i = slot_of(addr), n = 0; n < kTableSize; i = (i + 1) & (kTableSize - 1), ++n) {
+        uint64_t cur = __atomic_load_n(&g_table[i], __ATOMIC_ACQUIRE);
+        if (cur == kEmpty) return false;
+        if (cur != addr) continue;
+        pthread_mutex_lock(&g_table_mu);
+        bool hit = __atomic_load_n(&g_table[i], __ATOMIC_RELAXED) == addr;
+        if (hit) {
+            __atomic_store_n(&g_table[i], kTombstone, __ATOMIC_RELEASE);
+            __atomic_sub_fetch(&g_live, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&g_table_mu);
+        return hit;
+    }
+    return false;
+}
+
+// One write per record, under PIPE_BUF, so records from different threads
+// never interleave.  A full pipe drops the record rather than stall the
+// program; the count is reported with the next one that fits.
+void emit(const void *data, size_t len) {
+    int fd = __atomic_load_n(&g_fd, __ATOMIC_RELAXED);
+    if (fd < 0) return;
+    unsigned long dropped = __atomic_exchange_n(&g_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        Record r = {kDropped, 0, 0, 0, dropped};
+        if (write(fd, &r, sizeof(r)) != static_cast<ssize_t>(sizeof(r))) {
+            __atomic_add_fetch(&g_dropped, dropped, __ATOMIC_RELAXED);
+        }
+    }
+    if (write(fd, data, len) != static_cast<ssize_t>(len)) {
+        __atomic_add_fetch(&g_dropped, 1, __ATOMIC_RELAXED);
+    }
+}
+
+double next_uniform() {
+    if (t_rng == 0) t_rng = (reinterpret_cast<uintptr_t>(&t_rng) * 0x9e3779b97f4a7c15ULL) | 1;
+    t_rng ^= t_rng << 13;
+    t_rng ^= t_rng >> 7;
+    t_rng ^= t_rng << 17;
+    return (static_cast<double>(t_rng >> 11) + 0.5) / 9007199254740992.0;  // (0, 1)
+}
+
+long next_countdown() { return static_cast<long>(-log(next_uniform()) * g_rate) + 1; }
+
+void record_alloc(void *ptr, size_t size) {
+    if (!ptr) return;
+    t_busy = true;
+    struct {
+        Record r;
+        uint64_t frames[kMaxDepth];
+    } msg;
+    void *stack[kMaxDepth + 8];
+    int n = backtrace(stack, kMaxDepth + 8);
+    int skip = 0;
+    while (skip < n && reinterpret_cast<uintptr_t>(stack[skip]) >= g_self_start &&
+           reinterpret_cast<uintptr_t>(stack[skip]) < g_self_end) {
+        ++skip;
+    }
+    uint32_t depth = 0;
+    for (int i = skip; i < n && depth < kMaxDepth; ++i) {
+        msg.frames[depth++] = reinterpret_cast<uintptr_t>(stack[i]);
+    }
+    // Unbiased: an allocation of s bytes is sampled with p = 1 - e^(-s/rate)
+    double s = static_cast<double>(size ? size : 1);
+    double p = 1.0 - exp(-s / g_rate);
+    msg.r = {kAlloc, depth, reinterpret_cast<uintptr_t>(ptr), size,
+             static_cast<uint64_t>(s / (p > 0 ? p : 1.0) + 0.5)};
+    if (table_insert(msg.r.addr)) emit(&msg, sizeof(Record) + depth * sizeof(uint64_t));
+    t_busy = false;
+}
+
+// Takes `ptr` out of the table; true when it was a sample the daemon holds
+bool unsample(void *ptr) {
+    if (!ptr || __atomic_load_n(&g_fd, __ATOMIC_RELAXED) < 0 ||
+        __atomic_load_n(&g_live, __ATOMIC_RELAXED) == 0) {
+        return false;
+    }
+    return table_remove(reinterpret_cast<uintptr_t>(ptr));
+}
+
+void report_free(void *ptr) {
+    Record r = {kFree, 0, reinterpret_cast<uintptr_t>(ptr), 0, 0};
+    emit(&r, sizeof(r));
+}
+
+void record_free(void *ptr) {
+    if (unsample(ptr)) report_free(ptr);
+}
+
+inline bool should_sample(size_t size) {
+    if (g_fd < 0 || t_busy) return false;
+    // A thread's first allocation is a random distance into its first
+    // interval, as in tcmalloc; starting at 0 would always sample it
+    if (!t_seeded) {
+        t_seeded = true;
+        t_countdown = next_countdown();
+    }
+    t_countdown -= static_cast<long>(size);
+    if (t_countdown > 0) return false;
+    t_countdown = next_countdown();
+    return true;
+}
+
+int find_self(dl_phdr_info *info, size_t, void *) {
+    auto here = reinterpret_cast<uintptr_t>(&find_self);
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const auto &ph = info->dlpi_phdr[i];
+        if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_X)) continue;
+        uintptr_t start = info->dlpi_addr + ph.p_vaddr;
+        if (here >= start && here < start + ph.p_memsz) {
+            g_self_start = start;
+            g_self_end = start + ph.p_memsz;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The table lock is held across fork(), so the child never inherits it
+// locked by a thread that does not exist there
+void before_fork() { pthread_mutex_lock(&g_table_mu); }
+
+void after_fork_parent() { pthread_mutex_unlock(&g_table_mu); }
+
+void after_fork_child() {
+    pthread_mutex_init(&g_table_mu, nullptr);
+    // The daemon tracks one process; a forked child's frees would retire
+    // the parent's samples
+    int fd = g_fd;
+    g_fd = -1;
+    __atomic_store_n(&g_live, 0, __ATOMIC_RELAXED);
+    if (fd >= 0) close(fd);
+}
+
+__attribute__((constructor)) void heapsampler_init() {
+    const char *fd_env = getenv("DEBUGLANTERN_HEAP_FD");
+    const char *rate_env = getenv("DEBUGLANTERN_HEAP_RATE");
+    const char *lib_env = getenv("DEBUGLANTERN_HEAP_LIB");
+    if (!fd_env) return;
+    int fd = atoi(fd_env);
+    if (rate_env && atol(rate_env) > 0) g_rate = static_cast<double>(atol(rate_env));
+    if (lib_env) {
+        debuglantern::unpreload(lib_env);
+        // The loader has mapped us; the memfd it came from can go
+        const char *slash = strrchr(lib_env, '/');
+        if (slash) close(atoi(slash + 1));
+    }
+    unsetenv("DEBUGLANTERN_HEAP_FD");
+    unsetenv("DEBUGLANTERN_HEAP_RATE");
+    unsetenv("DEBUGLANTERN_HEAP_LIB");
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    void *table = mmap(nullptr, kTableSize * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    g_table = static_cast<uint64_t *>(table);
+    dl_iterate_phdr(find_self, nullptr);
+    // backtrace() loads the unwinder, which allocates, on first use
+    void *warm[4];
+    t_busy = true;
+    backtrace(warm, 4);
+    t_busy = false;
+    pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+    __atomic_store_n(&g_fd, fd, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+extern "C" {
+
+void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    if (should_sample(size)) record_alloc(p, size);
+    return p;
+}
+
+void free(void *ptr) {
+    record_free(ptr);
+    __libc_free(ptr);
+}
+
+void *calloc(size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    if (p && should_sample(n * size)) record_alloc(p, n * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+    // Out of the table first, so the block cannot be handed out and sampled
+    // again while it is still listed
+    bool sampled = unsample(ptr);
+    void *p = __libc_realloc(ptr, size);
+    if (p || size == 0) {
+        if (sampled) report_free(ptr);
+    } else if (sampled) {
+        // Failed: `ptr` is still allocated, and still the daemon's sample
+        table_insert(reinterpret_cast<uintptr_t>(ptr));
+    }
+    if (p && should_sample(size)) record_alloc(p, size);
+    return p;
+}
+
+void *memalign(size_t align, size_t size) {
+    void *p = __libc_memalign(align, size);
+    if (should_sample(size)) record_alloc(p, size);
+    return p;
+}
+
+void *aligned_alloc(size_t align, size_t size) { return memalign(align, size); }
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0) return EINVAL;
+    void *p = memalign(align, size);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    void *p = __libc_valloc(size);
+    if (should_sample(size)) record_alloc(p, size);
+    return p;
+}
+
+void *pvalloc(size_t size) {
+    void *p = __libc_pvalloc(size);
+    if (should_sample(size)) record_alloc(p, size);
+    return p;
+}
+
+}  // extern "C"
+
+#endif  // __GLIBC__
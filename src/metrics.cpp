@@ -0,0 +1,486 @@
+#include "metrics.h"
+
+#include "common.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace debuglantern {
+
+namespace {
+
+constexpr size_t kFields = 8;
+const char *const kFieldNames[kFields] = {"time_ms", "cpu_ms",  "rss_kb", "read_bytes",
+                                          "write_bytes", "threads", "fds", "processes"};
+constexpr uint64_t kBlockSamples = 64;
+constexpr size_t kBlocks = 64;  // 4096 readings: 68 minutes at 1 Hz
+constexpr unsigned kRescanEvery = 5;
+constexpr size_t kMaxProcs = 256;
+
+void fields_of(const ResourceSample &s, int64_t out[kFields]) {
+    out[0] = s.time_ms;
+    out[1] = s.cpu_ms;
+    out[2] = s.rss_kb;
+    out[3] = s.read_bytes;
+    out[4] = s.write_bytes;
+    out[5] = s.threads;
+    out[6] = s.fds;
+    out[7] = s.processes;
+}
+
+void put_varint(std::string &out, int64_t v) {
+    auto z = (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    while (z >= 0x80) {
+        out += static_cast<char>((z & 0x7f) | 0x80);
+        z >>= 7;
+    }
+    out += static_cast<char>(z);
+}
+
+int64_t get_varint(const std::string &in, size_t &pos) {
+    uint64_t z = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        auto b = static_cast<uint8_t>(in[pos++]);
+        z |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+// Rereads a /proc file from the start; -1 once the process is gone.
+ssize_t reread(int fd, char *buf, size_t size) {
+    ssize_t n;
+    do {
+        n = pread(fd, buf, size - 1, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) buf[n] = '\0';
+    return n;
+}
+
+int64_t field_after(const char *text, const char *key) {
+    const char *at = strstr(text, key);
+    return at ? strtoll(at + strlen(key), nullptr, 10) : 0;
+}
+
+// Entries of an open /proc/<pid>/fd, less "." and ".."
+int64_t count_dir(int fd) {
+    if (lseek(fd, 0, SEEK_SET) < 0) return 0;
+    struct Dirent64 {
+        uint64_t ino;
+        int64_t off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+    alignas(8) char buf[4096];
+    int64_t count = 0;
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (long off = 0; off < n;) {
+            auto *d = reinterpret_cast<Dirent64 *>(buf + off);
+            if (d->name[0] != '.') ++count;
+            off += d->reclen;
+        }
+    }
+    return count;
+}
+
+// A small /proc file in one read; empty when it cannot be read
+std::string read_text(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return {};
+    char buf[4096];
+    ssize_t n = reread(fd, buf, sizeof(buf));
+    close(fd);
+    return n > 0 ? std::string(buf, static_cast<size_t>(n)) : std::string();
+}
+
+// The text after "key:" on its line, trimmed
+std::string line_value(const std::string &text, const char *key) {
+    size_t at = text.find(key);
+    if (at == std::string::npos) return {};
+    at = text.find(':', at);
+    if (at == std::string::npos) return {};
+    size_t begin = text.find_first_not_of(" \t", at + 1);
+    size_t end = text.find('\n', at);
+    if (begin == std::string::npos || begin >= end) return {};
+    return text.substr(begin, end - begin);
+}
+
+const char *policy_name(int policy) {
+    switch (policy) {
+    case 0: return "other";
+    case 1: return "fifo";
+    case 2: return "rr";
+    case 3: return "batch";
+    case 5: return "idle";
+    case 6: return "deadline";
+    default: return "unknown";
+    }
+}
+
+std::string format_percent(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f", v);
+    return buf;
+}
+
+}  // namespace
+
+std::vector<pid_t> process_tree(pid_t root) {
+    std::multimap<pid_t, pid_t> children;
+    DIR *dir = opendir("/proc");
+    while (dir) {
+        dirent *e = readdir(dir);
+        if (!e) break;
+        if (e->d_name[0] < '1' || e->d_name[0] > '9') continue;
+        std::ifstream in(std::string("/proc/") + e->d_name + "/stat");
+        std::string stat;
+        std::getline(in, stat);
+        size_t paren = stat.rfind(')');
+        if (paren == std::string::npos) continue;
+        char state = 0;
+        int ppid = 0;
+        if (sscanf(stat.c_str() + paren + 1, " %c %d", &state, &ppid) == 2) {
+            children.emplace(ppid, static_cast<pid_t>(atoi(e->d_name)));
+        }
+    }
+    if (dir) closedir(dir);
+
+    std::vector<pid_t> out;
+    std::deque<pid_t> queue{root};
+    while (!queue.empty()) {
+        pid_t p = queue.front();
+        queue.pop_front();
+        out.push_back(p);
+        auto range = children.equal_range(p);
+        for (auto it = range.first; it != range.second; ++it) queue.push_back(it->second);
+    }
+    return out;
+}
+
+std::vector<pid_t> list_threads(pid_t pid) {
+    std::vector<pid_t> tids;
+    DIR *dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (!dir) return tids;
+    while (dirent *e = readdir(dir)) {
+        if (e->d_name[0] != '.') tids.push_back(static_cast<pid_t>(atoi(e->d_name)));
+    }
+    closedir(dir);
+    std::sort(tids.begin(), tids.end());
+    return tids;
+}
+
+ResourceHistory::ResourceHistory(pid_t root) : root_(root), blocks_(kBlocks) {}
+
+ResourceHistory::~ResourceHistory() {
+    stop();
+}
+
+bool ResourceHistory::open_proc(pid_t pid, Proc &p) {
+    std::string dir = "/proc/" + std::to_string(pid) + "/";
+    p.pid = pid;
+    p.stat_fd = open((dir + "stat").c_str(), O_RDONLY | O_CLOEXEC);
+    if (p.stat_fd < 0) return false;
+    p.statm_fd = open((dir + "statm").c_str(), O_RDONLY | O_CLOEXEC);
+    // Without ptrace access to the process these two are refused; it still
+    // counts, with no I/O or descriptors
+    p.io_fd = open((dir + "io").c_str(), O_RDONLY | O_CLOEXEC);
+    p.fd_dir = open((dir + "fd").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return true;
+}
+
+void ResourceHistory::close_proc(Proc &p) {
+    for (int fd : {p.stat_fd, p.statm_fd, p.io_fd, p.fd_dir}) {
+        if (fd >= 0) close(fd);
+    }
+    p.stat_fd = p.statm_fd = p.io_fd = p.fd_dir = -1;
+}
+
+// Adds one process's reading to `out`.  False once it has exited: the open
+// files belong to that process, so a reused pid reads as gone too.
+bool ResourceHistory::read_proc(Proc &p, ResourceSample &out) {
+    static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    static const long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    char buf[1024];
+    if (reread(p.stat_fd, buf, sizeof(buf)) <= 0) return false;
+    const char *paren = strrchr(buf, ')');
+    unsigned long utime = 0, stime = 0;
+    long threads = 0;
+    if (!paren || sscanf(paren + 1,
+                         " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %ld",
+                         &utime, &stime, &threads) != 3) {
+        return false;
+    }
+    int64_t ticks = static_cast<int64_t>(utime + stime);
+    int64_t rchar = 0, wchar = 0;
+    if (p.io_fd >= 0 && reread(p.io_fd, buf, sizeof(buf)) > 0) {
+        rchar = field_after(buf, "rchar:");
+        wchar = field_after(buf, "wchar:");
+    }
+    if (p.statm_fd >= 0 && reread(p.statm_fd, buf, sizeof(buf)) > 0) {
+        long size = 0, resident = 0;
+        if (sscanf(buf, "%ld %ld", &size, &resident) == 2) out.rss_kb += resident * page_kb;
+    }
+    if (p.fd_dir >= 0) out.fds += count_dir(p.fd_dir);
+    out.threads += threads;
+    ++out.processes;
+
+    if (p.primed && ticks_per_sec > 0) {
+        out.cpu_ms += std::max<int64_t>(ticks - p.cpu_ticks, 0) * 1000 / ticks_per_sec;
+        out.read_bytes += std::max<int64_t>(rchar - p.rchar, 0);
+        out.write_bytes += std::max<int64_t>(wchar - p.wchar, 0);
+    }
+    p.primed = true;
+    p.cpu_ticks = ticks;
+    p.rchar = rchar;
+    p.wchar = wchar;
+    return true;
+}
+
+// Opens processes that joined the tree; the ones that left are noticed
+// when their files stop reading.
+void ResourceHistory::rescan() {
+    for (pid_t pid : process_tree(root_)) {
+        if (procs_.size() >= kMaxProcs) break;
+        bool known = false;
+        for (const auto &p : procs_) known = known || p.pid == pid;
+        if (known) continue;
+        Proc p;
+        if (open_proc(pid, p)) procs_.push_back(p);
+    }
+}
+
+bool ResourceHistory::sample() {
+    if (stopped_) return false;
+    if (readings_++ % kRescanEvery == 0) rescan();
+    ResourceSample s;
+    s.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+    for (size_t i = 0; i < procs_.size();) {
+        if (read_proc(procs_[i], s)) {
+            ++i;
+            continue;
+        }
+        close_proc(procs_[i]);
+        procs_.erase(procs_.begin() + static_cast<long>(i));
+    }
+    if (s.processes == 0) return false;
+    push(s);
+    latest_ = s;
+    return true;
+}
+
+void ResourceHistory::stop() {
+    for (auto &p : procs_) close_proc(p);
+    procs_.clear();
+    stopped_ = true;
+}
+
+void ResourceHistory::push(const ResourceSample &s) {
+    Block &b = blocks_[(next_ / kBlockSamples) % kBlocks];
+    if (next_ % kBlockSamples == 0) {
+        // Overwrites the oldest block; a block starts from absolute values
+        b.first = next_;
+        b.count = 0;
+        b.bytes.clear();
+        std::memset(last_, 0, sizeof(last_));
+    }
+    int64_t v[kFields];
+    fields_of(s, v);
+    for (size_t i = 0; i < kFields; ++i) {
+        put_varint(b.bytes, v[i] - last_[i]);
+        last_[i] = v[i];
+    }
+    ++b.count;
+    ++next_;
+}
+
+std::string ResourceHistory::json(uint64_t since) const {
+    uint64_t capacity = kBlockSamples * kBlocks;
+    uint64_t first = 0;
+    if (next_ > capacity) first = ((next_ - 1) / kBlockSamples - (kBlocks - 1)) * kBlockSamples;
+    since = std::max(since, first);
+
+    std::string out = json_kv("first", static_cast<long long>(first)) + "," +
+                      json_kv("next", static_cast<long long>(next_)) + ",\"fields\":[";
+    for (size_t i = 0; i < kFields; ++i) {
+        if (i) out += ',';
+        out += std::string("\"") + kFieldNames[i] + "\"";
+    }
+    out += "],\"samples\":[";
+    bool any = false;
+    for (uint64_t start = since - since % kBlockSamples; start < next_; start += kBlockSamples) {
+        const Block &b = blocks_[(start / kBlockSamples) % kBlocks];
+        int64_t v[kFields] = {};
+        size_t pos = 0;
+        for (uint32_t k = 0; k < b.count; ++k) {
+            for (size_t i = 0; i < kFields; ++i) v[i] += get_varint(b.bytes, pos);
+            if (b.first + k < since) continue;
+            out += any ? ",[" : "[";
+            for (size_t i = 0; i < kFields; ++i) {
+                if (i) out += ',';
+                out += std::to_string(v[i]);
+            }
+            out += ']';
+            any = true;
+        }
+    }
+    out += "]";
+    return out;
+}
+
+bool ThreadSampler::start(pid_t pid) {
+    pid_ = pid;
+    started_ = std::chrono::steady_clock::now();
+    first_ = read_all();
+    return !first_.empty();
+}
+
+std::vector<ThreadSampler::Reading> ThreadSampler::read_all() {
+    std::vector<Reading> out;
+    for (pid_t proc : process_tree(pid_)) {
+        for (pid_t tid : list_threads(proc)) {
+            if (out.size() >= kMaxProcs) {
+                truncated_ = true;
+                return out;
+            }
+            std::string dir = "/proc/" + std::to_string(proc) + "/task/" + std::to_string(tid) + "/";
+            std::string stat = read_text(dir + "stat");
+            size_t paren = stat.rfind(')');
+            size_t open_paren = stat.find('(');
+            if (paren == std::string::npos || open_paren == std::string::npos) continue;
+            Reading r;
+            r.pid = proc;
+            r.tid = tid;
+            r.comm = stat.substr(open_paren + 1, paren - open_paren - 1);
+            // Fields 3 (state) to 41 (policy) of proc(5)
+            long long f[42] = {};
+            std::istringstream in(stat.substr(paren + 1));
+            std::string state;
+            in >> state;
+            for (int i = 4; i <= 41 && in >> f[i]; ++i) {
+            }
+            r.state = state.empty() ? '?' : state[0];
+            r.user_ticks = f[14];
+            r.system_ticks = f[15];
+            r.nice = static_cast<int>(f[19]);
+            r.start_time = f[22];
+            r.cpu = static_cast<int>(f[39]);
+            r.rt_priority = static_cast<int>(f[40]);
+            r.policy = static_cast<int>(f[41]);
+
+            std::string status = read_text(dir + "status");
+            r.voluntary = atoll(line_value(status, "voluntary_ctxt_switches").c_str());
+            r.involuntary = atoll(line_value(status, "nonvoluntary_ctxt_switches").c_str());
+            r.cpus_allowed = line_value(status, "Cpus_allowed_list");
+            std::string schedstat = read_text(dir + "schedstat");
+            sscanf(schedstat.c_str(), "%lld %lld %lld", &r.run_ns, &r.wait_ns, &r.timeslices);
+            std::string sched = read_text(dir + "sched");
+            std::string migrations = line_value(sched, "se.nr_migrations");
+            if (!migrations.empty()) r.migrations = atoll(migrations.c_str());
+            out.push_back(std::move(r));
+        }
+    }
+    return out;
+}
+
+std::string ThreadSampler::finish_json() {
+    std::vector<Reading> second = read_all();
+    auto elapsed = std::chrono::steady_clock::now() - started_;
+    auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    long long tick_ms = ticks_per_sec > 0 ? 1000 / ticks_per_sec : 10;
+
+    struct Row {
+        const Reading *now;
+        Reading delta;  // counters over the interval
+        bool fresh;
+        bool migrated;
+    };
+    std::vector<Row> rows;
+    size_t matched = 0;
+    for (const Reading &r : second) {
+        const Reading *before = nullptr;
+        for (const Reading &f : first_) {
+            if (f.tid == r.tid && f.start_time == r.start_time) {
+                before = &f;
+                break;
+            }
+        }
+        Row row{&r, r, before == nullptr, false};
+        if (before) {
+            ++matched;
+            row.delta.user_ticks -= before->user_ticks;
+            row.delta.system_ticks -= before->system_ticks;
+            row.delta.voluntary -= before->voluntary;
+            row.delta.involuntary -= before->involuntary;
+            row.delta.run_ns -= before->run_ns;
+            row.delta.wait_ns -= before->wait_ns;
+            row.delta.timeslices -= before->timeslices;
+            row.delta.migrations = r.migrations >= 0 && before->migrations >= 0
+                                       ? r.migrations - before->migrations
+                                       : -1;
+            row.migrated = before->cpu != r.cpu;
+        }
+        rows.push_back(std::move(row));
+    }
+    // Busiest threads first
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return a.delta.run_ns > b.delta.run_ns;
+    });
+
+    std::string out = "{" + json_kv("pid", static_cast<long long>(pid_));
+    out += "," + json_kv("duration_ms", static_cast<long long>(duration_ms));
+    out += "," + json_kv("exited", static_cast<long long>(first_.size() - matched));
+    if (truncated_) out += "," + json_kv("truncated", true);
+    out += ",\"threads\":[";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Reading &r = *rows[i].now;
+        const Reading &d = rows[i].delta;
+        std::string wchan = read_text("/proc/" + std::to_string(r.pid) + "/task/" +
+                                      std::to_string(r.tid) + "/wchan");
+        if (wchan == "0") wchan.clear();
+        double cpu_percent = duration_ms > 0 ? d.run_ns / 1e4 / static_cast<double>(duration_ms) : 0;
+        if (i) out += ",";
+        out += "{" + json_kv("pid", static_cast<long long>(r.pid)) + "," +
+               json_kv("tid", static_cast<long long>(r.tid)) + "," + json_kv("comm", r.comm, true) +
+               "," + json_kv("state", std::string(1, r.state), true) + "," +
+               json_kv("wchan", wchan, true) + "," + json_kv("cpu", static_cast<long long>(r.cpu)) +
+               "," + json_kv("migrated", rows[i].migrated) + "," +
+               json_kv("cpus_allowed", r.cpus_allowed, true) + "," +
+               json_kv("policy", policy_name(r.policy), true) + "," +
+               json_kv("rt_priority", static_cast<long long>(r.rt_priority)) + "," +
+               json_kv("nice", static_cast<long long>(r.nice)) + "," +
+               json_kv("user_ms", d.user_ticks * tick_ms) + "," +
+               json_kv("system_ms", d.system_ticks * tick_ms) + "," +
+               json_kv("run_us", d.run_ns / 1000) + "," +
+               json_kv("cpu_percent", format_percent(cpu_percent), false) + "," +
+               json_kv("runqueue_us", d.wait_ns / 1000) + "," +
+               json_kv("timeslices", d.timeslices) + "," + json_kv("voluntary", d.voluntary) +
+               "," + json_kv("involuntary", d.involuntary);
+        if (d.migrations >= 0) out += "," + json_kv("migrations", d.migrations);
+        if (rows[i].fresh) out += "," + json_kv("new", true);
+        out += "}";
+    }
+    out += "]}";
+    first_.clear();
+    return out;
+}
+
+}  // namespace debuglantern
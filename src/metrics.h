@@ -0,0 +1,136 @@
+#ifndef DEBUGLANTERN_METRICS_H
+#define DEBUGLANTERN_METRICS_H
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace debuglantern {
+
+// `root` and every process descended from it, parents first.
+std::vector<pid_t> process_tree(pid_t root);
+// The thread ids of a process, ascending.
+std::vector<pid_t> list_threads(pid_t pid);
+
+// One reading of a session's process tree.  Counters (CPU, I/O) are what
+// was used since the previous reading; the rest are levels.
+struct ResourceSample {
+    int64_t time_ms = 0;   // wall clock
+    int64_t cpu_ms = 0;    // user + system CPU time, all threads
+    int64_t rss_kb = 0;
+    int64_t read_bytes = 0;   // through read(2) and friends (rchar)
+    int64_t write_bytes = 0;  // (wchar)
+    int64_t threads = 0;
+    int64_t fds = 0;
+    int64_t processes = 0;
+};
+
+// Resource use of one run of a session over time, read from /proc.  The
+// files of every process in the tree stay open between readings and are
+// reread with pread(), so a reading costs a few syscalls per process;
+// children are looked for every few readings.  Readings go into a
+// fixed-size ring of delta-encoded blocks holding about an hour at 1 Hz.
+class ResourceHistory {
+public:
+    explicit ResourceHistory(pid_t root);
+    ~ResourceHistory();
+    ResourceHistory(const ResourceHistory &) = delete;
+    ResourceHistory &operator=(const ResourceHistory &) = delete;
+
+    // Takes a reading; false, having taken none, once the tree is gone.
+    bool sample();
+    // The run ended: closes the /proc files, keeps the history.
+    void stop();
+    // The last reading taken.
+    const ResourceSample &latest() const { return latest_; }
+
+    // "first":F,"next":N,"fields":[...],"samples":[[...],...] (no braces)
+    // for readings numbered `since` onwards; pass the reply's "next" to
+    // get only newer ones.
+    std::string json(uint64_t since) const;
+
+private:
+    struct Proc {
+        pid_t pid = 0;
+        int stat_fd = -1;
+        int statm_fd = -1;
+        int io_fd = -1;
+        int fd_dir = -1;
+        bool primed = false;  // the counters below hold a previous reading
+        int64_t cpu_ticks = 0;
+        int64_t rchar = 0;
+        int64_t wchar = 0;
+    };
+    struct Block {
+        uint64_t first = 0;  // number of its first reading
+        uint32_t count = 0;
+        std::string bytes;   // zigzag varints: the first reading, then deltas
+    };
+
+    bool open_proc(pid_t pid, Proc &p);
+    void close_proc(Proc &p);
+    bool read_proc(Proc &p, ResourceSample &out);
+    void rescan();
+    void push(const ResourceSample &s);
+
+    pid_t root_;
+    bool stopped_ = false;
+    unsigned readings_ = 0;
+    std::vector<Proc> procs_;
+    std::vector<Block> blocks_;  // ring, by reading number / block size
+    int64_t last_[8] = {};       // previous reading's fields, for deltas
+    uint64_t next_ = 0;
+    ResourceSample latest_;
+};
+
+// THREADS: how each thread of a process tree was scheduled over an
+// interval.  Two readings of /proc/<pid>/task/<tid>/{stat,status,schedstat}
+// give CPU time, context switches and run-queue delay (time runnable but
+// waiting for a CPU) as deltas, plus where each thread last ran.
+class ThreadSampler {
+public:
+    // First reading.  False when the process is gone.
+    bool start(pid_t pid);
+
+    // Second reading: {"pid","duration_ms","exited","threads":[{"pid","tid",
+    // "comm","state","wchan","cpu","migrated","policy","run_us",
+    // "runqueue_us","voluntary","involuntary",...}]}, busiest first.
+    // Threads that started in between count from their start ("new":true).
+    std::string finish_json();
+
+private:
+    struct Reading {
+        pid_t pid = 0;
+        pid_t tid = 0;
+        std::string comm;
+        char state = '?';
+        long long start_time = 0;  // ticks after boot; tells a reused tid apart
+        int cpu = -1;
+        int policy = 0;
+        int rt_priority = 0;
+        int nice = 0;
+        long long user_ticks = 0;
+        long long system_ticks = 0;
+        long long voluntary = 0;
+        long long involuntary = 0;
+        long long run_ns = 0;  // schedstat
+        long long wait_ns = 0;
+        long long timeslices = 0;
+        long long migrations = -1;  // from sched, on kernels that have it
+        std::string cpus_allowed;
+    };
+
+    std::vector<Reading> read_all();
+
+    pid_t pid_ = 0;
+    bool truncated_ = false;
+    std::vector<Reading> first_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_METRICS_H
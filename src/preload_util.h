@@ -0,0 +1,41 @@
+#ifndef DEBUGLANTERN_PRELOAD_UTIL_H
+#define DEBUGLANTERN_PRELOAD_UTIL_H
+
+// Shared by the libraries the daemon preloads into sessions (heapsampler.cpp,
+// startgate.cpp).  Internal linkage, so two of them loaded into one program
+// do not interpose on each other.
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace debuglantern {
+
+// Drops `entry` from the colon/space separated LD_PRELOAD, so programs this
+// one starts do not try to load a /proc/self/fd path they lack
+static inline void unpreload(const char *entry) {
+    const char *cur = getenv("LD_PRELOAD");
+    if (!cur) return;
+    char buf[4096];
+    size_t len = 0;
+    const char *p = cur;
+    while (*p) {
+        size_t n = strcspn(p, ": ");
+        if (n && !(strlen(entry) == n && strncmp(p, entry, n) == 0) && len + n + 1 < sizeof(buf)) {
+            if (len) buf[len++] = ':';
+            memcpy(buf + len, p, n);
+            len += n;
+        }
+        p += n;
+        if (*p) ++p;
+    }
+    buf[len] = '\0';
+    if (len) {
+        setenv("LD_PRELOAD", buf, 1);
+    } else {
+        unsetenv("LD_PRELOAD");
+    }
+}
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_PRELOAD_UTIL_H
@@ -0,0 +1,55 @@
+#include "prewarm.h"
+
+#include "common.h"
+
+#include <elf.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace debuglantern {
+
+namespace {
+
+template <class Ehdr, class Phdr>
+bool has_interp(int fd) {
+    Ehdr eh;
+    if (pread(fd, &eh, sizeof(eh), 0) != static_cast<ssize_t>(sizeof(eh))) return false;
+    if (eh.e_phentsize != sizeof(Phdr) || eh.e_phnum == 0) return false;
+    std::vector<Phdr> ph(eh.e_phnum);
+    size_t len = ph.size() * sizeof(Phdr);
+    if (pread(fd, ph.data(), len, static_cast<off_t>(eh.e_phoff)) != static_cast<ssize_t>(len))
+        return false;
+    for (const auto &p : ph) {
+        if (p.p_type == PT_INTERP) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+int start_gate_memfd() {
+    static int fd = sealed_memfd("libdebuglantern_gate.so", kStartGateLib, kStartGateLibSize);
+    return fd;
+}
+
+bool elf_is_dynamic(int fd) {
+    unsigned char ident[EI_NIDENT];
+    if (pread(fd, ident, sizeof(ident), 0) != static_cast<ssize_t>(sizeof(ident)) ||
+        memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        return false;
+    }
+    if (ident[EI_CLASS] == ELFCLASS64) return has_interp<Elf64_Ehdr, Elf64_Phdr>(fd);
+    if (ident[EI_CLASS] == ELFCLASS32) return has_interp<Elf32_Ehdr, Elf32_Phdr>(fd);
+    return false;
+}
+
+void add_gate_env(std::vector<std::string> &env, int lib_fd, int ready_fd, int gate_fd) {
+    std::string lib = "/proc/self/fd/" + std::to_string(lib_fd);
+    prepend_preload(env, lib);
+    env.push_back("DEBUGLANTERN_GATE_READY_FD=" + std::to_string(ready_fd));
+    env.push_back("DEBUGLANTERN_GATE_FD=" + std::to_string(gate_fd));
+    env.push_back("DEBUGLANTERN_GATE_LIB=" + lib);
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,37 @@
+#ifndef DEBUGLANTERN_PREWARM_H
+#define DEBUGLANTERN_PREWARM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace debuglantern {
+
+// libdebuglantern_gate.so (startgate.cpp), embedded at build time
+extern const unsigned char kStartGateLib[];
+extern const size_t kStartGateLibSize;
+
+// A sealed, close-on-exec memfd holding the start gate, created on first
+// use and shared by every prepared instance after; -1 when it cannot be made.
+int start_gate_memfd();
+
+// What the gate writes on the ready pipe once the program is parked before
+// main.  CLOCK_MONOTONIC, so comparable with std::chrono::steady_clock.
+struct GateReport {
+    uint64_t start_ns;  // __libc_start_main entered: dynamic loading done
+    uint64_t main_ns;   // constructors run: parked before main
+};
+
+// Whether the ELF file behind `fd` names a program interpreter (PT_INTERP).
+// Only dynamically linked programs load the gate; a static one would run
+// straight through to main.
+bool elf_is_dynamic(int fd);
+
+// Adds what the gate reads from the environment: itself in LD_PRELOAD,
+// ahead of any the session sets, and the two pipe ends it talks on.
+void add_gate_env(std::vector<std::string> &env, int lib_fd, int ready_fd, int gate_fd);
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_PREWARM_H
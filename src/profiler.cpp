@@ -0,0 +1,529 @@
+#include "profiler.h"
+
+#include "flamegraph.h"
+#include "symbolizer.h"
+
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace debuglantern {
+
+namespace {
+
+constexpr size_t kRingDataPages = 64;  // per CPU; must be a power of two
+constexpr int kPollIntervalMs = 100;
+
+// /proc/kallsyms, loaded on first use.  Addresses read as zero unless
+// kptr_restrict allows them, in which case frames stay "[kernel]".
+class KernelSymbols {
+public:
+    std::string symbolize(uint64_t addr) {
+        if (!loaded_) load();
+        auto it = std::upper_bound(syms_.begin(), syms_.end(), addr,
+                                   [](uint64_t a, const auto &s) { return a < s.first; });
+        if (it == syms_.begin()) return "[kernel]";
+        return std::prev(it)->second;
+    }
+
+private:
+    void load() {
+        loaded_ = true;
+        std::ifstream in("/proc/kallsyms");
+        std::string line;
+        while (std::getline(in, line)) {
+            unsigned long long addr = 0;
+            char type = 0;
+            char name[256];
+            if (sscanf(line.c_str(), "%llx %c %255s", &addr, &type, name) != 3) continue;
+            if (addr == 0 || (type != 't' && type != 'T' && type != 'w' && type != 'W')) continue;
+            syms_.emplace_back(addr, name);
+        }
+        std::sort(syms_.begin(), syms_.end());
+    }
+
+    bool loaded_ = false;
+    std::vector<std::pair<uint64_t, std::string>> syms_;
+};
+
+// ---------------------------------------------------------------------------
+// Sampling
+// ---------------------------------------------------------------------------
+
+long perf_event_open(perf_event_attr *attr, pid_t pid, int cpu, int group, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group, flags);
+}
+
+std::vector<int> online_cpus() {
+    std::vector<int> cpus;
+    std::ifstream in("/sys/devices/system/cpu/online");
+    std::string list;
+    std::getline(in, list);
+    std::istringstream ss(list);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        int lo = 0, hi = 0;
+        int n = sscanf(part.c_str(), "%d-%d", &lo, &hi);
+        if (n == 1) hi = lo;
+        for (int c = lo; n >= 1 && c <= hi; ++c) cpus.push_back(c);
+    }
+    if (cpus.empty()) {
+        for (long c = 0; c < sysconf(_SC_NPROCESSORS_ONLN); ++c) cpus.push_back(static_cast<int>(c));
+    }
+    return cpus;
+}
+
+std::vector<pid_t> list_threads(pid_t pid) {
+    std::vector<pid_t> tids;
+    DIR *dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (!dir) return tids;
+    while (dirent *e = readdir(dir)) {
+        if (e->d_name[0] != '.') tids.push_back(static_cast<pid_t>(atoi(e->d_name)));
+    }
+    closedir(dir);
+    return tids;
+}
+
+struct StackHash {
+    size_t operator()(const std::vector<uint64_t> &v) const {
+        uint64_t h = 1469598103934665603ULL;
+        for (uint64_t x : v) {
+            h ^= x;
+            h *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+// One mmap'd sample ring per CPU and event kind.  `fd` owns the mapping;
+// the events of the other threads on that CPU write into it through
+// SET_OUTPUT.
+struct Ring {
+    int fd = -1;
+    char *base = nullptr;
+    size_t map_size = 0;
+    std::vector<int> members;
+    bool switches = false;  // context-switch samples and records
+};
+
+// What a stack key's third word says about it
+constexpr uint64_t kOnCpu = 0;
+constexpr uint64_t kOffCpu = 1;
+constexpr uint64_t kAsleep = 2;  // blocked before recording began; [pid, tid, kAsleep, tid]
+
+constexpr uint32_t kSwitchIn = ~uint32_t(0);
+
+// A thread leaving the CPU with stack `stack`, or coming back (kSwitchIn)
+struct Switch {
+    uint64_t time;  // CLOCK_MONOTONIC ns
+    uint32_t tid;
+    uint32_t stack;
+};
+
+// Raw stacks are keyed by [pid, tid, kind, callchain...] with the kernel's
+// context markers left in, and symbolized once per distinct address at the
+// end.  tid is 0 unless stacks are kept per thread.  Off-CPU switches are
+// matched up once every ring is drained, since a thread may leave on one
+// CPU and come back on another.
+struct Collector {
+    std::unordered_map<std::vector<uint64_t>, long long, StackHash> raw;  // key -> weight
+    std::map<pid_t, AddressSpace> procs;
+    SampleStats stats;
+    SampleMode mode = SampleMode::cpu;
+    long long cpu_weight = 1;  // per cpu-clock sample: 1, or its microseconds
+
+    std::unordered_map<std::vector<uint64_t>, uint32_t, StackHash> stack_ids;
+    std::vector<const std::vector<uint64_t> *> stacks;
+    std::vector<Switch> switches;
+    std::unordered_map<pid_t, std::string> comms;   // per-thread mode
+    std::unordered_map<pid_t, std::string> asleep;  // tid -> wait channel at start
+};
+
+std::string read_line(const std::string &path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+std::string thread_file(pid_t pid, pid_t tid, const char *name) {
+    return "/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) + "/" + name;
+}
+
+uint32_t stack_id(Collector &c, const std::vector<uint64_t> &key) {
+    auto it = c.stack_ids.find(key);
+    if (it == c.stack_ids.end()) {
+        it = c.stack_ids.emplace(key, static_cast<uint32_t>(c.stacks.size())).first;
+        c.stacks.push_back(&it->first);
+    }
+    return it->second;
+}
+
+void copy_from_ring(const char *data, size_t size, uint64_t pos, void *dst, size_t len) {
+    size_t off = static_cast<size_t>(pos & (size - 1));
+    size_t first = std::min(len, size - off);
+    memcpy(dst, data + off, first);
+    memcpy(static_cast<char *>(dst) + first, data, len - first);
+}
+
+void record_sample(const std::vector<char> &rec, bool switched, Collector &c,
+                   std::vector<uint64_t> &key) {
+    // PERF_SAMPLE_IP | PERF_SAMPLE_TID [| PERF_SAMPLE_TIME] | PERF_SAMPLE_CALLCHAIN:
+    // u64 ip; u32 pid, tid; [u64 time;] u64 nr; u64 ips[nr]
+    size_t pos = sizeof(perf_event_header);
+    size_t fixed = switched ? 32 : 24;
+    if (rec.size() < pos + fixed) return;
+    uint64_t ip, nr, time = 0;
+    uint32_t pid, tid;
+    memcpy(&ip, rec.data() + pos, 8);
+    memcpy(&pid, rec.data() + pos + 8, 4);
+    memcpy(&tid, rec.data() + pos + 12, 4);
+    if (switched) memcpy(&time, rec.data() + pos + 16, 8);
+    memcpy(&nr, rec.data() + pos + fixed - 8, 8);
+    pos += fixed;
+    if (nr > (rec.size() - pos) / 8) return;
+
+    bool per_thread = c.mode == SampleMode::both;
+    key.assign({pid, per_thread ? tid : 0, switched ? kOffCpu : kOnCpu});
+    if (nr == 0) {
+        key.push_back(ip);
+    } else {
+        size_t at = key.size();
+        key.resize(at + nr);
+        memcpy(key.data() + at, rec.data() + pos, nr * 8);
+    }
+    if (switched) {
+        c.switches.push_back(Switch{time, tid, stack_id(c, key)});
+    } else {
+        c.raw[key] += c.cpu_weight;
+    }
+    ++c.stats.samples;
+    if (c.procs.find(pid) == c.procs.end()) c.procs[pid].load(pid);
+    if (per_thread && c.comms.find(tid) == c.comms.end()) {
+        c.comms[tid] = read_line(thread_file(pid, tid, "comm"));
+    }
+}
+
+void drain_ring(Ring &ring, size_t page, Collector &c) {
+    auto *meta = reinterpret_cast<perf_event_mmap_page *>(ring.base);
+    const char *data = ring.base + page;
+    size_t size = ring.map_size - page;
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+    std::vector<char> rec;
+    std::vector<uint64_t> key;
+    while (tail + sizeof(perf_event_header) <= head) {
+        perf_event_header hdr;
+        copy_from_ring(data, size, tail, &hdr, sizeof(hdr));
+        if (hdr.size < sizeof(hdr) || tail + hdr.size > head) break;
+        rec.resize(hdr.size);
+        copy_from_ring(data, size, tail, rec.data(), hdr.size);
+        if (hdr.type == PERF_RECORD_SAMPLE) {
+            record_sample(rec, ring.switches, c, key);
+        } else if (hdr.type == PERF_RECORD_SWITCH && !(hdr.misc & PERF_RECORD_MISC_SWITCH_OUT) &&
+                   hdr.size >= sizeof(hdr) + 16) {
+            // sample_id_all trailer: u32 pid, tid; u64 time
+            uint32_t tid;
+            uint64_t time;
+            memcpy(&tid, rec.data() + hdr.size - 12, 4);
+            memcpy(&time, rec.data() + hdr.size - 8, 8);
+            c.switches.push_back(Switch{time, tid, kSwitchIn});
+        } else if (hdr.type == PERF_RECORD_LOST && hdr.size >= sizeof(hdr) + 16) {
+            uint64_t lost;
+            memcpy(&lost, rec.data() + sizeof(hdr) + 8, 8);
+            c.stats.lost += static_cast<long long>(lost);
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+// Charges each switch-out stack with the time until its thread ran again,
+// or until `end` for threads still blocked.  Threads asleep at `start`
+// count from there.
+void settle_switches(Collector &c, pid_t pid, uint64_t start, uint64_t end) {
+    struct Pending {
+        uint64_t since;
+        uint32_t stack;
+    };
+    std::unordered_map<uint32_t, Pending> blocked;
+    bool per_thread = c.mode == SampleMode::both;
+    for (const auto &kv : c.asleep) {
+        auto tid = static_cast<uint64_t>(kv.first);
+        uint32_t id = stack_id(c, {static_cast<uint64_t>(pid), per_thread ? tid : 0, kAsleep, tid});
+        blocked[static_cast<uint32_t>(kv.first)] = Pending{start, id};
+    }
+    std::stable_sort(c.switches.begin(), c.switches.end(),
+                     [](const Switch &a, const Switch &b) { return a.time < b.time; });
+    auto charge = [&](const Pending &p, uint64_t until) {
+        if (until > p.since) c.raw[*c.stacks[p.stack]] += static_cast<long long>((until - p.since) / 1000);
+    };
+    for (const auto &sw : c.switches) {
+        if (sw.stack != kSwitchIn) {
+            blocked[sw.tid] = Pending{sw.time, sw.stack};
+            continue;
+        }
+        auto it = blocked.find(sw.tid);
+        if (it == blocked.end()) continue;
+        charge(it->second, sw.time);
+        blocked.erase(it);
+    }
+    for (const auto &kv : blocked) charge(kv.second, end);
+    c.switches.clear();
+}
+
+// Resolves each distinct address once and adds the chains to `graph`.
+void fold_stacks(Collector &c, FlameGraph &graph) {
+    KernelSymbols kernel;
+    std::map<pid_t, std::unordered_map<uint64_t, uint32_t>> user_frames;
+    std::unordered_map<uint64_t, uint32_t> kernel_frames;
+    std::unordered_map<pid_t, uint32_t> threads;
+    std::vector<uint32_t> frames;
+    uint32_t unknown = graph.intern("[unknown]");
+    bool per_thread = c.mode == SampleMode::both;
+    uint32_t on_cpu = per_thread ? graph.intern("[on-cpu]") : 0;
+    uint32_t off_cpu = per_thread ? graph.intern("[off-cpu]") : 0;
+
+    for (const auto &kv : c.raw) {
+        const auto &chain = kv.first;
+        pid_t pid = static_cast<pid_t>(chain[0]);
+        auto proc = c.procs.find(pid);
+        auto &ids = user_frames[pid];
+        frames.clear();
+        if (chain[2] == kAsleep) {
+            auto tid = static_cast<pid_t>(chain[3]);
+            frames.push_back(graph.intern("[asleep in " + c.asleep[tid] + "]"));
+        }
+        bool in_kernel = false;
+        bool leaf = true;
+        for (size_t i = 3; i < chain.size() && chain[2] != kAsleep; ++i) {
+            uint64_t addr = chain[i];
+            if (addr >= static_cast<uint64_t>(PERF_CONTEXT_MAX)) {
+                in_kernel = addr == static_cast<uint64_t>(PERF_CONTEXT_KERNEL);
+                leaf = true;
+                continue;
+            }
+            // Callers are return addresses; step back into the call itself
+            if (!leaf) --addr;
+            leaf = false;
+            auto &cache = in_kernel ? kernel_frames : ids;
+            auto it = cache.find(addr);
+            if (it == cache.end()) {
+                uint32_t id = in_kernel ? graph.intern(kernel.symbolize(addr))
+                            : proc != c.procs.end() ? graph.intern(proc->second.symbolize(addr))
+                            : unknown;
+                it = cache.emplace(addr, id).first;
+            }
+            frames.push_back(it->second);
+        }
+        // Chains are leaf-first; the graph wants root-first
+        if (frames.empty()) frames.push_back(unknown);
+        if (per_thread) {
+            auto tid = static_cast<pid_t>(chain[1]);
+            auto t = threads.find(tid);
+            if (t == threads.end()) {
+                std::string comm = c.comms[tid];
+                t = threads.emplace(tid, graph.intern(comm + " (" + std::to_string(tid) + ")")).first;
+            }
+            frames.push_back(chain[2] == kOnCpu ? on_cpu : off_cpu);
+            frames.push_back(t->second);
+        }
+        std::reverse(frames.begin(), frames.end());
+        graph.add(frames.data(), frames.size(), kv.second);
+    }
+}
+
+uint64_t monotonic_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+}  // namespace
+
+bool sample_stacks(pid_t pid, const SampleOptions &opts, const std::function<bool()> &keep_going,
+                   FlameGraph &graph, SampleStats &stats, std::string &error) {
+    bool timed = opts.mode != SampleMode::cpu;
+    perf_event_attr cpu_attr{};
+    cpu_attr.size = sizeof(cpu_attr);
+    // cpu-clock is a software event, so boards without a PMU driver work
+    cpu_attr.type = PERF_TYPE_SOFTWARE;
+    cpu_attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    if (timed) {
+        // A fixed period, so every sample stands for the same CPU time
+        cpu_attr.sample_period = 1000000000ULL / static_cast<uint64_t>(opts.frequency);
+    } else {
+        cpu_attr.freq = 1;
+        cpu_attr.sample_freq = static_cast<uint64_t>(opts.frequency);
+    }
+    cpu_attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    cpu_attr.disabled = 1;
+    cpu_attr.inherit = 1;
+    cpu_attr.exclude_hv = 1;
+
+    // Every switch away from the CPU, taken in the kernel as it happens,
+    // plus PERF_RECORD_SWITCH records stamped with the same clock
+    perf_event_attr switch_attr{};
+    switch_attr.size = sizeof(switch_attr);
+    switch_attr.type = PERF_TYPE_SOFTWARE;
+    switch_attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+    switch_attr.sample_period = 1;
+    switch_attr.sample_type =
+        PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+    switch_attr.context_switch = 1;
+    switch_attr.sample_id_all = 1;
+    switch_attr.use_clockid = 1;
+    switch_attr.clockid = CLOCK_MONOTONIC;
+    switch_attr.disabled = 1;
+    switch_attr.inherit = 1;
+    switch_attr.exclude_hv = 1;
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t map_size = (kRingDataPages + 1) * page;
+    std::vector<Ring> rings;
+    auto close_rings = [&]() {
+        for (auto &r : rings) {
+            for (int fd : r.members) close(fd);
+            munmap(r.base, r.map_size);
+            close(r.fd);
+        }
+        rings.clear();
+    };
+    auto open_event = [&](perf_event_attr &attr, pid_t tid, int cpu) {
+        int fd = static_cast<int>(perf_event_open(&attr, tid, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+        // Kernel stacks need a laxer perf_event_paranoid; keep user stacks.
+        // Switch samples are all taken in the kernel, so they cannot.
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && !attr.exclude_kernel &&
+            attr.config == PERF_COUNT_SW_CPU_CLOCK) {
+            attr.exclude_kernel = 1;
+            fd = static_cast<int>(perf_event_open(&attr, tid, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+        return fd;
+    };
+
+    // Events are per thread and CPU: inherit only follows threads created
+    // after the event is opened, so every existing thread needs its own.
+    std::vector<pid_t> tids = list_threads(pid);
+    if (tids.empty()) tids.push_back(pid);
+    auto open_rings = [&](perf_event_attr &attr, bool switched) {
+        for (int cpu : online_cpus()) {
+            Ring ring;
+            ring.switches = switched;
+            for (pid_t tid : tids) {
+                int fd = open_event(attr, tid, cpu);
+                if (fd < 0) {
+                    if (errno == ENODEV) break;                // CPU went offline
+                    if (errno == ESRCH && tid != pid) continue;  // thread exited
+                    error = errno == ESRCH ? "process exited"
+                          : switched && (errno == EACCES || errno == EPERM)
+                              ? "off-CPU profiling needs perf_event_paranoid <= 1 or CAP_PERFMON"
+                              : std::string("perf_event_open: ") + strerror(errno);
+                    if (ring.fd >= 0) rings.push_back(std::move(ring));
+                    return false;
+                }
+                if (ring.fd < 0) {
+                    void *base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (base == MAP_FAILED) {
+                        error = std::string("perf mmap: ") + strerror(errno);
+                        close(fd);
+                        return false;
+                    }
+                    ring.fd = fd;
+                    ring.base = static_cast<char *>(base);
+                    ring.map_size = map_size;
+                } else {
+                    ring.members.push_back(fd);
+                    if (ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, ring.fd) != 0) {
+                        error = std::string("perf set-output: ") + strerror(errno);
+                        rings.push_back(std::move(ring));
+                        return false;
+                    }
+                }
+            }
+            if (ring.fd >= 0) rings.push_back(std::move(ring));
+        }
+        return true;
+    };
+    if ((opts.mode != SampleMode::offcpu && !open_rings(cpu_attr, false)) ||
+        (timed && !open_rings(switch_attr, true))) {
+        close_rings();
+        return false;
+    }
+    if (rings.empty()) {
+        error = "perf_event_open: no online CPUs";
+        return false;
+    }
+
+    Collector c;
+    c.mode = opts.mode;
+    if (timed) {
+        graph.set_unit("us");
+        c.cpu_weight = 1000000 / opts.frequency;
+        // Threads already blocked would otherwise not show until they wake
+        for (pid_t tid : tids) {
+            std::string stat = read_line(thread_file(pid, tid, "stat"));
+            size_t paren = stat.rfind(')');
+            char state = paren != std::string::npos && paren + 2 < stat.size() ? stat[paren + 2] : 0;
+            if (state != 'S' && state != 'D') continue;
+            std::string wchan = read_line(thread_file(pid, tid, "wchan"));
+            c.asleep[tid] = !wchan.empty() && wchan != "0" ? wchan
+                          : state == 'D'                   ? "disk sleep"
+                                                           : "sleep";
+        }
+        if (opts.mode == SampleMode::both) {
+            for (pid_t tid : tids) c.comms[tid] = read_line(thread_file(pid, tid, "comm"));
+        }
+    }
+    c.procs[pid].load(pid);
+    std::vector<pollfd> pfds;
+    uint64_t start = monotonic_ns();
+    for (auto &r : rings) {
+        ioctl(r.fd, PERF_EVENT_IOC_ENABLE, 0);
+        for (int fd : r.members) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        pfds.push_back({r.fd, POLLIN, 0});
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(opts.duration_sec);
+    while (std::chrono::steady_clock::now() < deadline && keep_going()) {
+        if (poll(pfds.data(), pfds.size(), kPollIntervalMs) < 0 && errno != EINTR) break;
+        for (auto &r : rings) drain_ring(r, page, c);
+        if (kill(pid, 0) != 0 && errno == ESRCH) break;
+    }
+    for (auto &r : rings) {
+        ioctl(r.fd, PERF_EVENT_IOC_DISABLE, 0);
+        for (int fd : r.members) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    uint64_t end = monotonic_ns();
+    for (auto &r : rings) drain_ring(r, page, c);
+    close_rings();
+    if (timed) settle_switches(c, pid, start, end);
+
+    // Reread maps of processes still alive to catch libraries loaded late
+    for (auto &kv : c.procs) {
+        AddressSpace fresh;
+        if (fresh.load(kv.first)) kv.second = std::move(fresh);
+    }
+    fold_stacks(c, graph);
+    stats = c.stats;
+    return true;
+}
+
+}  // namespace debuglantern
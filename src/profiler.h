@@ -0,0 +1,49 @@
+#ifndef DEBUGLANTERN_PROFILER_H
+#define DEBUGLANTERN_PROFILER_H
+
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+
+namespace debuglantern {
+
+class FlameGraph;
+
+enum class SampleMode {
+    cpu,     // on-CPU stacks, counted in samples
+    offcpu,  // blocked stacks, weighted by microseconds until the thread ran again
+    both,    // on- and off-CPU time per thread, in microseconds
+};
+
+struct SampleOptions {
+    int duration_sec = 5;
+    int frequency = 99;  // Hz, per thread, for on-CPU samples
+    SampleMode mode = SampleMode::cpu;
+};
+
+struct SampleStats {
+    long long samples = 0;
+    long long lost = 0;  // dropped by the kernel when a ring filled up
+};
+
+// Samples every thread of `pid`, and processes it forks while sampling, with
+// perf_event_open.  Stacks are walked by the kernel through frame pointers,
+// symbolized in-process and merged into `graph`.
+//
+// Off-CPU stacks come from the context-switch software event, taken as a
+// thread leaves the CPU, and the kernel's switch records say when it came
+// back; threads already asleep when recording starts are charged from the
+// start under their wait channel.  Those samples are taken in the kernel,
+// so off-CPU modes need perf_event_paranoid <= 1 (or CAP_PERFMON).
+//
+// `keep_going` is polled a few times a second; returning false ends the
+// recording early.  Returns false with `error` set, having recorded nothing,
+// when the kernel refuses the events (no perf support, or
+// perf_event_paranoid too strict for this user).
+bool sample_stacks(pid_t pid, const SampleOptions &opts, const std::function<bool()> &keep_going,
+                   FlameGraph &graph, SampleStats &stats, std::string &error);
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_PROFILER_H
@@ -0,0 +1,116 @@
+#include "spawn.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+namespace debuglantern {
+
+namespace {
+
+// The child's stack.  execvpe() and fexecve() build paths on it, so it is
+// well over PATH_MAX; it only lives until the child has exec'd.
+constexpr size_t kChildStack = 256 * 1024;
+
+struct ChildArgs {
+    const SpawnOptions *opts;
+    sigset_t mask;             // the caller's, restored in the child
+    volatile int exec_errno;   // written by the child, read after it execs
+};
+
+int child_main(void *arg) {
+    auto *ca = static_cast<ChildArgs *>(arg);
+    const SpawnOptions &o = *ca->opts;
+
+    // Dispositions survive exec only when ignored (the daemon ignores
+    // SIGPIPE); handlers are reset by exec itself
+    struct sigaction dfl {};
+    dfl.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < NSIG; ++sig) {
+        struct sigaction cur {};
+        if (sigaction(sig, nullptr, &cur) == 0 && cur.sa_handler == SIG_IGN) {
+            sigaction(sig, &dfl, nullptr);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &ca->mask, nullptr);
+
+    if (o.stdio_fd >= 0 && o.terminal) {
+        setsid();
+        ioctl(o.stdio_fd, TIOCSCTTY, 0);
+        dup2(o.stdio_fd, STDIN_FILENO);
+    } else if (o.new_group) {
+        setpgid(0, 0);
+    }
+    if (o.stdio_fd >= 0) {
+        dup2(o.stdio_fd, STDOUT_FILENO);
+        dup2(o.stdio_fd, STDERR_FILENO);
+    }
+    for (int fd : o.keep_fds) {
+        fcntl(fd, F_SETFD, 0);
+    }
+    if (o.allow_ptrace) {
+        prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+    }
+
+    if (!o.cwd || chdir(o.cwd) == 0) {
+        if (o.exec_fd >= 0) {
+            fexecve(o.exec_fd, o.argv, o.envp);
+        } else if (o.search_path) {
+            execvpe(o.path, o.argv, o.envp);
+        } else {
+            execve(o.path, o.argv, o.envp);
+        }
+    }
+    ca->exec_errno = errno ? errno : ENOEXEC;
+    _exit(127);
+}
+
+}  // namespace
+
+Spawned spawn_process(const SpawnOptions &opts) {
+    Spawned out;
+    void *stack = mmap(nullptr, kChildStack, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        return out;
+    }
+
+    // No signal handler may run in the child on memory it shares with us
+    ChildArgs ca{&opts, {}, 0};
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &ca.mask);
+
+    void *top = static_cast<char *>(stack) + kChildStack;
+    int pidfd = -1;
+    pid_t pid = clone(child_main, top, CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD, &ca,
+                      &pidfd);
+    if (pid < 0 && errno == EINVAL) {
+        // Before 5.2: no CLONE_PIDFD; the caller falls back to pidfd_open()
+        pidfd = -1;
+        pid = clone(child_main, top, CLONE_VM | CLONE_VFORK | SIGCHLD, &ca);
+    }
+    int saved = errno;
+
+    pthread_sigmask(SIG_SETMASK, &ca.mask, nullptr);
+    munmap(stack, kChildStack);
+    if (pid < 0) {
+        errno = saved;
+        return out;
+    }
+    out.pid = pid;
+    out.pidfd = pidfd;
+    out.exec_errno = ca.exec_errno;
+    return out;
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,51 @@
+#ifndef DEBUGLANTERN_SPAWN_H
+#define DEBUGLANTERN_SPAWN_H
+
+#include <sys/types.h>
+
+#include <vector>
+
+namespace debuglantern {
+
+// What to run and how to set the child up.  Everything is built by the
+// caller beforehand: the child shares the caller's memory until it execs,
+// so it only makes system calls and never allocates.
+struct SpawnOptions {
+    const char *path = nullptr;   // execve() this, or look it up like execvp
+    bool search_path = false;     //   when this is set
+    int exec_fd = -1;             // fexecve() this instead of `path`
+    char *const *argv = nullptr;  // null-terminated
+    char *const *envp = nullptr;  // null-terminated
+    const char *cwd = nullptr;    // chdir() here first, if set
+
+    // stdout and stderr (and stdin, for a terminal), if >= 0
+    int stdio_fd = -1;
+    // `stdio_fd` is a terminal: start a new session with it as the
+    // controlling terminal.  Otherwise `new_group` puts the child in a
+    // process group of its own.
+    bool terminal = false;
+    bool new_group = true;
+    // Descriptors to pass down (their close-on-exec flag is cleared)
+    std::vector<int> keep_fds;
+    // Let any process of the user ptrace it (gdbserver --attach, profilers)
+    bool allow_ptrace = true;
+};
+
+struct Spawned {
+    pid_t pid = -1;     // -1 with errno set when the child could not be created
+    int pidfd = -1;     // close-on-exec; -1 on kernels before 5.2
+    int exec_errno = 0; // set when the child failed to exec and exited 127
+};
+
+// Starts a process the way posix_spawn() does: clone() with CLONE_VM and
+// CLONE_VFORK, so nothing of the caller's address space or page tables is
+// copied however large it is, and the caller resumes once the child has
+// exec'd (or failed to).  The pidfd comes from CLONE_PIDFD with the child,
+// so there is no window in which the pid could be reaped and reused before
+// it is watched.  Signals ignored by the caller are reset to their default
+// in the child, and its signal mask is the caller's.
+Spawned spawn_process(const SpawnOptions &opts);
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_SPAWN_H
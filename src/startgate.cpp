@@ -0,0 +1,93 @@
+// Start gate, preloaded into instances made ready by PREPARE.  The daemon
+// embeds this library and hands it to the dynamic loader through a memfd
+// in LD_PRELOAD, like the heap sampler.
+//
+// It interposes __libc_start_main, which _start calls once the loader has
+// mapped and relocated everything, and hands glibc a main of its own.  That
+// runs after the program's constructors, right where main would: it tells
+// the daemon how far it got (DEBUGLANTERN_GATE_READY_FD) and blocks reading
+// DEBUGLANTERN_GATE_FD until START releases it with one byte, then calls
+// the real main.  Times are CLOCK_MONOTONIC, the daemon's steady clock.
+//
+// Only dynamically linked glibc programs come through here.
+
+#include "preload_util.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" char **environ;
+
+namespace {
+
+// Matches GateReport on the daemon side (prewarm.h)
+struct Report {
+    uint64_t start_ns;  // __libc_start_main entered: the loader is done
+    uint64_t main_ns;   // constructors done: parked before main
+};
+
+using MainFn = int (*)(int, char **, char **);
+using StartMainFn = int (*)(MainFn, int, char **, void (*)(), void (*)(), void (*)(), void *);
+
+MainFn g_main = nullptr;
+uint64_t g_start_ns = 0;
+
+uint64_t now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+int env_fd(const char *name) {
+    const char *v = getenv(name);
+    return v ? atoi(v) : -1;
+}
+
+int gated_main(int argc, char **argv, char ** /*envp*/) {
+    Report r{g_start_ns, now_ns()};
+    int ready = env_fd("DEBUGLANTERN_GATE_READY_FD");
+    int gate = env_fd("DEBUGLANTERN_GATE_FD");
+    const char *lib = getenv("DEBUGLANTERN_GATE_LIB");
+    if (lib) {
+        debuglantern::unpreload(lib);
+        const char *slash = strrchr(lib, '/');
+        if (slash) close(atoi(slash + 1));
+    }
+    unsetenv("DEBUGLANTERN_GATE_READY_FD");
+    unsetenv("DEBUGLANTERN_GATE_FD");
+    unsetenv("DEBUGLANTERN_GATE_LIB");
+
+    if (ready >= 0 && gate >= 0) {
+        ssize_t n;
+        do {
+            n = write(ready, &r, sizeof(r));
+        } while (n < 0 && errno == EINTR);
+        char c;
+        do {
+            n = read(gate, &c, 1);
+        } while (n < 0 && errno == EINTR);
+        // Anything but the release byte means the daemon gave up on us
+        if (n != 1) _exit(0);
+    }
+    if (ready >= 0) close(ready);
+    if (gate >= 0) close(gate);
+    // unsetenv() may have moved the environment
+    return g_main(argc, argv, environ);
+}
+
+}  // namespace
+
+extern "C" int __libc_start_main(MainFn main, int argc, char **argv, void (*init)(),
+                                 void (*fini)(), void (*rtld_fini)(), void *stack_end) {
+    g_start_ns = now_ns();
+    auto real = reinterpret_cast<StartMainFn>(dlsym(RTLD_NEXT, "__libc_start_main"));
+    if (!real) _exit(127);
+    g_main = main;
+    return real(gated_main, argc, argv, init, fini, rtld_fini, stack_end);
+}
@@ -0,0 +1,421 @@
+#include "symbolizer.h"
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace debuglantern {
+
+// Function symbols of one ELF file: a sorted address table whose names
+// live in a single pool, so large binaries stay compact in the cache.
+class SymbolTable {
+public:
+    struct Load {
+        uint64_t offset = 0;
+        uint64_t vaddr = 0;
+        uint64_t filesz = 0;
+    };
+    struct Symbol {
+        uint64_t addr = 0;
+        uint64_t size = 0;
+        uint32_t name = 0;  // offset into names
+    };
+
+    std::vector<Load> loads;
+    std::vector<Symbol> symbols;
+    std::string names;
+    bool has_symtab = false;  // false for stripped files (.dynsym only)
+    std::string debuglink;    // .gnu_debuglink file name, if any
+
+    void add(uint64_t addr, uint64_t size, const char *name, size_t len) {
+        symbols.push_back({addr, size, static_cast<uint32_t>(names.size())});
+        names.append(name, len);
+        names += '\0';
+    }
+
+    // Folds in the symbols of a separate debug file for the same build.
+    void merge(const SymbolTable &debug) {
+        auto base = static_cast<uint32_t>(names.size());
+        names += debug.names;
+        for (const auto &s : debug.symbols) symbols.push_back({s.addr, s.size, s.name + base});
+    }
+
+    // .symtab and .dynsym overlap; keep one entry per address
+    void finish() {
+        std::stable_sort(symbols.begin(), symbols.end(),
+                         [](const Symbol &a, const Symbol &b) { return a.addr < b.addr; });
+        symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                                  [](const Symbol &a, const Symbol &b) { return a.addr == b.addr; }),
+                      symbols.end());
+        symbols.shrink_to_fit();
+    }
+
+    // Mangled name of the function containing `offset` in the file.
+    const char *lookup(uint64_t offset) const {
+        uint64_t vaddr = 0;
+        bool mapped = false;
+        for (const auto &l : loads) {
+            if (offset >= l.offset && offset < l.offset + l.filesz) {
+                vaddr = offset - l.offset + l.vaddr;
+                mapped = true;
+                break;
+            }
+        }
+        if (!mapped) return nullptr;
+        auto it = std::upper_bound(symbols.begin(), symbols.end(), vaddr,
+                                   [](uint64_t a, const Symbol &s) { return a < s.addr; });
+        if (it == symbols.begin()) return nullptr;
+        --it;
+        if (it->size && vaddr >= it->addr + it->size) return nullptr;
+        return names.c_str() + it->name;
+    }
+};
+
+namespace {
+
+constexpr size_t kMaxCachedTables = 64;
+constexpr size_t kMaxNoteBytes = 64 * 1024;
+
+// ---------------------------------------------------------------------------
+// ELF parsing
+// ---------------------------------------------------------------------------
+
+template <class Ehdr, class Phdr>
+std::string read_build_id(int fd) {
+    Ehdr eh;
+    if (pread(fd, &eh, sizeof(eh), 0) != static_cast<ssize_t>(sizeof(eh))) return "";
+    if (eh.e_phentsize != sizeof(Phdr) || eh.e_phnum == 0) return "";
+    std::vector<Phdr> ph(eh.e_phnum);
+    size_t len = ph.size() * sizeof(Phdr);
+    if (pread(fd, ph.data(), len, static_cast<off_t>(eh.e_phoff)) != static_cast<ssize_t>(len))
+        return "";
+
+    for (const auto &p : ph) {
+        if (p.p_type != PT_NOTE || p.p_filesz == 0 || p.p_filesz > kMaxNoteBytes) continue;
+        std::string notes(p.p_filesz, '\0');
+        if (pread(fd, notes.data(), notes.size(), static_cast<off_t>(p.p_offset)) !=
+            static_cast<ssize_t>(notes.size())) {
+            continue;
+        }
+        size_t align = p.p_align == 8 ? 8 : 4;
+        auto pad = [align](size_t n) { return (n + align - 1) & ~(align - 1); };
+        size_t pos = 0;
+        while (pos + 12 <= notes.size()) {
+            uint32_t namesz, descsz, type;
+            memcpy(&namesz, notes.data() + pos, 4);
+            memcpy(&descsz, notes.data() + pos + 4, 4);
+            memcpy(&type, notes.data() + pos + 8, 4);
+            size_t name_at = pos + 12;
+            size_t desc_at = name_at + pad(namesz);
+            if (desc_at + descsz > notes.size()) break;
+            if (type == NT_GNU_BUILD_ID && namesz == 4 &&
+                memcmp(notes.data() + name_at, "GNU", 4) == 0) {
+                static const char *hex = "0123456789abcdef";
+                std::string id;
+                for (size_t i = 0; i < descsz; ++i) {
+                    auto b = static_cast<unsigned char>(notes[desc_at + i]);
+                    id += hex[b >> 4];
+                    id += hex[b & 0xf];
+                }
+                return id;
+            }
+            pos = desc_at + pad(descsz);
+        }
+    }
+    return "";
+}
+
+template <class Ehdr, class Phdr, class Shdr, class Sym>
+void read_elf_tables(const unsigned char *base, size_t size, SymbolTable &t) {
+    if (size < sizeof(Ehdr)) return;
+    const auto *eh = reinterpret_cast<const Ehdr *>(base);
+
+    if (eh->e_phoff && eh->e_phentsize == sizeof(Phdr) &&
+        eh->e_phoff + uint64_t(eh->e_phnum) * sizeof(Phdr) <= size) {
+        const auto *ph = reinterpret_cast<const Phdr *>(base + eh->e_phoff);
+        for (unsigned i = 0; i < eh->e_phnum; ++i) {
+            if (ph[i].p_type == PT_LOAD)
+                t.loads.push_back({ph[i].p_offset, ph[i].p_vaddr, ph[i].p_filesz});
+        }
+    }
+
+    if (!eh->e_shoff || eh->e_shentsize != sizeof(Shdr) ||
+        eh->e_shoff + uint64_t(eh->e_shnum) * sizeof(Shdr) > size) {
+        return;
+    }
+    const auto *sh = reinterpret_cast<const Shdr *>(base + eh->e_shoff);
+    const Shdr *shstr = eh->e_shstrndx < eh->e_shnum ? &sh[eh->e_shstrndx] : nullptr;
+    if (shstr && shstr->sh_offset + shstr->sh_size > size) shstr = nullptr;
+
+    for (unsigned i = 0; i < eh->e_shnum; ++i) {
+        const Shdr &s = sh[i];
+        if (s.sh_type == SHT_PROGBITS && shstr && s.sh_name < shstr->sh_size &&
+            s.sh_offset + s.sh_size <= size) {
+            const char *name = reinterpret_cast<const char *>(base + shstr->sh_offset + s.sh_name);
+            if (strncmp(name, ".gnu_debuglink", shstr->sh_size - s.sh_name) == 0) {
+                const char *link = reinterpret_cast<const char *>(base + s.sh_offset);
+                t.debuglink.assign(link, strnlen(link, s.sh_size));
+            }
+            continue;
+        }
+        if ((s.sh_type != SHT_SYMTAB && s.sh_type != SHT_DYNSYM) || s.sh_link >= eh->e_shnum ||
+            s.sh_entsize != sizeof(Sym) || s.sh_offset + s.sh_size > size) {
+            continue;
+        }
+        const Shdr &str = sh[s.sh_link];
+        if (str.sh_offset + str.sh_size > size) continue;
+        if (s.sh_type == SHT_SYMTAB) t.has_symtab = true;
+        const char *strtab = reinterpret_cast<const char *>(base + str.sh_offset);
+        const auto *syms = reinterpret_cast<const Sym *>(base + s.sh_offset);
+        size_t count = s.sh_size / sizeof(Sym);
+        for (size_t k = 0; k < count; ++k) {
+            const Sym &sym = syms[k];
+            int type = ELF64_ST_TYPE(sym.st_info);
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_value == 0 ||
+                sym.st_shndx == SHN_UNDEF || sym.st_name >= str.sh_size) {
+                continue;
+            }
+            const char *name = strtab + sym.st_name;
+            size_t len = strnlen(name, str.sh_size - sym.st_name);
+            if (len) t.add(sym.st_value, sym.st_size, name, len);
+        }
+    }
+}
+
+bool parse_elf(int fd, SymbolTable &t) {
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < EI_NIDENT) return false;
+    size_t size = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return false;
+    const auto *b = static_cast<const unsigned char *>(map);
+    bool ok = memcmp(b, ELFMAG, SELFMAG) == 0;
+    if (ok && b[EI_CLASS] == ELFCLASS64)
+        read_elf_tables<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym>(b, size, t);
+    else if (ok && b[EI_CLASS] == ELFCLASS32)
+        read_elf_tables<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Sym>(b, size, t);
+    munmap(map, size);
+    return ok;
+}
+
+std::string dir_name(const std::string &path) {
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+// Where gdb looks for separate debug info: by build-id, then by
+// .gnu_debuglink next to the binary.
+std::vector<std::string> debug_file_candidates(const std::string &build_id,
+                                               const std::string &path,
+                                               const std::string &debuglink) {
+    std::vector<std::string> out;
+    if (build_id.size() > 2) {
+        out.push_back("/usr/lib/debug/.build-id/" + build_id.substr(0, 2) + "/" +
+                      build_id.substr(2) + ".debug");
+    }
+    std::string dir = dir_name(path);
+    if (!debuglink.empty() && debuglink.find('/') == std::string::npos && !dir.empty()) {
+        out.push_back(dir + "/" + debuglink);
+        out.push_back(dir + "/.debug/" + debuglink);
+        out.push_back("/usr/lib/debug" + dir + "/" + debuglink);
+    }
+    return out;
+}
+
+std::shared_ptr<const SymbolTable> build_table(int fd, const std::string &build_id,
+                                               const std::string &path) {
+    auto t = std::make_shared<SymbolTable>();
+    if (!parse_elf(fd, *t)) return nullptr;
+    if (!t->has_symtab) {
+        for (const auto &candidate : debug_file_candidates(build_id, path, t->debuglink)) {
+            int dfd = open(candidate.c_str(), O_RDONLY | O_CLOEXEC);
+            if (dfd < 0) continue;
+            // A debuglink match must come from the same build
+            bool same = build_id.empty() || elf_build_id(dfd) == build_id;
+            SymbolTable debug;
+            if (same && parse_elf(dfd, debug) && debug.has_symtab) {
+                t->merge(debug);
+                close(dfd);
+                break;
+            }
+            close(dfd);
+        }
+    }
+    t->finish();
+    return t;
+}
+
+// ---------------------------------------------------------------------------
+// Shared cache
+// ---------------------------------------------------------------------------
+
+struct CachedTable {
+    std::shared_ptr<const SymbolTable> table;
+    uint64_t last_used = 0;
+};
+
+struct TableCache {
+    std::mutex mu;
+    std::map<std::string, CachedTable> tables;
+    uint64_t clock = 0;
+};
+
+TableCache &table_cache() {
+    static TableCache cache;
+    return cache;
+}
+
+// Files without a build-id are keyed by identity and version instead.
+std::string table_key(int fd, const std::string &build_id) {
+    if (!build_id.empty()) return "build-id:" + build_id;
+    struct stat st{};
+    if (fstat(fd, &st) != 0) return "";
+    return "inode:" + std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev)) +
+           ":" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" +
+           std::to_string(st.st_mtime);
+}
+
+std::shared_ptr<const SymbolTable> table_for_fd(int fd, const std::string &path) {
+    std::string build_id = elf_build_id(fd);
+    std::string key = table_key(fd, build_id);
+    if (key.empty()) return nullptr;
+
+    TableCache &cache = table_cache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mu);
+        auto it = cache.tables.find(key);
+        if (it != cache.tables.end()) {
+            it->second.last_used = ++cache.clock;
+            return it->second.table;
+        }
+    }
+
+    // Parse unlocked; a concurrent miss on the same file just parses twice
+    auto table = build_table(fd, build_id, path);
+    if (!table) return nullptr;
+    std::lock_guard<std::mutex> lock(cache.mu);
+    auto &slot = cache.tables[key];
+    if (!slot.table) slot.table = table;
+    slot.last_used = ++cache.clock;
+    while (cache.tables.size() > kMaxCachedTables) {
+        auto oldest = cache.tables.begin();
+        for (auto it = cache.tables.begin(); it != cache.tables.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) oldest = it;
+        }
+        cache.tables.erase(oldest);
+    }
+    return slot.table;
+}
+
+std::string demangle(const char *name) {
+    if (strncmp(name, "_Z", 2) != 0) return name;
+    int status = 0;
+    char *out = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0 || !out) return name;
+    std::string s(out);
+    free(out);
+    return s;
+}
+
+std::string base_name(const std::string &path) {
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+std::string elf_build_id(int fd) {
+    unsigned char ident[EI_NIDENT];
+    if (pread(fd, ident, sizeof(ident), 0) != static_cast<ssize_t>(sizeof(ident)) ||
+        memcmp(ident, ELFMAG, SELFMAG) != 0) {
+        return "";
+    }
+    if (ident[EI_CLASS] == ELFCLASS64) return read_build_id<Elf64_Ehdr, Elf64_Phdr>(fd);
+    if (ident[EI_CLASS] == ELFCLASS32) return read_build_id<Elf32_Ehdr, Elf32_Phdr>(fd);
+    return "";
+}
+
+void preload_symbols(int fd, const std::string &path) {
+    std::thread([fd, path]() {
+        table_for_fd(fd, path);
+        close(fd);
+    }).detach();
+}
+
+bool AddressSpace::load(pid_t pid) {
+    std::string proc = "/proc/" + std::to_string(pid);
+    std::ifstream in(proc + "/maps");
+    if (!in) return false;
+    std::vector<Mapping> maps;
+    std::map<std::string, std::shared_ptr<const SymbolTable>> files;  // by dev:inode
+    std::string line;
+    while (std::getline(in, line)) {
+        unsigned long long start, end, offset, inode;
+        unsigned dev_major, dev_minor;
+        char perms[5] = {};
+        int path_pos = 0;
+        if (sscanf(line.c_str(), "%llx-%llx %4s %llx %x:%x %llu %n", &start, &end, perms, &offset,
+                   &dev_major, &dev_minor, &inode, &path_pos) < 7) {
+            continue;
+        }
+        if (perms[2] != 'x') continue;
+        Mapping m;
+        m.start = start;
+        m.end = end;
+        m.offset = offset;
+        if (path_pos > 0 && static_cast<size_t>(path_pos) < line.size())
+            m.path = line.substr(path_pos);
+        if (!m.path.empty() && m.path[0] != '[') {
+            std::string file = std::to_string(dev_major) + ":" + std::to_string(dev_minor) + ":" +
+                               std::to_string(inode);
+            auto it = files.find(file);
+            if (it == files.end()) {
+                // map_files reaches memfd and deleted binaries too
+                std::string range = line.substr(0, line.find(' '));
+                int fd = open((proc + "/map_files/" + range).c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0 && m.path[0] == '/') fd = open(m.path.c_str(), O_RDONLY | O_CLOEXEC);
+                std::shared_ptr<const SymbolTable> table;
+                if (fd >= 0) {
+                    table = table_for_fd(fd, m.path[0] == '/' ? m.path : "");
+                    close(fd);
+                }
+                it = files.emplace(file, table).first;
+            }
+            m.table = it->second;
+        }
+        maps.push_back(std::move(m));
+    }
+    std::sort(maps.begin(), maps.end(),
+              [](const Mapping &a, const Mapping &b) { return a.start < b.start; });
+    maps_ = std::move(maps);
+    return true;
+}
+
+std::string AddressSpace::symbolize(uint64_t addr) const {
+    auto it = std::upper_bound(maps_.begin(), maps_.end(), addr,
+                               [](uint64_t a, const Mapping &m) { return a < m.start; });
+    if (it == maps_.begin()) return "[unknown]";
+    --it;
+    if (addr >= it->end) return "[unknown]";
+    if (it->table) {
+        if (const char *name = it->table->lookup(addr - it->start + it->offset))
+            return demangle(name);
+    }
+    if (it->path.empty()) return "[unknown]";
+    return it->path[0] == '[' ? it->path : "[" + base_name(it->path) + "]";
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,51 @@
+#ifndef DEBUGLANTERN_SYMBOLIZER_H
+#define DEBUGLANTERN_SYMBOLIZER_H
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace debuglantern {
+
+class SymbolTable;
+
+// GNU build-id of the ELF file behind `fd`, as lowercase hex; "" when the
+// file has none or is not ELF.  Reads only the headers and notes.
+std::string elf_build_id(int fd);
+
+// Indexes the symbols of the ELF file behind `fd` into the shared cache
+// on a background thread, so the first profile of a session does not pay
+// for it.  `path` locates separate debug files next to the binary and may
+// be empty (memfd).  Takes ownership of `fd`.
+void preload_symbols(int fd, const std::string &path);
+
+// Executable mappings of one process, read from /proc/<pid>/maps, with the
+// symbol table of every mapped file.  Tables come from a process-wide cache
+// keyed by build-id (device and inode for files without one), so a binary
+// is parsed once no matter how many sessions or profiles map it.
+class AddressSpace {
+public:
+    bool load(pid_t pid);
+
+    // Demangled function name for `addr`, "[file]" for an address in a
+    // mapping without a matching symbol, or "[unknown]".
+    std::string symbolize(uint64_t addr) const;
+
+private:
+    struct Mapping {
+        uint64_t start = 0;
+        uint64_t end = 0;
+        uint64_t offset = 0;
+        std::string path;
+        std::shared_ptr<const SymbolTable> table;
+    };
+
+    std::vector<Mapping> maps_;  // sorted by start
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_SYMBOLIZER_H
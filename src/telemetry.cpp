@@ -0,0 +1,332 @@
+#include "telemetry.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace debuglantern {
+
+namespace {
+
+// Control commands with a histogram of their own; the rest share "other"
+const char *const kCommands[] = {
+    "UPLOAD", "LIST",   "DEPS",  "OUTPUT",    "STATUS", "ARGS",     "ENV",      "ENVDEL",
+    "ENVLIST", "START", "STOP",  "KILL",      "DEBUG",  "DELETE",   "ATTACH",   "TAIL",
+    "OUTPUTRAW", "RESIZE", "ACTIVITY", "COUNTERS", "THREADS", "METRICS", "HEAP", "STATS",
+    "TRACE",   "PREPARE", "other",
+};
+constexpr size_t kCommandCount = sizeof(kCommands) / sizeof(kCommands[0]);
+
+// Prometheus bucket bounds: powers of two microseconds, 16 us to about 1 s.
+// They fall on LatencyHistogram bucket edges, so the counts are exact.
+constexpr int kFirstBoundLog2 = 4;
+constexpr int kLastBoundLog2 = 20;
+
+const char *const kStates[] = {"loaded", "running", "debugging", "stopped"};
+
+uint64_t ns_of(std::chrono::steady_clock::duration d) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+}
+
+std::string format_seconds(uint64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", static_cast<double>(ns) / 1e9);
+    return buf;
+}
+
+void header(std::string &out, const char *name, const char *type, const char *help) {
+    out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+std::string format_us_as_seconds(uint64_t us) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", static_cast<double>(us) / 1e6);
+    return buf;
+}
+
+void histogram_lines(std::string &out, const char *name, const std::string &labels,
+                     const LatencyHistogram &h) {
+    std::string open = labels.empty() ? "{" : "{" + labels + ",";
+    std::string plain = labels.empty() ? "" : "{" + labels + "}";
+    // Read the total first: buckets only grow, so none exceeds it
+    uint64_t total = h.count();
+    uint64_t sum = h.sum_ns();
+    for (int k = kFirstBoundLog2; k <= kLastBoundLog2; ++k) {
+        uint64_t below = std::min(h.count_below(uint64_t{1} << k), total);
+        out += std::string(name) + "_bucket" + open + "le=\"" +
+               format_us_as_seconds(uint64_t{1} << k) + "\"} " + std::to_string(below) + "\n";
+    }
+    out += std::string(name) + "_bucket" + open + "le=\"+Inf\"} " + std::to_string(total) + "\n";
+    out += std::string(name) + "_sum" + plain + " " + format_seconds(sum) + "\n";
+    out += std::string(name) + "_count" + plain + " " + std::to_string(total) + "\n";
+}
+
+}  // namespace
+
+size_t LatencyHistogram::bucket_of(uint64_t us) {
+    if (us < 8) return static_cast<size_t>(us);
+    int exp = 63 - __builtin_clzll(us);  // 3 or more
+    size_t bucket = static_cast<size_t>(exp - 2) * 8 + ((us >> (exp - 3)) & 7);
+    return std::min(bucket, kBuckets - 1);
+}
+
+uint64_t LatencyHistogram::bucket_top(size_t bucket) {
+    if (bucket < 8) return bucket;
+    int exp = static_cast<int>(bucket / 8) + 2;
+    uint64_t width = uint64_t{1} << (exp - 3);
+    return (8 + bucket % 8) * width + width - 1;
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration took) {
+    uint64_t ns = ns_of(took);
+    uint64_t us = ns / 1000;
+    buckets_[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    // A single writer, so no compare-and-swap
+    if (us > max_us_.load(std::memory_order_relaxed)) max_us_.store(us, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile_us(double q) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(total) + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        seen += buckets_[b].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(bucket_top(b), max_us());
+    }
+    return max_us();
+}
+
+uint64_t LatencyHistogram::count_below(uint64_t us) const {
+    uint64_t n = 0;
+    for (size_t b = 0, end = bucket_of(us); b < end; ++b) {
+        n += buckets_[b].load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+std::string LatencyHistogram::json() const {
+    uint64_t total = count();
+    uint64_t mean = total ? sum_ns() / total / 1000 : 0;
+    return json_kv("count", static_cast<long long>(total)) + "," +
+           json_kv("mean_us", static_cast<long long>(mean)) + "," +
+           json_kv("p50_us", static_cast<long long>(percentile_us(0.5))) + "," +
+           json_kv("p90_us", static_cast<long long>(percentile_us(0.9))) + "," +
+           json_kv("p99_us", static_cast<long long>(percentile_us(0.99))) + "," +
+           json_kv("p999_us", static_cast<long long>(percentile_us(0.999))) + "," +
+           json_kv("max_us", static_cast<long long>(max_us()));
+}
+
+Telemetry::Telemetry(size_t max_sessions)
+    : max_sessions_(max_sessions),
+      slots_(new Slot[max_sessions]),
+      commands_(new LatencyHistogram[kCommandCount]) {}
+
+int Telemetry::acquire(const std::string &id) {
+    for (size_t i = 0; i < max_sessions_; ++i) {
+        Slot &s = slots_[i];
+        if (s.used.load(std::memory_order_relaxed)) continue;
+        uint64_t words[kIdWords] = {};
+        std::memcpy(words, id.data(), std::min(id.size(), sizeof(words) - 1));
+        s.seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t w = 0; w < kIdWords; ++w) s.id[w].store(words[w], std::memory_order_relaxed);
+        s.state.store(0, std::memory_order_relaxed);
+        s.cpu_ms.store(0, std::memory_order_relaxed);
+        s.rss_kb.store(0, std::memory_order_relaxed);
+        s.output_bytes.store(0, std::memory_order_relaxed);
+        s.used.store(true, std::memory_order_relaxed);
+        s.seq.fetch_add(1, std::memory_order_release);
+        return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void Telemetry::release(int slot) {
+    if (slot < 0) return;
+    Slot &s = slots_[slot];
+    s.seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.used.store(false, std::memory_order_relaxed);
+    s.seq.fetch_add(1, std::memory_order_release);
+}
+
+void Telemetry::set_state(int slot, int state) {
+    if (slot >= 0) slots_[slot].state.store(state, std::memory_order_relaxed);
+}
+
+void Telemetry::add_resources(int slot, int64_t cpu_ms, int64_t rss_kb) {
+    if (slot < 0) return;
+    slots_[slot].cpu_ms.fetch_add(cpu_ms, std::memory_order_relaxed);
+    slots_[slot].rss_kb.store(rss_kb, std::memory_order_relaxed);
+}
+
+void Telemetry::add_output(int slot, size_t bytes) {
+    output_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    if (slot >= 0) slots_[slot].output_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Telemetry::set_binary_bytes(size_t total, size_t limit) {
+    binary_bytes_.store(total, std::memory_order_relaxed);
+    binary_limit_.store(limit, std::memory_order_relaxed);
+}
+
+void Telemetry::add_upload_bytes(size_t bytes) {
+    upload_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Telemetry::upload_done(std::chrono::steady_clock::duration took) {
+    uploads_.fetch_add(1, std::memory_order_relaxed);
+    upload_ns_.fetch_add(ns_of(took), std::memory_order_relaxed);
+}
+
+size_t Telemetry::command_index(const std::string &command) {
+    for (size_t i = 0; i + 1 < kCommandCount; ++i) {
+        if (command == kCommands[i]) return i;
+    }
+    return kCommandCount - 1;
+}
+
+void Telemetry::observe_command(const std::string &command,
+                                std::chrono::steady_clock::duration took) {
+    commands_[command_index(command)].record(took);
+}
+
+void Telemetry::observe_loop(std::chrono::steady_clock::duration took, bool stalled) {
+    loop_.record(took);
+    if (stalled) stalls_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string Telemetry::commands_json() const {
+    std::string out = "[";
+    for (size_t c = 0; c < kCommandCount; ++c) {
+        const LatencyHistogram &h = commands_[c];
+        if (h.count() == 0) continue;
+        if (out.size() > 1) out += ",";
+        out += "{" + json_kv("command", kCommands[c], true) + "," + h.json() + "}";
+    }
+    return out + "]";
+}
+
+std::string Telemetry::loop_json() const {
+    return json_kv("stalls", static_cast<long long>(stalls_.load(std::memory_order_relaxed))) +
+           ",\"iterations\":{" + loop_.json() + "}";
+}
+
+std::string Telemetry::render() const {
+    struct View {
+        char id[kIdWords * 8];
+        int state;
+        int64_t cpu_ms;
+        int64_t rss_kb;
+        uint64_t output_bytes;
+    };
+    // A slot rewritten while it is read is read again; one that keeps
+    // changing is left out of this scrape.
+    std::unique_ptr<View[]> views(new View[max_sessions_]);
+    size_t count = 0;
+    for (size_t i = 0; i < max_sessions_; ++i) {
+        const Slot &s = slots_[i];
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            uint64_t before = s.seq.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            bool used = s.used.load(std::memory_order_relaxed);
+            View v;
+            uint64_t words[kIdWords];
+            for (size_t w = 0; w < kIdWords; ++w) words[w] = s.id[w].load(std::memory_order_relaxed);
+            std::memcpy(v.id, words, sizeof(v.id));
+            v.id[sizeof(v.id) - 1] = '\0';
+            v.state = s.state.load(std::memory_order_relaxed);
+            v.cpu_ms = s.cpu_ms.load(std::memory_order_relaxed);
+            v.rss_kb = s.rss_kb.load(std::memory_order_relaxed);
+            v.output_bytes = s.output_bytes.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != before) continue;
+            if (used) views[count++] = v;
+            break;
+        }
+    }
+
+    std::string out;
+    out.reserve(4096 + count * 512);
+    auto line = [&out](const std::string &name, const std::string &value) {
+        out += name + " " + value + "\n";
+    };
+    auto session = [](const char *metric, const View &v) {
+        return std::string(metric) + "{session=\"" + v.id + "\"}";
+    };
+
+    header(out, "debuglantern_sessions", "gauge", "Sessions by state.");
+    size_t by_state[4] = {};
+    for (size_t i = 0; i < count; ++i) {
+        if (views[i].state >= 0 && views[i].state < 4) ++by_state[views[i].state];
+    }
+    for (int st = 0; st < 4; ++st) {
+        line(std::string("debuglantern_sessions{state=\"") + kStates[st] + "\"}",
+             std::to_string(by_state[st]));
+    }
+    header(out, "debuglantern_sessions_max", "gauge", "Session limit (--max-sessions).");
+    line("debuglantern_sessions_max", std::to_string(max_sessions_));
+    header(out, "debuglantern_binary_bytes", "gauge", "RAM held by uploaded binaries.");
+    line("debuglantern_binary_bytes", std::to_string(binary_bytes_.load(std::memory_order_relaxed)));
+    header(out, "debuglantern_binary_bytes_max", "gauge",
+           "Limit on RAM held by uploaded binaries (--max-total-bytes).");
+    line("debuglantern_binary_bytes_max",
+         std::to_string(binary_limit_.load(std::memory_order_relaxed)));
+
+    header(out, "debuglantern_session_cpu_seconds_total", "counter",
+           "CPU time of a session's process tree, over all its runs.");
+    for (size_t i = 0; i < count; ++i) {
+        line(session("debuglantern_session_cpu_seconds_total", views[i]),
+             format_seconds(static_cast<uint64_t>(views[i].cpu_ms) * 1000000));
+    }
+    header(out, "debuglantern_session_rss_bytes", "gauge",
+           "Resident memory of a session's process tree at the last reading.");
+    for (size_t i = 0; i < count; ++i) {
+        line(session("debuglantern_session_rss_bytes", views[i]),
+             std::to_string(views[i].rss_kb * 1024));
+    }
+    header(out, "debuglantern_session_output_bytes_total", "counter",
+           "Bytes a session's processes wrote to stdout and stderr.");
+    for (size_t i = 0; i < count; ++i) {
+        line(session("debuglantern_session_output_bytes_total", views[i]),
+             std::to_string(views[i].output_bytes));
+    }
+    header(out, "debuglantern_output_bytes_total", "counter",
+           "Bytes of output captured from all sessions, deleted ones included.");
+    line("debuglantern_output_bytes_total",
+         std::to_string(output_bytes_.load(std::memory_order_relaxed)));
+
+    header(out, "debuglantern_upload_bytes_total", "counter", "Upload bytes received.");
+    line("debuglantern_upload_bytes_total",
+         std::to_string(upload_bytes_.load(std::memory_order_relaxed)));
+    header(out, "debuglantern_uploads_total", "counter", "Uploads received in full.");
+    line("debuglantern_uploads_total", std::to_string(uploads_.load(std::memory_order_relaxed)));
+    header(out, "debuglantern_upload_seconds_total", "counter",
+           "Time from UPLOAD to the last byte, summed over uploads received in full.");
+    line("debuglantern_upload_seconds_total",
+         format_seconds(upload_ns_.load(std::memory_order_relaxed)));
+
+    header(out, "debuglantern_command_duration_seconds", "histogram",
+           "Time the control loop spent handling a command.");
+    for (size_t c = 0; c < kCommandCount; ++c) {
+        if (commands_[c].count() == 0) continue;
+        histogram_lines(out, "debuglantern_command_duration_seconds",
+                        std::string("command=\"") + kCommands[c] + "\"", commands_[c]);
+    }
+    header(out, "debuglantern_loop_iteration_seconds", "histogram",
+           "Time from epoll_wait() returning to the next call.");
+    histogram_lines(out, "debuglantern_loop_iteration_seconds", "", loop_);
+    header(out, "debuglantern_loop_stalls_total", "counter",
+           "Loop iterations over the stall threshold (--stall-threshold).");
+    line("debuglantern_loop_stalls_total", std::to_string(stalls_.load(std::memory_order_relaxed)));
+    return out;
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,111 @@
+#ifndef DEBUGLANTERN_TELEMETRY_H
+#define DEBUGLANTERN_TELEMETRY_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace debuglantern {
+
+// Latency in log-linear buckets, HdrHistogram style: eight per power of two
+// of microseconds, so any value is known to within 12.5% from 1 us to
+// days, in fixed memory.  One thread records; any thread may read.
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 8 * 38;
+
+    void record(std::chrono::steady_clock::duration took);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+    // The value at quantile `q` (0..1), as the top of its bucket; 0 if empty
+    uint64_t percentile_us(double q) const;
+    // Values recorded below `us`, which should be a power of two
+    uint64_t count_below(uint64_t us) const;
+    // "count":..,"mean_us":..,"p50_us":..,"p90_us":..,"p99_us":..,
+    // "p999_us":..,"max_us":.. (no braces)
+    std::string json() const;
+
+private:
+    static size_t bucket_of(uint64_t us);
+    static uint64_t bucket_top(size_t bucket);
+
+    std::atomic<uint64_t> buckets_[kBuckets];
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_us_{0};
+};
+
+// The daemon's own numbers, exported by the web UI at GET /metrics in the
+// Prometheus text format.  The control loop is the only writer; scrapes
+// read from the web UI's threads.  Everything is a relaxed atomic, and
+// per-session slots are guarded by a sequence count instead of a lock, so
+// a scrape never holds up the loop and the loop never waits for a scrape.
+class Telemetry {
+public:
+    // Room for `max_sessions` sessions, fixed for the daemon's lifetime.
+    explicit Telemetry(size_t max_sessions);
+    Telemetry(const Telemetry &) = delete;
+    Telemetry &operator=(const Telemetry &) = delete;
+
+    // Control loop only.  A slot for a new session; -1 if none is free.
+    int acquire(const std::string &id);
+    void release(int slot);
+    void set_state(int slot, int state);
+    // One resource reading: CPU time since the last one, and RSS now
+    void add_resources(int slot, int64_t cpu_ms, int64_t rss_kb);
+    void add_output(int slot, size_t bytes);
+
+    void set_binary_bytes(size_t total, size_t limit);
+    void add_upload_bytes(size_t bytes);
+    void upload_done(std::chrono::steady_clock::duration took);
+    // How long the loop spent on one command line
+    void observe_command(const std::string &command, std::chrono::steady_clock::duration took);
+    // One pass of the event loop: from epoll_wait() returning to the next call
+    void observe_loop(std::chrono::steady_clock::duration took, bool stalled);
+
+    // Any thread.  {"command","count",...percentiles} per command seen.
+    std::string commands_json() const;
+    // "stalls":..,"iterations":{...as LatencyHistogram::json()} (no braces)
+    std::string loop_json() const;
+
+    // Any thread.  The whole exposition, text format 0.0.4.
+    std::string render() const;
+
+private:
+    static constexpr size_t kIdWords = 5;  // 40 bytes: a UUID and its NUL
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};  // odd while acquire/release rewrites it
+        std::atomic<bool> used{false};
+        std::atomic<uint64_t> id[kIdWords];
+        std::atomic<int> state{0};
+        std::atomic<int64_t> cpu_ms{0};
+        std::atomic<int64_t> rss_kb{0};
+        std::atomic<uint64_t> output_bytes{0};
+    };
+
+    static size_t command_index(const std::string &command);
+
+    size_t max_sessions_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<LatencyHistogram[]> commands_;
+    LatencyHistogram loop_;
+    std::atomic<uint64_t> stalls_{0};
+    std::atomic<uint64_t> binary_bytes_{0};
+    std::atomic<uint64_t> binary_limit_{0};
+    std::atomic<uint64_t> output_bytes_{0};
+    std::atomic<uint64_t> upload_bytes_{0};
+    std::atomic<uint64_t> uploads_{0};
+    std::atomic<uint64_t> upload_ns_{0};
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_TELEMETRY_H
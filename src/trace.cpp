@@ -0,0 +1,65 @@
+#include "trace.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+namespace debuglantern {
+
+namespace {
+
+int64_t ns_since_epoch(TraceBuffer::Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+// Trace-event timestamps are microseconds; keep the nanoseconds as decimals
+std::string format_us(int64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld.%03lld", static_cast<long long>(ns / 1000),
+             static_cast<long long>(ns % 1000));
+    return buf;
+}
+
+}  // namespace
+
+TraceBuffer::TraceBuffer(size_t capacity) : capacity_(capacity) {}
+
+void TraceBuffer::add(const std::string &session, const char *name, Clock::time_point begin,
+                      Clock::time_point end, const std::string &args) {
+    int64_t begin_ns = ns_since_epoch(begin);
+    int64_t duration_ns = std::max<int64_t>(ns_since_epoch(end) - begin_ns, 0);
+    spans_.push_back(Span{session, name, begin_ns, duration_ns, args});
+    if (spans_.size() > capacity_) {
+        spans_.pop_front();
+        ++dropped_;
+    }
+}
+
+std::string TraceBuffer::chrome_json(const std::string &session) const {
+    std::string out = "{\"traceEvents\":[";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"debuglanternd\"}}";
+    // One track per session, numbered as they first appear
+    std::map<std::string, int> tracks;
+    for (const Span &s : spans_) {
+        if (!session.empty() && s.session != session) continue;
+        auto it = tracks.find(s.session);
+        if (it == tracks.end()) {
+            int tid = static_cast<int>(tracks.size()) + 1;
+            it = tracks.emplace(s.session, tid).first;
+            out += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+                   std::to_string(tid) + ",\"args\":{" +
+                   json_kv("name", "session " + s.session.substr(0, 8), true) + "}}";
+        }
+        out += ",{" + json_kv("name", s.name, true) + ",\"cat\":\"session\",\"ph\":\"X\"," +
+               "\"ts\":" + format_us(s.begin_ns) + ",\"dur\":" + format_us(s.duration_ns) +
+               ",\"pid\":1,\"tid\":" + std::to_string(it->second) + ",\"args\":{" +
+               json_kv("session", s.session, true) + (s.args.empty() ? "" : "," + s.args) + "}}";
+    }
+    out += "],\"displayTimeUnit\":\"ms\",\"otherData\":{" +
+           json_kv("dropped_spans", static_cast<long long>(dropped_)) + "}}";
+    return out;
+}
+
+}  // namespace debuglantern
@@ -0,0 +1,66 @@
+#ifndef DEBUGLANTERN_TRACE_H
+#define DEBUGLANTERN_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+namespace debuglantern {
+
+// Timed phases of session lifecycles (receiving an upload, extracting it,
+// fork, first output, ...) kept for TRACE, which renders them in the Chrome
+// trace-event format that Perfetto and chrome://tracing open.  Each session
+// is one track.  The buffer holds the most recent spans; older ones are
+// dropped.  Control loop only.
+class TraceBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TraceBuffer(size_t capacity);
+
+    // A finished span.  `args` is extra JSON members ("bytes":123), or empty.
+    void add(const std::string &session, const char *name, Clock::time_point begin,
+             Clock::time_point end, const std::string &args = "");
+
+    // Records a span from construction to destruction.
+    class Scope {
+    public:
+        Scope(TraceBuffer &trace, std::string session, const char *name)
+            : trace_(trace), session_(std::move(session)), name_(name), begin_(Clock::now()) {}
+        ~Scope() { trace_.add(session_, name_, begin_, Clock::now(), args_); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        void set_args(std::string args) { args_ = std::move(args); }
+
+    private:
+        TraceBuffer &trace_;
+        std::string session_;
+        const char *name_;
+        Clock::time_point begin_;
+        std::string args_;
+    };
+
+    // {"traceEvents":[...],"displayTimeUnit":"ms"} for one session's spans,
+    // or everyone's when `session` is empty.
+    std::string chrome_json(const std::string &session) const;
+
+private:
+    struct Span {
+        std::string session;
+        const char *name;
+        int64_t begin_ns;
+        int64_t duration_ns;
+        std::string args;
+    };
+
+    size_t capacity_;
+    std::deque<Span> spans_;
+    uint64_t dropped_ = 0;
+};
+
+}  // namespace debuglantern
+
+#endif  // DEBUGLANTERN_TRACE_H
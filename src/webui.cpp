@@ -1,9 +1,20 @@
 #include "webui.h"
 
+#include "common.h"
+#include "continuous.h"
+#include "flamegraph.h"
+#include "profiler.h"
+#include "symbolizer.h"
+#include "telemetry.h"
+
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -12,6 +23,8 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <random>
 #include <sstream>
 #include <thread>
 #include <vector>
@@ -44,7 +57,15 @@ header .icon{font-size:2rem}
 .upload-zone:hover,.upload-zone.dragover{border-color:var(--accent);background:rgba(233,69,96,.05)}
 .upload-zone input{display:none}
 .upload-zone p{color:var(--gray);font-size:.9rem}
+.upload-zone .exec-path{margin-top:12px;background:var(--card);border:1px solid var(--border);color:var(--text);padding:4px 8px;border-radius:4px;font-size:.75rem;font-family:inherit;width:320px;max-width:100%}
+.upload-progress{display:none;margin-top:12px;height:6px;background:var(--bg);border:1px solid var(--border);border-radius:3px;overflow:hidden}
+.upload-progress .bar{height:100%;width:0;background:var(--green);transition:width .1s}
+.upload-text{display:none;margin-top:6px;font-size:.75rem;color:var(--gray)}
 table{width:100%;border-collapse:collapse}
+#table,#table thead,#sessions{display:block}
+#table tr{display:grid;grid-template-columns:110px 120px 90px 120px 260px minmax(0,1fr)}
+#sessions>tr{content-visibility:auto;contain-intrinsic-size:auto 47px}
+#sessions>tr.config-row>td{grid-column:1/-1}
 th,td{padding:10px 12px;text-align:left;border-bottom:1px solid var(--border)}
 th{color:var(--gray);font-size:.75rem;text-transform:uppercase;letter-spacing:1px}
 .badge{display:inline-block;padding:2px 10px;border-radius:12px;font-size:.75rem;font-weight:600}
@@ -53,6 +74,8 @@ th{color:var(--gray);font-size:.75rem;text-transform:uppercase;letter-spacing:1p
 .badge-debugging{background:var(--accent);color:#fff}
 .badge-stopped{background:var(--gray);color:#fff}
 .id-cell{font-size:.8rem;color:var(--gray);cursor:pointer}
+.spark{font-size:.75rem;color:var(--gray);white-space:nowrap}
+.spark svg{vertical-align:middle}
 .id-cell:hover{color:var(--text)}
 .actions button{background:var(--card);border:1px solid var(--border);color:var(--text);padding:4px 10px;border-radius:6px;cursor:pointer;font-size:.75rem;margin-right:4px;font-family:inherit;transition:border-color .15s}
 .actions button:hover{border-color:var(--accent)}
@@ -84,14 +107,35 @@ th{color:var(--gray);font-size:.75rem;text-transform:uppercase;letter-spacing:1p
 .output-panel h3{font-size:.85rem;color:var(--gray);margin-bottom:8px;display:flex;align-items:center;justify-content:space-between}
 .output-panel h3 button{background:none;border:1px solid var(--border);color:var(--gray);padding:2px 8px;border-radius:4px;cursor:pointer;font-size:.7rem;font-family:inherit}
 .output-panel h3 button:hover{border-color:var(--accent);color:var(--text)}
+.output-panel h3 select{background:var(--card);border:1px solid var(--border);color:var(--gray);padding:2px 4px;border-radius:4px;font-size:.7rem;font-family:inherit}
 .output-content{background:var(--bg);border:1px solid var(--border);border-radius:8px;padding:12px;font-size:.75rem;max-height:400px;overflow-y:auto;white-space:pre-wrap;word-wrap:break-word;line-height:1.5;color:var(--green)}
+.log-view{height:400px;overflow-anchor:none;white-space:normal}
+.log-spacer{position:relative}
+.log-page{position:absolute;left:0;right:0;white-space:pre-wrap;word-wrap:break-word}
 .activity-panel{background:var(--card);border:1px solid var(--border);border-radius:12px;padding:16px;margin-top:16px}
 .activity-panel h3{font-size:.85rem;color:var(--gray);margin-bottom:8px;display:flex;align-items:center;justify-content:space-between}
 .activity-panel h3 button{background:none;border:1px solid var(--border);color:var(--gray);padding:2px 8px;border-radius:4px;cursor:pointer;font-size:.7rem;font-family:inherit}
 .activity-panel h3 button:hover{border-color:var(--accent);color:var(--text)}
 .activity-content{background:var(--bg);border:1px solid var(--border);border-radius:8px;padding:12px;font-size:.75rem;max-height:200px;overflow-y:auto;white-space:pre-wrap;word-wrap:break-word;line-height:1.5;color:var(--yellow)}
 .activity-content .time{color:var(--gray);margin-right:8px}
-#flamegraph-content svg{max-width:100%;height:auto}
+.flame-bar{display:flex;gap:8px;align-items:center;flex-wrap:wrap;font-size:.75rem;color:var(--gray);margin-bottom:8px}
+.flame-bar select,.flame-bar input,.flame-bar button{background:var(--card);border:1px solid var(--border);color:var(--text);padding:2px 6px;border-radius:4px;font-size:.75rem;font-family:inherit}
+.flame-bar button{cursor:pointer}
+.flame-bar a{color:var(--green);margin-left:4px}
+.flame-view{position:relative;background:var(--bg);border:1px solid var(--border);border-radius:8px;overflow:hidden}
+.flame-view canvas{display:block;width:100%;cursor:pointer}
+.flame-tip{position:absolute;display:none;pointer-events:none;background:var(--card);border:1px solid var(--border);border-radius:4px;padding:4px 8px;font-size:.7rem;color:var(--text);white-space:pre;z-index:1}
+.flame-top{width:100%;margin-top:8px;font-size:.7rem;border-collapse:collapse;text-align:left}
+.flame-top th,.flame-top td{padding:2px 6px;border-bottom:1px solid var(--border)}
+.flame-top th.num,.flame-top td.num{text-align:right;width:7em}
+.flame-top th.sort{cursor:pointer}
+.flame-top td.fn{max-width:0;overflow:hidden;text-overflow:ellipsis;white-space:nowrap;cursor:pointer}
+.thread-table{margin-top:0}
+.thread-table td.num,.thread-table th.num{width:auto}
+.thread-table td.warn{color:var(--accent);font-weight:600}
+.thread-table td.rt{color:var(--yellow)}
+.terminal{min-height:240px;max-height:420px;outline:none;color:var(--text);margin:0}
+.terminal:focus{border-color:var(--accent)}
 </style>
 </head>
 <body>
@@ -111,22 +155,33 @@ th{color:var(--gray);font-size:.75rem;text-transform:uppercase;letter-spacing:1p
   </div>
   <div class="upload-zone" id="upload-zone" onclick="document.getElementById('file-input').click()">
     <input type="file" id="file-input">
-    <p>Drop ELF binary here or click to upload</p>
+    <p>Drop ELF binary or tar.gz bundle here or click to upload</p>
+    <input class="exec-path" id="exec-path" placeholder="exec path inside bundle (tar.gz only), e.g. app/bin/app" onclick="event.stopPropagation()">
+    <div class="upload-progress" id="upload-progress"><div class="bar" id="upload-bar"></div></div>
+    <div class="upload-text" id="upload-text"></div>
   </div>
   <table id="table" style="display:none">
     <thead>
-      <tr><th>ID</th><th>State</th><th>PID</th><th>Debug Port</th><th>Actions</th></tr>
+      <tr><th>ID</th><th>State</th><th>PID</th><th>Debug Port</th><th>Resources</th><th>Actions</th></tr>
     </thead>
     <tbody id="sessions"></tbody>
   </table>
   <div class="empty" id="empty">No sessions</div>
   <div class="output-panel" id="output-panel">
     <h3><span>Output: <span id="output-session-id"></span></span><span><button onclick="clearOutput()">Clear</button> <button onclick="closeOutput()">Close</button></span></h3>
-    <div class="output-content" id="output-content"></div>
+    <div class="output-content log-view" id="output-content"><div class="log-spacer" id="output-spacer"></div></div>
+  </div>
+  <div class="output-panel" id="terminal-panel">
+    <h3><span>&#x2328; Terminal: <span id="terminal-session-id"></span> <span id="terminal-state"></span></span><span><button onclick="closeTerminal()">Close</button></span></h3>
+    <pre class="output-content terminal" id="terminal-content" tabindex="0"></pre>
   </div>
   <div class="output-panel" id="flamegraph-panel">
-    <h3><span>&#x1F525; Flamegraph: <span id="flamegraph-session-id"></span></span><span><button onclick="closeFlamegraph()">Close</button></span></h3>
-    <div id="flamegraph-content" style="overflow-x:auto;text-align:center"></div>
+    <h3><span>&#x1F525; Flamegraph: <span id="flamegraph-session-id"></span></span><span><button id="flame-cont" onclick="toggleContinuous()">Continuous: off</button> <select id="flame-last" style="display:none" onchange="captureLast(this.value);this.value=''"><option value="">last&hellip;</option><option value="1m">1 min</option><option value="5m">5 min</option><option value="15m">15 min</option><option value="60m">60 min</option></select> <select id="flame-base" onchange="flameCompare(this.value)"></select> <select id="flame-history" onchange="loadProfile(this.value)"></select> <select id="flame-heap" title="heap profile (sessions started with Heap)" onchange="loadHeap(this.value)"><option value="">heap&hellip;</option><option value="live">live bytes</option><option value="alloc">allocated bytes</option></select> <select id="flame-kind" title="what to record"><option value="cpu">on-CPU</option><option value="offcpu">off-CPU</option><option value="both">on+off CPU</option></select> <button onclick="startFlamegraph(flameSession)">New</button> <button onclick="closeFlamegraph()">Close</button></span></h3>
+    <div id="flamegraph-content"></div>
+  </div>
+  <div class="output-panel" id="threads-panel">
+    <h3><span>&#x2630; Threads: <span id="threads-session-id"></span> <span id="threads-info"></span></span><span><button onclick="closeThreads()">Close</button></span></h3>
+    <table class="flame-top thread-table"><thead><tr><th>TID</th><th>Name</th><th>State</th><th>Wait channel</th><th class="num">CPU</th><th>Policy</th><th class="num">CPU %</th><th class="num">Run queue</th><th class="num">Vol</th><th class="num">Invol</th><th class="num">Migr</th></tr></thead><tbody id="threads-body"></tbody></table>
   </div>
   <div class="activity-panel" id="activity-panel">
     <h3><span>&#x1F4CB; Activity</span><span><button onclick="clearActivity()">Clear</button></span></h3>
@@ -137,11 +192,9 @@ th{color:var(--gray);font-size:.75rem;text-transform:uppercase;letter-spacing:1p
 <script>
 const $=s=>document.getElementById(s);
 let connected=false;
-let outputSessionId=null;
-let outputOffset=0;
 let outputTimer=null;
 let openConfigs=new Set();
-let lastSessionData={};
+const rows=new Map();
 
 function toast(msg,err){
   const el=document.createElement('div');
@@ -157,7 +210,8 @@ function badge(state){
 
 function toggleConfig(id){
   if(openConfigs.has(id)){openConfigs.delete(id);}else{openConfigs.add(id);}
-  renderFromCache();
+  const r=rows.get(id);
+  if(r)upsertRow(r.s);
 }
 
 function actionButtons(s){
@@ -166,11 +220,16 @@ function actionButtons(s){
   if(s.state==='LOADED'||s.state==='STOPPED'){
     h+='<button onclick="act(\'start\',\''+s.id+'\')">&blacktriangleright; Start</button>';
     h+='<button onclick="act(\'start\',\''+s.id+'\',true)">&#x1F41B; Debug</button>';
+    h+='<button onclick="act(\'start\',\''+s.id+'\',false,true)">&#x2328; PTY</button>';
+    h+='<button onclick="act(\'start\',\''+s.id+'\',false,false,true)" title="start with the heap allocation sampler">&#x25A6; Heap</button>';
     h+='<button class="danger" onclick="act(\'delete\',\''+s.id+'\')">&times; Delete</button>';
   }
   if(s.state==='RUNNING'){
     h+='<button onclick="showOutput(\''+s.id+'\')">&#x23F5; Output</button>';
+    h+='<button onclick="openTerminal(\''+s.id+'\')">&#x2328; Terminal</button>';
     h+='<button onclick="startFlamegraph(\''+s.id+'\')">&#x1F525; Flamegraph</button>';
+    if(s.heap_profile)h+='<button onclick="showHeap(\''+s.id+'\')">&#x25A6; Heap</button>';
+    h+='<button onclick="showThreads(\''+s.id+'\')">&#x2630; Threads</button>';
     h+='<button onclick="act(\'debug\',\''+s.id+'\')">&#x1F41B; Attach GDB</button>';
     h+='<button onclick="act(\'stop\',\''+s.id+'\')">&#x23F9; Stop</button>';
     h+='<button class="danger" onclick="act(\'kill\',\''+s.id+'\')">&#x2620; Kill</button>';
@@ -191,7 +250,7 @@ function configRow(s){
   if(!openConfigs.has(s.id))return '';
   const canSave=s.state==='LOADED'||s.state==='STOPPED';
   const dis=canSave?'':' disabled';
-  let h='<tr class="config-row" data-cfg="'+s.id+'"><td colspan="5"><div class="config-panel">';
+  let h='<tr class="config-row" data-cfg="'+s.id+'"><td colspan="6"><div class="config-panel">';
   h+='<div class="cfg-section">';
   h+='<label>args</label>';
   h+='<input class="args-input" id="args-'+s.id+'" placeholder="arg1 arg2 ..." value="'+(s.args?s.args.replace(/"/g,'&quot;'):'')+'">';
@@ -216,55 +275,133 @@ function configRow(s){
   return h;
 }
 
-function render(sessions){
-  const focused=document.activeElement;
-  let focusId=null,focusPos=0,focusVal='';
-  if(focused&&focused.tagName==='INPUT'&&focused.id){
-    focusId=focused.id;
-    focusPos=focused.selectionStart||0;
-    focusVal=focused.value;
-  }
-  const inputVals={};
-  document.querySelectorAll('.config-panel input').forEach(inp=>{
-    if(inp.id)inputVals[inp.id]=inp.value;
-  });
-
-  lastSessionData={};
-  sessions.forEach(s=>{lastSessionData[s.id]=s;});
-
-  const tb=$('sessions');
-  $('table').style.display=sessions.length?'table':'none';
-  $('empty').style.display=sessions.length?'none':'block';
-  $('session-count').textContent=sessions.length+' session'+(sessions.length!==1?'s':'');
-  tb.innerHTML=sessions.map(s=>{
-    let row='<tr>';
-    row+='<td class="id-cell" title="'+s.id+'" onclick="navigator.clipboard.writeText(\''+s.id+'\');toast(\'Copied ID\')">'+s.id.substring(0,8)+'&hellip;</td>';
-    row+='<td>'+badge(s.state)+'</td>';
-    row+='<td>'+(s.pid||'&mdash;')+'</td>';
-    row+='<td>'+(s.debug_port||'&mdash;')+'</td>';
-    row+='<td class="actions">'+actionButtons(s)+'</td>';
-    row+='</tr>';
-    row+=configRow(s);
-    return row;
-  }).join('');
+// Session table: one keyed <tr> (plus optional config <tr>) per session.
+// A row is rebuilt only when its data changes, so the table costs nothing
+// per tick once it has settled; the SSE stream delivers diffs.  The rows
+// are grid rows rather than table rows, with content-visibility:auto, so
+// rows out of view are skipped by style and layout: a real table lays out
+// every row again on any change, tens of ms at 1k sessions.
+function rowSig(s){return JSON.stringify(s)+(openConfigs.has(s.id)?'+':'');}
+
+function rowHtml(s){
+  let row='<td class="id-cell" title="'+s.id+'" onclick="navigator.clipboard.writeText(\''+s.id+'\');toast(\'Copied ID\')">'+s.id.substring(0,8)+'&hellip;</td>';
+  row+='<td>'+badge(s.state)+'</td>';
+  row+='<td>'+(s.pid||'&mdash;')+'</td>';
+  row+='<td>'+(s.debug_port||'&mdash;')+'</td>';
+  row+='<td class="spark">'+sparkHtml(s.id)+'</td>';
+  row+='<td class="actions">'+actionButtons(s)+'</td>';
+  return row;
+}
 
-  for(const [id,val] of Object.entries(inputVals)){
-    const el=$(id);
-    if(el)el.value=val;
+function upsertRow(s){
+  let r=rows.get(s.id);
+  const sig=rowSig(s);
+  if(r&&r.sig===sig)return;
+  if(!r){
+    r={tr:document.createElement('tr'),cfg:null};
+    rows.set(s.id,r);
+    $('sessions').appendChild(r.tr);
+  }
+  r.s=s;
+  r.sig=sig;
+  r.tr.innerHTML=rowHtml(s);
+
+  const vals={};
+  let focusId=null,focusPos=0;
+  if(r.cfg){
+    r.cfg.querySelectorAll('input').forEach(inp=>{if(inp.id)vals[inp.id]=inp.value;});
+    const f=document.activeElement;
+    if(f&&r.cfg.contains(f)&&f.id){focusId=f.id;focusPos=f.selectionStart||0;}
+    r.cfg.remove();
+    r.cfg=null;
   }
-  if(focusId){
-    const el=$(focusId);
-    if(el){
-      el.value=focusVal;
-      el.focus();
-      try{el.setSelectionRange(focusPos,focusPos);}catch(e){}
+  const html=configRow(s);
+  if(html){
+    const t=document.createElement('tbody');
+    t.innerHTML=html;
+    r.cfg=t.firstElementChild;
+    r.tr.after(r.cfg);
+    for(const [id,v] of Object.entries(vals)){const el=$(id);if(el)el.value=v;}
+    if(focusId){
+      const el=$(focusId);
+      if(el){el.focus();try{el.setSelectionRange(focusPos,focusPos);}catch(e){}}
     }
   }
 }
 
-function renderFromCache(){
-  const sessions=Object.values(lastSessionData);
-  if(sessions.length)render(sessions);
+// Resource sparklines: each running session's /proc readings, fetched
+// incrementally (?since=) every two seconds; the last SPARK_POINTS are kept.
+const SPARK_POINTS=120,sparks=new Map();
+
+async function pollMetrics(){
+  for(const [id,r] of rows){
+    const live=r.s.state==='RUNNING'||r.s.state==='DEBUGGING';
+    let m=sparks.get(id);
+    if(m&&m.run!==r.s.run)m=null;
+    if(!live&&(!m||m.done))continue;
+    if(!m){m={run:r.s.run,next:0,interval:1000,pts:[],done:false};sparks.set(id,m);}
+    try{
+      const d=await (await fetch('/api/sessions/'+id+'/metrics?since='+m.next)).json();
+      if(d.error_code||!d.fields)continue;
+      for(const v of d.samples){const o={};d.fields.forEach((k,i)=>o[k]=v[i]);m.pts.push(o);}
+      if(m.pts.length>SPARK_POINTS)m.pts.splice(0,m.pts.length-SPARK_POINTS);
+      m.next=d.next;m.interval=d.interval_ms||1000;m.done=!live;
+      const cell=r.tr.querySelector('.spark');
+      if(cell)cell.innerHTML=sparkHtml(id);
+    }catch(e){}
+  }
+}
+setInterval(pollMetrics,2000);
+
+function sparkLine(vals,color){
+  const w=60,h=18,max=Math.max(...vals,1e-9);
+  const pts=vals.map((v,i)=>(i*w/(SPARK_POINTS-1)).toFixed(1)+','+(h-1-v/max*(h-2)).toFixed(1)).join(' ');
+  return '<svg width="'+w+'" height="'+h+'"><polyline fill="none" style="stroke:'+color+'" points="'+pts+'"/></svg>';
+}
+
+function fmtBytes(b){return b>=1073741824?(b/1073741824).toFixed(1)+' GB':b>=1048576?(b/1048576).toFixed(1)+' MB':(b/1024).toFixed(0)+' KB';}
+
+function sparkHtml(id){
+  const m=sparks.get(id);
+  if(!m||!m.pts.length)return '&mdash;';
+  const p=m.pts,last=p[p.length-1],per=1000/m.interval;
+  const cpu=p.map(x=>100*x.cpu_ms/m.interval);
+  const title='CPU '+cpu[cpu.length-1].toFixed(1)+'%, RSS '+fmtBytes(last.rss_kb*1024)+
+    '\n'+last.processes+' process'+(last.processes!==1?'es':'')+', '+last.threads+' threads, '+last.fds+' fds'+
+    '\nread '+fmtBytes(last.read_bytes*per)+'/s, written '+fmtBytes(last.write_bytes*per)+'/s';
+  return '<span title="'+title+'">'+sparkLine(cpu,'var(--green)')+' '+cpu[cpu.length-1].toFixed(0)+'% '+
+    sparkLine(p.map(x=>x.rss_kb),'var(--yellow)')+' '+fmtBytes(last.rss_kb*1024)+'</span>';
+}
+
+function removeRow(id){
+  const r=rows.get(id);
+  if(!r)return;
+  r.tr.remove();
+  if(r.cfg)r.cfg.remove();
+  rows.delete(id);
+  sparks.delete(id);
+  openConfigs.delete(id);
+}
+
+function updateCount(){
+  const n=rows.size;
+  $('table').style.display=n?'block':'none';
+  $('empty').style.display=n?'none':'block';
+  $('session-count').textContent=n+' session'+(n!==1?'s':'');
+}
+
+// Full snapshot: upsert everything listed, drop rows that are gone.
+function render(sessions){
+  const seen=new Set();
+  for(const s of sessions){seen.add(s.id);upsertRow(s);}
+  for(const id of [...rows.keys()])if(!seen.has(id))removeRow(id);
+  updateCount();
+}
+
+function applyDiff(d){
+  for(const id of d.remove||[])removeRow(id);
+  for(const s of d.upsert||[])upsertRow(s);
+  updateCount();
 }
 
 async function refresh(){
@@ -282,9 +419,13 @@ function setConnected(v){
   $('conn-text').textContent=v?'connected':'disconnected';
 }
 
-async function act(cmd,id,debug){
+async function act(cmd,id,debug,pty,heap){
   try{
-    const q=debug?'?flags=--debug':'';
+    const flags=[];
+    if(debug)flags.push('--debug');
+    if(pty)flags.push('--pty');
+    if(heap)flags.push('--heap');
+    const q=flags.length?'?flags='+flags.join(','):'';
     const r=await fetch('/api/sessions/'+id+'/'+cmd+q,{method:'POST'});
     const d=await r.json();
     if(d.error_code){toast(d.message,true);}
@@ -328,78 +469,850 @@ async function delEnv(id,key){
   }catch(e){toast('Failed: '+e.message,true);}
 }
 
-async function showOutput(id){
-  outputSessionId=id;
-  outputOffset=0;
-  $('output-content').textContent='';
-  $('output-session-id').textContent=id.substring(0,8)+'...';
-  $('output-panel').style.display='block';
-  fetchOutput();
-  if(outputTimer)clearInterval(outputTimer);
-  outputTimer=setInterval(fetchOutput,1000);
+// Output viewer: the retained stream is cut into fixed byte pages that are
+// fetched on demand.  Only pages near the viewport are in the DOM; the rest
+// are stand-ins of measured (or estimated) height.  A page shows the lines
+// that start inside it, reading up to LOG_OVERLAP bytes into the next page
+// to finish its last line, so boundaries never split shorter lines.  Pages
+// are small so that laying out the one a jump lands on fits in a frame or two.
+const LOG_PAGE=16384,LOG_OVERLAP=16384,LOG_CACHE=192;
+const logEnc=new TextEncoder(),logDec=new TextDecoder();
+let lv=null,logGen=0;
+
+function logReset(id){
+  $('output-spacer').textContent='';
+  lv={id,gen:++logGen,total:0,start:0,floor:0,pages:new Map(),follow:true,raf:0,tick:0,
+      lastScroll:-1,pxPerByte:18/80,mBytes:0,mPx:0};
+}
+
+function logFirst(){return Math.floor(Math.max(lv.start,lv.floor)/LOG_PAGE);}
+function logLast(){
+  const lo=Math.max(lv.start,lv.floor);
+  return lv.total>lo?Math.floor((lv.total-1)/LOG_PAGE):logFirst()-1;
+}
+function logLo(k){return Math.max(k*LOG_PAGE,lv.start,lv.floor);}
+function logPage(k){
+  let p=lv.pages.get(k);
+  if(!p){p={k,bytes:null,base:0,end:0,h:null,el:null,shown:0,loading:false,stale:false,dirty:false,used:0};lv.pages.set(k,p);}
+  return p;
+}
+function logHeight(k){
+  const p=lv.pages.get(k);
+  if(p&&p.h!==null)return p.h;
+  return Math.max(0,Math.min((k+1)*LOG_PAGE,lv.total)-logLo(k))*lv.pxPerByte;
+}
+
+function logText(p){
+  const b=p.bytes,pe=(p.k+1)*LOG_PAGE-p.base;
+  let i=Math.max(0,logLo(p.k)-p.base);
+  if(p.k>logFirst()){
+    const n=b.subarray(i,i+LOG_OVERLAP).indexOf(10);
+    if(n>=0)i+=n+1;
+  }
+  let j=b.length;
+  if(j>pe){
+    const n=b.subarray(pe).indexOf(10);
+    j=n>=0?pe+n+1:pe;
+  }
+  p.shown=Math.max(0,j-i);
+  return logDec.decode(b.subarray(i,j));
+}
+
+// Applies offsets from an OUTPUT response.  A shrinking total means the
+// process was restarted and its buffer reset.
+function logMeta(d){
+  if(d.total===undefined)return;
+  if(d.total<lv.total){
+    const id=lv.id,follow=lv.follow;
+    logReset(id);
+    lv.follow=follow;
+  }
+  lv.total=d.total;
+  lv.start=d.start||0;
+  const first=logFirst();
+  for(const [k,p] of lv.pages){
+    if(k<first){if(p.el)p.el.remove();lv.pages.delete(k);continue;}
+    if(p.bytes&&p.end<Math.min((k+1)*LOG_PAGE+LOG_OVERLAP,lv.total))p.stale=true;
+  }
 }
 
-async function fetchOutput(){
-  if(!outputSessionId)return;
+async function logFetch(p){
+  if(p.loading)return;
+  p.loading=true;
+  const g=lv.gen,lo=logLo(p.k),hi=(p.k+1)*LOG_PAGE+LOG_OVERLAP;
   try{
-    const r=await fetch('/api/sessions/'+outputSessionId+'/output?offset='+outputOffset);
+    const r=await fetch('/api/sessions/'+lv.id+'/output?offset='+lo+'&length='+(hi-lo));
     const d=await r.json();
-    if(d.output&&d.output.length>0){
-      $('output-content').textContent+=d.output;
-      const el=$('output-content');
-      el.scrollTop=el.scrollHeight;
+    if(!lv||lv.gen!==g||d.error_code)return;
+    logMeta(d);
+    if(lv.gen!==g||lv.pages.get(p.k)!==p)return;
+    p.bytes=logEnc.encode(d.output||'');
+    p.base=d.offset;
+    p.end=Math.min(hi,d.total);
+    p.stale=false;
+    p.dirty=true;
+    logEvict();
+    logSchedule();
+  }catch(e){}
+  finally{p.loading=false;}
+}
+
+function logEvict(){
+  const held=[...lv.pages.values()].filter(p=>p.bytes);
+  if(held.length<=LOG_CACHE)return;
+  held.sort((a,b)=>a.used-b.used);
+  for(const p of held.slice(0,held.length-LOG_CACHE)){
+    if(p.used===lv.tick)break;
+    p.bytes=null;
+    if(p.el){p.el.remove();p.el=null;}
+  }
+}
+
+function logSchedule(){if(lv&&!lv.raf)lv.raf=requestAnimationFrame(logRender);}
+
+function logRender(){
+  if(!lv)return;
+  lv.raf=0;
+  const box=$('output-content'),first=logFirst(),last=logLast(),vh=box.clientHeight||400;
+  let height=0;
+  for(let k=first;k<=last;k++)height+=logHeight(k);
+  const view=lv.follow?Math.max(0,height-vh):box.scrollTop;
+
+  // Pick pages within a screen of the viewport and remember where the
+  // first visible one sits so measuring doesn't shift what the user sees.
+  const want=[];
+  let top=0,anchor=null,anchorOff=0;
+  for(let k=first;k<=last;k++){
+    const h=logHeight(k);
+    if(anchor===null&&top+h>view){anchor=k;anchorOff=view-top;}
+    if(top+h>=view-vh&&top<=view+2*vh)want.push(k);
+    top+=h;
+  }
+
+  lv.tick++;
+  for(const k of want){
+    const p=logPage(k);
+    p.used=lv.tick;
+    if(!p.bytes||p.stale)logFetch(p);
+    if(!p.bytes)continue;
+    if(!p.el){
+      p.el=document.createElement('div');
+      p.el.className='log-page';
+      $('output-spacer').appendChild(p.el);
+      p.dirty=true;
     }
-    if(d.total!==undefined)outputOffset=d.total;
+    if(p.dirty){p.el.textContent=logText(p);p.dirty=false;p.h=null;}
+  }
+  for(const p of lv.pages.values()){
+    if(p.el&&p.used!==lv.tick){p.el.remove();p.el=null;}
+  }
+  for(const k of want){
+    const p=lv.pages.get(k);
+    if(!p||!p.el||p.h!==null)continue;
+    p.h=p.el.offsetHeight;
+    lv.mBytes+=p.shown;
+    lv.mPx+=p.h;
+  }
+  if(lv.mBytes)lv.pxPerByte=lv.mPx/lv.mBytes;
+
+  top=0;
+  let anchorTop=0;
+  for(let k=first;k<=last;k++){
+    if(k===anchor)anchorTop=top;
+    const p=lv.pages.get(k);
+    if(p&&p.el)p.el.style.top=top+'px';
+    top+=logHeight(k);
+  }
+  $('output-spacer').style.height=top+'px';
+  box.scrollTop=lv.follow?top:anchorTop+anchorOff;
+  lv.lastScroll=box.scrollTop;
+}
+
+async function logPoll(){
+  if(!lv)return;
+  const g=lv.gen;
+  try{
+    const r=await fetch('/api/sessions/'+lv.id+'/output?offset='+lv.total+'&length=0');
+    const d=await r.json();
+    if(!lv||lv.gen!==g||d.error_code)return;
+    const before=lv.total;
+    logMeta(d);
+    if(lv.total!==before||lv.gen!==g)logSchedule();
   }catch(e){}
 }
 
+function showOutput(id){
+  logReset(id);
+  $('output-session-id').textContent=id.substring(0,8)+'...';
+  $('output-panel').style.display='block';
+  logPoll();
+  if(outputTimer)clearInterval(outputTimer);
+  outputTimer=setInterval(logPoll,1000);
+}
+
 function closeOutput(){
   $('output-panel').style.display='none';
-  outputSessionId=null;
+  $('output-spacer').textContent='';
+  lv=null;
   if(outputTimer){clearInterval(outputTimer);outputTimer=null;}
 }
 
+// Hides everything received so far; only output after this point is shown.
 function clearOutput(){
-  $('output-content').textContent='';
+  if(!lv)return;
+  $('output-spacer').textContent='';
+  lv.pages.clear();
+  lv.floor=lv.total;
+  lv.follow=true;
+  logSchedule();
+}
+
+$('output-content').addEventListener('scroll',()=>{
+  const box=$('output-content');
+  if(!lv||box.scrollTop===lv.lastScroll)return;
+  lv.follow=box.scrollTop+box.clientHeight>=box.scrollHeight-4;
+  logSchedule();
+});
+window.addEventListener('resize',()=>{
+  if(!lv)return;
+  for(const p of lv.pages.values())p.h=null;
+  logSchedule();
+});
+
+// Per-thread scheduling: THREADS over one second, repeated every two while
+// the panel is open.  Preemption, run-queue delay and migrations stand out.
+let threadsSession=null,threadsTimer=null,threadsBusy=false;
+
+function showThreads(id){
+  threadsSession=id;
+  $('threads-session-id').textContent=id.substring(0,8)+'...';
+  $('threads-info').textContent='sampling...';
+  $('threads-body').replaceChildren();
+  $('threads-panel').style.display='block';
+  pollThreads();
+  if(!threadsTimer)threadsTimer=setInterval(pollThreads,2000);
+}
+
+function closeThreads(){
+  $('threads-panel').style.display='none';
+  threadsSession=null;
+  if(threadsTimer){clearInterval(threadsTimer);threadsTimer=null;}
 }
 
+async function pollThreads(){
+  if(!threadsSession||threadsBusy)return;
+  const id=threadsSession;
+  threadsBusy=true;
+  try{
+    const d=await (await fetch('/api/sessions/'+id+'/threads?duration=1')).json();
+    if(threadsSession!==id)return;
+    if(d.error_code){$('threads-info').textContent=d.message||d.error_code;return;}
+    threadsRender(d);
+  }catch(e){}
+  finally{threadsBusy=false;}
+}
+
+function threadsRender(d){
+  $('threads-info').textContent='('+d.threads.length+' threads'+(d.exited?', '+d.exited+' exited':'')+
+    (d.truncated?', truncated':'')+', over '+d.duration_ms+' ms)';
+  const body=$('threads-body');
+  body.replaceChildren();
+  for(const t of d.threads){
+    const rt=t.policy==='fifo'||t.policy==='rr'||t.policy==='deadline';
+    const migr=t.migrations!==undefined?t.migrations:(t.migrated?'moved':0);
+    const cells=[
+      [t.tid+(t.new?' (new)':''),''],[t.comm,''],[t.state,''],[t.wchan,''],
+      [t.cpu,t.migrated?'num warn':'num'],
+      [t.policy+(rt?' '+t.rt_priority:t.nice?' nice '+t.nice:''),rt?'rt':''],
+      [t.cpu_percent.toFixed(1),'num'],
+      [(t.runqueue_us/1000).toFixed(2)+' ms',t.runqueue_us>1000?'num warn':'num'],
+      [t.voluntary,'num'],[t.involuntary,t.involuntary&&(rt||t.involuntary>t.voluntary)?'num warn':'num'],
+      [migr,migr?'num warn':'num']];
+    const tr=document.createElement('tr');
+    tr.title='CPUs allowed: '+t.cpus_allowed+'\nuser '+t.user_ms+' ms, system '+t.system_ms+' ms, '+
+      t.timeslices+' timeslices';
+    for(const [v,cls] of cells){
+      const td=document.createElement('td');
+      td.className=cls;
+      td.textContent=v;
+      tr.appendChild(td);
+    }
+    body.appendChild(tr);
+  }
+}
+
+// Flamegraphs are recorded by background jobs on the board.  Progress
+// arrives as SSE "profiles" events; finished profiles stay in a
+// per-session history.
+let flameSession=null,flameJob=null,flameBase='';
+
 async function startFlamegraph(id){
-  toast('Profiling for 5 seconds...');
+  openFlamePanel(id);
+  flameMessage('Starting profile...');
+  try{
+    const r=await fetch('/api/sessions/'+id+'/profiles?duration=5&mode='+$('flame-kind').value,{method:'POST'});
+    const d=await r.json();
+    if(d.error){toast('Flamegraph: '+d.error,true);flameMessage(d.error,true);return;}
+    toast(d.cached?'Using recent profile':'Profiling for 5 seconds...');
+    flameJob=d.id;
+    profileUpdate(d);
+    loadHistory();
+  }catch(e){
+    toast('Flamegraph failed: '+e.message,true);
+    flameMessage(e.message,true);
+  }
+}
+
+function openFlamePanel(id){
+  if(flameSession!==id){flameSession=id;flameJob=null;fv=null;$('flamegraph-content').innerHTML='';}
   $('flamegraph-session-id').textContent=id.substring(0,8)+'...';
-  $('flamegraph-content').innerHTML='<p style="color:var(--gray);padding:24px">Recording CPU samples (5s)...</p>';
   $('flamegraph-panel').style.display='block';
+  loadHistory();
+  contStatus();
+  if(!contTimer)contTimer=setInterval(contStatus,10000);
+}
+
+// Always-on sampling for the open session; windows of it become profiles.
+let contTimer=null;
+async function contStatus(){
+  if(!flameSession)return;
+  const b=$('flame-cont');
+  try{
+    const r=await fetch('/api/sessions/'+flameSession+'/continuous');
+    const d=r.ok?await r.json():null;
+    const on=!!d&&d.state!=='ended';
+    b.dataset.on=on?'1':'';
+    b.textContent=on?'Continuous: '+d.frequency+' Hz, '+d.cpu_percent.toFixed(2)+'% CPU':'Continuous: off';
+    b.title=on?d.buckets.length+' of '+d.window_minutes+' min kept, budget '+d.budget_percent+'% CPU'+
+      (d.throttled?', throttled '+d.throttled+'x':'')+(d.error?'\n'+d.error:''):
+      'Sample this session at a low rate all the time';
+    $('flame-last').style.display=on?'':'none';
+  }catch(e){}
+}
+
+async function toggleContinuous(){
+  if(!flameSession)return;
+  const on=$('flame-cont').dataset.on;
+  await fetch('/api/sessions/'+flameSession+'/continuous',{method:on?'DELETE':'PUT'});
+  contStatus();
+}
+
+async function captureLast(span){
+  if(!span||!flameSession)return;
   try{
-    const r=await fetch('/api/sessions/'+id+'/flamegraph?duration=5');
-    const ct=r.headers.get('content-type')||'';
-    if(ct.includes('svg')){
-      $('flamegraph-content').innerHTML=await r.text();
-      toast('Flamegraph ready');
-    }else{
-      const d=await r.json();
-      toast(d.error||'Flamegraph failed',true);
-      $('flamegraph-content').innerHTML='<p style="color:var(--accent);padding:24px">Failed to generate flamegraph. Is perf installed?</p>';
+    const r=await fetch('/api/sessions/'+flameSession+'/profiles?last='+span,{method:'POST'});
+    const d=await r.json();
+    if(!r.ok){
+      toast(d.error==='no_data'?'No continuous samples yet; buckets close every minute':'Capture failed: '+d.error,true);
+      return;
     }
-  }catch(e){
-    toast('Flamegraph failed: '+e.message,true);
-    $('flamegraph-content').innerHTML='<p style="color:var(--accent);padding:24px">'+e.message+'</p>';
+    loadProfile(d.id);
+    loadHistory();
+  }catch(e){toast('Capture failed: '+e.message,true);}
+}
+
+function flameMessage(msg,err){
+  fv=null;
+  const p=document.createElement('p');
+  p.style.cssText='padding:24px;color:var('+(err?'--accent':'--gray')+')';
+  p.textContent=msg;
+  $('flamegraph-content').replaceChildren(p);
+}
+
+function profileLabel(j){
+  const t=new Date(j.created*1000).toTimeString().substring(0,8);
+  return t+' run '+j.run+' '+j.duration+'s'+(j.mode&&j.mode!=='cpu'?' '+j.mode:'')+
+    (j.engine?' '+j.engine:'')+(j.state==='done'?'':' '+j.state);
+}
+
+async function loadHistory(){
+  if(!flameSession)return;
+  try{
+    const r=await fetch('/api/sessions/'+flameSession+'/profiles');
+    const list=await r.json();
+    $('flame-history').innerHTML='<option value="">history ('+list.length+')</option>'+
+      list.map(j=>'<option value="'+j.id+'"'+(j.id===flameJob?' selected':'')+'>'+profileLabel(j)+'</option>').join('');
+  }catch(e){}
+  loadBases();
+}
+
+function profileUpdate(j){
+  if(j.id!==flameJob)return;
+  if(j.state==='queued')flameMessage('Queued behind other profiles...');
+  else if(j.state==='recording')flameMessage('Recording '+({offcpu:'off-CPU stacks',both:'on- and off-CPU stacks'}[j.mode]||'CPU samples')+
+    ' ('+j.duration+'s)... '+j.progress+'%');
+  else if(j.state==='processing')flameMessage('Building flamegraph...');
+  else if(j.state==='done')loadProfile(j.id);
+  else flameMessage(j.error||('Profile '+j.state),true);
+}
+
+async function loadProfile(jobId){
+  if(!jobId)return;
+  flameJob=jobId;
+  $('flame-heap').value='';
+  const base=flameBase!==jobId?flameBase:'';
+  if(fv&&fv.job===jobId&&fv.base===base)return;
+  try{
+    const r=await fetch('/api/profiles/'+jobId+(base?'/diff?base='+base:'/json'));
+    if(r.ok){const d=await r.json();if(flameJob===jobId)flameShow(jobId,base,d);return;}
+    if(r.status===400){flameMessage('Cannot compare: one profile counts samples, the other time',true);return;}
+    const j=await (await fetch('/api/profiles/'+jobId)).json();
+    if(j.state!=='done')profileUpdate(j);
+  }catch(e){flameMessage(e.message,true);}
+}
+
+// Heap profiles are not jobs: the sampler preloaded by START --heap-profile
+// reports all along, and each view is built from what it sent so far.
+function showHeap(id){
+  openFlamePanel(id);
+  $('flame-heap').value='live';
+  loadHeap('live');
+}
+
+async function loadHeap(view){
+  if(!view||!flameSession)return;
+  flameJob=null;
+  try{
+    const r=await fetch('/api/sessions/'+flameSession+'/heap?view='+view);
+    const d=await r.json();
+    if(!r.ok){flameMessage(d.message||d.error,true);return;}
+    flameShow('heap:'+view,'',d);
+  }catch(e){flameMessage(e.message,true);}
+}
+
+// Baseline for a differential view: an earlier capture of this session or
+// a capture of another session (another upload).
+async function loadBases(){
+  try{
+    const list=await (await fetch('/api/profiles')).json();
+    const done=list.filter(j=>j.state==='done');
+    if(flameBase&&!done.some(j=>j.id===flameBase))flameBase='';
+    $('flame-base').innerHTML='<option value="">compare with&hellip;</option>'+
+      done.map(j=>'<option value="'+j.id+'"'+(j.id===flameBase?' selected':'')+'>'+
+        j.session.substring(0,8)+' '+profileLabel(j)+'</option>').join('');
+  }catch(e){}
+}
+
+function flameCompare(id){
+  flameBase=id;
+  if(flameJob)loadProfile(flameJob);
+}
+
+// Canvas flame/icicle viewer over /api/profiles/{job}/json, whose nodes come
+// parent-first as [frame,parent,total,self] quads, or over .../diff, which
+// appends the baseline's total and self to each node.  A diff is laid out
+// by the mean of both profiles' shares and colored by how the share moved.
+const FLAME_ROW=18;
+let fv=null;
+
+function flameShow(jobId,base,d){
+  const diff=d.base!==undefined,stride=diff?6:4,n=d.nodes.length/stride;
+  const frame=new Uint32Array(n),parent=new Uint32Array(n),depth=new Uint16Array(n);
+  const total=new Float64Array(n),self=new Float64Array(n),weight=new Float64Array(n);
+  const btotal=new Float64Array(n),bself=new Float64Array(n),kids=[];
+  const share=(v,t)=>t>0?v/t:0;
+  let maxDepth=0,maxDelta=0;
+  for(let i=0;i<n;i++){
+    const o=i*stride;
+    frame[i]=d.nodes[o];parent[i]=d.nodes[o+1];total[i]=d.nodes[o+2];self[i]=d.nodes[o+3];
+    if(diff){
+      btotal[i]=d.nodes[o+4];bself[i]=d.nodes[o+5];
+      weight[i]=(share(total[i],d.total)+share(btotal[i],d.base))/2;
+      maxDelta=Math.max(maxDelta,Math.abs(share(total[i],d.total)-share(btotal[i],d.base)));
+    }else weight[i]=total[i];
+    kids.push([]);
+    if(i){kids[parent[i]].push(i);depth[i]=depth[parent[i]]+1;maxDepth=Math.max(maxDepth,depth[i]);}
+  }
+  // Same order as the SVG: children by name
+  for(const k of kids)if(k.length>1)k.sort((a,b)=>d.names[frame[a]]<d.names[frame[b]]?-1:1);
+  fv={job:jobId,base,diff,names:d.names,frame,parent,depth,total,self,weight,btotal,bself,kids,
+      maxDepth,maxDelta,sum:d.total,bsum:d.base||0,regressions:d.regressions||[],unit:d.unit||'samples',
+      zoom:0,mode:'flame',match:null,rects:[],sort:'self'};
+  const heap=d.view!==undefined;
+  const url=heap?'/api/sessions/'+d.id+'/heap?view='+d.view+'&format=':'/api/profiles/'+jobId+'/';
+  const file=heap?'heap-'+d.view+'-'+d.id.substring(0,8):'profile-'+jobId.substring(0,8);
+  const links=diff?
+    'baseline '+flameAmount(d.base)+' / '+flameAmount(d.total)+' &middot; export'+
+    '<a href="'+url+'diff?base='+base+'&format=svg" download="'+file+'-diff.svg">diff svg</a>':
+    flameAmount(d.total)+(heap?(d.view==='live'?' live':' allocated')+' in '+(d.duration_ms/1000).toFixed(1)+'s, '+
+      d.samples+' samples'+(d.dropped?', '+d.dropped+' dropped':''):'')+' &middot; export'+
+    '<a href="'+url+'svg" download="'+file+'.svg">svg</a>'+
+    '<a href="'+url+'folded" download="'+file+'.folded">folded</a>'+
+    '<a href="'+url+'speedscope" download="'+file+'.speedscope.json">speedscope</a>'+
+    '<a href="'+url+'pprof" download="'+file+'.pb">pprof</a>';
+  $('flamegraph-content').innerHTML=
+    '<div class="flame-bar"><select id="flame-mode" onchange="fv.mode=this.value;flameRender()">'+
+    '<option value="flame">flame</option><option value="icicle">icicle</option></select>'+
+    '<input id="flame-search" placeholder="search (regex)" oninput="flameSearch(this.value)">'+
+    '<span id="flame-match"></span><button onclick="flameZoom(0)">Reset zoom</button>'+
+    (diff?'<span><span style="color:#ff5050">&#x25A0;</span> grew <span style="color:#5050ff">&#x25A0;</span> shrank</span>':'')+
+    '<span style="margin-left:auto">'+links+'</span></div>'+
+    '<div class="flame-view"><canvas id="flame-canvas"></canvas><div class="flame-tip" id="flame-tip"></div></div>'+
+    '<table class="flame-top"><thead id="flame-top-head"></thead><tbody id="flame-top"></tbody></table>';
+  const c=$('flame-canvas');
+  c.addEventListener('mousemove',flameHover);
+  c.addEventListener('mouseleave',()=>{$('flame-tip').style.display='none';});
+  c.addEventListener('click',e=>{const i=flameHit(e);if(i>=0)flameZoom(i);});
+  flameRender();
+  flameTop();
+}
+
+function flameShare(i){return fv.sum>0?fv.total[i]/fv.sum:0;}
+function flameBaseShare(i){return fv.bsum>0?fv.btotal[i]/fv.bsum:0;}
+
+function flameColor(name,i){
+  if(fv.match)return fv.match[i]?'#e94560':'#3a3a5a';
+  if(fv.diff){
+    const delta=flameShare(i)-flameBaseShare(i);
+    const fade=Math.round(45+210*(1-(fv.maxDelta>0?Math.abs(delta)/fv.maxDelta:0)));
+    return delta>0?'rgb(255,'+fade+','+fade+')':'rgb('+fade+','+fade+',255)';
+  }
+  let h=0;
+  for(let k=0;k<name.length;k++)h=(h*31+name.charCodeAt(k))|0;
+  h=Math.abs(h);
+  return 'rgb('+(205+h%50)+','+(80+(h>>8)%130)+','+(20+(h>>16)%40)+')';
+}
+
+function flameRender(){
+  const c=$('flame-canvas');
+  if(!fv||!c)return;
+  const W=c.clientWidth,H=(fv.maxDepth+1)*FLAME_ROW,dpr=window.devicePixelRatio||1;
+  c.width=W*dpr;c.height=H*dpr;c.style.height=H+'px';
+  const g=c.getContext('2d');
+  g.scale(dpr,dpr);
+  g.font='11px monospace';
+  g.textBaseline='middle';
+  fv.rects=[];
+  const row=d=>fv.mode==='flame'?(fv.maxDepth-d)*FLAME_ROW:d*FLAME_ROW;
+  const box=(i,x,w,dim)=>{
+    const y=row(fv.depth[i]),name=i?fv.names[fv.frame[i]]:'all';
+    g.globalAlpha=dim?0.5:1;
+    g.fillStyle=flameColor(name,i);
+    g.fillRect(x,y,Math.max(w-1,0.5),FLAME_ROW-1);
+    if(w>30){
+      const fit=Math.floor((w-6)/6.6);
+      g.fillStyle=fv.match&&!fv.match[i]?'#999':'#000';
+      g.fillText(name.length>fit?name.substring(0,Math.max(fit-2,0))+'..':name,x+3,y+FLAME_ROW/2);
+    }
+    fv.rects.push([x,y,w,i]);
+  };
+  // Ancestors of the zoomed frame span the whole width
+  for(let a=fv.parent[fv.zoom],z=fv.zoom;z!==0;z=a,a=fv.parent[a])box(a,0,W,true);
+  const scale=fv.weight[fv.zoom]>0?W/fv.weight[fv.zoom]:0;
+  const walk=(i,x)=>{
+    const w=fv.weight[i]*scale;
+    if(w<0.5)return;
+    box(i,x,w,false);
+    for(const k of fv.kids[i]){walk(k,x);x+=fv.weight[k]*scale;}
+  };
+  walk(fv.zoom,0);
+  g.globalAlpha=1;
+}
+
+function flameHit(e){
+  if(!fv)return -1;
+  const r=e.target.getBoundingClientRect(),x=e.clientX-r.left,y=e.clientY-r.top;
+  for(const [rx,ry,rw,i] of fv.rects)if(x>=rx&&x<rx+rw&&y>=ry&&y<ry+FLAME_ROW)return i;
+  return -1;
+}
+
+function pct(f){return (100*f).toFixed(2)+'%';}
+function flamePct(v){return pct(fv.sum>0?v/fv.sum:0);}
+function flameBasePct(v){return pct(fv.bsum>0?v/fv.bsum:0);}
+// Counts are samples, microseconds for off-CPU and on+off views, or bytes
+// for heap profiles
+function flameAmount(v){
+  if(fv.unit==='bytes')return v>=1073741824?(v/1073741824).toFixed(2)+' GB':v>=1048576?(v/1048576).toFixed(1)+' MB':
+    v>=1024?(v/1024).toFixed(1)+' KB':v+' B';
+  if(fv.unit!=='us')return v+' samples';
+  return v>=1e6?(v/1e6).toFixed(2)+' s':v>=1e3?(v/1e3).toFixed(1)+' ms':v+' us';
+}
+
+function flameHover(e){
+  const tip=$('flame-tip'),i=flameHit(e);
+  if(i<0){tip.style.display='none';return;}
+  const name=i?fv.names[fv.frame[i]]:'all';
+  if(fv.diff){
+    const delta=100*(flameShare(i)-flameBaseShare(i));
+    tip.textContent=name+'\ntotal '+flameBasePct(fv.btotal[i])+' -> '+flamePct(fv.total[i])+
+      ' ('+(delta>=0?'+':'')+delta.toFixed(2)+')  self '+flameBasePct(fv.bself[i])+' -> '+flamePct(fv.self[i]);
+  }else{
+    tip.textContent=name+'\ntotal '+flameAmount(fv.total[i])+' ('+flamePct(fv.total[i])+
+      ')  self '+flameAmount(fv.self[i])+' ('+flamePct(fv.self[i])+')';
+  }
+  const r=e.target.getBoundingClientRect();
+  tip.style.display='block';
+  tip.style.left=Math.min(e.clientX-r.left+12,r.width-tip.offsetWidth-4)+'px';
+  tip.style.top=(e.clientY-r.top+16)+'px';
+}
+
+function flameZoom(i){
+  if(!fv)return;
+  fv.zoom=i;
+  flameRender();
+}
+
+function flameSearch(q){
+  if(!fv)return;
+  let re=null;
+  try{re=q?new RegExp(q):null;}catch(e){}
+  const n=fv.frame.length;
+  if(!re){fv.match=null;$('flame-match').textContent='';flameRender();return;}
+  // Matched share counts each sample once, even under nested matches
+  const match=new Uint8Array(n),under=new Uint8Array(n);
+  let sum=0;
+  for(let i=1;i<n;i++){
+    match[i]=re.test(fv.names[fv.frame[i]])?1:0;
+    under[i]=under[fv.parent[i]]|match[i];
+    if(match[i]&&!under[fv.parent[i]])sum+=fv.weight[i];
+  }
+  fv.match=match;
+  $('flame-match').textContent='matched '+pct(fv.weight[0]>0?sum/fv.weight[0]:0);
+  flameRender();
+}
+
+function flameSort(by){
+  fv.sort=by;
+  flameTop();
+}
+
+function flameRow(cells,onpick){
+  const tr=document.createElement('tr');
+  cells.forEach((v,k)=>{
+    const td=document.createElement('td');
+    td.className=k?'num':'fn';
+    td.textContent=v;
+    if(!k){td.title=v;td.onclick=()=>{
+      const q=v.replace(/[.*+?^${}()|[\]\\]/g,'\\$&');
+      $('flame-search').value=q;flameSearch(q);
+    };}
+    tr.appendChild(td);
+  });
+  return tr;
+}
+
+// Self and total time per function; total skips recursive re-entries so a
+// sample is not counted twice for the same function.  A diff lists the
+// functions whose share of self samples grew the most instead.
+function flameTop(){
+  const head=$('flame-top-head'),body=$('flame-top');
+  body.replaceChildren();
+  if(fv.diff){
+    head.innerHTML='<tr><th>Regressed functions</th><th class="num">Base self</th><th class="num">Self</th>'+
+      '<th class="num">&Delta; self</th><th class="num">&Delta; total</th></tr>';
+    const d=(a,b)=>{const v=100*((fv.sum>0?a/fv.sum:0)-(fv.bsum>0?b/fv.bsum:0));return (v>=0?'+':'')+v.toFixed(2);};
+    for(const r of fv.regressions){
+      body.appendChild(flameRow([r.name,flameBasePct(r.base_self),flamePct(r.self),
+        d(r.self,r.base_self),d(r.total,r.base_total)]));
+    }
+    return;
+  }
+  head.innerHTML='<tr><th>Top functions</th>'+
+    '<th class="num sort" onclick="flameSort(\'self\')">Self</th><th class="num">%</th>'+
+    '<th class="num sort" onclick="flameSort(\'total\')">Total</th><th class="num">%</th></tr>';
+  const n=fv.frame.length,self=new Map(),total=new Map();
+  for(let i=1;i<n;i++){
+    const f=fv.frame[i];
+    self.set(f,(self.get(f)||0)+fv.self[i]);
+    let a=fv.parent[i];
+    while(a&&fv.frame[a]!==f)a=fv.parent[a];
+    if(!a)total.set(f,(total.get(f)||0)+fv.total[i]);
+  }
+  const key=fv.sort==='self'?self:total;
+  const rows=[...total.keys()].sort((a,b)=>(key.get(b)||0)-(key.get(a)||0)).slice(0,25);
+  for(const f of rows){
+    const amt=v=>fv.unit==='us'?flameAmount(v):v;
+    body.appendChild(flameRow([fv.names[f],amt(self.get(f)||0),flamePct(self.get(f)||0),
+      amt(total.get(f)),flamePct(total.get(f))]));
+  }
+}
+
+function onProfiles(list){
+  let history=false;
+  for(const j of list){
+    profileUpdate(j);
+    if(j.session===flameSession&&j.state!=='recording')history=true;
+  }
+  if(history)loadHistory();
+}
+
+// Terminal: raw bytes over a WebSocket.  Output is decoded incrementally and
+// painted at most once per animation frame; escape sequences are stripped
+// rather than emulated.
+const TERM_MAX_CHARS=200000;
+const TERM_KEYS={Enter:'\r',Backspace:'\x7f',Tab:'\t',Escape:'\x1b',ArrowUp:'\x1b[A',ArrowDown:'\x1b[B',ArrowRight:'\x1b[C',ArrowLeft:'\x1b[D',Home:'\x1b[H',End:'\x1b[F',Delete:'\x1b[3~',PageUp:'\x1b[5~',PageDown:'\x1b[6~'};
+let term=null;
+
+function openTerminal(id){
+  closeTerminal();
+  const proto=location.protocol==='https:'?'wss:':'ws:';
+  const ws=new WebSocket(proto+'//'+location.host+'/api/sessions/'+id+'/terminal');
+  ws.binaryType='arraybuffer';
+  term={ws:ws,id:id,decoder:new TextDecoder(),encoder:new TextEncoder(),pty:false,text:'',pending:'',raf:0};
+  $('terminal-session-id').textContent=id.substring(0,8)+'...';
+  $('terminal-state').textContent='connecting';
+  $('terminal-content').textContent='';
+  $('terminal-panel').style.display='block';
+  ws.onmessage=e=>{
+    if(!term||term.ws!==ws)return;
+    if(typeof e.data==='string'){
+      try{const d=JSON.parse(e.data);term.pty=!!d.pty;}catch(err){}
+      $('terminal-state').textContent=term.pty?'(pty)':'(output only; start with PTY for input)';
+      termResize();
+      $('terminal-content').focus();
+      return;
+    }
+    termWrite(term.decoder.decode(new Uint8Array(e.data),{stream:true}));
+  };
+  ws.onclose=()=>{if(term&&term.ws===ws)$('terminal-state').textContent='(closed)';};
+}
+
+function termWrite(s){
+  term.pending+=s;
+  if(!term.raf)term.raf=requestAnimationFrame(termPaint);
+}
+
+function termPaint(){
+  if(!term)return;
+  term.raf=0;
+  let s=term.pending.replace(/\x1b\][^\x07\x1b]*(\x07|\x1b\\)/g,'').replace(/\x1b\[[0-9;?]*[ -\/]*[@-~]/g,'').replace(/\x1b[()][0-9A-Za-z]|\x1b[=>78M]/g,'');
+  term.pending='';
+  let t=term.text;
+  for(const seg of s.replace(/\r\n/g,'\n').split(/(\r|\x08|\x07)/)){
+    if(seg==='\r'){t=t.substring(0,t.lastIndexOf('\n')+1);}
+    else if(seg==='\x08'){if(t.length&&t[t.length-1]!=='\n')t=t.substring(0,t.length-1);}
+    else if(seg!=='\x07')t+=seg;
   }
+  if(t.length>TERM_MAX_CHARS)t=t.substring(t.length-TERM_MAX_CHARS);
+  term.text=t;
+  const el=$('terminal-content');
+  const atBottom=el.scrollTop+el.clientHeight>=el.scrollHeight-4;
+  el.textContent=t;
+  if(atBottom)el.scrollTop=el.scrollHeight;
+}
+
+function termSend(s){
+  if(term&&term.pty&&term.ws.readyState===1)term.ws.send(term.encoder.encode(s));
+}
+
+function termResize(){
+  if(!term||term.ws.readyState!==1)return;
+  const el=$('terminal-content');
+  const probe=document.createElement('span');
+  probe.textContent='M';
+  el.appendChild(probe);
+  const cw=probe.getBoundingClientRect().width||8,ch=probe.getBoundingClientRect().height||16;
+  probe.remove();
+  const cols=Math.max(20,Math.floor((el.clientWidth-24)/cw)),rows=Math.max(5,Math.floor((el.clientHeight-24)/ch));
+  term.ws.send(JSON.stringify({type:'resize',cols:cols,rows:rows}));
+}
+
+function closeTerminal(){
+  if(term){try{term.ws.close();}catch(e){}if(term.raf)cancelAnimationFrame(term.raf);}
+  term=null;
+  $('terminal-panel').style.display='none';
 }
 
+$('terminal-content').addEventListener('keydown',e=>{
+  if(!term||!term.pty)return;
+  let s=null;
+  if(e.ctrlKey&&e.key.length===1){
+    const c=e.key.toUpperCase().charCodeAt(0);
+    if(c>=64&&c<=95)s=String.fromCharCode(c-64);
+  }else if(TERM_KEYS[e.key]){s=TERM_KEYS[e.key];}
+  else if(e.key.length===1&&!e.metaKey){s=e.key;}
+  if(s!==null){e.preventDefault();termSend(s);}
+});
+$('terminal-content').addEventListener('paste',e=>{
+  if(!term||!term.pty)return;
+  e.preventDefault();
+  termSend(e.clipboardData.getData('text'));
+});
+window.addEventListener('resize',termResize);
+window.addEventListener('resize',flameRender);
+
 function closeFlamegraph(){
   $('flamegraph-panel').style.display='none';
   $('flamegraph-content').innerHTML='';
+  fv=null;
+  flameSession=null;
+  flameJob=null;
+  if(contTimer){clearInterval(contTimer);contTimer=null;}
+}
+
+// Uploads go out in fixed-size chunks over /api/uploads so progress can be
+// shown and a dropped connection resumes from the daemon's byte count.
+const UPLOAD_CHUNK=4*1024*1024;
+const UPLOAD_RETRIES=5;
+
+function isBundle(name){return /\.(tar\.gz|tgz)$/i.test(name);}
+
+function uploadProgress(sent,total,label){
+  const pct=total?Math.floor(sent*100/total):0;
+  $('upload-progress').style.display='block';
+  $('upload-text').style.display='block';
+  $('upload-bar').style.width=pct+'%';
+  $('upload-text').textContent=label+' '+pct+'% ('+(sent/1048576).toFixed(1)+' / '+(total/1048576).toFixed(1)+' MB)';
+}
+
+function uploadDone(){
+  $('upload-progress').style.display='none';
+  $('upload-text').style.display='none';
+  $('upload-bar').style.width='0';
+}
+
+function sendChunk(token,offset,blob,onprogress){
+  return new Promise((resolve,reject)=>{
+    const xhr=new XMLHttpRequest();
+    xhr.open('PUT','/api/uploads/'+token+'?offset='+offset);
+    xhr.setRequestHeader('Content-Type','application/octet-stream');
+    xhr.upload.onprogress=e=>{if(e.lengthComputable)onprogress(e.loaded);};
+    xhr.onload=()=>{
+      let d={};
+      try{d=JSON.parse(xhr.responseText);}catch(e){}
+      if(xhr.status===200)resolve(d);
+      else if(xhr.status===409&&d.received!==undefined)resolve(d);
+      else reject(new Error(d.error||('HTTP '+xhr.status)));
+    };
+    xhr.onerror=()=>reject(new Error('network error'));
+    xhr.send(blob);
+  });
 }
 
 async function upload(file){
   if(!file)return;
-  toast('Uploading '+file.name+'...');
+  const execPath=$('exec-path').value.trim();
+  if(isBundle(file.name)&&!execPath){toast('Set the exec path inside the bundle first',true);$('exec-path').focus();return;}
+  if(!isBundle(file.name)&&execPath){toast('Exec path is only used for tar.gz bundles',true);return;}
+  let q='?size='+file.size;
+  if(execPath)q+='&exec_path='+encodeURIComponent(execPath);
   try{
-    const r=await fetch('/api/upload',{method:'POST',body:file,headers:{'Content-Type':'application/octet-stream'}});
-    const d=await r.json();
-    if(d.error_code){toast(d.message,true);}
-    else{toast('Uploaded: '+d.id.substring(0,8));}
+    const r=await fetch('/api/uploads'+q,{method:'POST'});
+    const c=await r.json();
+    if(!c.upload){toast('Upload failed: '+(c.error||'unknown'),true);return;}
+    let offset=0,retries=0,result=null;
+    uploadProgress(0,file.size,file.name);
+    while(offset<file.size){
+      const end=Math.min(offset+UPLOAD_CHUNK,file.size);
+      try{
+        const d=await sendChunk(c.upload,offset,file.slice(offset,end),n=>uploadProgress(offset+n,file.size,file.name));
+        offset=d.received;
+        if(d.done)result=d.result;
+        retries=0;
+      }catch(e){
+        if(++retries>UPLOAD_RETRIES)throw e;
+        await new Promise(res=>setTimeout(res,500*retries));
+        const s=await fetch('/api/uploads/'+c.upload).then(x=>x.json());
+        if(s.received===undefined)throw e;
+        offset=s.received;
+      }
+      uploadProgress(offset,file.size,file.name);
+    }
+    uploadDone();
+    if(!result||result.error_code||result.error){toast((result&&(result.message||result.error))||'Upload failed',true);}
+    else{toast('Uploaded: '+result.id.substring(0,8)+(result.bundle?' (bundle)':''));$('exec-path').value='';}
     refresh();
-  }catch(e){toast('Upload failed',true);}
+  }catch(e){uploadDone();toast('Upload failed: '+e.message,true);}
 }
 
 $('file-input').addEventListener('change',function(){upload(this.files[0]);this.value='';});
@@ -444,6 +1357,8 @@ let evtSrc;
 function connectSSE(){
   evtSrc=new EventSource('/api/events');
   evtSrc.onmessage=e=>{try{render(JSON.parse(e.data));setConnected(true);}catch(err){}};
+  evtSrc.addEventListener('sessions',e=>{try{applyDiff(JSON.parse(e.data));}catch(err){}});
+  evtSrc.addEventListener('profiles',e=>{try{onProfiles(JSON.parse(e.data));}catch(err){}});
   evtSrc.addEventListener('activity',e=>{try{updateActivity(JSON.parse(e.data));}catch(err){}});
   evtSrc.onerror=()=>{evtSrc.close();setConnected(false);setTimeout(connectSSE,3000);};
 }
@@ -477,15 +1392,33 @@ refresh();
 // HTTP helpers
 // ---------------------------------------------------------------------------
 
+constexpr size_t kUploadChunkBuffer = 64 * 1024;
+constexpr int kUploadIdleTimeoutSec = 600;
+constexpr int kUploadResponseTimeoutSec = 120;
+
+constexpr int kMaxRunningProfiles = 2;  // perf with DWARF unwinding is heavy
+constexpr size_t kMaxQueuedProfiles = 8;
+constexpr size_t kMaxProfilesPerSession = 20;
+constexpr size_t kMaxProfiles = 200;
+constexpr int kDefaultProfileMaxAge = 60;
+constexpr size_t kMaxContinuousProfilers = 8;
+
+}  // namespace
+
 struct HttpRequest {
     std::string method;
     std::string path;
     std::string query;
+    std::map<std::string, std::string> headers;  // lower-cased names
     std::string body;
     size_t content_length = 0;
 };
 
-bool read_request(int fd, HttpRequest &req) {
+namespace {
+
+// Reads the request line and headers.  Any body bytes that arrived with the
+// headers are left in req.body; read_request_body() fetches the rest.
+bool read_request_head(int fd, HttpRequest &req) {
     std::string buf;
     char tmp[8192];
 
@@ -498,7 +1431,7 @@ bool read_request(int fd, HttpRequest &req) {
 
     auto header_end = buf.find("\r\n\r\n");
     std::string headers = buf.substr(0, header_end);
-    std::string rest = buf.substr(header_end + 4);
+    req.body = buf.substr(header_end + 4);
 
     // First line
     auto le = headers.find("\r\n");
@@ -517,243 +1450,388 @@ bool read_request(int fd, HttpRequest &req) {
         req.path = full_path;
     }
 
-    // Content-Length (case-insensitive)
-    std::string lh = headers;
-    std::transform(lh.begin(), lh.end(), lh.begin(), ::tolower);
-    auto cl = lh.find("content-length:");
-    if (cl != std::string::npos) {
-        auto vs = cl + 15;
-        while (vs < lh.size() && lh[vs] == ' ') vs++;
-        auto ve = lh.find("\r\n", vs);
-        if (ve == std::string::npos) ve = lh.size();
-        req.content_length = std::stoull(lh.substr(vs, ve - vs));
+    // Header fields (names are case-insensitive)
+    size_t pos = (le == std::string::npos) ? headers.size() : le + 2;
+    while (pos < headers.size()) {
+        auto eol = headers.find("\r\n", pos);
+        if (eol == std::string::npos) eol = headers.size();
+        std::string line = headers.substr(pos, eol - pos);
+        pos = eol + 2;
+        auto colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        auto vs = line.find_first_not_of(' ', colon + 1);
+        req.headers[name] = (vs == std::string::npos) ? "" : line.substr(vs);
+    }
+
+    auto cl = req.headers.find("content-length");
+    if (cl != req.headers.end()) {
+        try { req.content_length = std::stoull(cl->second); } catch (...) { return false; }
     }
+    if (req.body.size() > req.content_length) req.body.resize(req.content_length);
+    return true;
+}
 
-    // Read body
-    req.body = rest;
+bool read_request_body(int fd, HttpRequest &req) {
+    char tmp[8192];
     while (req.body.size() < req.content_length) {
         ssize_t n = read(fd, tmp, std::min(sizeof(tmp), req.content_length - req.body.size()));
         if (n <= 0) return false;
         req.body.append(tmp, static_cast<size_t>(n));
     }
-
     return true;
 }
 
-std::vector<std::string> split_path(const std::string &path) {
-    std::vector<std::string> parts;
-    std::istringstream iss(path);
-    std::string part;
-    while (std::getline(iss, part, '/')) {
-        if (!part.empty()) parts.push_back(part);
+std::string url_decode(const std::string &s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() &&
+                   isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+                   isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+            out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
     }
-    return parts;
+    return out;
 }
 
-void send_http(int fd, int status, const std::string &ctype, const std::string &body) {
-    const char *text = "OK";
-    if (status == 204) text = "No Content";
-    else if (status == 400) text = "Bad Request";
-    else if (status == 404) text = "Not Found";
-    else if (status == 500) text = "Internal Server Error";
-
-    std::ostringstream oss;
-    oss << "HTTP/1.1 " << status << " " << text << "\r\n";
-    if (!ctype.empty()) oss << "Content-Type: " << ctype << "\r\n";
-    oss << "Content-Length: " << body.size() << "\r\n"
-        << "Access-Control-Allow-Origin: *\r\n"
-        << "Access-Control-Allow-Methods: GET, POST, DELETE, OPTIONS\r\n"
-        << "Access-Control-Allow-Headers: Content-Type\r\n"
-        << "Connection: close\r\n"
-        << "\r\n"
-        << body;
+// Returns the decoded value of `key` in a query string, or `def` if absent.
+std::string query_param(const std::string &query, const std::string &key,
+                        const std::string &def = "") {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        auto amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        std::string pair = query.substr(pos, amp - pos);
+        auto eq = pair.find('=');
+        if (pair.substr(0, eq) == key) {
+            return (eq == std::string::npos) ? "" : url_decode(pair.substr(eq + 1));
+        }
+        pos = amp + 1;
+    }
+    return def;
+}
 
-    std::string resp = oss.str();
+bool write_all(int fd, const char *data, size_t len) {
     size_t off = 0;
-    while (off < resp.size()) {
-        ssize_t n = write(fd, resp.data() + off, resp.size() - off);
-        if (n <= 0) break;
+    while (off < len) {
+        ssize_t n = write(fd, data + off, len - off);
+        if (n <= 0) return false;
         off += static_cast<size_t>(n);
     }
+    return true;
 }
 
-std::string trim_newlines(const std::string &s) {
-    auto e = s.find_last_not_of("\r\n");
-    return (e == std::string::npos) ? "" : s.substr(0, e + 1);
+// Reads one newline-terminated control response.
+std::string read_control_line(int fd) {
+    std::string resp;
+    char buf[4096];
+    while (true) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        resp.append(buf, static_cast<size_t>(n));
+        if (memchr(buf, '\n', static_cast<size_t>(n))) break;
+    }
+    return resp;
+}
+
+// Valid exec paths are forwarded as a single protocol word.
+bool valid_exec_path(const std::string &p) {
+    if (p.empty() || p.find("..") != std::string::npos) return false;
+    for (char c : p) {
+        if (isspace(static_cast<unsigned char>(c))) return false;
+    }
+    return true;
 }
 
 // ---------------------------------------------------------------------------
-// Flamegraph helpers (run in WebUI thread, safe to block)
+// WebSocket helpers (RFC 6455)
 // ---------------------------------------------------------------------------
 
-struct FlameNode {
-    std::string name;
-    int self_samples = 0;
-    std::map<std::string, FlameNode> children;
-};
-
-static int flame_total(const FlameNode &n) {
-    int t = n.self_samples;
-    for (const auto &c : n.children) t += flame_total(c.second);
-    return t;
-}
-
-static int flame_depth(const FlameNode &n) {
-    int d = 0;
-    for (const auto &c : n.children)
-        d = std::max(d, 1 + flame_depth(c.second));
-    return d;
-}
-
-// Parse perf-script output into folded stacks (like stackcollapse-perf.pl)
-static std::map<std::string, int> collapse_perf_script(const std::string &input) {
-    std::map<std::string, int> stacks;
-    std::istringstream iss(input);
-    std::string line;
-    std::vector<std::string> frames;
-
-    auto flush = [&]() {
-        if (frames.empty()) return;
-        // perf script gives leaf-first; reverse to root-first
-        std::reverse(frames.begin(), frames.end());
-        std::string key;
-        for (size_t i = 0; i < frames.size(); ++i) {
-            if (i) key += ';';
-            key += frames[i];
+constexpr size_t kMaxWsFramePayload = 1024 * 1024;
+
+std::string sha1_digest(const std::string &msg) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string data = msg;
+    uint64_t bit_len = static_cast<uint64_t>(msg.size()) * 8;
+    data += static_cast<char>(0x80);
+    while (data.size() % 64 != 56) data += '\0';
+    for (int i = 7; i >= 0; --i) data += static_cast<char>((bit_len >> (i * 8)) & 0xff);
+
+    auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            const auto *p = reinterpret_cast<const unsigned char *>(data.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
         }
-        stacks[key]++;
-        frames.clear();
-    };
-
-    while (std::getline(iss, line)) {
-        if (line.empty()) { flush(); continue; }
-        if (line[0] == '\t' || line[0] == ' ') {
-            // Stack frame line: "    addr func+offset (module)"
-            size_t p = line.find_first_not_of(" \t");
-            if (p == std::string::npos) continue;
-            size_t sp = line.find(' ', p);
-            if (sp == std::string::npos) continue;
-            size_t fs = line.find_first_not_of(" ", sp);
-            if (fs == std::string::npos) continue;
-            size_t fe = line.find_first_of("+ (", fs);
-            std::string func = (fe != std::string::npos)
-                ? line.substr(fs, fe - fs) : line.substr(fs);
-            if (!func.empty() && func[0] != '(')
-                frames.push_back(func);
-        } else {
-            flush();  // header line for next sample
+        for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
         }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
     }
-    flush();
-    return stacks;
-}
-
-static FlameNode build_flame_tree(const std::map<std::string, int> &stacks) {
-    FlameNode root;
-    root.name = "all";
-    for (const auto &kv : stacks) {
-        FlameNode *node = &root;
-        std::istringstream iss(kv.first);
-        std::string fn;
-        while (std::getline(iss, fn, ';')) {
-            auto &child = node->children[fn];
-            if (child.name.empty()) child.name = fn;
-            node = &child;
-        }
-        node->self_samples += kv.second;
+    std::string out;
+    for (uint32_t v : h) {
+        for (int i = 3; i >= 0; --i) out += static_cast<char>((v >> (i * 8)) & 0xff);
     }
-    return root;
-}
-
-static std::string flame_color(const std::string &name) {
-    unsigned h = 0;
-    for (char c : name) h = h * 31 + static_cast<unsigned>(c);
-    int r = 200 + static_cast<int>(h % 55);
-    int g = 80 + static_cast<int>((h >> 8) % 60);
-    int b = 10 + static_cast<int>((h >> 16) % 30);
-    char buf[8];
-    snprintf(buf, sizeof(buf), "#%02x%02x%02x", r, g, b);
-    return buf;
+    return out;
 }
 
-static std::string svg_escape(const std::string &s) {
+std::string base64_encode(const std::string &in) {
+    static const char *tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
     std::string out;
-    out.reserve(s.size());
-    for (char c : s) {
-        switch (c) {
-            case '<': out += "&lt;"; break;
-            case '>': out += "&gt;"; break;
-            case '&': out += "&amp;"; break;
-            case '"': out += "&quot;"; break;
-            default: out += c;
-        }
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3) {
+        uint32_t v = (uint32_t(uint8_t(in[i])) << 16) | (uint32_t(uint8_t(in[i + 1])) << 8) | uint8_t(in[i + 2]);
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63];
+        out += tbl[(v >> 6) & 63];  out += tbl[v & 63];
+    }
+    if (i + 1 == in.size()) {
+        uint32_t v = uint32_t(uint8_t(in[i])) << 16;
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63]; out += "==";
+    } else if (i + 2 == in.size()) {
+        uint32_t v = (uint32_t(uint8_t(in[i])) << 16) | (uint32_t(uint8_t(in[i + 1])) << 8);
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63]; out += tbl[(v >> 6) & 63]; out += '=';
     }
     return out;
 }
 
-static void render_flame_node(std::ostringstream &svg, const FlameNode &node,
-                              int level, double x, int total, int max_depth,
-                              int svg_w, int cell_h, int top_margin) {
-    int nt = flame_total(node);
-    double w = (static_cast<double>(nt) / total) * (svg_w - 20);
-    if (w < 0.5) return;
-    double y = top_margin + (max_depth - level) * cell_h;
-    std::string col = (level == 0) ? "#4ecca3" : flame_color(node.name);
-
-    svg << "<g><title>" << svg_escape(node.name) << " (" << nt
-        << " samples, " << (total > 0 ? nt * 100 / total : 0)
-        << "%)</title><rect x=\"" << (10 + x) << "\" y=\"" << y
-        << "\" width=\"" << w << "\" height=\"" << (cell_h - 1)
-        << "\" fill=\"" << col << "\" rx=\"2\"/>";
-    if (w > 30) {
-        int mc = static_cast<int>(w / 7);
-        std::string label = node.name;
-        if (mc > 2 && static_cast<int>(label.size()) > mc)
-            label = label.substr(0, mc - 2) + "..";
-        svg << "<text x=\"" << (10 + x + 3) << "\" y=\"" << (y + cell_h - 5)
-            << "\" fill=\"#000\" font-size=\"11\" "
-            << "style=\"pointer-events:none\">"
-            << svg_escape(label) << "</text>";
-    }
-    svg << "</g>\n";
-
-    double cx = x;
-    for (const auto &c : node.children) {
-        render_flame_node(svg, c.second, level + 1, cx, total,
-                          max_depth, svg_w, cell_h, top_margin);
-        cx += (static_cast<double>(flame_total(c.second)) / total) * (svg_w - 20);
-    }
-}
-
-static std::string generate_flamegraph_svg(const FlameNode &root, int total) {
-    if (total == 0)
-        return "<svg xmlns='http://www.w3.org/2000/svg' width='600' height='40'>"
-               "<text y='20' fill='#e0e0e0' font-family='monospace'>"
-               "No samples collected</text></svg>";
-
-    int depth = flame_depth(root);
-    int cell_h = 18;
-    int svg_w = 1200;
-    int top_margin = 60;
-    int svg_h = top_margin + (depth + 1) * cell_h + 10;
-
-    std::ostringstream svg;
-    svg << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << svg_w
-        << "\" height=\"" << svg_h << "\" viewBox=\"0 0 " << svg_w << " "
-        << svg_h << "\" style=\"background:#0f0f23;"
-        << "font-family:'SF Mono','Fira Code',monospace\">\n";
-    svg << "<text x=\"" << svg_w / 2 << "\" y=\"24\" text-anchor=\"middle\" "
-        << "fill=\"#e94560\" font-size=\"16\" font-weight=\"bold\">"
-        << "Flamegraph</text>\n";
-    svg << "<text x=\"" << svg_w / 2 << "\" y=\"42\" text-anchor=\"middle\" "
-        << "fill=\"#666\" font-size=\"11\">" << total
-        << " samples</text>\n";
-
-    render_flame_node(svg, root, 0, 0, total, depth, svg_w, cell_h, top_margin);
-
-    svg << "</svg>\n";
-    return svg.str();
-}
+bool ws_send_frame(int fd, uint8_t opcode, const char *data, size_t len) {
+    char hdr[10];
+    size_t hlen = 2;
+    hdr[0] = static_cast<char>(0x80 | opcode);
+    if (len < 126) {
+        hdr[1] = static_cast<char>(len);
+    } else if (len <= 0xffff) {
+        hdr[1] = 126;
+        hdr[2] = static_cast<char>((len >> 8) & 0xff);
+        hdr[3] = static_cast<char>(len & 0xff);
+        hlen = 4;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; ++i) hdr[2 + i] = static_cast<char>((uint64_t(len) >> ((7 - i) * 8)) & 0xff);
+        hlen = 10;
+    }
+    return write_all(fd, hdr, hlen) && write_all(fd, data, len);
+}
+
+struct WsFrame {
+    uint8_t opcode = 0;
+    bool fin = false;
+    std::string payload;
+};
+
+// Extracts one complete client frame from `buf`.  Returns 1 on success, 0 if
+// more bytes are needed, -1 on a protocol violation.
+int ws_parse_frame(std::string &buf, WsFrame &frame) {
+    if (buf.size() < 2) return 0;
+    auto b0 = static_cast<uint8_t>(buf[0]);
+    auto b1 = static_cast<uint8_t>(buf[1]);
+    if (!(b1 & 0x80)) return -1;  // client frames must be masked
+    uint64_t len = b1 & 0x7f;
+    size_t pos = 2;
+    if (len == 126) {
+        if (buf.size() < 4) return 0;
+        len = (uint64_t(uint8_t(buf[2])) << 8) | uint8_t(buf[3]);
+        pos = 4;
+    } else if (len == 127) {
+        if (buf.size() < 10) return 0;
+        len = 0;
+        for (int i = 0; i < 8; ++i) len = (len << 8) | uint8_t(buf[2 + i]);
+        pos = 10;
+    }
+    if (len > kMaxWsFramePayload) return -1;
+    if (buf.size() < pos + 4 + len) return 0;
+    const char *mask = buf.data() + pos;
+    pos += 4;
+    frame.fin = (b0 & 0x80) != 0;
+    frame.opcode = b0 & 0x0f;
+    frame.payload.assign(buf, pos, static_cast<size_t>(len));
+    for (size_t i = 0; i < frame.payload.size(); ++i) frame.payload[i] ^= mask[i % 4];
+    buf.erase(0, pos + static_cast<size_t>(len));
+    return 1;
+}
+
+// Integer field from a flat JSON object, e.g. {"cols":80}.
+long long json_int_field(const std::string &json, const std::string &key, long long def) {
+    auto pos = json.find("\"" + key + "\":");
+    if (pos == std::string::npos) return def;
+    try { return std::stoll(json.substr(pos + key.size() + 3)); } catch (...) { return def; }
+}
+
+// A span like "300", "5m" or "2h", in seconds; -1 if malformed.
+long parse_span(const std::string &s) {
+    char *end = nullptr;
+    long v = strtol(s.c_str(), &end, 10);
+    if (end == s.c_str() || v < 0) return -1;
+    std::string unit(end);
+    if (unit.empty() || unit == "s") return v;
+    if (unit == "m") return v * 60;
+    if (unit == "h") return v * 3600;
+    return -1;
+}
+
+// Unix seconds, or a local wall-clock time "HH:MM[:SS]" meaning its most
+// recent occurrence; -1 if malformed.
+time_t parse_when(const std::string &s, time_t now) {
+    if (s.find(':') == std::string::npos) {
+        char *end = nullptr;
+        long long v = strtoll(s.c_str(), &end, 10);
+        return end != s.c_str() && *end == '\0' && v > 0 ? static_cast<time_t>(v) : -1;
+    }
+    int h = 0, m = 0, sec = 0;
+    if (sscanf(s.c_str(), "%d:%d:%d", &h, &m, &sec) < 2 || h < 0 || h > 23 || m < 0 || m > 59 ||
+        sec < 0 || sec > 59) {
+        return -1;
+    }
+    tm t{};
+    localtime_r(&now, &t);
+    t.tm_hour = h;
+    t.tm_min = m;
+    t.tm_sec = sec;
+    t.tm_isdst = -1;
+    time_t when = mktime(&t);
+    return when > now ? when - 24 * 3600 : when;
+}
+
+// String field from a JSON object; the first occurrence of the key wins.
+std::string json_string_field(const std::string &json, const std::string &key) {
+    auto pos = json.find("\"" + key + "\":\"");
+    if (pos == std::string::npos) return "";
+    pos += key.size() + 4;
+    std::string out;
+    for (size_t i = pos; i < json.size() && json[i] != '"'; ++i) {
+        char c = json[i];
+        if (c == '\\' && i + 1 < json.size()) {
+            // The escapes json_escape() writes
+            switch (c = json[++i]) {
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                default: break;
+            }
+        }
+        out += c;
+    }
+    return out;
+}
+
+// Splits a JSON array of objects ("[{...},{...}]") into its elements.
+std::vector<std::string> split_json_objects(const std::string &array) {
+    std::vector<std::string> out;
+    int depth = 0;
+    bool in_str = false;
+    size_t start = 0;
+    for (size_t i = 0; i < array.size(); ++i) {
+        char c = array[i];
+        if (in_str) {
+            if (c == '\\') ++i;
+            else if (c == '"') in_str = false;
+            continue;
+        }
+        if (c == '"') {
+            in_str = true;
+        } else if (c == '{') {
+            if (depth++ == 0) start = i;
+        } else if (c == '}') {
+            if (--depth == 0) out.push_back(array.substr(start, i - start + 1));
+        }
+    }
+    return out;
+}
+
+std::string random_token() {
+    static std::mutex mu;
+    static std::mt19937_64 rng{std::random_device{}()};
+    std::lock_guard<std::mutex> lock(mu);
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx",
+             static_cast<unsigned long long>(rng()),
+             static_cast<unsigned long long>(rng()));
+    return buf;
+}
+
+// Single "bytes=" range: A-B, A- (last = SIZE_MAX) or -N (suffix = N).
+// Multiple ranges are not supported; the caller then serves everything.
+bool parse_byte_range(const std::string &value, size_t &first, size_t &last, size_t &suffix) {
+    if (value.compare(0, 6, "bytes=") != 0 || value.find(',') != std::string::npos) return false;
+    std::string spec = value.substr(6);
+    auto dash = spec.find('-');
+    if (dash == std::string::npos) return false;
+    std::string a = spec.substr(0, dash);
+    std::string b = spec.substr(dash + 1);
+    try {
+        first = 0;
+        last = SIZE_MAX;
+        suffix = 0;
+        if (a.empty()) {
+            suffix = std::stoull(b);
+            return suffix > 0;
+        }
+        first = std::stoull(a);
+        if (!b.empty()) last = std::stoull(b);
+        return last >= first;
+    } catch (...) {
+        return false;
+    }
+}
+
+std::vector<std::string> split_path(const std::string &path) {
+    std::vector<std::string> parts;
+    std::istringstream iss(path);
+    std::string part;
+    while (std::getline(iss, part, '/')) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+void send_http(int fd, int status, const std::string &ctype, const std::string &body) {
+    const char *text = "OK";
+    if (status == 202) text = "Accepted";
+    else if (status == 204) text = "No Content";
+    else if (status == 400) text = "Bad Request";
+    else if (status == 404) text = "Not Found";
+    else if (status == 409) text = "Conflict";
+    else if (status == 429) text = "Too Many Requests";
+    else if (status == 500) text = "Internal Server Error";
+    else if (status == 502) text = "Bad Gateway";
+
+    std::ostringstream oss;
+    oss << "HTTP/1.1 " << status << " " << text << "\r\n";
+    if (!ctype.empty()) oss << "Content-Type: " << ctype << "\r\n";
+    oss << "Content-Length: " << body.size() << "\r\n"
+        << "Access-Control-Allow-Origin: *\r\n"
+        << "Access-Control-Allow-Methods: GET, POST, PUT, DELETE, OPTIONS\r\n"
+        << "Access-Control-Allow-Headers: Content-Type\r\n"
+        << "Connection: close\r\n"
+        << "\r\n"
+        << body;
+
+    std::string resp = oss.str();
+    write_all(fd, resp.data(), resp.size());
+}
+
+std::string trim_newlines(const std::string &s) {
+    auto e = s.find_last_not_of("\r\n");
+    return (e == std::string::npos) ? "" : s.substr(0, e + 1);
+}
 
 }  // namespace
 
@@ -761,13 +1839,13 @@ static std::string generate_flamegraph_svg(const FlameNode &root, int total) {
 // WebUI implementation
 // ---------------------------------------------------------------------------
 
-WebUI::WebUI(int web_port, int control_port)
-    : web_port_(web_port), control_port_(control_port) {}
+WebUI::WebUI(int web_port, int control_port, const Telemetry &telemetry)
+    : web_port_(web_port), control_port_(control_port), telemetry_(telemetry) {}
 
 WebUI::~WebUI() { stop(); }
 
 bool WebUI::start() {
-    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (listen_fd_ < 0) {
         perror("webui: socket");
         return false;
@@ -808,13 +1886,19 @@ void WebUI::stop() {
         listen_fd_ = -1;
     }
     if (thread_.joinable()) thread_.join();
+    std::map<std::string, std::shared_ptr<ContinuousProfiler>> profilers;
+    {
+        std::lock_guard<std::mutex> lock(continuous_mu_);
+        profilers.swap(continuous_);
+    }
+    for (auto &kv : profilers) kv.second->stop();
 }
 
 void WebUI::run() {
     while (running_) {
         sockaddr_in addr{};
         socklen_t len = sizeof(addr);
-        int fd = accept(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        int fd = accept4(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len, SOCK_CLOEXEC);
         if (fd < 0) continue;
 
         std::thread([this, fd]() {
@@ -831,10 +1915,18 @@ void WebUI::handle_client(int fd) {
     setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
     HttpRequest req;
-    if (!read_request(fd, req)) return;
+    if (!read_request_head(fd, req)) return;
 
     auto parts = split_path(req.path);
 
+    // Upload bodies are streamed to the control port as they arrive; every
+    // other request is small enough to buffer.
+    bool streams_body = req.method == "POST" && parts.size() == 2 &&
+                        parts[0] == "api" && parts[1] == "upload";
+    streams_body = streams_body || (req.method == "PUT" && parts.size() == 3 &&
+                                    parts[0] == "api" && parts[1] == "uploads");
+    if (!streams_body && !read_request_body(fd, req)) return;
+
     // CORS preflight
     if (req.method == "OPTIONS") {
         send_http(fd, 204, "", "");
@@ -853,6 +1945,13 @@ void WebUI::handle_client(int fd) {
         return;
     }
 
+    // Prometheus scrape; read from the daemon's counters, not over the
+    // control port, so it costs the control loop nothing
+    if (req.method == "GET" && req.path == "/metrics") {
+        send_http(fd, 200, "text/plain; version=0.0.4; charset=utf-8", telemetry_.render());
+        return;
+    }
+
     // GET /api/sessions
     if (req.method == "GET" && parts.size() == 2 &&
         parts[0] == "api" && parts[1] == "sessions") {
@@ -874,6 +1973,25 @@ void WebUI::handle_client(int fd) {
         send_http(fd, 200, "application/json", resp);
         return;
     }
+    // GET /api/stats (loop timing, command latency, stalls)
+    if (req.method == "GET" && parts.size() == 2 &&
+        parts[0] == "api" && parts[1] == "stats") {
+        auto resp = proxy("STATS");
+        send_http(fd, 200, "application/json", resp);
+        return;
+    }
+    // GET /api/trace?session=<id> (Chrome trace JSON; all sessions without one)
+    if (req.method == "GET" && parts.size() == 2 &&
+        parts[0] == "api" && parts[1] == "trace") {
+        auto session = query_param(req.query, "session");
+        if (session.find_first_of(" \t\r\n") != std::string::npos) {
+            send_http(fd, 400, "application/json", R"({"error":"invalid_session"})");
+            return;
+        }
+        auto resp = proxy(session.empty() ? "TRACE" : "TRACE " + session);
+        send_http(fd, 200, "application/json", resp);
+        return;
+    }
     // GET /api/events (SSE)
     if (req.method == "GET" && parts.size() == 2 &&
         parts[0] == "api" && parts[1] == "events") {
@@ -881,55 +1999,131 @@ void WebUI::handle_client(int fd) {
         return;
     }
 
-    // GET /api/sessions/{id}/output
+    // GET /api/sessions/{id}/terminal  (WebSocket upgrade)
+    if (req.method == "GET" && parts.size() == 4 &&
+        parts[0] == "api" && parts[1] == "sessions" && parts[3] == "terminal") {
+        serve_terminal(fd, req, parts[2]);
+        return;
+    }
+
+    // GET /api/sessions/{id}/output.raw  (Range, ?offset=N, ?follow=1)
+    if (req.method == "GET" && parts.size() == 4 &&
+        parts[0] == "api" && parts[1] == "sessions" && parts[3] == "output.raw") {
+        serve_output_raw(fd, req, parts[2]);
+        return;
+    }
+
+    // GET /api/sessions/{id}/output?offset=N&length=M
     if (req.method == "GET" && parts.size() == 4 &&
         parts[0] == "api" && parts[1] == "sessions" && parts[3] == "output") {
-        std::string offset = "0";
-        auto opos = req.query.find("offset=");
-        if (opos != std::string::npos) {
-            offset = req.query.substr(opos + 7);
-            auto amp = offset.find('&');
-            if (amp != std::string::npos) offset = offset.substr(0, amp);
+        std::string cmd = "OUTPUT " + parts[2] + " " + query_param(req.query, "offset", "0");
+        std::string length = query_param(req.query, "length", "");
+        if (!length.empty()) cmd += " " + length;
+        auto resp = proxy(cmd);
+        send_http(fd, 200, "application/json", resp);
+        return;
+    }
+
+    // Profiling jobs:
+    //   POST   /api/sessions/{id}/profiles?duration=5[&sampler=auto|native|perf]
+    //          [&mode=cpu|offcpu|both][&max_age=60]
+    //   GET    /api/sessions/{id}/profiles          (history, newest first)
+    //   GET    /api/sessions/{id}/flamegraph?duration=5  (blocking; SVG)
+    //   GET    /api/profiles                        (every session's, newest first)
+    //   GET    /api/profiles/{job}[/svg|json|folded|speedscope|pprof]
+    //   GET    /api/profiles/{job}/diff?base={job}[&format=svg][&top=20]
+    //   DELETE /api/profiles/{job}
+    //   GET|PUT|DELETE /api/sessions/{id}/continuous[?hz=19&window=60&budget=1]
+    //   POST   /api/sessions/{id}/profiles?last=5m | ?from=10:02&to=10:04
+    //          (a profile cut from the continuous buckets; done at once)
+    if (parts.size() == 4 && parts[0] == "api" && parts[1] == "sessions" &&
+        parts[3] == "continuous") {
+        handle_continuous_request(fd, req, parts[2]);
+        return;
+    }
+    if (parts.size() == 4 && parts[0] == "api" && parts[1] == "sessions" &&
+        ((parts[3] == "profiles" && (req.method == "GET" || req.method == "POST")) ||
+         (parts[3] == "flamegraph" && req.method == "GET"))) {
+        handle_profile_request(fd, req, parts);
+        return;
+    }
+    if ((parts.size() >= 2 && parts.size() <= 4) && parts[0] == "api" &&
+        parts[1] == "profiles") {
+        handle_profile_request(fd, req, parts);
+        return;
+    }
+
+    // POST /api/upload[?exec_path=dir/app]  (single request, streamed)
+    if (req.method == "POST" && parts.size() == 2 &&
+        parts[0] == "api" && parts[1] == "upload") {
+        std::string exec_path = query_param(req.query, "exec_path");
+        if (!exec_path.empty() && !valid_exec_path(exec_path)) {
+            send_http(fd, 400, "application/json", R"({"error":"invalid_exec_path"})");
+            return;
         }
-        auto resp = proxy("OUTPUT " + parts[2] + " " + offset);
+        auto resp = proxy_upload(fd, req, exec_path);
         send_http(fd, 200, "application/json", resp);
         return;
     }
 
-    // GET /api/sessions/{id}/flamegraph?duration=5
-    if (req.method == "GET" && parts.size() == 4 &&
-        parts[0] == "api" && parts[1] == "sessions" && parts[3] == "flamegraph") {
-        int duration = 5;
-        auto dpos = req.query.find("duration=");
-        if (dpos != std::string::npos) {
-            auto dval = req.query.substr(dpos + 9);
-            auto amp = dval.find('&');
-            if (amp != std::string::npos) dval = dval.substr(0, amp);
-            try { duration = std::stoi(dval); } catch (...) {}
-            if (duration < 1) duration = 1;
-            if (duration > 30) duration = 30;
+    // Chunked, resumable uploads:
+    //   POST   /api/uploads?size=N[&exec_path=P]   -> {"upload":token,...}
+    //   PUT    /api/uploads/{token}?offset=X       <- chunk bytes
+    //   GET    /api/uploads/{token}                -> {"received":R,...}
+    //   DELETE /api/uploads/{token}
+    if (parts.size() >= 2 && parts[0] == "api" && parts[1] == "uploads") {
+        if (req.method == "POST" && parts.size() == 2) {
+            handle_upload_create(fd, req);
+            return;
         }
-        // Extend socket timeout for profiling duration
-        struct timeval ltv{duration + 15, 0};
-        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &ltv, sizeof(ltv));
-        auto svg = generate_flamegraph(parts[2], duration);
-        if (svg.empty()) {
-            send_http(fd, 400, "application/json",
-                      R"({"error":"flamegraph_failed"})");
-        } else {
-            send_http(fd, 200, "image/svg+xml", svg);
+        if (parts.size() == 3) {
+            if (req.method == "PUT") { handle_upload_chunk(fd, req, parts[2]); return; }
+            if (req.method == "GET") { handle_upload_status(fd, parts[2]); return; }
+            if (req.method == "DELETE") { handle_upload_abort(fd, parts[2]); return; }
         }
+    }
+
+    // GET /api/sessions/{id}/counters?duration=1 (perf stat; answers after duration)
+    if (req.method == "GET" && parts.size() == 4 && parts[0] == "api" &&
+        parts[1] == "sessions" && parts[3] == "counters") {
+        double seconds = 1;
+        try { seconds = std::stod(query_param(req.query, "duration", "1")); } catch (...) {}
+        char dur[32];
+        snprintf(dur, sizeof(dur), "%g", seconds);
+        auto resp = proxy("COUNTERS " + parts[2] + " " + dur, static_cast<int>(seconds) + 5);
+        send_http(fd, 200, "application/json", resp);
         return;
     }
 
-    // POST /api/upload
-    if (req.method == "POST" && parts.size() == 2 &&
-        parts[0] == "api" && parts[1] == "upload") {
-        auto resp = proxy_upload(req.body.data(), req.body.size());
+    // GET /api/sessions/{id}/threads?duration=1 (per-thread scheduling; answers after duration)
+    if (req.method == "GET" && parts.size() == 4 && parts[0] == "api" &&
+        parts[1] == "sessions" && parts[3] == "threads") {
+        double seconds = 1;
+        try { seconds = std::stod(query_param(req.query, "duration", "1")); } catch (...) {}
+        char dur[32];
+        snprintf(dur, sizeof(dur), "%g", seconds);
+        auto resp = proxy("THREADS " + parts[2] + " " + dur, static_cast<int>(seconds) + 5);
         send_http(fd, 200, "application/json", resp);
         return;
     }
 
+    // GET /api/sessions/{id}/metrics?since=N (resource readings numbered N onwards)
+    if (req.method == "GET" && parts.size() == 4 && parts[0] == "api" &&
+        parts[1] == "sessions" && parts[3] == "metrics") {
+        unsigned long long since =
+            std::strtoull(query_param(req.query, "since", "0").c_str(), nullptr, 10);
+        auto resp = proxy("METRICS " + parts[2] + " " + std::to_string(since));
+        send_http(fd, 200, "application/json", resp);
+        return;
+    }
+
+    // GET /api/sessions/{id}/heap?view=live|alloc[&format=json|svg|folded|speedscope|pprof]
+    if (req.method == "GET" && parts.size() == 4 && parts[0] == "api" &&
+        parts[1] == "sessions" && parts[3] == "heap") {
+        handle_heap_request(fd, req, parts[2]);
+        return;
+    }
+
     // POST /api/sessions/{id}/{action}
     if (parts.size() == 4 && parts[0] == "api" && parts[1] == "sessions") {
         std::string id = parts[2];
@@ -939,6 +2133,8 @@ void WebUI::handle_client(int fd) {
         if (action == "start") {
             cmd = "START " + id;
             if (req.query.find("debug") != std::string::npos) cmd += " --debug";
+            if (req.query.find("pty") != std::string::npos) cmd += " --pty";
+            if (req.query.find("heap") != std::string::npos) cmd += " --heap-profile";
         } else if (action == "args") {
             cmd = "ARGS " + id + " " + req.body;
         } else if (action == "env") {
@@ -952,14 +2148,7 @@ void WebUI::handle_client(int fd) {
           else if (action == "debug")  { cmd = "DEBUG " + id; }
           else if (action == "delete") { cmd = "DELETE " + id; }
           else if (action == "output") {
-            std::string offset = "0";
-            auto opos = req.query.find("offset=");
-            if (opos != std::string::npos) {
-                offset = req.query.substr(opos + 7);
-                auto amp = offset.find('&');
-                if (amp != std::string::npos) offset = offset.substr(0, amp);
-            }
-            cmd = "OUTPUT " + id + " " + offset;
+            cmd = "OUTPUT " + id + " " + query_param(req.query, "offset", "0");
           }
 
         if (!cmd.empty()) {
@@ -994,17 +2183,65 @@ void WebUI::serve_sse(int fd) {
         "\r\n";
     if (write(fd, header.data(), header.size()) <= 0) return;
 
+    // The first message is a full snapshot on the default event; after that
+    // only sessions that changed or disappeared are sent, as a "sessions"
+    // event: {"upsert":[...],"remove":["id",...]}.
+    std::map<std::string, std::string> sent;
+    std::string last_activity;
+    uint64_t profile_since = 0;
+    bool snapshot = true;
+    int idle_ticks = 0;
+
     while (running_) {
+        std::string event;
         std::string data = trim_newlines(proxy("LIST"));
-        std::string event = "data: " + data + "\n\n";
-        ssize_t n = write(fd, event.data(), event.size());
-        if (n <= 0) break;
+        if (!data.empty() && data[0] == '[') {
+            std::map<std::string, std::string> now;
+            std::string upsert;
+            for (auto &obj : split_json_objects(data)) {
+                std::string id = json_string_field(obj, "id");
+                auto prev = sent.find(id);
+                if (prev == sent.end() || prev->second != obj) {
+                    if (!upsert.empty()) upsert += ",";
+                    upsert += obj;
+                }
+                now[id] = std::move(obj);
+            }
+            std::string removed;
+            for (const auto &kv : sent) {
+                if (now.count(kv.first)) continue;
+                if (!removed.empty()) removed += ",";
+                removed += "\"" + json_escape(kv.first) + "\"";
+            }
+            if (snapshot) {
+                event = "data: " + data + "\n\n";
+                snapshot = false;
+            } else if (!upsert.empty() || !removed.empty()) {
+                event = "event: sessions\ndata: {\"upsert\":[" + upsert +
+                        "],\"remove\":[" + removed + "]}\n\n";
+            }
+            sent.swap(now);
+        }
 
-        // Send activity as a named event
+        // Send activity as a named event when it changes
         std::string activity = trim_newlines(proxy("ACTIVITY"));
-        std::string act_event = "event: activity\ndata: " + activity + "\n\n";
-        n = write(fd, act_event.data(), act_event.size());
-        if (n <= 0) break;
+        if (activity != last_activity) {
+            event += "event: activity\ndata: " + activity + "\n\n";
+            last_activity = activity;
+        }
+
+        // Profiling jobs that changed since the last tick
+        std::string profiles = profile_updates(profile_since);
+        if (!profiles.empty()) {
+            event += "event: profiles\ndata: " + profiles + "\n\n";
+        }
+
+        // Comment line every ~15s so dead clients are noticed
+        if (event.empty() && ++idle_ticks >= 15) event = ": ping\n\n";
+        if (!event.empty()) {
+            idle_ticks = 0;
+            if (!write_all(fd, event.data(), event.size())) break;
+        }
 
         for (int i = 0; i < 10 && running_; i++) {
             usleep(100000);  // 100ms, total ~1s
@@ -1012,11 +2249,151 @@ void WebUI::serve_sse(int fd) {
     }
 }
 
-std::string WebUI::proxy(const std::string &command) {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) return R"({"error":"connection_failed"})";
+// Raw session output with no JSON escaping.  Offsets (including Range
+// values) are absolute stream positions as in OUTPUT.  A plain request gets
+// the retained bytes or the requested range with a Content-Length;
+// `follow=1` streams with chunked encoding until the output ends or the
+// client goes away.
+void WebUI::serve_output_raw(int fd, const HttpRequest &req, const std::string &id) {
+    bool follow = query_param(req.query, "follow", "0") != "0";
+    size_t offset = 0;
+    size_t length = SIZE_MAX;
+    try { offset = std::stoull(query_param(req.query, "offset", "0")); } catch (...) {}
+
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    size_t suffix = 0;
+    auto rh = req.headers.find("range");
+    bool ranged = rh != req.headers.end() && parse_byte_range(rh->second, first, last, suffix);
+    if (ranged && suffix > 0) {
+        // Suffix ranges count back from the current end of the stream
+        long long total = json_int_field(proxy("OUTPUT " + id + " 0 0"), "total", 0);
+        first = static_cast<size_t>(total) > suffix ? static_cast<size_t>(total) - suffix : 0;
+    }
+    if (ranged) {
+        offset = first;
+        if (last != SIZE_MAX) length = last - first + 1;
+    }
 
-    struct timeval tv{5, 0};
+    int cfd = control_connect(10);
+    if (cfd < 0) {
+        send_http(fd, 502, "application/json", R"({"error":"connection_failed"})");
+        return;
+    }
+    std::string cmd = follow ? "TAIL " + id + " " + std::to_string(offset)
+                             : "OUTPUTRAW " + id + " " + std::to_string(offset) + " " +
+                                   std::to_string(length);
+    cmd += "\n";
+    std::string pending;
+    if (write_all(cfd, cmd.data(), cmd.size())) {
+        pending = read_control_line(cfd);
+    }
+    auto nl = pending.find('\n');
+    std::string reply = (nl == std::string::npos) ? pending : pending.substr(0, nl);
+    pending = (nl == std::string::npos) ? "" : pending.substr(nl + 1);
+    if (reply.empty() || reply.find("\"error_code\"") != std::string::npos) {
+        close(cfd);
+        int status = reply.find("\"not_found\"") != std::string::npos ? 404 : 502;
+        send_http(fd, status, "application/json", reply.empty() ? R"({"error":"read_failed"})" : reply);
+        return;
+    }
+    long long from = json_int_field(reply, "offset", 0);
+
+    if (follow) {
+        struct timeval no_timeout{0, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout));
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+        std::string head =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain; charset=utf-8\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Cache-Control: no-cache\r\n"
+            "X-Output-Offset: " + std::to_string(from) + "\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+        bool ok = write_all(fd, head.data(), head.size());
+        std::string chunk;
+        char buf[65536];
+        while (ok && running_) {
+            if (!pending.empty()) {
+                char size_line[32];
+                snprintf(size_line, sizeof(size_line), "%zx\r\n", pending.size());
+                chunk.assign(size_line);
+                chunk += pending;
+                chunk += "\r\n";
+                pending.clear();
+                ok = write_all(fd, chunk.data(), chunk.size());
+                continue;
+            }
+            pollfd pfds[2] = {{cfd, POLLIN, 0}, {fd, POLLIN, 0}};
+            int pr = poll(pfds, 2, 1000);
+            if (pr < 0 && errno != EINTR) break;
+            if (pr <= 0) continue;
+            if (pfds[1].revents) {
+                // The client never sends anything; readable means it left
+                if (read(fd, buf, sizeof(buf)) <= 0) break;
+            }
+            if (pfds[0].revents) {
+                ssize_t n = read(cfd, buf, sizeof(buf));
+                if (n <= 0) {
+                    write_all(fd, "0\r\n\r\n", 5);
+                    break;
+                }
+                pending.assign(buf, static_cast<size_t>(n));
+            }
+        }
+        close(cfd);
+        return;
+    }
+
+    long long len = json_int_field(reply, "length", 0);
+    long long start = json_int_field(reply, "start", 0);
+    long long total = json_int_field(reply, "total", 0);
+    std::ostringstream oss;
+    if (ranged && len == 0) {
+        close(cfd);
+        oss << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+            << "Content-Range: bytes */" << total << "\r\n"
+            << "Content-Length: 0\r\n"
+            << "Access-Control-Allow-Origin: *\r\n"
+            << "Connection: close\r\n\r\n";
+        std::string resp = oss.str();
+        write_all(fd, resp.data(), resp.size());
+        return;
+    }
+    oss << (ranged ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n")
+        << "Content-Type: text/plain; charset=utf-8\r\n"
+        << "Content-Length: " << len << "\r\n";
+    if (ranged) {
+        oss << "Content-Range: bytes " << from << "-" << (from + len - 1) << "/" << total << "\r\n";
+    }
+    oss << "Accept-Ranges: bytes\r\n"
+        << "X-Output-Start: " << start << "\r\n"
+        << "X-Output-Offset: " << from << "\r\n"
+        << "Access-Control-Allow-Origin: *\r\n"
+        << "Connection: close\r\n\r\n";
+    std::string head = oss.str();
+    size_t remaining = static_cast<size_t>(len);
+    if (pending.size() > remaining) pending.resize(remaining);
+    bool ok = write_all(fd, head.data(), head.size()) &&
+              write_all(fd, pending.data(), pending.size());
+    remaining -= pending.size();
+    char buf[65536];
+    while (ok && remaining > 0) {
+        ssize_t n = read(cfd, buf, std::min(sizeof(buf), remaining));
+        if (n <= 0) break;
+        ok = write_all(fd, buf, static_cast<size_t>(n));
+        remaining -= static_cast<size_t>(n);
+    }
+    close(cfd);
+}
+
+int WebUI::control_connect(int timeout_sec) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct timeval tv{timeout_sec, 0};
     setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
@@ -1027,130 +2404,1069 @@ std::string WebUI::proxy(const std::string &command) {
 
     if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
         close(fd);
-        return R"({"error":"connection_failed"})";
+        return -1;
     }
+    return fd;
+}
 
-    std::string msg = command + "\n";
-    if (write(fd, msg.data(), msg.size()) <= 0) {
-        close(fd);
-        return R"({"error":"write_failed"})";
+// Bridges a browser WebSocket to an ATTACH stream on the control port.
+// Binary frames carry raw bytes both ways; text frames carry JSON control
+// messages ({"type":"resize","cols":C,"rows":R}).  Writes to the browser
+// block, so a slow browser stops this thread from reading the control
+// socket and the daemon's per-client backlog cap takes over.
+void WebUI::serve_terminal(int fd, const HttpRequest &req, const std::string &id) {
+    auto up = req.headers.find("upgrade");
+    auto key = req.headers.find("sec-websocket-key");
+    std::string upgrade = (up == req.headers.end()) ? "" : up->second;
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+    if (upgrade != "websocket" || key == req.headers.end()) {
+        send_http(fd, 400, "application/json", R"({"error":"websocket_required"})");
+        return;
     }
 
-    std::string resp;
-    char buf[4096];
-    while (true) {
+    int cfd = control_connect(5);
+    if (cfd < 0) {
+        send_http(fd, 502, "application/json", R"({"error":"connection_failed"})");
+        return;
+    }
+    std::string cmd = "ATTACH " + id + "\n";
+    if (!write_all(cfd, cmd.data(), cmd.size())) {
+        close(cfd);
+        send_http(fd, 502, "application/json", R"({"error":"write_failed"})");
+        return;
+    }
+
+    // The reply line may arrive together with the first output bytes.
+    std::string pending;
+    char buf[65536];
+    while (pending.find('\n') == std::string::npos) {
+        ssize_t n = read(cfd, buf, sizeof(buf));
+        if (n <= 0) break;
+        pending.append(buf, static_cast<size_t>(n));
+    }
+    auto nl = pending.find('\n');
+    std::string reply = (nl == std::string::npos) ? pending : pending.substr(0, nl);
+    pending = (nl == std::string::npos) ? "" : pending.substr(nl + 1);
+    if (reply.find("\"attached\":true") == std::string::npos) {
+        close(cfd);
+        send_http(fd, 400, "application/json", reply.empty() ? R"({"error":"attach_failed"})" : reply);
+        return;
+    }
+
+    std::string accept = base64_encode(
+        sha1_digest(key->second + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+    std::string resp =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + accept + "\r\n\r\n";
+    if (!write_all(fd, resp.data(), resp.size()) ||
+        !ws_send_frame(fd, 0x1, reply.data(), reply.size()) ||
+        (!pending.empty() && !ws_send_frame(fd, 0x2, pending.data(), pending.size()))) {
+        close(cfd);
+        return;
+    }
+
+    // Poll drives reads; a browser that stops draining for 10 s is dropped.
+    struct timeval no_timeout{0, 0};
+    struct timeval send_timeout{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+
+    std::string wsbuf;
+    std::string message;
+    uint8_t message_op = 0;
+    bool open = true;
+    while (open && running_) {
+        pollfd pfds[2] = {{fd, POLLIN, 0}, {cfd, POLLIN, 0}};
+        int pr = poll(pfds, 2, 1000);
+        if (pr < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfds[1].revents) {
+            ssize_t n = read(cfd, buf, sizeof(buf));
+            if (n <= 0 || !ws_send_frame(fd, 0x2, buf, static_cast<size_t>(n))) {
+                break;  // session output ended, or browser stalled
+            }
+        }
+        if (!pfds[0].revents) continue;
+
         ssize_t n = read(fd, buf, sizeof(buf));
         if (n <= 0) break;
-        resp.append(buf, static_cast<size_t>(n));
-        if (resp.find('\n') != std::string::npos) break;
+        wsbuf.append(buf, static_cast<size_t>(n));
+        WsFrame frame;
+        int rc = 0;
+        while (open && (rc = ws_parse_frame(wsbuf, frame)) == 1) {
+            if (frame.opcode == 0x8) {  // close
+                ws_send_frame(fd, 0x8, "", 0);
+                open = false;
+            } else if (frame.opcode == 0x9) {  // ping
+                ws_send_frame(fd, 0xA, frame.payload.data(), frame.payload.size());
+            } else if (frame.opcode == 0x1 || frame.opcode == 0x2 || frame.opcode == 0x0) {
+                if (frame.opcode != 0x0) message_op = frame.opcode;
+                message += frame.payload;
+                if (message.size() > kMaxWsFramePayload) { open = false; break; }
+                if (!frame.fin) continue;
+                if (message_op == 0x2) {
+                    if (!write_all(cfd, message.data(), message.size())) open = false;
+                } else if (json_int_field(message, "cols", 0) > 0) {
+                    proxy("RESIZE " + id + " " +
+                          std::to_string(json_int_field(message, "cols", 80)) + " " +
+                          std::to_string(json_int_field(message, "rows", 24)));
+                }
+                message.clear();
+            }
+        }
+        if (rc < 0) break;
+    }
+    if (open) ws_send_frame(fd, 0x8, "", 0);
+    close(cfd);
+}
+
+std::string WebUI::proxy(const std::string &command, int timeout_sec) {
+    int fd = control_connect(timeout_sec);
+    if (fd < 0) return R"({"error":"connection_failed"})";
+
+    std::string msg = command + "\n";
+    if (write(fd, msg.data(), msg.size()) <= 0) {
+        close(fd);
+        return R"({"error":"write_failed"})";
     }
 
+    std::string resp = read_control_line(fd);
     close(fd);
     return trim_newlines(resp);
 }
 
-std::string WebUI::proxy_upload(const char *data, size_t len) {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
+// Forwards a request body to UPLOAD in fixed-size pieces so the daemon
+// starts writing the memfd before the browser has finished sending, and
+// WebUI memory stays bounded regardless of upload size.
+std::string WebUI::proxy_upload(int client_fd, const HttpRequest &req,
+                                const std::string &exec_path) {
+    if (req.content_length == 0) return R"({"error":"empty_body"})";
+
+    int fd = control_connect(30);
     if (fd < 0) return R"({"error":"connection_failed"})";
 
-    struct timeval tv{30, 0};
+    std::string header = "UPLOAD " + std::to_string(req.content_length);
+    if (!exec_path.empty()) header += " " + exec_path;
+    header += "\n";
+    if (!write_all(fd, header.data(), header.size()) ||
+        !write_all(fd, req.body.data(), req.body.size())) {
+        close(fd);
+        return R"({"error":"upload_write_failed"})";
+    }
+
+    std::vector<char> buf(kUploadChunkBuffer);
+    size_t remaining = req.content_length - req.body.size();
+    while (remaining > 0) {
+        ssize_t n = read(client_fd, buf.data(), std::min(buf.size(), remaining));
+        if (n <= 0 || !write_all(fd, buf.data(), static_cast<size_t>(n))) {
+            close(fd);
+            return R"({"error":"upload_write_failed"})";
+        }
+        remaining -= static_cast<size_t>(n);
+    }
+
+    struct timeval tv{kUploadResponseTimeoutSec, 0};
     setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    std::string resp = read_control_line(fd);
+    close(fd);
+    return trim_newlines(resp);
+}
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-    addr.sin_port = htons(static_cast<uint16_t>(control_port_));
+void WebUI::handle_upload_create(int fd, const HttpRequest &req) {
+    reap_uploads();
 
-    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
-        close(fd);
-        return R"({"error":"connection_failed"})";
+    size_t size = 0;
+    try { size = std::stoull(query_param(req.query, "size", "0")); } catch (...) {}
+    std::string exec_path = query_param(req.query, "exec_path");
+    if (size == 0) {
+        send_http(fd, 400, "application/json", R"({"error":"invalid_size"})");
+        return;
+    }
+    if (!exec_path.empty() && !valid_exec_path(exec_path)) {
+        send_http(fd, 400, "application/json", R"({"error":"invalid_exec_path"})");
+        return;
     }
 
-    std::string header = "UPLOAD " + std::to_string(len) + "\n";
-    if (write(fd, header.data(), header.size()) <= 0) {
-        close(fd);
-        return R"({"error":"write_failed"})";
+    int cfd = control_connect(30);
+    if (cfd < 0) {
+        send_http(fd, 502, "application/json", R"({"error":"connection_failed"})");
+        return;
+    }
+    std::string header = "UPLOAD " + std::to_string(size);
+    if (!exec_path.empty()) header += " " + exec_path;
+    header += "\n";
+    if (!write_all(cfd, header.data(), header.size())) {
+        close(cfd);
+        send_http(fd, 502, "application/json", R"({"error":"write_failed"})");
+        return;
     }
 
-    size_t off = 0;
-    while (off < len) {
-        ssize_t n = write(fd, data + off, len - off);
-        if (n <= 0) { close(fd); return R"({"error":"upload_write_failed"})"; }
-        off += static_cast<size_t>(n);
+    auto slot = std::make_shared<UploadSlot>();
+    slot->control_fd = cfd;
+    slot->size = size;
+    slot->exec_path = exec_path;
+    slot->last_active = time(nullptr);
+    std::string token = random_token();
+    {
+        std::lock_guard<std::mutex> lock(uploads_mu_);
+        uploads_[token] = slot;
     }
 
-    std::string resp;
-    char buf[4096];
-    while (true) {
-        ssize_t n = read(fd, buf, sizeof(buf));
-        if (n <= 0) break;
-        resp.append(buf, static_cast<size_t>(n));
-        if (resp.find('\n') != std::string::npos) break;
+    std::ostringstream oss;
+    oss << "{" << json_kv("upload", token, true) << ","
+        << json_kv("size", static_cast<long long>(size)) << ","
+        << json_kv("received", 0LL) << "}";
+    send_http(fd, 200, "application/json", oss.str());
+}
+
+void WebUI::handle_upload_chunk(int fd, const HttpRequest &req, const std::string &token) {
+    auto slot = find_upload(token);
+    if (!slot) {
+        send_http(fd, 404, "application/json", R"({"error":"upload_not_found"})");
+        return;
     }
 
-    close(fd);
-    return trim_newlines(resp);
+    // One writer per upload; a retry that races a stalled chunk is told to
+    // re-check the offset instead of interleaving bytes.
+    std::unique_lock<std::mutex> slot_lock(slot->mu, std::try_to_lock);
+    if (!slot_lock.owns_lock() || slot->control_fd < 0) {
+        send_http(fd, 409, "application/json", R"({"error":"upload_busy"})");
+        return;
+    }
+
+    size_t offset = 0;
+    try { offset = std::stoull(query_param(req.query, "offset", "0")); } catch (...) {}
+    if (offset != slot->received || slot->received + req.content_length > slot->size) {
+        std::ostringstream oss;
+        oss << "{" << json_kv("error", "offset_mismatch", true) << ","
+            << json_kv("received", static_cast<long long>(slot->received.load())) << ","
+            << json_kv("size", static_cast<long long>(slot->size)) << "}";
+        send_http(fd, 409, "application/json", oss.str());
+        return;
+    }
+
+    // Count bytes as they are forwarded so an interrupted chunk can resume
+    // from exactly where the daemon left off.
+    bool control_ok = write_all(slot->control_fd, req.body.data(), req.body.size());
+    if (control_ok) slot->received += req.body.size();
+    size_t remaining = req.content_length - req.body.size();
+    std::vector<char> buf(kUploadChunkBuffer);
+    bool client_ok = true;
+    while (control_ok && remaining > 0) {
+        ssize_t n = read(fd, buf.data(), std::min(buf.size(), remaining));
+        if (n <= 0) { client_ok = false; break; }
+        control_ok = write_all(slot->control_fd, buf.data(), static_cast<size_t>(n));
+        if (control_ok) {
+            slot->received += static_cast<size_t>(n);
+            remaining -= static_cast<size_t>(n);
+        }
+    }
+    slot->last_active = time(nullptr);
+
+    if (!control_ok) {
+        close(slot->control_fd);
+        slot->control_fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(uploads_mu_);
+            uploads_.erase(token);
+        }
+        send_http(fd, 502, "application/json", R"({"error":"upload_write_failed"})");
+        return;
+    }
+    if (!client_ok) return;  // browser went away; it may resume later
+
+    std::ostringstream oss;
+    oss << "{" << json_kv("upload", token, true) << ","
+        << json_kv("size", static_cast<long long>(slot->size)) << ","
+        << json_kv("received", static_cast<long long>(slot->received.load()));
+    if (slot->received == slot->size) {
+        struct timeval tv{kUploadResponseTimeoutSec, 0};
+        setsockopt(slot->control_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        std::string resp = trim_newlines(read_control_line(slot->control_fd));
+        close(slot->control_fd);
+        slot->control_fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(uploads_mu_);
+            uploads_.erase(token);
+        }
+        if (resp.empty()) resp = R"({"error":"no_response"})";
+        oss << "," << json_kv("done", true) << ",\"result\":" << resp;
+    } else {
+        oss << "," << json_kv("done", false);
+    }
+    oss << "}";
+    send_http(fd, 200, "application/json", oss.str());
+}
+
+void WebUI::handle_upload_status(int fd, const std::string &token) {
+    auto slot = find_upload(token);
+    if (!slot) {
+        send_http(fd, 404, "application/json", R"({"error":"upload_not_found"})");
+        return;
+    }
+    std::ostringstream oss;
+    oss << "{" << json_kv("upload", token, true) << ","
+        << json_kv("size", static_cast<long long>(slot->size)) << ","
+        << json_kv("received", static_cast<long long>(slot->received.load())) << ","
+        << json_kv("exec_path", slot->exec_path, true) << "}";
+    send_http(fd, 200, "application/json", oss.str());
+}
+
+void WebUI::handle_upload_abort(int fd, const std::string &token) {
+    std::shared_ptr<UploadSlot> slot;
+    {
+        std::lock_guard<std::mutex> lock(uploads_mu_);
+        auto it = uploads_.find(token);
+        if (it != uploads_.end()) {
+            slot = it->second;
+            uploads_.erase(it);
+        }
+    }
+    if (!slot) {
+        send_http(fd, 404, "application/json", R"({"error":"upload_not_found"})");
+        return;
+    }
+    // Closing the control connection mid-upload makes the daemon discard
+    // the partial memfd / temp archive.
+    std::lock_guard<std::mutex> slot_lock(slot->mu);
+    if (slot->control_fd >= 0) {
+        close(slot->control_fd);
+        slot->control_fd = -1;
+    }
+    send_http(fd, 200, "application/json", R"({"aborted":true})");
 }
 
-std::string WebUI::generate_flamegraph(const std::string &session_id,
-                                       int duration) {
-    // 1. Get PID from session status
-    auto status = proxy("STATUS " + session_id);
-    auto pid_pos = status.find("\"pid\":");
-    if (pid_pos == std::string::npos) return "";
-    size_t ps = pid_pos + 6;
-    size_t pe = status.find_first_of(",}", ps);
-    std::string pid_str = status.substr(ps, pe - ps);
-    while (!pid_str.empty() && pid_str[0] == ' ') pid_str.erase(0, 1);
-    if (pid_str == "null" || pid_str.empty()) return "";
-    for (char c : pid_str) {
-        if (!isdigit(c)) return "";
+std::shared_ptr<WebUI::UploadSlot> WebUI::find_upload(const std::string &token) {
+    std::lock_guard<std::mutex> lock(uploads_mu_);
+    auto it = uploads_.find(token);
+    return (it == uploads_.end()) ? nullptr : it->second;
+}
+
+void WebUI::reap_uploads() {
+    time_t now = time(nullptr);
+    std::lock_guard<std::mutex> lock(uploads_mu_);
+    for (auto it = uploads_.begin(); it != uploads_.end();) {
+        auto &slot = it->second;
+        // A slot whose lock is held has a chunk in flight; leave it alone.
+        std::unique_lock<std::mutex> slot_lock(slot->mu, std::try_to_lock);
+        if (slot_lock.owns_lock() && now - slot->last_active > kUploadIdleTimeoutSec) {
+            if (slot->control_fd >= 0) {
+                close(slot->control_fd);
+                slot->control_fd = -1;
+            }
+            slot_lock.unlock();
+            it = uploads_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Profiling jobs
+// ---------------------------------------------------------------------------
+
+std::shared_ptr<WebUI::ProfileJob> WebUI::submit_profile(const std::string &session_id,
+                                                         int duration,
+                                                         const std::string &sampler,
+                                                         const std::string &mode,
+                                                         int max_age, bool &reused,
+                                                         std::string &error) {
+    reused = false;
+    std::string status = proxy("STATUS " + session_id);
+    long long pid = json_int_field(status, "pid", 0);
+    if (pid <= 0) {
+        error = status.find("\"not_found\"") != std::string::npos ? "not_found" : "not_running";
+        return nullptr;
+    }
+    long long run = json_int_field(status, "run", 0);
+    time_t now = time(nullptr);
+
+    std::lock_guard<std::mutex> lock(profiles_mu_);
+    // Same session, run, window, sampler and mode: join a recording still in flight, or
+    // reuse one that finished recently enough.
+    std::shared_ptr<ProfileJob> match;
+    for (auto &kv : profiles_) {
+        const ProfileJob &j = *kv.second;
+        if (j.session_id != session_id || j.run != run || j.duration != duration ||
+            j.sampler != sampler || j.mode != mode) {
+            continue;
+        }
+        bool active = j.state == "queued" || j.state == "recording" || j.state == "processing";
+        bool fresh = j.state == "done" && max_age > 0 && now - j.finished < max_age;
+        if ((active || fresh) && (!match || j.created >= match->created)) match = kv.second;
+    }
+    if (match) {
+        reused = true;
+        return match;
     }
 
-    // 2. Run perf record
-    std::string perf_data = "/tmp/debuglantern-perf-" + session_id + ".data";
+    size_t queued = 0;
+    for (auto &kv : profiles_) {
+        if (kv.second->state == "queued") ++queued;
+    }
+    if (queued >= kMaxQueuedProfiles) {
+        error = "too_many_jobs";
+        return nullptr;
+    }
+
+    auto job = std::make_shared<ProfileJob>();
+    job->id = random_token();
+    job->session_id = session_id;
+    job->run = run;
+    job->duration = duration;
+    job->sampler = sampler;
+    job->mode = mode;
+    job->target_pid = std::to_string(pid);
+    job->state = "queued";
+    job->created = now;
+    touch_profile(*job);
+    profiles_[job->id] = job;
+    prune_profiles();
+    dispatch_profiles();
+    return job;
+}
+
+// Starts queued jobs, oldest first, while under the per-board limit.
+// Caller holds profiles_mu_.
+void WebUI::dispatch_profiles() {
+    while (running_profiles_ < kMaxRunningProfiles) {
+        std::shared_ptr<ProfileJob> next;
+        for (auto &kv : profiles_) {
+            if (kv.second->state != "queued") continue;
+            if (!next || kv.second->seq < next->seq) next = kv.second;
+        }
+        if (!next) return;
+        next->state = "recording";
+        next->started = time(nullptr);
+        touch_profile(*next);
+        ++running_profiles_;
+        std::thread(&WebUI::run_profile, this, next).detach();
+    }
+}
+
+void WebUI::run_profile(std::shared_ptr<ProfileJob> job) {
+    auto graph = std::make_shared<FlameGraph>();
+    std::string error;
+    bool recorded = false;
+
+    if (job->sampler != "perf") {
+        SampleOptions opts;
+        opts.duration_sec = job->duration;
+        opts.mode = job->mode == "offcpu" ? SampleMode::offcpu
+                  : job->mode == "both"   ? SampleMode::both
+                                          : SampleMode::cpu;
+        SampleStats stats;
+        time_t last_tick = time(nullptr);
+        auto keep_going = [&]() {
+            std::lock_guard<std::mutex> lock(profiles_mu_);
+            time_t now = time(nullptr);
+            if (now != last_tick) {
+                last_tick = now;
+                touch_profile(*job);
+            }
+            return !job->cancel && running_;
+        };
+        pid_t pid = static_cast<pid_t>(std::stol(job->target_pid));
+        recorded = sample_stacks(pid, opts, keep_going, *graph, stats, error);
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        if (recorded) {
+            job->engine = "native";
+            job->samples = stats.samples;
+            job->lost = stats.lost;
+        } else if (job->sampler == "auto" && error != "process exited") {
+            error.clear();  // no usable perf events here; try the perf binary
+        }
+    }
+    if (!recorded && error.empty()) recorded = record_with_perf(*job, *graph, error);
+
+    bool cancelled;
     {
-        // Use cpu-clock (software event) so profiling works on boards without
-        // a kernel PMU driver.  --call-graph dwarf produces accurate stacks
-        // even when binaries are compiled without frame pointers (clang default).
-        std::string cmd = "perf record -F 99 -p " + pid_str
-                          + " --call-graph dwarf -e cpu-clock -o "
-                          + perf_data + " -- sleep "
-                          + std::to_string(duration) + " 2>/dev/null";
-        int ret = ::system(cmd.c_str());
-        if (ret != 0) {
-            unlink(perf_data.c_str());
-            return "<svg xmlns='http://www.w3.org/2000/svg' width='600' "
-                   "height='40'><text y='20' fill='#e94560' "
-                   "font-family='monospace'>perf record failed "
-                   "(is perf installed? check perf_event_paranoid)"
-                   "</text></svg>";
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        cancelled = job->cancel;
+    }
+
+    std::lock_guard<std::mutex> lock(profiles_mu_);
+    job->finished = time(nullptr);
+    job->state = cancelled ? "cancelled" : (recorded ? "done" : "failed");
+    job->error = cancelled ? "" : error;
+    if (job->state == "done") job->graph = std::move(graph);
+    touch_profile(*job);
+    --running_profiles_;
+    dispatch_profiles();
+}
+
+// Fallback for kernels or policies that refuse perf_event_open to the
+// daemon, and for binaries without frame pointers (?sampler=perf): DWARF
+// unwinding through the perf binary.
+bool WebUI::record_with_perf(ProfileJob &job, FlameGraph &graph, std::string &error) {
+    // Unique per job, so concurrent recordings never share a data file
+    char perf_data[] = "/tmp/debuglantern-perf-XXXXXX";
+    int tfd = mkstemp(perf_data);
+    if (tfd < 0) {
+        error = "cannot create perf data file";
+        return false;
+    }
+    close(tfd);
+    {
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        job.engine = "perf";
+    }
+
+    // Use cpu-clock (software event) so profiling works on boards without
+    // a kernel PMU driver.  --call-graph dwarf produces accurate stacks
+    // even when binaries are compiled without frame pointers (clang default).
+    // Off-CPU modes record every context switch instead, with the switch
+    // records that say when each thread came back, and cpu-clock at a
+    // fixed period so its samples can be weighted in time.
+    std::string dur = std::to_string(job.duration);
+    std::vector<const char *> argv = {"perf", "record", "-p", job.target_pid.c_str(),
+                                      "--call-graph", "dwarf", "-o", perf_data};
+    if (job.mode == "cpu") {
+        argv.insert(argv.end(), {"-F", "99", "-e", "cpu-clock"});
+    } else {
+        argv.insert(argv.end(), {"--switch-events", "-e", "cs/period=1/"});
+        if (job.mode == "both") argv.insert(argv.end(), {"-e", "cpu-clock/period=10101010/"});
+    }
+    argv.insert(argv.end(), {"--", "sleep", dur.c_str(), nullptr});
+    pid_t perf = fork();
+    if (perf == 0) {
+        // The daemon ignores SIGPIPE and may have inherited an ignored
+        // SIGINT; perf needs SIGINT to stop a cancelled recording.
+        signal(SIGINT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
         }
+        execvp("perf", const_cast<char *const *>(argv.data()));
+        _exit(127);
+    }
+    {
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        job.perf_pid = perf;
     }
 
-    // 3. Run perf script and capture output
-    std::string script_output;
+    // SIGINT makes perf stop early; progress ticks once a second for
+    // SSE subscribers.
+    int status = 0;
+    bool interrupted = false;
+    for (int tick = 1; perf > 0; ++tick) {
+        pid_t r = waitpid(perf, &status, WNOHANG);
+        if (r == perf || (r < 0 && errno != EINTR)) break;
+        usleep(200000);
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        if ((job.cancel || !running_) && !interrupted) {
+            kill(perf, SIGINT);
+            interrupted = true;
+        }
+        if (tick % 5 == 0) touch_profile(job);
+    }
+
+    bool ok = perf > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    // Read while the target still runs; perf script resolves the rest
+    AddressSpace space;
+    space.load(static_cast<pid_t>(std::stol(job.target_pid)));
     {
-        std::string cmd = "perf script -i " + perf_data + " 2>/dev/null";
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        job.perf_pid = -1;
+        if (ok && !job.cancel) {
+            job.state = "processing";
+            touch_profile(job);
+        }
+        ok = ok && !job.cancel;
+    }
+    if (!ok) {
+        error = "perf record failed (is perf installed? check perf_event_paranoid)";
+    } else {
+        std::string cmd = std::string("perf script -i ") + perf_data;
+        if (job.mode != "cpu") cmd += " -F comm,tid,time,event,ip,sym --show-switch-events";
+        cmd += " 2>/dev/null";
         FILE *fp = popen(cmd.c_str(), "r");
-        if (!fp) {
-            unlink(perf_data.c_str());
-            return "";
+        if (fp) {
+            auto resolve = [&space](uint64_t addr) { return space.symbolize(addr); };
+            if (job.mode == "cpu") {
+                collapse_perf_script(fp, graph, resolve);
+            } else {
+                collapse_perf_switches(fp, graph, job.mode == "both", 1000000 / 99, resolve);
+            }
+            pclose(fp);
+        } else {
+            error = "perf script failed";
+            ok = false;
         }
-        char buf[4096];
-        while (fgets(buf, sizeof(buf), fp))
-            script_output += buf;
-        pclose(fp);
     }
-    unlink(perf_data.c_str());
+    unlink(perf_data);
+    return ok;
+}
 
-    // 4. Collapse stacks and build flame tree
-    auto stacks = collapse_perf_script(script_output);
-    auto tree = build_flame_tree(stacks);
-    int total = flame_total(tree);
+// Caller holds profiles_mu_.
+void WebUI::touch_profile(ProfileJob &job) {
+    job.seq = ++profile_seq_;
+}
 
-    return generate_flamegraph_svg(tree, total);
+// Bounds history: per session and overall, oldest finished jobs go first.
+// Caller holds profiles_mu_.
+void WebUI::prune_profiles() {
+    std::map<std::string, std::vector<std::shared_ptr<ProfileJob>>> finished;
+    size_t total_finished = 0;
+    for (auto &kv : profiles_) {
+        const std::string &st = kv.second->state;
+        if (st == "done" || st == "failed" || st == "cancelled") {
+            finished[kv.second->session_id].push_back(kv.second);
+            ++total_finished;
+        }
+    }
+    std::vector<std::shared_ptr<ProfileJob>> victims;
+    std::vector<std::shared_ptr<ProfileJob>> rest;
+    for (auto &kv : finished) {
+        auto &list = kv.second;
+        std::sort(list.begin(), list.end(),
+                  [](const auto &a, const auto &b) { return a->seq > b->seq; });
+        for (size_t i = 0; i < list.size(); ++i) {
+            (i < kMaxProfilesPerSession ? rest : victims).push_back(list[i]);
+        }
+    }
+    std::sort(rest.begin(), rest.end(),
+              [](const auto &a, const auto &b) { return a->seq > b->seq; });
+    size_t keep = total_finished - victims.size();
+    for (size_t i = kMaxProfiles; i < keep; ++i) victims.push_back(rest[i]);
+    for (auto &v : victims) profiles_.erase(v->id);
+}
+
+std::shared_ptr<WebUI::ProfileJob> WebUI::find_profile(const std::string &id) {
+    std::lock_guard<std::mutex> lock(profiles_mu_);
+    auto it = profiles_.find(id);
+    return it == profiles_.end() ? nullptr : it->second;
+}
+
+// Caller holds profiles_mu_.
+std::string WebUI::profile_json(const ProfileJob &job) {
+    long long progress = 0;
+    if (job.state == "recording" && job.duration > 0) {
+        progress = std::min<long long>(99, (time(nullptr) - job.started) * 100 / job.duration);
+    } else if (job.state == "processing" || job.state == "done") {
+        progress = 100;
+    }
+    std::ostringstream oss;
+    oss << "{" << json_kv("id", job.id, true) << ","
+        << json_kv("session", job.session_id, true) << ","
+        << json_kv("run", job.run) << ","
+        << json_kv("duration", static_cast<long long>(job.duration)) << ","
+        << json_kv("sampler", job.sampler, true) << ","
+        << json_kv("mode", job.mode, true) << ","
+        << json_kv("state", job.state, true) << ","
+        << json_kv("progress", progress) << ","
+        << json_kv("created", static_cast<long long>(job.created));
+    if (job.finished) oss << "," << json_kv("finished", static_cast<long long>(job.finished));
+    if (!job.engine.empty()) oss << "," << json_kv("engine", job.engine, true);
+    if (job.engine == "continuous") oss << "," << json_kv("started", static_cast<long long>(job.started));
+    if ((job.engine == "native" || job.engine == "continuous") && job.finished) {
+        oss << "," << json_kv("samples", job.samples) << "," << json_kv("lost", job.lost);
+    }
+    if (!job.error.empty()) oss << "," << json_kv("error", job.error, true);
+    oss << "}";
+    return oss.str();
+}
+
+// Jobs changed since `since` as a JSON array ("" when none); advances it.
+std::string WebUI::profile_updates(uint64_t &since) {
+    std::lock_guard<std::mutex> lock(profiles_mu_);
+    if (profile_seq_ == since) return "";
+    std::string out;
+    for (auto &kv : profiles_) {
+        if (kv.second->seq <= since) continue;
+        out += out.empty() ? "[" : ",";
+        out += profile_json(*kv.second);
+    }
+    since = profile_seq_;
+    return out.empty() ? "" : out + "]";
+}
+
+// Profiles of one session, or of all sessions when `session_id` is empty,
+// newest first.
+std::string WebUI::profile_list_json(const std::string &session_id) {
+    std::vector<std::shared_ptr<ProfileJob>> list;
+    std::lock_guard<std::mutex> lock(profiles_mu_);
+    for (auto &kv : profiles_) {
+        if (session_id.empty() || kv.second->session_id == session_id) list.push_back(kv.second);
+    }
+    std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) {
+        return a->created != b->created ? a->created > b->created : a->seq > b->seq;
+    });
+    std::string body = "[";
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (i) body += ",";
+        body += profile_json(*list[i]);
+    }
+    return body + "]";
+}
+
+void WebUI::handle_continuous_request(int fd, const HttpRequest &req, const std::string &sid) {
+    std::shared_ptr<ContinuousProfiler> profiler;
+    if (req.method == "PUT") {
+        ContinuousOptions opts;
+        try { opts.frequency = std::stoi(query_param(req.query, "hz", "19")); } catch (...) {}
+        try { opts.window_minutes = std::stoi(query_param(req.query, "window", "60")); } catch (...) {}
+        try { opts.budget_percent = std::stod(query_param(req.query, "budget", "1")); } catch (...) {}
+        opts.frequency = std::clamp(opts.frequency, 1, 99);
+        opts.window_minutes = std::clamp(opts.window_minutes, 1, 24 * 60);
+        opts.budget_percent = std::clamp(opts.budget_percent, 0.01, 100.0);
+
+        std::string status = proxy("STATUS " + sid);
+        if (status.find("\"not_found\"") != std::string::npos) {
+            send_http(fd, 404, "application/json", R"({"error":"not_found"})");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(continuous_mu_);
+        auto it = continuous_.find(sid);
+        if (it != continuous_.end() && it->second->running()) {
+            profiler = it->second;  // already on; options stay as they were
+        } else {
+            size_t active = 0;
+            for (auto &kv : continuous_) active += kv.second->running() ? 1 : 0;
+            if (active >= kMaxContinuousProfilers) {
+                send_http(fd, 429, "application/json", R"({"error":"too_many_profilers"})");
+                return;
+            }
+            profiler = std::make_shared<ContinuousProfiler>(opts, [this, sid]() -> pid_t {
+                std::string st = proxy("STATUS " + sid);
+                if (st.find("\"not_found\"") != std::string::npos) return -1;
+                return static_cast<pid_t>(std::max(0LL, json_int_field(st, "pid", 0)));
+            });
+            profiler->start();
+            continuous_[sid] = profiler;
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(continuous_mu_);
+        auto it = continuous_.find(sid);
+        if (it != continuous_.end()) {
+            profiler = it->second;
+            if (req.method == "DELETE") continuous_.erase(it);
+        }
+    }
+    if (!profiler || (req.method != "GET" && req.method != "PUT" && req.method != "DELETE")) {
+        send_http(fd, 404, "application/json", R"({"error":"not_enabled"})");
+        return;
+    }
+    // Joins the sampling thread, which finishes within one poll interval
+    if (req.method == "DELETE") profiler->stop();
+    std::string body = profiler->status_json();
+    body.insert(body.size() - 1, "," + json_kv("session", sid, true));
+    send_http(fd, 200, "application/json", body);
+}
+
+// POST /api/sessions/{id}/profiles with ?last= or ?from=[&to=]: merges the
+// continuous buckets of that window into a finished profile job.
+void WebUI::capture_continuous(int fd, const HttpRequest &req, const std::string &sid) {
+    time_t now = time(nullptr);
+    time_t from, to = now;
+    std::string last = query_param(req.query, "last", "");
+    if (!last.empty()) {
+        long span = parse_span(last);
+        from = span > 0 ? now - span : -1;
+    } else {
+        from = parse_when(query_param(req.query, "from", ""), now);
+        std::string until = query_param(req.query, "to", "");
+        if (!until.empty()) to = parse_when(until, now);
+    }
+    if (from < 0 || to < 0 || to <= from) {
+        send_http(fd, 400, "application/json", R"({"error":"bad_window"})");
+        return;
+    }
+
+    std::shared_ptr<ContinuousProfiler> profiler;
+    {
+        std::lock_guard<std::mutex> lock(continuous_mu_);
+        auto it = continuous_.find(sid);
+        if (it != continuous_.end()) profiler = it->second;
+    }
+    if (!profiler) {
+        send_http(fd, 409, "application/json", R"({"error":"not_enabled"})");
+        return;
+    }
+    auto graph = std::make_shared<FlameGraph>();
+    time_t first = 0, end = 0;
+    if (profiler->collect(from, to, *graph, first, end) == 0) {
+        send_http(fd, 409, "application/json", R"({"error":"no_data"})");
+        return;
+    }
+
+    auto job = std::make_shared<ProfileJob>();
+    job->id = random_token();
+    job->session_id = sid;
+    job->run = json_int_field(proxy("STATUS " + sid), "run", 0);
+    job->duration = static_cast<int>(end - first);
+    job->sampler = "continuous";
+    job->engine = "continuous";
+    job->frequency = profiler->frequency();
+    job->state = "done";
+    job->created = now;
+    job->started = first;
+    job->finished = end;
+    job->samples = graph->total();
+    job->graph = std::move(graph);
+    std::string body;
+    {
+        std::lock_guard<std::mutex> lock(profiles_mu_);
+        touch_profile(*job);
+        profiles_[job->id] = job;
+        prune_profiles();
+        body = profile_json(*job);
+    }
+    send_http(fd, 200, "application/json", body);
+}
+
+// The daemon's HEAP reply, a folded call tree with the sampler's totals in
+// front of it, in any of the profile export formats.
+void WebUI::handle_heap_request(int fd, const HttpRequest &req, const std::string &sid) {
+    std::string view = query_param(req.query, "view", "live");
+    std::string format = query_param(req.query, "format", "json");
+    if (view != "live" && view != "alloc") {
+        send_http(fd, 400, "application/json", R"({"error":"bad_view"})");
+        return;
+    }
+    if (format != "svg" && format != "json" && format != "folded" && format != "speedscope" &&
+        format != "pprof") {
+        send_http(fd, 400, "application/json", R"({"error":"bad_format"})");
+        return;
+    }
+    std::string reply = proxy("HEAP " + sid + " " + view, 15);
+    auto folded_at = reply.find(",\"folded\":\"");
+    if (folded_at == std::string::npos) {
+        std::string code = json_string_field(reply, "error_code");
+        send_http(fd, code == "not_found" ? 404 : 409, "application/json", reply);
+        return;
+    }
+
+    FlameGraph graph;
+    graph.set_unit("bytes");
+    std::string folded = json_string_field(reply, "folded");
+    size_t start = 0;
+    while (start < folded.size()) {
+        size_t end = folded.find('\n', start);
+        if (end == std::string::npos) end = folded.size();
+        std::string_view line(folded.data() + start, end - start);
+        auto space = line.rfind(' ');
+        if (space != std::string_view::npos) {
+            long long count = std::atoll(std::string(line.substr(space + 1)).c_str());
+            if (count > 0) graph.add_folded(line.substr(0, space), count);
+        }
+        start = end + 1;
+    }
+
+    long long rate = json_int_field(reply, "rate", 1);
+    long long duration_ns = json_int_field(reply, "duration_ms", 0) * 1000000;
+    std::string name = "session " + sid.substr(0, 8) + " (heap, " + view + ")";
+    if (format == "svg") {
+        send_http(fd, 200, "image/svg+xml", render_flamegraph_svg(graph));
+    } else if (format == "json") {
+        // The viewer's tree, with the sampler's totals alongside
+        send_http(fd, 200, "application/json",
+                  reply.substr(0, folded_at) + "," + flamegraph_json(graph).substr(1));
+    } else if (format == "folded") {
+        send_http(fd, 200, "text/plain; charset=utf-8", flamegraph_folded(graph));
+    } else if (format == "speedscope") {
+        send_http(fd, 200, "application/json", flamegraph_speedscope(graph, name));
+    } else {
+        int64_t time_ns = static_cast<int64_t>(time(nullptr)) * 1000000000 - duration_ns;
+        send_http(fd, 200, "application/octet-stream",
+                  flamegraph_pprof(graph, rate, duration_ns, time_ns));
+    }
+}
+
+void WebUI::handle_profile_request(int fd, const HttpRequest &req,
+                                   const std::vector<std::string> &parts) {
+    if (parts.size() == 2) {
+        if (req.method == "GET") {
+            send_http(fd, 200, "application/json", profile_list_json(""));
+        } else {
+            send_http(fd, 404, "application/json", R"({"error":"not_found"})");
+        }
+        return;
+    }
+
+    // /api/sessions/{id}/profiles and the blocking /api/sessions/{id}/flamegraph
+    if (parts[1] == "sessions") {
+        const std::string &sid = parts[2];
+        if (req.method == "GET" && parts[3] == "profiles") {
+            send_http(fd, 200, "application/json", profile_list_json(sid));
+            return;
+        }
+
+        if (req.method == "POST" && (!query_param(req.query, "last", "").empty() ||
+                                     !query_param(req.query, "from", "").empty())) {
+            capture_continuous(fd, req, sid);
+            return;
+        }
+
+        int duration = 5;
+        int max_age = kDefaultProfileMaxAge;
+        try { duration = std::stoi(query_param(req.query, "duration", "5")); } catch (...) {}
+        try { max_age = std::stoi(query_param(req.query, "max_age", "60")); } catch (...) {}
+        duration = std::clamp(duration, 1, 30);
+        std::string sampler = query_param(req.query, "sampler", "auto");
+        if (sampler != "auto" && sampler != "native" && sampler != "perf") {
+            send_http(fd, 400, "application/json", R"({"error":"bad_sampler"})");
+            return;
+        }
+        std::string mode = query_param(req.query, "mode", "cpu");
+        if (mode != "cpu" && mode != "offcpu" && mode != "both") {
+            send_http(fd, 400, "application/json", R"({"error":"bad_mode"})");
+            return;
+        }
+        bool reused = false;
+        std::string error;
+        auto job = submit_profile(sid, duration, sampler, mode, max_age, reused, error);
+
+        if (req.method == "POST") {
+            if (!job) {
+                int status = error == "not_found" ? 404 : (error == "too_many_jobs" ? 429 : 400);
+                send_http(fd, status, "application/json", "{" + json_kv("error", error, true) + "}");
+                return;
+            }
+            std::string body;
+            {
+                std::lock_guard<std::mutex> lock(profiles_mu_);
+                body = profile_json(*job);
+            }
+            body.insert(body.size() - 1, "," + json_kv("cached", reused));
+            send_http(fd, reused ? 200 : 202, "application/json", body);
+            return;
+        }
+
+        // Legacy GET .../flamegraph: wait for the job and return the SVG
+        if (!job) {
+            send_http(fd, 400, "application/json", R"({"error":"flamegraph_failed"})");
+            return;
+        }
+        struct timeval ltv{15, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &ltv, sizeof(ltv));
+        while (running_) {
+            {
+                std::lock_guard<std::mutex> lock(profiles_mu_);
+                if (job->state == "done") break;
+                if (job->state == "failed" || job->state == "cancelled") {
+                    std::string msg = job->error.empty() ? job->state : job->error;
+                    send_http(fd, 200, "image/svg+xml",
+                              "<svg xmlns='http://www.w3.org/2000/svg' width='600' "
+                              "height='40'><text y='20' fill='#e94560' "
+                              "font-family='monospace'>" + svg_escape(msg) + "</text></svg>");
+                    return;
+                }
+            }
+            usleep(200000);
+        }
+        std::shared_ptr<const FlameGraph> graph;
+        {
+            std::lock_guard<std::mutex> lock(profiles_mu_);
+            graph = job->graph;
+        }
+        send_http(fd, 200, "image/svg+xml", graph ? render_flamegraph_svg(*graph) : "");
+        return;
+    }
+
+    // /api/profiles/{job}[/svg|json|folded|speedscope|pprof|diff]
+    auto job = find_profile(parts[2]);
+    if (!job) {
+        send_http(fd, 404, "application/json", R"({"error":"not_found"})");
+        return;
+    }
+    std::unique_lock<std::mutex> lock(profiles_mu_);
+    if (req.method == "GET" && parts.size() == 3) {
+        std::string body = profile_json(*job);
+        lock.unlock();
+        send_http(fd, 200, "application/json", body);
+    } else if (req.method == "GET" && parts.size() == 4 && parts[3] == "diff") {
+        // Differential flamegraph of this job against ?base=
+        auto base = profiles_.find(query_param(req.query, "base", ""));
+        if (base == profiles_.end()) {
+            lock.unlock();
+            send_http(fd, 404, "application/json", R"({"error":"base_not_found"})");
+            return;
+        }
+        if (job->state != "done" || !job->graph || base->second->state != "done" ||
+            !base->second->graph) {
+            lock.unlock();
+            send_http(fd, 409, "application/json", R"({"error":"not_ready"})");
+            return;
+        }
+        std::shared_ptr<const FlameGraph> graph = job->graph;
+        std::shared_ptr<const FlameGraph> base_graph = base->second->graph;
+        lock.unlock();
+        // Samples and microseconds do not share a scale
+        if (graph->unit() != base_graph->unit()) {
+            send_http(fd, 400, "application/json", R"({"error":"unit_mismatch"})");
+            return;
+        }
+        int top = 20;
+        try { top = std::stoi(query_param(req.query, "top", "20")); } catch (...) {}
+        FlameDiff diff = diff_flamegraphs(*base_graph, *graph);
+        if (query_param(req.query, "format", "json") == "svg") {
+            send_http(fd, 200, "image/svg+xml", render_flamegraph_diff_svg(diff));
+        } else {
+            send_http(fd, 200, "application/json",
+                      flamegraph_diff_json(diff, static_cast<size_t>(std::clamp(top, 1, 500))));
+        }
+    } else if (req.method == "GET" && parts.size() == 4) {
+        const std::string &format = parts[3];
+        if (format != "svg" && format != "json" && format != "folded" && format != "speedscope" &&
+            format != "pprof") {
+            lock.unlock();
+            send_http(fd, 404, "application/json", R"({"error":"not_found"})");
+            return;
+        }
+        if (job->state != "done" || !job->graph) {
+            lock.unlock();
+            send_http(fd, 409, "application/json", R"({"error":"not_ready"})");
+            return;
+        }
+        // Rendered outside the lock; the graph is immutable once published
+        std::shared_ptr<const FlameGraph> graph = job->graph;
+        int64_t duration_ns = static_cast<int64_t>(job->finished - job->started) * 1000000000;
+        int64_t time_ns = static_cast<int64_t>(job->started) * 1000000000;
+        std::string name = "session " + job->session_id.substr(0, 8) + " (" + job->engine + ")";
+        int frequency = std::max(1, job->frequency);
+        lock.unlock();
+        if (format == "svg") {
+            send_http(fd, 200, "image/svg+xml", render_flamegraph_svg(*graph));
+        } else if (format == "json") {
+            send_http(fd, 200, "application/json", flamegraph_json(*graph));
+        } else if (format == "folded") {
+            send_http(fd, 200, "text/plain; charset=utf-8", flamegraph_folded(*graph));
+        } else if (format == "speedscope") {
+            send_http(fd, 200, "application/json", flamegraph_speedscope(*graph, name));
+        } else {
+            send_http(fd, 200, "application/octet-stream",
+                      flamegraph_pprof(*graph, 1000000000 / frequency, duration_ns, time_ns));
+        }
+    } else if (req.method == "DELETE" && parts.size() == 3) {
+        // Cancels a pending job; removes a finished one from history
+        if (job->state == "queued") {
+            job->state = "cancelled";
+            job->finished = time(nullptr);
+            touch_profile(*job);
+        } else if (job->state == "recording" || job->state == "processing") {
+            job->cancel = true;
+            if (job->perf_pid > 0) kill(job->perf_pid, SIGINT);
+        } else {
+            profiles_.erase(job->id);
+            ++profile_seq_;
+        }
+        std::string body = profile_json(*job);
+        lock.unlock();
+        send_http(fd, 200, "application/json", body);
+    } else {
+        lock.unlock();
+        send_http(fd, 404, "application/json", R"({"error":"not_found"})");
+    }
 }
 
 }  // namespace debuglantern
@@ -1,34 +1,128 @@
 #ifndef DEBUGLANTERN_WEBUI_H
 #define DEBUGLANTERN_WEBUI_H
 
+#include <sys/types.h>
+
 #include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace debuglantern {
 
+class ContinuousProfiler;
+class FlameGraph;
+class Telemetry;
+struct HttpRequest;
+
 class WebUI {
 public:
-    WebUI(int web_port, int control_port);
+    // `telemetry` is the daemon's, served at GET /metrics; it outlives the UI.
+    WebUI(int web_port, int control_port, const Telemetry &telemetry);
     ~WebUI();
 
     bool start();
     void stop();
 
 private:
+    // A resumable browser upload: the control connection stays open across
+    // chunk requests so bytes are forwarded to the daemon as they arrive.
+    // `mu` serializes chunk writers; `received` may be read without it.
+    struct UploadSlot {
+        std::mutex mu;
+        int control_fd = -1;
+        size_t size = 0;
+        std::atomic<size_t> received{0};
+        std::string exec_path;  // immutable after creation
+        time_t last_active = 0;
+    };
+
+    // One flamegraph recording.  Jobs are queued, run at most
+    // kMaxRunningProfiles at a time, and kept afterwards as the session's
+    // profile history.  Fields are guarded by profiles_mu_.
+    struct ProfileJob {
+        std::string id;
+        std::string session_id;
+        long long run = 0;  // session START count when recorded
+        int duration = 0;
+        std::string sampler;  // requested: auto, native or perf
+        std::string mode = "cpu";  // cpu, offcpu or both (see SampleMode)
+        std::string engine;   // what recorded it: native or perf
+        std::string target_pid;
+        std::string state;  // queued, recording, processing, done, failed, cancelled
+        std::string error;
+        time_t created = 0;
+        time_t started = 0;
+        time_t finished = 0;
+        pid_t perf_pid = -1;
+        bool cancel = false;
+        uint64_t seq = 0;  // profile_seq_ at the last change
+        long long samples = 0;
+        long long lost = 0;
+        int frequency = 99;  // Hz, for the sample period in exports
+        std::shared_ptr<const FlameGraph> graph;  // set once done; rendered on request
+    };
+
     void run();
     void handle_client(int fd);
     void serve_sse(int fd);
+    void serve_terminal(int fd, const HttpRequest &req, const std::string &id);
+    void serve_output_raw(int fd, const HttpRequest &req, const std::string &id);
+
+    void handle_upload_create(int fd, const HttpRequest &req);
+    void handle_upload_chunk(int fd, const HttpRequest &req, const std::string &token);
+    void handle_upload_status(int fd, const std::string &token);
+    void handle_upload_abort(int fd, const std::string &token);
+    std::shared_ptr<UploadSlot> find_upload(const std::string &token);
+    void reap_uploads();
 
-    std::string proxy(const std::string &command);
-    std::string proxy_upload(const char *data, size_t len);
-    std::string generate_flamegraph(const std::string &session_id, int duration);
+    int control_connect(int timeout_sec);
+    std::string proxy(const std::string &command, int timeout_sec = 5);
+    std::string proxy_upload(int client_fd, const HttpRequest &req,
+                             const std::string &exec_path);
+
+    std::shared_ptr<ProfileJob> submit_profile(const std::string &session_id, int duration,
+                                               const std::string &sampler,
+                                               const std::string &mode, int max_age,
+                                               bool &reused, std::string &error);
+    void dispatch_profiles();
+    void run_profile(std::shared_ptr<ProfileJob> job);
+    bool record_with_perf(ProfileJob &job, FlameGraph &graph, std::string &error);
+    void touch_profile(ProfileJob &job);
+    void prune_profiles();
+    std::shared_ptr<ProfileJob> find_profile(const std::string &id);
+    std::string profile_json(const ProfileJob &job);
+    std::string profile_list_json(const std::string &session_id);
+    std::string profile_updates(uint64_t &since);
+    void handle_profile_request(int fd, const HttpRequest &req,
+                                const std::vector<std::string> &parts);
+    void handle_continuous_request(int fd, const HttpRequest &req, const std::string &sid);
+    void capture_continuous(int fd, const HttpRequest &req, const std::string &sid);
+    void handle_heap_request(int fd, const HttpRequest &req, const std::string &sid);
 
     int web_port_;
     int control_port_;
+    const Telemetry &telemetry_;
     int listen_fd_ = -1;
     std::thread thread_;
     std::atomic<bool> running_{false};
+
+    std::mutex uploads_mu_;
+    std::map<std::string, std::shared_ptr<UploadSlot>> uploads_;
+
+    std::mutex profiles_mu_;
+    std::map<std::string, std::shared_ptr<ProfileJob>> profiles_;
+    uint64_t profile_seq_ = 0;
+    int running_profiles_ = 0;
+
+    // Per-session always-on profilers, off until enabled over HTTP
+    std::mutex continuous_mu_;
+    std::map<std::string, std::shared_ptr<ContinuousProfiler>> continuous_;
 };
 
 }  // namespace debuglantern